@@ -9,6 +9,7 @@
 #include "User.h"
 
 #ifdef MURMUR
+#	include "ACLCache.h"
 #	include "ServerUser.h"
 
 #	include <QtCore/QStack>
@@ -93,6 +94,9 @@ ChanACL::operator QString() const {
 
 #ifdef MURMUR
 
+static const ChanACL::Permissions DEFAULT_PERMISSIONS = ChanACL::Traverse | ChanACL::Enter | ChanACL::Speak
+														| ChanACL::Whisper | ChanACL::TextMessage | ChanACL::Listen;
+
 bool ChanACL::hasPermission(ServerUser *p, Channel *chan, QFlags< Perm > perm, ACLCache *cache) {
 	Permissions granted = effectivePermissions(p, chan, cache);
 
@@ -107,128 +111,192 @@ QFlags< ChanACL::Perm > ChanACL::effectivePermissions(ServerUser *p, Channel *ch
 	}
 
 	Permissions granted;
+	std::uint64_t generation = 0;
 
 	if (cache) {
-		QHash< Channel *, Permissions > *h = cache->value(p);
-		if (h)
-			granted = h->value(chan);
-	}
+		if (cache->lookup(p->m_aclCache, chan->iId, granted)) {
+			return granted | Cached;
+		}
 
-	if (granted & Cached) {
-		return granted;
+		generation = cache->generation();
 	}
 
+	InheritedPermissions state;
+	state.granted = DEFAULT_PERMISSIONS;
+
+	// Collect the parent channels up to the closest one whose state can be resumed from (or the root channel)
 	QStack< Channel * > chanstack;
-	Channel *ch = chan;
+	Channel *ch = chan->cParent;
 
 	while (ch) {
+		if (cache) {
+			const InheritedPermissions *inherited = cache->lookupInherited(p->m_aclCache, ch->iId);
+			if (inherited && appliesTo(*inherited, *p, *ch, *chan)) {
+				state = *inherited;
+				break;
+			}
+		}
+
 		chanstack.push(ch);
 		ch = ch->cParent;
 	}
 
-	// Default permissions
-	Permissions def = Traverse | Enter | Speak | Whisper | TextMessage | Listen;
+	// Iterate over the remaining parent channels from the top down
+	while (!chanstack.isEmpty() && !state.denied) {
+		ch = chanstack.pop();
+		applyACLs(state, *p, *chan, *ch);
 
-	granted = def;
+		if (cache && appliesTo(state, *p, *ch, *chan)) {
+			// The state doesn't depend on chan in particular, so the other subchannels of ch can resume from it
+			cache->storeInherited(p->m_aclCache, ch->iId, state, generation);
+		}
+	}
 
-	bool traverse = true;
-	bool write    = false;
+	// Finally the channel itself
+	if (!state.denied) {
+		applyACLs(state, *p, *chan, *chan);
+	}
 
-	// Iterate over all parent channels from root to the channel the user is in (inclusive)
-	while (!chanstack.isEmpty()) {
-		ch = chanstack.pop();
-		if (!ch->bInheritACL) {
-			granted = def;
-		}
+	granted = state.denied ? None : state.granted;
 
-		for (const ChanACL *acl : ch->qlACL) {
-			bool matchUser  = (acl->iUserId != -1) && (acl->iUserId == p->iId);
-			bool matchGroup = Group::appliesToUser(*chan, *ch, acl->qsGroup, *p);
-
-			bool applyFromSelf  = (ch == chan && acl->bApplyHere);
-			bool applyInherited = (ch != chan && acl->bApplySubs);
-
-			// Flag indicating whether the current ACL affects the target channel "chan"
-			bool apply = applyFromSelf || applyInherited;
-
-			// "apply" will be true for ACLs set in the reference channel directly (applyHere),
-			// or from a parent channel which hands the ACLs down (applySubs).
-			// However, we have one ACL that needs to be evaluated differently - the Traverse ACL.
-			// Consider this channel layout:
-			// Root
-			// - A (Traverse denied for THIS channel, but not sub channels)
-			//  - B
-			//   - C
-			// If the user tries to enter C, we need to deny Traverse, because the user
-			// should already be blocked from traversing A. But "apply" will be false,
-			// as the "normal" ACL inheritence rules do not apply here.
-			// Therefore, we need applyDenyTraverse which will be true, if any channel
-			// from root to the reference channel denies Traverse without necessarily
-			// handing it down.
-			bool applyDenyTraverse = applyInherited || acl->bApplyHere;
-
-			if (matchUser || matchGroup) {
-				// The "traverse" and "write" booleans do not grant or deny anything here.
-				// We merely check, if we are missing traverse AND write in this
-				// channel and therefore abort without any permissions later on.
-				if (apply && (acl->pAllow & Traverse)) {
-					traverse = true;
-				}
-				if (applyDenyTraverse && (acl->pDeny & Traverse)) {
-					traverse = false;
-				}
+	if (granted & Write) {
+		granted |=
+			Traverse | Enter | MuteDeafen | Move | MakeChannel | LinkChannel | TextMessage | MakeTempChannel | Listen;
+		if (chan->iId == 0)
+			granted |= Kick | Ban | ResetUserContent | Register | SelfRegister;
+	}
 
-				write = apply && (acl->pAllow & Write) && !(acl->pDeny & Write);
+	if (cache) {
+		cache->store(p->m_aclCache, chan->iId, granted, generation);
+	}
 
-				// These permissions are only grantable from the root channel
-				// as they affect the users globally. For example: You can not
-				// kick a client from a channel without kicking them from the server.
-				if (ch->iId == 0 && applyFromSelf) {
-					if (acl->pAllow & Kick) {
-						granted |= Kick;
-					}
-					if (acl->pAllow & Ban) {
-						granted |= Ban;
-					}
-					if (acl->pAllow & ResetUserContent) {
-						granted |= ResetUserContent;
-					}
-					if (acl->pAllow & Register) {
-						granted |= Register;
-					}
-					if (acl->pAllow & SelfRegister) {
-						granted |= SelfRegister;
+	return granted;
+}
+
+void ChanACL::applyACLs(InheritedPermissions &state, const ServerUser &p, const Channel &chan, const Channel &ch) {
+	if (!ch.bInheritACL) {
+		state.granted = DEFAULT_PERMISSIONS;
+	}
+
+	for (const ChanACL *acl : ch.qlACL) {
+		bool matchUser  = (acl->iUserId != -1) && (acl->iUserId == p.iId);
+		bool matchGroup = Group::appliesToUser(chan, ch, acl->qsGroup, p);
+
+		if (&ch != &chan) {
+			// Keep track of what the match depends on, so that it is known whether the state can be reused for other
+			// subchannels of ch
+			QString groupName;
+			switch (Group::contextDependence(acl->qsGroup, groupName)) {
+				case Group::ContextDependence::None:
+					break;
+				case Group::ContextDependence::UserChannel:
+					state.dependsOnUserChannel = true;
+					state.inUserChannel        = (p.cChannel == &chan);
+					break;
+				case Group::ContextDependence::GroupDefinitions:
+					if (!state.contextGroups.contains(groupName)) {
+						state.contextGroups << groupName;
 					}
-				}
+					break;
+				case Group::ContextDependence::Hierarchy:
+					state.dependsOnHierarchy = true;
+					break;
+			}
+		}
+
+		bool applyFromSelf  = (&ch == &chan && acl->bApplyHere);
+		bool applyInherited = (&ch != &chan && acl->bApplySubs);
+
+		// Flag indicating whether the current ACL affects the target channel "chan"
+		bool apply = applyFromSelf || applyInherited;
+
+		// "apply" will be true for ACLs set in the reference channel directly (applyHere),
+		// or from a parent channel which hands the ACLs down (applySubs).
+		// However, we have one ACL that needs to be evaluated differently - the Traverse ACL.
+		// Consider this channel layout:
+		// Root
+		// - A (Traverse denied for THIS channel, but not sub channels)
+		//  - B
+		//   - C
+		// If the user tries to enter C, we need to deny Traverse, because the user
+		// should already be blocked from traversing A. But "apply" will be false,
+		// as the "normal" ACL inheritence rules do not apply here.
+		// Therefore, we need applyDenyTraverse which will be true, if any channel
+		// from root to the reference channel denies Traverse without necessarily
+		// handing it down.
+		bool applyDenyTraverse = applyInherited || acl->bApplyHere;
+
+		if (matchUser || matchGroup) {
+			// The "traverse" and "write" booleans do not grant or deny anything here.
+			// We merely check, if we are missing traverse AND write in this
+			// channel and therefore abort without any permissions later on.
+			if (apply && (acl->pAllow & Traverse)) {
+				state.traverse = true;
+			}
+			if (applyDenyTraverse && (acl->pDeny & Traverse)) {
+				state.traverse = false;
+			}
+
+			state.write = apply && (acl->pAllow & Write) && !(acl->pDeny & Write);
 
-				// Every other regular ACL is handled here
-				if (apply) {
-					granted |= (acl->pAllow & ~(Kick | Ban | ResetUserContent | Register | SelfRegister | Cached));
-					granted &= ~acl->pDeny;
+			// These permissions are only grantable from the root channel
+			// as they affect the users globally. For example: You can not
+			// kick a client from a channel without kicking them from the server.
+			if (ch.iId == 0 && applyFromSelf) {
+				if (acl->pAllow & Kick) {
+					state.granted |= Kick;
+				}
+				if (acl->pAllow & Ban) {
+					state.granted |= Ban;
+				}
+				if (acl->pAllow & ResetUserContent) {
+					state.granted |= ResetUserContent;
+				}
+				if (acl->pAllow & Register) {
+					state.granted |= Register;
+				}
+				if (acl->pAllow & SelfRegister) {
+					state.granted |= SelfRegister;
 				}
 			}
-		}
-		if (!traverse && !write) {
-			granted = None;
-			break;
+
+			// Every other regular ACL is handled here
+			if (apply) {
+				state.granted |= (acl->pAllow & ~(Kick | Ban | ResetUserContent | Register | SelfRegister | Cached));
+				state.granted &= ~acl->pDeny;
+			}
 		}
 	}
 
-	if (granted & Write) {
-		granted |=
-			Traverse | Enter | MuteDeafen | Move | MakeChannel | LinkChannel | TextMessage | MakeTempChannel | Listen;
-		if (chan->iId == 0)
-			granted |= Kick | Ban | ResetUserContent | Register | SelfRegister;
+	if (!state.traverse && !state.write) {
+		state.granted = None;
+		state.denied  = true;
 	}
+}
 
-	if (cache) {
-		if (!cache->contains(p))
-			cache->insert(p, new QHash< Channel *, Permissions >);
+bool ChanACL::appliesTo(const InheritedPermissions &state, const ServerUser &p, const Channel &parent,
+						const Channel &chan) {
+	if (state.dependsOnHierarchy) {
+		return false;
+	}
 
-		cache->value(p)->insert(chan, granted | Cached);
+	if (state.dependsOnUserChannel && state.inUserChannel != (p.cChannel == &chan)) {
+		return false;
 	}
 
-	return granted;
+	if (!state.contextGroups.isEmpty()) {
+		// Group memberships are evaluated starting at chan. As long as neither chan nor any channel in between
+		// defines the group, the walk up the tree only finds the definitions parent is subject to, too.
+		for (const Channel *c = &chan; c && c != &parent; c = c->cParent) {
+			for (const QString &group : state.contextGroups) {
+				if (c->qhGroups.contains(group)) {
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
 }
 
 #else
@@ -8,10 +8,14 @@
 
 #include <QtCore/QHash>
 #include <QtCore/QObject>
+#include <QtCore/QStringList>
 
 class Channel;
 class User;
 class ServerUser;
+#ifdef MURMUR
+class ACLCache;
+#endif
 
 class ChanACL : public QObject {
 private:
@@ -47,9 +51,6 @@ public:
 
 	Q_DECLARE_FLAGS(Permissions, Perm)
 
-	typedef QHash< Channel *, Permissions > ChanCache;
-	typedef QHash< User *, ChanCache * > ACLCache;
-
 	Channel *c;
 	bool bApplyHere;
 	bool bApplySubs;
@@ -71,13 +72,48 @@ public:
 	explicit operator QString() const;
 
 #ifdef MURMUR
+	/// The state of evaluating the ACLs from the root channel down to a channel, as it is handed down to the
+	/// subchannels of that channel. Evaluating the permissions in any of these subchannels can resume from this
+	/// state instead of starting at the root channel again.
+	struct InheritedPermissions {
+		Permissions granted;
+		bool traverse = true;
+		bool write    = false;
+		/// Whether Traverse and Write have both been denied, which denies everything in the subchannels
+		bool denied = false;
+
+		/// Whether an ACL for "in" or "out" has been evaluated. These only depend on whether the user is in the
+		/// subchannel, which is stored in inUserChannel.
+		bool dependsOnUserChannel = false;
+		bool inUserChannel        = false;
+		/// Whether an ACL for "sub" has been evaluated. These depend on the exact subchannel, so the state can't be
+		/// reused at all.
+		bool dependsOnHierarchy = false;
+		/// The groups whose membership has been evaluated in the context of the subchannel. The state can only be
+		/// reused for subchannels that (together with the channels in between) don't define any of these groups.
+		QStringList contextGroups;
+	};
+
 	static bool hasPermission(ServerUser *p, Channel *c, QFlags< Perm > perm, ACLCache *cache);
+	/// Evaluates the ACLs from the root channel down to the given channel. If a cache is given, the permissions
+	/// are looked up in and stored to it, and the evaluation resumes from the closest parent channel whose
+	/// InheritedPermissions have been cached before (and caches the ones of the channels it evaluates).
 	static QFlags< Perm > effectivePermissions(ServerUser *p, Channel *c, ACLCache *cache);
 #else
 	static QString whatsThis(Perm p);
 #endif
 	static QString permName(QFlags< Perm > p);
 	static QString permName(Perm p);
+
+#ifdef MURMUR
+private:
+	/// Applies the ACLs of the channel ch, which is either the channel chan itself or one of its parents, to the
+	/// given state
+	static void applyACLs(InheritedPermissions &state, const ServerUser &p, const Channel &chan, const Channel &ch);
+	/// @returns Whether the given state, that has been computed for the channel parent, holds for its subchannel chan
+	static bool appliesTo(const InheritedPermissions &state, const ServerUser &p, const Channel &parent,
+						  const Channel &chan);
+#endif
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(ChanACL::Permissions)
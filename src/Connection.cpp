@@ -26,7 +26,6 @@ HANDLE Connection::hQoS = nullptr;
 Connection::Connection(QObject *p, QSslSocket *qtsSock) : QObject(p) {
 	qtsSocket = qtsSock;
 	qtsSocket->setParent(this);
-	iPacketLength        = -1;
 	bDisconnectedEmitted = false;
 	csCrypt              = std::make_unique< CryptStateOCB2 >();
 
@@ -100,46 +99,48 @@ void Connection::resetActivityTime() {
 }
 
 /**
- * This function waits until a complete package is received and then emits it as a message.
- * It gets called everytime new data is available and interprets the message prefix header
- * to figure out the type and length. It then waits until the complete message is buffered
- * and emits it as a message so it can be handled by the corresponding message handler
- * routine.
+ * This function gets called everytime new data is available. The data is read into the connection's receive buffer in
+ * large chunks, in which the messages are split up using the prefix header containing their type and length. Every
+ * complete message is emitted as a message (referring to the buffer instead of a copy of it) so it can be handled by
+ * the corresponding message handler routine.
  *
  * @see QSslSocket::readyRead()
  * @see void ServerHandler::message(unsigned int msgType, const QByteArray &qbaMsg)
  * @see void Server::message(unsigned int uiType, const QByteArray &qbaMsg, ServerUser *u)
  */
 void Connection::socketRead() {
-	while (true) {
-		qint64 iAvailable = qtsSocket->bytesAvailable();
-		if (iPacketLength == -1) {
-			if (iAvailable < 6)
-				return;
-
-			unsigned char a_ucBuffer[6];
+	while (qtsSocket->bytesAvailable() > 0) {
+		const gsl::span< char > buffer = m_reader.writeBuffer();
 
-			qtsSocket->read(reinterpret_cast< char * >(a_ucBuffer), 6);
-			m_type        = static_cast< Mumble::Protocol::TCPMessageType >(qFromBigEndian< quint16 >(&a_ucBuffer[0]));
-			iPacketLength = qFromBigEndian< int >(&a_ucBuffer[2]);
-			iAvailable -= 6;
+		const qint64 read = qtsSocket->read(buffer.data(), static_cast< qint64 >(buffer.size()));
+		if (read <= 0) {
+			break;
 		}
+		m_reader.commit(static_cast< std::size_t >(read));
 
-		if ((iPacketLength == -1) || (iAvailable < iPacketLength))
-			return;
+		Mumble::Protocol::TCPMessageType type;
+		QByteArray payload;
+		TCPMessageReader::Status status;
 
-		if (iPacketLength > 0x7fffff) {
+		while ((status = m_reader.next(type, payload)) == TCPMessageReader::Status::Message) {
+			emit message(type, payload);
+
+			if (!qtsSocket->isOpen()) {
+				// The connection has been aborted while handling the message
+				m_reader.clear();
+				return;
+			}
+		}
+
+		if (status == TCPMessageReader::Status::TooLarge) {
 			qWarning() << "Host tried to send huge packet";
+			m_reader.clear();
 			disconnectSocket(true);
 			return;
 		}
-
-		QByteArray qbaBuffer = qtsSocket->read(iPacketLength);
-		iPacketLength        = -1;
-		iAvailable -= iPacketLength;
-
-		emit message(m_type, qbaBuffer);
 	}
+
+	m_reader.release();
 }
 
 void Connection::socketError(QAbstractSocket::SocketError err) {
@@ -186,11 +187,55 @@ void Connection::sendMessage(const ::google::protobuf::Message &msg, Mumble::Pro
 }
 
 void Connection::sendMessage(const QByteArray &qbaMsg) {
-	if (!qbaMsg.isEmpty())
-		qtsSocket->write(qbaMsg);
+	if (qbaMsg.isEmpty())
+		return;
+
+	if (!m_queuedMessages.isEmpty()) {
+		m_queuedMessages.append(qbaMsg);
+		return;
+	}
+
+	qtsSocket->write(qbaMsg);
+}
+
+void Connection::queueMessage(const QByteArray &qbaMsg) {
+	if (qbaMsg.isEmpty())
+		return;
+
+	if (m_queuedMessages.isEmpty()) {
+		QMetaObject::invokeMethod(this, &Connection::flushQueuedMessages, Qt::QueuedConnection);
+	}
+
+	m_queuedMessages.append(qbaMsg);
+}
+
+void Connection::flushQueuedMessages() {
+	if (m_queuedMessages.isEmpty())
+		return;
+
+	if (m_queuedMessages.size() == 1) {
+		qtsSocket->write(m_queuedMessages.first());
+	} else {
+		qsizetype size = 0;
+		for (const QByteArray &qbaMsg : m_queuedMessages) {
+			size += qbaMsg.size();
+		}
+
+		QByteArray qbaData;
+		qbaData.reserve(size);
+		for (const QByteArray &qbaMsg : m_queuedMessages) {
+			qbaData.append(qbaMsg);
+		}
+
+		qtsSocket->write(qbaData);
+	}
+
+	m_queuedMessages.clear();
 }
 
 void Connection::forceFlush() {
+	flushQueuedMessages();
+
 	if (qtsSocket->state() != QAbstractSocket::ConnectedState)
 		return;
 
@@ -206,10 +251,13 @@ void Connection::disconnectSocket(bool force) {
 		return;
 	}
 
-	if (force)
+	if (force) {
+		m_queuedMessages.clear();
 		qtsSocket->abort();
-	else
+	} else {
+		flushQueuedMessages();
 		qtsSocket->disconnectFromHost();
+	}
 }
 
 QHostAddress Connection::peerAddress() const {
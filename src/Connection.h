@@ -7,6 +7,7 @@
 #define MUMBLE_CONNECTION_H_
 
 #include "MumbleProtocol.h"
+#include "TCPMessageReader.h"
 
 #include <QtCore/QtGlobal>
 
@@ -41,8 +42,9 @@ private:
 protected:
 	QSslSocket *qtsSocket;
 	QElapsedTimer qtLastPacket;
-	Mumble::Protocol::TCPMessageType m_type;
-	int iPacketLength;
+	TCPMessageReader m_reader;
+	/// Messages that have been queued, but not written yet
+	QList< QByteArray > m_queuedMessages;
 #ifdef Q_OS_WIN
 	static HANDLE hQoS;
 	DWORD dwFlow;
@@ -52,11 +54,15 @@ protected slots:
 	void socketError(QAbstractSocket::SocketError);
 	void socketDisconnected();
 	void socketSslErrors(const QList< QSslError > &errors);
+	void flushQueuedMessages();
 public slots:
 	void proceedAnyway();
 signals:
 	void encrypted();
 	void connectionClosed(QAbstractSocket::SocketError, const QString &reason);
+	/// Emitted for every received message. The payload refers to the connection's receive buffer and is only valid
+	/// while the signal is being emitted, so receivers that keep it around (or pass it to another thread) have to copy
+	/// it.
 	void message(Mumble::Protocol::TCPMessageType type, const QByteArray &);
 	void handleSslErrors(const QList< QSslError > &);
 
@@ -68,6 +74,12 @@ public:
 	void sendMessage(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType msgType,
 					 QByteArray &cache);
 	void sendMessage(const QByteArray &qbaMsg);
+	/// Queues the given (serialized) message. All messages queued during one iteration of the event loop are written
+	/// to the socket together once control returns to the event loop, so that they end up in as few writes (and TLS
+	/// records) as possible. The data is shared with the caller, not copied, until then.
+	///
+	/// Messages sent with sendMessage() while there are queued messages are queued as well, so they keep their order.
+	void queueMessage(const QByteArray &qbaMsg);
 	void disconnectSocket(bool force = false);
 	void forceFlush();
 	qint64 activityTime() const;
@@ -249,4 +249,53 @@ bool Group::appliesToUser(const Channel &currentChannel, const Channel &aclChann
 	return invert ? !matches : matches;
 }
 
+Group::ContextDependence Group::contextDependence(QString groupSpecification, QString &groupName) {
+	// This has to be kept in sync with appliesToUser
+	bool usesACLChannel = false;
+
+	while (!groupSpecification.isEmpty()) {
+		if (groupSpecification.startsWith(QChar::fromLatin1('!'))) {
+			groupSpecification = groupSpecification.remove(0, 1);
+			continue;
+		}
+
+		if (groupSpecification.startsWith(QChar::fromLatin1('~'))) {
+			usesACLChannel     = true;
+			groupSpecification = groupSpecification.remove(0, 1);
+			continue;
+		}
+
+		if (groupSpecification.startsWith(QChar::fromLatin1('#'))
+			|| groupSpecification.startsWith(QChar::fromLatin1('$'))) {
+			// Access tokens and certificate hashes only depend on the user
+			return ContextDependence::None;
+		}
+
+		break;
+	}
+
+	if (groupSpecification.isEmpty() || groupSpecification == QLatin1String("none")
+		|| groupSpecification == QLatin1String("all") || groupSpecification == QLatin1String("auth")
+		|| groupSpecification == QLatin1String("strong")) {
+		return ContextDependence::None;
+	}
+
+	if (groupSpecification == QLatin1String("sub") || groupSpecification.startsWith(QLatin1String("sub,"))) {
+		// Even relative to the ACL's channel, the channel hierarchy of the current channel is used
+		return ContextDependence::Hierarchy;
+	}
+
+	if (usesACLChannel) {
+		return ContextDependence::None;
+	}
+
+	if (groupSpecification == QLatin1String("in") || groupSpecification == QLatin1String("out")) {
+		return ContextDependence::UserChannel;
+	}
+
+	groupName = groupSpecification;
+
+	return ContextDependence::GroupDefinitions;
+}
+
 #endif
@@ -35,6 +35,22 @@ public:
 
 	static bool appliesToUser(const Channel &currentChannel, const Channel &aclChannel, QString groupSpecification,
 							  const ServerUser &user);
+
+	/// What the result of appliesToUser depends on, apart from the user and the channel the ACL is defined in
+	enum class ContextDependence {
+		/// Nothing else
+		None,
+		/// Whether the user is in the channel the permissions are evaluated for ("in" and "out")
+		UserChannel,
+		/// The definitions of the group in the channel the permissions are evaluated for and in its parents
+		GroupDefinitions,
+		/// The position of the channel the permissions are evaluated for in the channel tree ("sub")
+		Hierarchy
+	};
+
+	/// @param groupName If the specification depends on the group definitions, this is set to the group's name
+	/// @returns What the result of appliesToUser for the given group specification depends on
+	static ContextDependence contextDependence(QString groupSpecification, QString &groupName);
 #endif
 };
 
@@ -5,44 +5,433 @@
 
 #include "HTMLFilter.h"
 
-#include <QtCore/QXmlStreamReader>
-
-QString HTMLFilter::escapeTags(const QString &in) {
-	QString out;
-	for (int i = 0; i < in.size(); i++) {
-		if (in.at(i) == QLatin1Char('<')) {
-			out += QLatin1String("&lt;");
-		} else if (in.at(i) == QLatin1Char('>')) {
-			out += QLatin1String("&gt;");
+#include <QtCore/QStringView>
+#include <QtCore/QVarLengthArray>
+
+#include <cstdint>
+
+namespace {
+
+/// Walks over a document the way QXmlStreamReader would (if the document was wrapped in a root element), reporting
+/// its content to a handler. Only the open elements are kept track of, everything else is reported as views into the
+/// document.
+///
+/// The handler has to provide
+/// - text(QStringView) for character data (including CDATA sections),
+/// - character(char32_t) for character and entity references,
+/// - attribute(QStringView element, QStringView name, QStringView value) for every attribute, whose (raw) value
+///   has been checked to be well-formed and
+/// - endElement(QStringView name) for every end tag (including the ones of empty-element tags).
+template< typename Handler > class Scanner {
+public:
+	Scanner(QStringView document, Handler &handler)
+		: m_pos(document.data()), m_end(document.data() + document.size()), m_handler(handler) {}
+
+	/// @returns Whether the document is well-formed
+	bool scan() {
+		const QChar *text = m_pos;
+
+		while (m_pos != m_end) {
+			if (*m_pos == QLatin1Char('<')) {
+				flushText(text);
+				if (!markup()) {
+					return false;
+				}
+				text = m_pos;
+			} else if (*m_pos == QLatin1Char('&')) {
+				flushText(text);
+
+				char32_t c;
+				if (!reference(c)) {
+					return false;
+				}
+				m_handler.character(c);
+
+				text = m_pos;
+			} else {
+				if (!isXmlChar(*m_pos)) {
+					return false;
+				}
+				// "]]>" may only end a CDATA section
+				if (*m_pos == QLatin1Char('>') && m_pos - text >= 2 && m_pos[-1] == QLatin1Char(']')
+					&& m_pos[-2] == QLatin1Char(']')) {
+					return false;
+				}
+				++m_pos;
+			}
+		}
+		flushText(text);
+
+		return m_openElements.isEmpty();
+	}
+
+protected:
+	static bool isSpace(QChar c) {
+		return c == QLatin1Char(' ') || c == QLatin1Char('\t') || c == QLatin1Char('\n') || c == QLatin1Char('\r');
+	}
+
+	static bool isNameStart(QChar c) { return c.isLetter() || c == QLatin1Char('_') || c == QLatin1Char(':'); }
+
+	static bool isNameChar(QChar c) {
+		return c.isLetterOrNumber() || c.isMark() || c == QLatin1Char('_') || c == QLatin1Char(':')
+			   || c == QLatin1Char('-') || c == QLatin1Char('.');
+	}
+
+	static bool isXmlChar(char32_t c) {
+		return c == 0x9 || c == 0xA || c == 0xD || (c >= 0x20 && c <= 0xD7FF) || (c >= 0xE000 && c <= 0xFFFD)
+			   || (c >= 0x10000 && c <= 0x10FFFF);
+	}
+
+	/// The check for a single UTF-16 code unit of the document, which lets the halves of surrogate pairs through
+	static bool isXmlChar(QChar c) { return c.isSurrogate() || isXmlChar(static_cast< char32_t >(c.unicode())); }
+
+	/// Parses the digits of a character reference. Unlike QString::toUInt, this doesn't allow for any whitespace, signs
+	/// or prefixes.
+	static bool characterCode(QStringView digits, unsigned int base, char32_t &code) {
+		if (digits.isEmpty()) {
+			return false;
+		}
+
+		std::uint32_t value = 0;
+		for (QChar c : digits) {
+			const char16_t u = c.unicode();
+
+			std::uint32_t digit;
+			if (u >= '0' && u <= '9') {
+				digit = static_cast< std::uint32_t >(u - '0');
+			} else if (base == 16 && u >= 'a' && u <= 'f') {
+				digit = static_cast< std::uint32_t >(u - 'a' + 10);
+			} else if (base == 16 && u >= 'A' && u <= 'F') {
+				digit = static_cast< std::uint32_t >(u - 'A' + 10);
+			} else {
+				return false;
+			}
+
+			value = value * base + digit;
+			if (value > 0x10FFFF) {
+				return false;
+			}
+		}
+
+		code = value;
+		return true;
+	}
+
+	void flushText(const QChar *text) {
+		if (text != m_pos) {
+			m_handler.text(QStringView(text, m_pos));
+		}
+	}
+
+	bool startsWith(QLatin1String prefix) const {
+		return m_end - m_pos >= prefix.size() && QStringView(m_pos, prefix.size()) == prefix;
+	}
+
+	/// Moves behind the given terminator
+	/// @returns The content up to the terminator, or a null view if the document ends before it or the content
+	/// 	contains a character that isn't allowed in XML
+	QStringView skipPast(QLatin1String terminator) {
+		const QChar *start = m_pos;
+		for (; m_pos != m_end; ++m_pos) {
+			if (startsWith(terminator)) {
+				const QStringView content(start, m_pos);
+				m_pos += terminator.size();
+				return content;
+			}
+			if (!isXmlChar(*m_pos)) {
+				return QStringView();
+			}
+		}
+		return QStringView();
+	}
+
+	void skipSpace() {
+		while (m_pos != m_end && isSpace(*m_pos)) {
+			++m_pos;
+		}
+	}
+
+	QStringView name() {
+		const QChar *start = m_pos;
+		if (m_pos == m_end || !isNameStart(*m_pos)) {
+			return QStringView();
+		}
+		while (m_pos != m_end && isNameChar(*m_pos)) {
+			++m_pos;
+		}
+		return QStringView(start, m_pos);
+	}
+
+	/// Parses a reference to a (predefined) entity or a character, starting at the '&'
+	bool reference(char32_t &c) {
+		++m_pos;
+
+		const QChar *start = m_pos;
+		while (m_pos != m_end && *m_pos != QLatin1Char(';')) {
+			if (m_pos - start > 10) {
+				return false;
+			}
+			++m_pos;
+		}
+		if (m_pos == m_end) {
+			return false;
+		}
+		const QStringView entity(start, m_pos);
+		++m_pos;
+
+		if (entity == QLatin1String("lt")) {
+			c = '<';
+		} else if (entity == QLatin1String("gt")) {
+			c = '>';
+		} else if (entity == QLatin1String("amp")) {
+			c = '&';
+		} else if (entity == QLatin1String("quot")) {
+			c = '"';
+		} else if (entity == QLatin1String("apos")) {
+			c = '\'';
+		} else if (entity.startsWith(QLatin1Char('#'))) {
+			const bool hex = entity.startsWith(QLatin1String("#x"));
+			if (!characterCode(entity.mid(hex ? 2 : 1), hex ? 16 : 10, c) || !isXmlChar(c)) {
+				return false;
+			}
 		} else {
-			out += in.at(i);
+			return false;
 		}
+
+		return true;
 	}
-	return out;
-}
 
-bool HTMLFilter::filter(const QString &in, QString &out) {
-	if (!in.contains(QLatin1Char('<'))) {
-		out = in.simplified();
-	} else {
-		QXmlStreamReader qxsr(QString::fromLatin1("<document>%1</document>").arg(in));
-		QString qs;
-		while (!qxsr.atEnd()) {
-			switch (qxsr.readNext()) {
-				case QXmlStreamReader::Invalid:
+	/// Parses a tag, comment, CDATA section or processing instruction, starting at the '<'
+	bool markup() {
+		if (startsWith(QLatin1String("<!--"))) {
+			m_pos += 4;
+			return !skipPast(QLatin1String("-->")).isNull();
+		}
+		if (startsWith(QLatin1String("<![CDATA["))) {
+			m_pos += 9;
+			const QStringView data = skipPast(QLatin1String("]]>"));
+			if (data.isNull()) {
+				return false;
+			}
+			if (!data.isEmpty()) {
+				m_handler.text(data);
+			}
+			return true;
+		}
+		if (startsWith(QLatin1String("<?"))) {
+			m_pos += 2;
+			return !name().isEmpty() && !skipPast(QLatin1String("?>")).isNull();
+		}
+		if (startsWith(QLatin1String("</"))) {
+			m_pos += 2;
+			return endTag();
+		}
+
+		++m_pos;
+		return startTag();
+	}
+
+	bool endTag() {
+		const QStringView element = name();
+		skipSpace();
+		if (element.isEmpty() || m_pos == m_end || *m_pos != QLatin1Char('>')) {
+			return false;
+		}
+		++m_pos;
+
+		if (m_openElements.isEmpty() || m_openElements.last() != element) {
+			return false;
+		}
+		m_openElements.removeLast();
+
+		m_handler.endElement(element);
+		return true;
+	}
+
+	bool startTag() {
+		const QStringView element = name();
+		if (element.isEmpty()) {
+			return false;
+		}
+
+		QVarLengthArray< QStringView, 8 > attributes;
+
+		while (true) {
+			const QChar *beforeSpace = m_pos;
+			skipSpace();
+			if (m_pos == m_end) {
+				return false;
+			}
+
+			if (*m_pos == QLatin1Char('>')) {
+				++m_pos;
+				m_openElements.append(element);
+				return true;
+			}
+			if (startsWith(QLatin1String("/>"))) {
+				m_pos += 2;
+				m_handler.endElement(element);
+				return true;
+			}
+
+			// Attributes have to be separated by whitespace
+			QStringView attributeName;
+			if (beforeSpace == m_pos || !attribute(element, attributeName)) {
+				return false;
+			}
+
+			// Every attribute may only be given once
+			if (attributes.contains(attributeName)) {
+				return false;
+			}
+			attributes.append(attributeName);
+		}
+	}
+
+	bool attribute(QStringView element, QStringView &attribute) {
+		attribute = name();
+		skipSpace();
+		if (attribute.isEmpty() || m_pos == m_end || *m_pos != QLatin1Char('=')) {
+			return false;
+		}
+		++m_pos;
+		skipSpace();
+		if (m_pos == m_end || (*m_pos != QLatin1Char('"') && *m_pos != QLatin1Char('\''))) {
+			return false;
+		}
+
+		const QChar quote  = *m_pos++;
+		const QChar *start = m_pos;
+		while (m_pos != m_end && *m_pos != quote) {
+			if (*m_pos == QLatin1Char('<')) {
+				return false;
+			}
+			if (*m_pos == QLatin1Char('&')) {
+				char32_t c;
+				if (!reference(c)) {
 					return false;
-				case QXmlStreamReader::Characters:
-					qs += qxsr.text();
-					break;
-				case QXmlStreamReader::EndElement:
-					if ((qxsr.name() == QLatin1String("br")) || (qxsr.name() == QLatin1String("p")))
-						qs += QLatin1Char('\n');
-					break;
-				default:
-					break;
+				}
+			} else if (!isXmlChar(*m_pos)) {
+				return false;
+			} else {
+				++m_pos;
 			}
 		}
-		out = escapeTags(qs.simplified());
+		if (m_pos == m_end) {
+			return false;
+		}
+
+		m_handler.attribute(element, attribute, QStringView(start, m_pos));
+		++m_pos;
+
+		return true;
+	}
+
+	const QChar *m_pos;
+	const QChar *const m_end;
+	Handler &m_handler;
+	/// The names of the elements whose end tag is yet to come. Documents are rarely nested deeper than this, so
+	/// keeping track of them doesn't need any allocations.
+	QVarLengthArray< QStringView, 32 > m_openElements;
+};
+
+/// Collects the character data of a document, replacing every sequence of whitespace by a single space (like
+/// QString::simplified) and escaping the characters that would otherwise start or end a tag.
+class PlainTextWriter {
+public:
+	PlainTextWriter(QString &out) : m_out(out) {}
+
+	void text(QStringView text) {
+		for (QChar c : text) {
+			append(c);
+		}
+	}
+
+	void character(char32_t c) {
+		if (QChar::requiresSurrogates(c)) {
+			append(QChar(QChar::highSurrogate(c)));
+			append(QChar(QChar::lowSurrogate(c)));
+		} else {
+			append(QChar(static_cast< char16_t >(c)));
+		}
+	}
+
+	void attribute(QStringView, QStringView, QStringView) {}
+
+	void endElement(QStringView name) {
+		if (name == QLatin1String("br") || name == QLatin1String("p")) {
+			append(QLatin1Char('\n'));
+		}
+	}
+
+protected:
+	void append(QChar c) {
+		if (c.isSpace()) {
+			m_pendingSpace = true;
+			return;
+		}
+
+		if (m_pendingSpace && !m_out.isEmpty()) {
+			m_out += QLatin1Char(' ');
+		}
+		m_pendingSpace = false;
+
+		if (c == QLatin1Char('<')) {
+			m_out += QLatin1String("&lt;");
+		} else if (c == QLatin1Char('>')) {
+			m_out += QLatin1String("&gt;");
+		} else {
+			m_out += c;
+		}
 	}
+
+	QString &m_out;
+	bool m_pendingSpace = false;
+};
+
+/// Adds up the length of the images embedded in a document
+class ImageMeasurer {
+public:
+	qsizetype imageLength = 0;
+
+	void text(QStringView) {}
+	void character(char32_t) {}
+	void endElement(QStringView) {}
+
+	void attribute(QStringView element, QStringView name, QStringView value) {
+		if (element == QLatin1String("img") && name == QLatin1String("src")) {
+			imageLength += value.size();
+		}
+	}
+};
+
+} // namespace
+
+bool HTMLFilter::filter(const QString &in, QString &out) {
+	if (!in.contains(QLatin1Char('<'))) {
+		out = in.simplified();
+		return true;
+	}
+
+	QString plain;
+	plain.reserve(in.size());
+
+	PlainTextWriter writer(plain);
+	if (!Scanner< PlainTextWriter >(in, writer).scan()) {
+		return false;
+	}
+
+	out = plain;
+	return true;
+}
+
+bool HTMLFilter::measure(const QString &in, Measurement &measurement) {
+	ImageMeasurer measurer;
+	if (!Scanner< ImageMeasurer >(in, measurer).scan()) {
+		return false;
+	}
+
+	measurement.imageLength = measurer.imageLength;
+	measurement.textLength  = in.size() - measurer.imageLength;
 	return true;
 }
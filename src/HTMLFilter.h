@@ -16,13 +16,25 @@
 /// text messages, comments, and more
 /// to plain text when a server is
 /// configured to disallow HTML.
+///
+/// The documents are parsed as XML
+/// fragments by a scanner that makes
+/// a single pass over them, without
+/// copying them.
 class HTMLFilter {
-	/// escapeTags returns the in HTML document
-	/// with all occurrences of > and <
-	/// replaced by &lt; and &gt;.
-	static QString escapeTags(const QString &in);
-
 public:
+	/// The sizes determined by measure.
+	struct Measurement {
+		/// The length of the document,
+		/// not counting the images.
+		qsizetype textLength = 0;
+		/// The combined length of the
+		/// src attributes' values of all
+		/// <img> elements (which usually
+		/// are base64-encoded data URLs).
+		qsizetype imageLength = 0;
+	};
+
 	/// filter does a best-effort conversion of the
 	/// in HTML document to a plain-text representation.
 	///
@@ -33,6 +45,18 @@ public:
 	/// If the filtering failed, the function returns false
 	/// and out is left unchanged.
 	static bool filter(const QString &in, QString &out);
+
+	/// measure determines how much of the
+	/// in HTML document is made up of
+	/// images and how much of it is text.
+	///
+	/// If the document is well-formed, the
+	/// function writes the sizes to
+	/// measurement, and returns true.
+	///
+	/// Otherwise, the function returns false
+	/// and measurement is left unchanged.
+	static bool measure(const QString &in, Measurement &measurement);
 };
 
 #endif
@@ -108,9 +108,8 @@ bool HostAddress::match(const HostAddress &netmask, unsigned int bits) const {
 		} else {
 			// Compare only the first bits bits (no this is not a typo)
 			using mask_t = std::uint8_t;
-			mask_t mask =
-				static_cast< mask_t >(std::numeric_limits< mask_t >::max() >> (sizeof(mask_t) * CHAR_BIT - bits));
-			mask = static_cast< mask_t >(htons(mask));
+			const mask_t mask =
+				static_cast< mask_t >(std::numeric_limits< mask_t >::max() << (sizeof(mask_t) * CHAR_BIT - bits));
 
 			if ((m_byteRepresentation[i] & mask) != (netmask.m_byteRepresentation[i] & mask)) {
 				return false;
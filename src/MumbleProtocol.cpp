@@ -13,6 +13,7 @@
 #include <cassert>
 #include <cmath>
 #include <cstring>
+#include <limits>
 
 namespace Mumble {
 namespace Protocol {
@@ -504,6 +505,161 @@ namespace Protocol {
 	}
 
 
+	namespace {
+		/// The wire types of the Protobuf encoding (see https://protobuf.dev/programming-guides/encoding/)
+		enum class WireType : byte {
+			Varint          = 0,
+			Fixed64         = 1,
+			LengthDelimited = 2,
+			StartGroup      = 3,
+			EndGroup        = 4,
+			Fixed32         = 5
+		};
+
+		/// The maximum nesting depth of (unknown) groups, which is the same as Protobuf's default recursion limit
+		constexpr const int MAX_GROUP_DEPTH = 100;
+
+		/// A minimal reader of the Protobuf wire format. It accepts exactly the input that the Protobuf library accepts
+		/// and allows decoding messages without parsing them into a Protobuf object (which copies all strings and bytes
+		/// fields onto the heap).
+		class WireReader {
+		public:
+			WireReader(const byte *begin, const byte *end) : m_pos(begin), m_end(end) {}
+
+			bool atEnd() const { return m_pos == m_end; }
+
+			bool readVarint(std::uint64_t &value) {
+				value = 0;
+
+				// Varints consist of up to 10 bytes. Any bits beyond the 64th one are discarded.
+				for (unsigned int i = 0; i < 10 && m_pos != m_end; ++i) {
+					const byte current = *m_pos++;
+
+					value |= static_cast< std::uint64_t >(current & 0x7f) << (7 * i);
+
+					if (!(current & 0x80)) {
+						return true;
+					}
+				}
+
+				return false;
+			}
+
+			bool readTag(std::uint32_t &fieldNumber, WireType &wireType) {
+				std::uint64_t tag;
+				// Tags consist of up to 5 bytes
+				const byte *begin = m_pos;
+				if (!readVarint(tag) || m_pos - begin > 5) {
+					return false;
+				}
+
+				fieldNumber = static_cast< std::uint32_t >(tag) >> 3;
+				wireType    = static_cast< WireType >(tag & 0x7);
+
+				return fieldNumber != 0;
+			}
+
+			bool readFixed32(std::uint32_t &value) {
+				if (m_end - m_pos < 4) {
+					return false;
+				}
+
+				value = qFromLittleEndian< std::uint32_t >(m_pos);
+				m_pos += 4;
+
+				return true;
+			}
+
+			bool readFloat(float &value) {
+				std::uint32_t bits;
+				if (!readFixed32(bits)) {
+					return false;
+				}
+
+				static_assert(sizeof(float) == sizeof(std::uint32_t), "Unexpected size of float");
+				std::memcpy(&value, &bits, sizeof(value));
+
+				return true;
+			}
+
+			/// Reads the size of a length-delimited field and returns its contents (without copying them)
+			bool readLengthDelimited(const byte *&begin, std::size_t &size) {
+				std::uint64_t length;
+				// The length is limited to 2^31 - 1 (and thus 5 bytes)
+				const byte *lengthBegin = m_pos;
+				if (!readVarint(length) || m_pos - lengthBegin > 5
+					|| length > static_cast< std::uint64_t >(std::numeric_limits< std::int32_t >::max())
+					|| length > static_cast< std::uint64_t >(m_end - m_pos)) {
+					return false;
+				}
+
+				begin = m_pos;
+				size  = static_cast< std::size_t >(length);
+				m_pos += size;
+
+				return true;
+			}
+
+			/// Skips a field that isn't known (or has an unexpected wire type)
+			bool skip(std::uint32_t fieldNumber, WireType wireType, int depth = 0) {
+				std::uint64_t value;
+				const byte *begin;
+				std::size_t size;
+
+				switch (wireType) {
+					case WireType::Varint:
+						return readVarint(value);
+					case WireType::Fixed64:
+						if (m_end - m_pos < 8) {
+							return false;
+						}
+						m_pos += 8;
+						return true;
+					case WireType::LengthDelimited:
+						return readLengthDelimited(begin, size);
+					case WireType::StartGroup:
+						if (depth >= MAX_GROUP_DEPTH) {
+							return false;
+						}
+
+						// Skip all fields of the group until its end
+						while (true) {
+							std::uint32_t currentFieldNumber;
+							WireType currentWireType;
+							if (!readTag(currentFieldNumber, currentWireType)) {
+								return false;
+							}
+
+							if (currentWireType == WireType::EndGroup) {
+								return currentFieldNumber == fieldNumber;
+							}
+
+							if (!skip(currentFieldNumber, currentWireType, depth + 1)) {
+								return false;
+							}
+						}
+					case WireType::Fixed32:
+						if (m_end - m_pos < 4) {
+							return false;
+						}
+						m_pos += 4;
+						return true;
+					case WireType::EndGroup:
+						// There is no group to end
+						break;
+				}
+
+				// Invalid wire type
+				return false;
+			}
+
+		private:
+			const byte *m_pos;
+			const byte *m_end;
+		};
+	} // namespace
+
+
 	template< Role role >
 	UDPDecoder< role >::UDPDecoder(Version::full_t protocolVersion) : ProtocolHandler< role >(protocolVersion) {
 		m_byteBuffer.resize(MAX_UDP_PACKET_SIZE);
@@ -804,40 +960,146 @@ namespace Protocol {
 		m_messageType = UDPMessageType::Audio;
 		m_audioData   = {};
 
-		if (!m_audioMessage.ParseFromArray(data.data(), static_cast< int >(data.size()))) {
-			// Invalid format
-			return false;
+		// Instead of parsing the data into a MumbleUDP::Audio object (which copies the payload onto the heap), the
+		// fields are read directly from the wire format. The payload thus points into the given data.
+		WireReader reader(data.data(), data.data() + data.size());
+
+		// target and context are part of a oneof, so only the one that appears last counts
+		std::uint32_t headerField = 0;
+		std::uint32_t headerValue = 0;
+		const byte *payloadBegin  = nullptr;
+		std::size_t payloadSize   = 0;
+		std::size_t positionCount = 0;
+		float volumeAdjustment    = 0;
+
+		while (!reader.atEnd()) {
+			std::uint32_t fieldNumber;
+			WireType wireType;
+			if (!reader.readTag(fieldNumber, wireType)) {
+				// Invalid format
+				return false;
+			}
+
+			std::uint64_t value;
+			bool known = true;
+
+			switch (fieldNumber) {
+				case MumbleUDP::Audio::kTargetFieldNumber:
+				case MumbleUDP::Audio::kContextFieldNumber:
+				case MumbleUDP::Audio::kSenderSessionFieldNumber:
+				case MumbleUDP::Audio::kFrameNumberFieldNumber:
+				case MumbleUDP::Audio::kIsTerminatorFieldNumber:
+					if (wireType != WireType::Varint) {
+						known = false;
+						break;
+					}
+
+					if (!reader.readVarint(value)) {
+						return false;
+					}
+
+					if (fieldNumber == MumbleUDP::Audio::kTargetFieldNumber
+						|| fieldNumber == MumbleUDP::Audio::kContextFieldNumber) {
+						headerField = fieldNumber;
+						headerValue = static_cast< std::uint32_t >(value);
+					} else if (fieldNumber == MumbleUDP::Audio::kSenderSessionFieldNumber) {
+						m_audioData.senderSession = static_cast< std::uint32_t >(value);
+					} else if (fieldNumber == MumbleUDP::Audio::kFrameNumberFieldNumber) {
+						m_audioData.frameNumber = value;
+					} else {
+						m_audioData.isLastFrame = value != 0;
+					}
+					break;
+				case MumbleUDP::Audio::kOpusDataFieldNumber:
+					if (wireType != WireType::LengthDelimited) {
+						known = false;
+						break;
+					}
+
+					if (!reader.readLengthDelimited(payloadBegin, payloadSize)) {
+						return false;
+					}
+					break;
+				case MumbleUDP::Audio::kPositionalDataFieldNumber:
+					// Repeated fields may be sent packed or one by one
+					if (wireType == WireType::Fixed32) {
+						float coordinate;
+						if (!reader.readFloat(coordinate)) {
+							return false;
+						}
+
+						if (positionCount < m_audioData.position.size()) {
+							m_audioData.position[positionCount] = coordinate;
+						}
+						positionCount++;
+					} else if (wireType == WireType::LengthDelimited) {
+						const byte *packedBegin;
+						std::size_t packedSize;
+						if (!reader.readLengthDelimited(packedBegin, packedSize) || packedSize % sizeof(float) != 0) {
+							return false;
+						}
+
+						WireReader packedReader(packedBegin, packedBegin + packedSize);
+						while (!packedReader.atEnd()) {
+							float coordinate;
+							packedReader.readFloat(coordinate);
+
+							if (positionCount < m_audioData.position.size()) {
+								m_audioData.position[positionCount] = coordinate;
+							}
+							positionCount++;
+						}
+					} else {
+						known = false;
+					}
+					break;
+				case MumbleUDP::Audio::kVolumeAdjustmentFieldNumber:
+					if (wireType != WireType::Fixed32) {
+						known = false;
+						break;
+					}
+
+					if (!reader.readFloat(volumeAdjustment)) {
+						return false;
+					}
+					break;
+				default:
+					known = false;
+					break;
+			}
+
+			if (!known && !reader.skip(fieldNumber, wireType)) {
+				return false;
+			}
 		}
 
-		m_audioData.targetOrContext =
-			this->getRole() == Role::Client ? m_audioMessage.context() : m_audioMessage.target();
+		if (headerField
+			== (this->getRole() == Role::Client ? static_cast< std::uint32_t >(MumbleUDP::Audio::kContextFieldNumber)
+												: static_cast< std::uint32_t >(MumbleUDP::Audio::kTargetFieldNumber))) {
+			m_audioData.targetOrContext = headerValue;
+		} else {
+			m_audioData.targetOrContext = 0;
+		}
 		// Atm the only codec supported by the new package format is Opus
-		m_audioData.usedCodec     = AudioCodec::Opus;
-		m_audioData.senderSession = m_audioMessage.sender_session();
-		m_audioData.frameNumber   = m_audioMessage.frame_number();
-		if (m_audioMessage.opus_data().empty()) {
+		m_audioData.usedCodec = AudioCodec::Opus;
+
+		if (payloadSize == 0) {
 			// Audio packets without audio data are invalid
 			return false;
 		}
 
-		std::string &audioPayload = *m_audioMessage.mutable_opus_data();
-		m_audioData.payload = gsl::span< byte >(reinterpret_cast< byte * >(&audioPayload[0]), audioPayload.size());
-
-		m_audioData.isLastFrame = m_audioMessage.is_terminator();
+		m_audioData.payload = gsl::span< const byte >(payloadBegin, payloadSize);
 
-		if (m_audioMessage.positional_data_size() != 0) {
-			if (m_audioMessage.positional_data_size() != 3) {
+		if (positionCount != 0) {
+			if (positionCount != 3) {
 				// We always expect a 3D position, if positional data is present
 				return false;
 			}
-			for (unsigned int i = 0; i < 3; ++i) {
-				m_audioData.position[i] = m_audioMessage.positional_data(static_cast< int >(i));
-			}
 
 			m_audioData.containsPositionalData = true;
 		}
 
-		m_audioData.volumeAdjustment = VolumeAdjustment::fromFactor(m_audioMessage.volume_adjustment());
+		m_audioData.volumeAdjustment = VolumeAdjustment::fromFactor(volumeAdjustment);
 		if (m_audioData.volumeAdjustment.factor == 0.0f) {
 			// No volume adjustment was set, reset to default
 			m_audioData.volumeAdjustment = VolumeAdjustment::fromFactor(1.0f);
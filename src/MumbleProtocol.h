@@ -265,7 +265,6 @@ namespace Protocol {
 		AudioData m_audioData = {};
 		PingData m_pingData   = {};
 		MumbleUDP::Ping m_pingMessage;
-		MumbleUDP::Audio m_audioMessage;
 
 		bool decodePing_legacy(const gsl::span< const byte > data);
 		bool decodePing_protobuf(const gsl::span< const byte > data);
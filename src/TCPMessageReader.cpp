@@ -0,0 +1,173 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "TCPMessageReader.h"
+
+#include <QtCore/QMutex>
+#include <QtCore/QtEndian>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+/// The buffers of readers that have consumed all of their data, ready to be used by the next reader that
+/// receives something
+class BufferPool {
+public:
+	/// The amount of buffers that are kept around at most
+	static constexpr std::size_t MAX_FREE_BUFFERS = 32;
+
+	~BufferPool() {
+		for (char *buffer : m_free) {
+			delete[] buffer;
+		}
+	}
+
+	char *acquire() {
+		{
+			QMutexLocker lock(&m_mutex);
+			if (!m_free.empty()) {
+				char *buffer = m_free.back();
+				m_free.pop_back();
+				return buffer;
+			}
+		}
+
+		return new char[TCPMessageReader::BLOCK_SIZE];
+	}
+
+	void recycle(char *buffer) {
+		{
+			QMutexLocker lock(&m_mutex);
+			if (m_free.size() < MAX_FREE_BUFFERS) {
+				m_free.push_back(buffer);
+				return;
+			}
+		}
+
+		delete[] buffer;
+	}
+
+	static BufferPool &get() {
+		static BufferPool pool;
+		return pool;
+	}
+
+private:
+	QMutex m_mutex;
+	std::vector< char * > m_free;
+};
+
+} // namespace
+
+TCPMessageReader::~TCPMessageReader() {
+	clear();
+}
+
+gsl::span< char > TCPMessageReader::writeBuffer() {
+	if (!m_data) {
+		m_data     = BufferPool::get().acquire();
+		m_capacity = BLOCK_SIZE;
+	}
+
+	if (m_begin == m_end) {
+		m_begin = 0;
+		m_end   = 0;
+	}
+
+	// Usually, all complete messages have been consumed before more data is received, so what is left is the
+	// beginning of a single message. It has to fit into the buffer as a whole, so that it can be handed out as one
+	// piece.
+	const std::size_t size     = m_end - m_begin;
+	const std::size_t required = std::max({ currentMessageSize(), size + 1, HEADER_SIZE });
+
+	if (m_begin + required > m_capacity) {
+		if (required > m_capacity) {
+			char *data = new char[required];
+			std::memcpy(data, m_data + m_begin, size);
+
+			clear();
+			m_data     = data;
+			m_capacity = required;
+		} else {
+			std::memmove(m_data, m_data + m_begin, size);
+		}
+
+		m_begin = 0;
+		m_end   = size;
+	}
+
+	return { m_data + m_end, m_capacity - m_end };
+}
+
+void TCPMessageReader::commit(std::size_t size) {
+	assert(m_end + size <= m_capacity);
+
+	m_end += size;
+}
+
+TCPMessageReader::Status TCPMessageReader::next(Mumble::Protocol::TCPMessageType &type, QByteArray &payload) {
+	if (m_end - m_begin < HEADER_SIZE) {
+		return Status::Incomplete;
+	}
+
+	const unsigned char *header = reinterpret_cast< const unsigned char * >(m_data + m_begin);
+	const std::size_t length    = qFromBigEndian< quint32 >(&header[2]);
+
+	if (length > MAX_PAYLOAD_SIZE) {
+		return Status::TooLarge;
+	}
+
+	if (m_end - m_begin < HEADER_SIZE + length) {
+		return Status::Incomplete;
+	}
+
+	type    = static_cast< Mumble::Protocol::TCPMessageType >(qFromBigEndian< quint16 >(&header[0]));
+	payload = QByteArray::fromRawData(m_data + m_begin + HEADER_SIZE, static_cast< int >(length));
+
+	m_begin += HEADER_SIZE + length;
+
+	return Status::Message;
+}
+
+void TCPMessageReader::release() {
+	if (m_begin == m_end) {
+		clear();
+	}
+}
+
+void TCPMessageReader::clear() {
+	if (m_data) {
+		if (m_capacity == BLOCK_SIZE) {
+			BufferPool::get().recycle(m_data);
+		} else {
+			delete[] m_data;
+		}
+	}
+
+	m_data     = nullptr;
+	m_capacity = 0;
+	m_begin    = 0;
+	m_end      = 0;
+}
+
+std::size_t TCPMessageReader::pending() const {
+	return m_end - m_begin;
+}
+
+std::size_t TCPMessageReader::currentMessageSize() const {
+	if (m_end - m_begin < HEADER_SIZE) {
+		return 0;
+	}
+
+	const unsigned char *header = reinterpret_cast< const unsigned char * >(m_data + m_begin);
+	const std::size_t length    = qFromBigEndian< quint32 >(&header[2]);
+
+	// Messages that are too large are rejected by next() anyway
+	return HEADER_SIZE + std::min(length, MAX_PAYLOAD_SIZE);
+}
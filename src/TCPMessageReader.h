@@ -0,0 +1,71 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_TCPMESSAGEREADER_H_
+#define MUMBLE_TCPMESSAGEREADER_H_
+
+#include "MumbleProtocol.h"
+
+#include <QtCore/QByteArray>
+
+#include <gsl/span>
+
+#include <cstddef>
+
+/// Splits the data received on a TCP connection into the messages of the Mumble protocol, without allocating (or
+/// copying) every message on its own.
+///
+/// The data is read from the socket in large chunks into a buffer, in which the messages are parsed in place. The
+/// payload of every message is handed out as a view into that buffer. Once all data has been consumed, the buffer
+/// is returned to a pool shared by all readers, so idle connections don't hold on to a buffer of their own.
+class TCPMessageReader {
+private:
+	Q_DISABLE_COPY(TCPMessageReader)
+
+public:
+	enum class Status { Message, Incomplete, TooLarge };
+
+	/// The size of the prefix (type and length) of every message
+	static constexpr std::size_t HEADER_SIZE = 6;
+	/// The largest payload a message may have
+	static constexpr std::size_t MAX_PAYLOAD_SIZE = 0x7fffff;
+	/// The size of the (pooled) buffers. Messages that don't fit into one get a buffer of their own.
+	static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+	TCPMessageReader() = default;
+	~TCPMessageReader();
+
+	/// @returns The free space at the end of the buffer, which the received data is to be written to. Its size is
+	///          never zero. Data that hasn't been consumed yet may be moved, which invalidates the payloads returned by
+	///          next().
+	gsl::span< char > writeBuffer();
+	/// Marks the given amount of bytes (written to the buffer returned by writeBuffer()) as received
+	void commit(std::size_t size);
+
+	/// Extracts the next message from the received data. Its payload refers to the reader's buffer and is valid until
+	/// writeBuffer(), release() or clear() is called. Callers that want to keep it have to copy it.
+	Status next(Mumble::Protocol::TCPMessageType &type, QByteArray &payload);
+
+	/// Returns the buffer to the pool if all of the received data has been consumed
+	void release();
+	/// Discards all received data and returns the buffer to the pool
+	void clear();
+
+	/// The amount of received bytes that haven't been consumed yet
+	std::size_t pending() const;
+
+private:
+	char *m_data           = nullptr;
+	std::size_t m_capacity = 0;
+	/// The received, but not yet consumed, data is stored in [m_begin, m_end)
+	std::size_t m_begin = 0;
+	std::size_t m_end   = 0;
+
+	/// @returns The size the message at m_begin takes up including its header, or 0 if its header hasn't been
+	///          received completely yet
+	std::size_t currentMessageSize() const;
+};
+
+#endif
@@ -0,0 +1,196 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "ACL.h"
+#include "ACLCache.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+// These benchmarks compare ACLCache with the cache that has been used before (a QHash of QHashes protected by a
+// mutex) on a large server. Permissions are looked up for random users in random channels out of the ones they are
+// interested in, while ACLs are edited (which invalidates the whole cache) every so often.
+
+constexpr const unsigned int CHANNEL_COUNT = 5000;
+constexpr const unsigned int USER_COUNT    = 1000;
+/// The amount of channels every user looks up permissions in (their own channel, linked ones, whisper targets, ...)
+constexpr const unsigned int CHANNELS_PER_USER = 8;
+/// The amount of lookups per iteration
+constexpr const std::size_t LOOKUPS = 4096;
+
+// NOTE: These are merely mocks of the Channel and ServerUser classes
+struct MockChannel {
+	unsigned int iId;
+};
+
+struct MockUser {
+	int iId;
+	ACLCache::UserCache m_aclCache;
+};
+
+/// Stands in for ChanACL::effectivePermissions, which walks the channel tree from the root to the channel and
+/// evaluates every ACL and group on the way.
+static ChanACL::Permissions computePermissions(const MockUser &user, const MockChannel &channel) {
+	unsigned int hash = static_cast< unsigned int >(user.iId) * 2654435761U ^ channel.iId;
+	for (int i = 0; i < 64; ++i) {
+		hash = (hash ^ (hash >> 13)) * 0x5BD1E995U;
+	}
+
+	return static_cast< ChanACL::Permissions >(static_cast< int >(hash & ChanACL::All));
+}
+
+/// The baseline: the cache as it has been used before ACLCache
+struct LockedHashCache {
+	QMutex mutex;
+	QHash< const MockUser *, QHash< const MockChannel *, ChanACL::Permissions > * > cache;
+
+	~LockedHashCache() { invalidate(); }
+
+	ChanACL::Permissions get(MockUser &user, const MockChannel &channel) {
+		QMutexLocker lock(&mutex);
+
+		QHash< const MockChannel *, ChanACL::Permissions > *h = cache.value(&user);
+		if (h) {
+			ChanACL::Permissions granted = h->value(&channel);
+			if (granted & ChanACL::Cached) {
+				return granted;
+			}
+		}
+
+		ChanACL::Permissions granted = computePermissions(user, channel);
+
+		if (!h) {
+			h = new QHash< const MockChannel *, ChanACL::Permissions >();
+			cache.insert(&user, h);
+		}
+		h->insert(&channel, granted | ChanACL::Cached);
+
+		return granted;
+	}
+
+	void invalidate() {
+		QMutexLocker lock(&mutex);
+
+		for (QHash< const MockChannel *, ChanACL::Permissions > *h : cache) {
+			delete h;
+		}
+		cache.clear();
+	}
+};
+
+struct FlatCache {
+	ACLCache cache;
+
+	ChanACL::Permissions get(MockUser &user, const MockChannel &channel) {
+		ChanACL::Permissions granted;
+		if (cache.lookup(user.m_aclCache, channel.iId, granted)) {
+			return granted;
+		}
+
+		const std::uint64_t generation = cache.generation();
+		granted                        = computePermissions(user, channel);
+		cache.store(user.m_aclCache, channel.iId, granted, generation);
+
+		return granted;
+	}
+
+	void invalidate() { cache.invalidate(); }
+};
+
+struct Lookup {
+	MockUser *user;
+	const MockChannel *channel;
+};
+
+struct MockServer {
+	std::vector< MockChannel > channels;
+	std::vector< std::unique_ptr< MockUser > > users;
+	std::vector< Lookup > lookups;
+
+	MockServer() {
+		for (unsigned int i = 0; i < CHANNEL_COUNT; ++i) {
+			channels.push_back({ i });
+		}
+
+		std::mt19937 rng(42);
+		std::uniform_int_distribution< unsigned int > randomChannel(0, CHANNEL_COUNT - 1);
+		std::uniform_int_distribution< unsigned int > randomUser(0, USER_COUNT - 1);
+		std::uniform_int_distribution< unsigned int > randomInterest(0, CHANNELS_PER_USER - 1);
+
+		std::vector< std::vector< unsigned int > > interests(USER_COUNT);
+		for (unsigned int i = 0; i < USER_COUNT; ++i) {
+			users.push_back(std::make_unique< MockUser >());
+			users.back()->iId = static_cast< int >(i + 1);
+
+			for (unsigned int j = 0; j < CHANNELS_PER_USER; ++j) {
+				interests[i].push_back(randomChannel(rng));
+			}
+		}
+
+		for (std::size_t i = 0; i < LOOKUPS; ++i) {
+			const unsigned int user = randomUser(rng);
+			lookups.push_back({ users[user].get(), &channels[interests[user][randomInterest(rng)]] });
+		}
+	}
+};
+
+template< typename Cache > static void BM_lookup(::benchmark::State &state) {
+	// The amount of lookups between two ACL edits. 0 disables the edits.
+	const std::size_t editInterval = static_cast< std::size_t >(state.range(0));
+
+	MockServer server;
+	Cache cache;
+
+	std::size_t sinceEdit = 0;
+	std::size_t edits     = 0;
+
+	for (auto _ : state) {
+		for (const Lookup &lookup : server.lookups) {
+			if (editInterval > 0 && ++sinceEdit == editInterval) {
+				cache.invalidate();
+				sinceEdit = 0;
+				edits++;
+			}
+
+			benchmark::DoNotOptimize(cache.get(*lookup.user, *lookup.channel));
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * LOOKUPS));
+	state.counters["edits"] = static_cast< double >(edits);
+}
+
+BENCHMARK_TEMPLATE(BM_lookup, LockedHashCache)->Arg(0)->Arg(100000)->Arg(10000)->Arg(1000);
+BENCHMARK_TEMPLATE(BM_lookup, FlatCache)->Arg(0)->Arg(100000)->Arg(10000)->Arg(1000);
+
+
+/// Measures an ACL edit on its own: invalidating a cache that contains the permissions of all users in all the
+/// channels they are interested in.
+template< typename Cache > static void BM_edit(::benchmark::State &state) {
+	MockServer server;
+	Cache cache;
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		for (const Lookup &lookup : server.lookups) {
+			benchmark::DoNotOptimize(cache.get(*lookup.user, *lookup.channel));
+		}
+		state.ResumeTiming();
+
+		cache.invalidate();
+	}
+}
+
+BENCHMARK_TEMPLATE(BM_edit, LockedHashCache);
+BENCHMARK_TEMPLATE(BM_edit, FlatCache);
+
+
+BENCHMARK_MAIN();
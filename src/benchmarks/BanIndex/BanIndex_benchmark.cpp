@@ -0,0 +1,182 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "Ban.h"
+#include "BanIndex.h"
+#include "HostAddress.h"
+
+#include <QtCore/QList>
+
+#include <random>
+#include <vector>
+
+// These benchmarks measure checking connecting clients against a large ban list (e.g. imported from a block list)
+// with BanIndex and with the linear scan that has been used before. Most of the connecting clients aren't banned,
+// which is the worst case for the linear scan, as it has to look at every single ban.
+
+constexpr const int BAN_COUNT = 100000;
+/// The amount of addresses (and certificate hashes) checked per iteration
+constexpr const std::size_t LOOKUPS = 1024;
+
+static HostAddress randomIPv4(std::mt19937 &rng) {
+	HostAddress address;
+	address.fromIPv4(static_cast< std::uint32_t >(rng()), false);
+	return address;
+}
+
+static QString randomHash(std::mt19937 &rng) {
+	QString hash;
+	for (int i = 0; i < 5; ++i) {
+		hash += QString::number(static_cast< quint32 >(rng()), 16).rightJustified(8, QLatin1Char('0'));
+	}
+	return hash;
+}
+
+/// Mostly single addresses, some networks and a couple of IPv6 networks, all of them permanent
+static QList< Ban > createBans(std::mt19937 &rng) {
+	QList< Ban > bans;
+	bans.reserve(BAN_COUNT);
+
+	for (int i = 0; i < BAN_COUNT; ++i) {
+		Ban ban;
+		ban.qdtStart  = QDateTime::currentDateTime().toUTC();
+		ban.iDuration = 0;
+
+		const unsigned int kind = rng() % 100;
+		if (kind < 80) {
+			ban.haAddress = randomIPv4(rng);
+			ban.iMask     = 128;
+			ban.qsHash    = randomHash(rng);
+		} else if (kind < 95) {
+			ban.haAddress = randomIPv4(rng);
+			ban.iMask     = static_cast< int >(96 + 16 + rng() % 9);
+		} else {
+			ban.haAddress.reset();
+			for (std::size_t byte = 0; byte < 8; ++byte) {
+				ban.haAddress.setByte(byte, static_cast< std::uint8_t >(rng()));
+			}
+			ban.iMask = static_cast< int >(48 + rng() % 17);
+		}
+
+		bans << ban;
+	}
+
+	return bans;
+}
+
+class BanFixture : public ::benchmark::Fixture {
+public:
+	QList< Ban > bans;
+	BanIndex index;
+	std::vector< HostAddress > addresses;
+	std::vector< QString > hashes;
+
+	void SetUp(const ::benchmark::State &) override {
+		std::mt19937 rng(42);
+
+		bans = createBans(rng);
+		index.update(bans);
+
+		addresses.clear();
+		hashes.clear();
+		for (std::size_t i = 0; i < LOOKUPS; ++i) {
+			addresses.push_back(randomIPv4(rng));
+			hashes.push_back(randomHash(rng));
+		}
+	}
+
+	void TearDown(const ::benchmark::State &) override {
+		bans.clear();
+		index.clear();
+	}
+};
+
+BENCHMARK_DEFINE_F(BanFixture, BM_matchAddress_linear)(::benchmark::State &state) {
+	for (auto _ : state) {
+		for (const HostAddress &address : addresses) {
+			// This is what Server::newClient used to do for every connection
+			QList< Ban > unexpired = bans;
+			for (const Ban &ban : bans) {
+				if (ban.isExpired()) {
+					unexpired.removeOne(ban);
+				}
+			}
+
+			bool banned = false;
+			for (const Ban &ban : bans) {
+				if (ban.haAddress.match(address, static_cast< unsigned int >(ban.iMask))) {
+					banned = true;
+					break;
+				}
+			}
+			benchmark::DoNotOptimize(banned);
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * LOOKUPS));
+}
+
+BENCHMARK_DEFINE_F(BanFixture, BM_matchAddress_index)(::benchmark::State &state) {
+	for (auto _ : state) {
+		for (const HostAddress &address : addresses) {
+			benchmark::DoNotOptimize(index.takeExpired());
+			benchmark::DoNotOptimize(index.findAddressBan(address));
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * LOOKUPS));
+}
+
+BENCHMARK_DEFINE_F(BanFixture, BM_matchHash_linear)(::benchmark::State &state) {
+	for (auto _ : state) {
+		for (const QString &hash : hashes) {
+			bool banned = false;
+			for (const Ban &ban : bans) {
+				if (ban.qsHash == hash) {
+					banned = true;
+				}
+			}
+			benchmark::DoNotOptimize(banned);
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * LOOKUPS));
+}
+
+BENCHMARK_DEFINE_F(BanFixture, BM_matchHash_index)(::benchmark::State &state) {
+	for (auto _ : state) {
+		for (const QString &hash : hashes) {
+			benchmark::DoNotOptimize(index.findHashBan(hash));
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * LOOKUPS));
+}
+
+/// Adding a single ban to the list (e.g. a kick-ban) and updating the index with the whole list
+BENCHMARK_DEFINE_F(BanFixture, BM_updateIndex)(::benchmark::State &state) {
+	std::mt19937 rng(1);
+
+	for (auto _ : state) {
+		Ban ban;
+		ban.haAddress = randomIPv4(rng);
+		ban.iMask     = 128;
+		ban.qdtStart  = QDateTime::currentDateTime().toUTC();
+		ban.iDuration = 0;
+		bans << ban;
+
+		index.update(bans);
+	}
+}
+
+BENCHMARK_REGISTER_F(BanFixture, BM_matchAddress_linear)->Unit(benchmark::kMillisecond);
+BENCHMARK_REGISTER_F(BanFixture, BM_matchAddress_index)->Unit(benchmark::kMicrosecond);
+BENCHMARK_REGISTER_F(BanFixture, BM_matchHash_linear)->Unit(benchmark::kMillisecond);
+BENCHMARK_REGISTER_F(BanFixture, BM_matchHash_index)->Unit(benchmark::kMicrosecond);
+BENCHMARK_REGISTER_F(BanFixture, BM_updateIndex)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
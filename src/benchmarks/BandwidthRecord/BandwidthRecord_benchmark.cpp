@@ -0,0 +1,113 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "BandwidthRecord.h"
+#include "Timer.h"
+
+#include <QtCore/QMutex>
+
+// These benchmarks measure the cost of accounting for an audio packet (as done by the voice thread for every packet
+// it receives), on its own and while other threads (the main thread and Ice) are querying the user's statistics.
+// The "bytesPerUser" counter shows the memory every user needs for its record.
+
+// NOTE: This is a copy of BandwidthRecord before it used a seqlock. It is used as a baseline.
+struct MutexBandwidthRecord {
+	int iRecNum = 0;
+	int iSum    = 0;
+	Timer tFirst;
+	Timer tIdleControl;
+	unsigned short a_iBW[N_BANDWIDTH_SLOTS] = {};
+	Timer a_qtWhen[N_BANDWIDTH_SLOTS];
+	mutable QMutex qmMutex;
+
+	bool addFrame(int size, int maxpersec) {
+		QMutexLocker ml(&qmMutex);
+
+		quint64 elapsed = a_qtWhen[iRecNum].elapsed();
+
+		if (elapsed == 0)
+			return false;
+
+		int nsum = iSum - a_iBW[iRecNum] + size;
+		int bw   = static_cast< int >((static_cast< quint64 >(nsum) * 1000000ULL) / elapsed);
+
+		if (bw > maxpersec)
+			return false;
+
+		a_iBW[iRecNum] = static_cast< unsigned short >(size);
+		a_qtWhen[iRecNum].restart();
+
+		iSum = nsum;
+
+		iRecNum++;
+		if (iRecNum == N_BANDWIDTH_SLOTS)
+			iRecNum = 0;
+
+		return true;
+	}
+
+	int bandwidth() const {
+		QMutexLocker ml(&qmMutex);
+
+		int sum         = 0;
+		quint64 elapsed = 0ULL;
+
+		for (int i = 1; i < N_BANDWIDTH_SLOTS; ++i) {
+			int idx   = (iRecNum + N_BANDWIDTH_SLOTS - i) % N_BANDWIDTH_SLOTS;
+			quint64 e = a_qtWhen[idx].elapsed();
+			if (e > 1000000ULL) {
+				break;
+			} else {
+				sum += a_iBW[idx];
+				elapsed = e;
+			}
+		}
+
+		if (elapsed < 250000ULL)
+			return 0;
+
+		return static_cast< int >((static_cast< quint64 >(sum) * 1000000ULL) / elapsed);
+	}
+};
+
+/// The limit is high enough for all frames to be accepted
+constexpr int MAX_BANDWIDTH = 1000 * 1000 * 1000;
+/// IP + UDP + Crypt + a typical Opus frame
+constexpr int PACKET_SIZE = 20 + 8 + 4 + 80;
+
+/// Thread 0 plays the voice thread, all other threads query the statistics
+template< typename Record > static void accountFrames(::benchmark::State &state, Record &record) {
+	if (state.thread_index() == 0) {
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(record.addFrame(PACKET_SIZE, MAX_BANDWIDTH));
+		}
+
+		state.SetItemsProcessed(static_cast< int64_t >(state.iterations()));
+	} else {
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(record.bandwidth());
+		}
+	}
+
+	state.counters["bytesPerUser"] =
+		benchmark::Counter(static_cast< double >(sizeof(Record)), benchmark::Counter::kAvgThreads);
+}
+
+static void BM_mutex(::benchmark::State &state) {
+	static MutexBandwidthRecord record;
+	accountFrames(state, record);
+}
+
+static void BM_seqlock(::benchmark::State &state) {
+	static BandwidthRecord record;
+	accountFrames(state, record);
+}
+
+BENCHMARK(BM_mutex)->ThreadRange(1, 4)->UseRealTime();
+BENCHMARK(BM_seqlock)->ThreadRange(1, 4)->UseRealTime();
+
+BENCHMARK_MAIN();
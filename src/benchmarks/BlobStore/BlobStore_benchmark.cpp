@@ -0,0 +1,114 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "BlobStore.h"
+#include "QtUtils.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QSet>
+
+#include <random>
+#include <vector>
+
+// These benchmarks simulate 5000 registered users connecting to a server, each of which loads their texture from the
+// database (which always yields a new buffer). The textures are taken from a pool of distinct ones, as many users
+// tend to pick the same (popular) avatar. The "residentBytes" counter shows the memory taken up by the textures once
+// all users are connected.
+
+constexpr std::size_t USER_COUNT = 5000;
+/// The size of a typical (PNG) avatar
+constexpr int TEXTURE_SIZE = 24 * 1024;
+
+constexpr int DISTINCT_TEXTURES_RANGE = 0;
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	/// The textures as they are stored in the database
+	std::vector< QByteArray > database;
+	/// The texture every user has picked (as an index into database)
+	std::vector< std::size_t > choices;
+
+	void SetUp(const ::benchmark::State &state) override {
+		std::mt19937 rng(42);
+
+		database.clear();
+		for (int64_t i = 0; i < state.range(DISTINCT_TEXTURES_RANGE); ++i) {
+			QByteArray texture(TEXTURE_SIZE, Qt::Uninitialized);
+			for (int j = 0; j < TEXTURE_SIZE; ++j) {
+				texture[j] = static_cast< char >(rng());
+			}
+			database.push_back(texture);
+		}
+
+		// Popular textures are picked by a lot of users
+		std::geometric_distribution< std::size_t > popularity(0.05);
+		choices.clear();
+		for (std::size_t i = 0; i < USER_COUNT; ++i) {
+			choices.push_back(popularity(rng) % database.size());
+		}
+	}
+
+	void TearDown(const ::benchmark::State &) override {
+		database.clear();
+		choices.clear();
+	}
+
+	/// Stands in for the database query, which returns a new buffer every time
+	QByteArray load(std::size_t user) const {
+		const QByteArray &texture = database[choices[user]];
+		return QByteArray(texture.constData(), texture.size());
+	}
+
+	static double residentBytes(const std::vector< QByteArray > &textures) {
+		QSet< const char * > buffers;
+		double bytes = 0;
+		for (const QByteArray &texture : textures) {
+			if (!buffers.contains(texture.constData())) {
+				buffers.insert(texture.constData());
+				bytes += texture.size();
+			}
+		}
+		return bytes;
+	}
+};
+
+/// Every user keeps the texture loaded for them (as Server::hashAssign used to do)
+BENCHMARK_DEFINE_F(Fixture, BM_copyPerUser)(::benchmark::State &state) {
+	std::vector< QByteArray > textures(USER_COUNT);
+	std::vector< QByteArray > hashes(USER_COUNT);
+
+	for (auto _ : state) {
+		for (std::size_t user = 0; user < USER_COUNT; ++user) {
+			textures[user] = load(user);
+			hashes[user]   = sha1(textures[user]);
+		}
+	}
+
+	state.counters["residentBytes"] = residentBytes(textures);
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_blobStore)(::benchmark::State &state) {
+	std::vector< QByteArray > textures(USER_COUNT);
+	std::vector< QByteArray > hashes(USER_COUNT);
+
+	for (auto _ : state) {
+		BlobStore< QByteArray > store;
+
+		for (std::size_t user = 0; user < USER_COUNT; ++user) {
+			const QByteArray texture = load(user);
+			hashes[user]             = sha1(texture);
+			textures[user]           = store.intern(hashes[user], texture);
+		}
+	}
+
+	state.counters["residentBytes"] = residentBytes(textures);
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_copyPerUser)->RangeMultiplier(10)->Range(10, 1000)->Unit(benchmark::kMillisecond);
+BENCHMARK_REGISTER_F(Fixture, BM_blobStore)->RangeMultiplier(10)->Range(10, 1000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
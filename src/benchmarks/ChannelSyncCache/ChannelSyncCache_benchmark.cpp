@@ -0,0 +1,141 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "Channel.h"
+#include "ChannelSyncCache.h"
+#include "Connection.h"
+#include "MumbleProtocol.h"
+
+#include <QtCore/QQueue>
+#include <QtCore/QSet>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+// These benchmarks measure the cost of producing the channel tree part of the initial synchronization for one user
+// logging in to a server with N channels: Describing and serializing every channel (as Server::msgAuthenticate used
+// to do) against copying the messages out of a ChannelSyncCache. Whether the user may enter a channel is decided
+// by a cheap stand-in for the (cached) permission check in both cases.
+
+constexpr int CHANNEL_COUNT_RANGE = 0;
+
+/// How many subchannels every channel has
+constexpr int FANOUT = 8;
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	std::unique_ptr< Channel > root;
+	ChannelSyncCache cache;
+
+	void SetUp(const ::benchmark::State &state) override {
+		std::mt19937 rng(42);
+
+		root = std::make_unique< Channel >(0, QLatin1String("Root"));
+
+		std::vector< Channel * > channels = { root.get() };
+		for (int64_t i = 1; i < state.range(CHANNEL_COUNT_RANGE); ++i) {
+			Channel *channel = new Channel(static_cast< unsigned int >(i), QString::fromLatin1("Channel %1").arg(i),
+										   channels[static_cast< std::size_t >((i - 1) / FANOUT)]);
+			channel->iPosition = static_cast< int >(i % FANOUT);
+			if (i % 4 == 0) {
+				channel->qsDesc      = QString(200, QLatin1Char('x'));
+				channel->qbaDescHash = QByteArray(20, 'h');
+			}
+			channels.push_back(channel);
+		}
+
+		// Some channels are linked
+		for (std::size_t i = 0; i < channels.size() / 16; ++i) {
+			channels[rng() % channels.size()]->link(channels[rng() % channels.size()]);
+		}
+
+		cache.clear();
+	}
+
+	void TearDown(const ::benchmark::State &) override {
+		cache.clear();
+		root.reset();
+	}
+
+	static void describe(Channel &channel, bool descriptionHash, MumbleProto::ChannelState &mpcs) {
+		mpcs.set_channel_id(channel.iId);
+		if (channel.cParent) {
+			mpcs.set_parent(channel.cParent->iId);
+		}
+		mpcs.set_name(channel.qsName.toStdString());
+		mpcs.set_position(channel.iPosition);
+		if (descriptionHash && !channel.qbaDescHash.isEmpty()) {
+			mpcs.set_description_hash(channel.qbaDescHash.toStdString());
+		} else if (!channel.qsDesc.isEmpty()) {
+			mpcs.set_description(channel.qsDesc.toStdString());
+		}
+		mpcs.set_max_users(channel.uiMaxUsers);
+		mpcs.set_is_enter_restricted(false);
+	}
+
+	static bool canEnter(Channel &channel) { return channel.iId % 7 != 0; }
+};
+
+BENCHMARK_DEFINE_F(Fixture, BM_serializePerLogin)(::benchmark::State &state) {
+	for (auto _ : state) {
+		// Every message used to be written to the socket on its own
+		std::vector< QByteArray > written;
+
+		QQueue< Channel * > q;
+		QSet< Channel * > chans;
+		q << root.get();
+		MumbleProto::ChannelState mpcs;
+
+		while (!q.isEmpty()) {
+			Channel *c = q.dequeue();
+			chans.insert(c);
+
+			mpcs.Clear();
+			describe(*c, true, mpcs);
+			mpcs.set_can_enter(canEnter(*c));
+
+			QByteArray message;
+			Connection::messageToNetwork(mpcs, Mumble::Protocol::TCPMessageType::ChannelState, message);
+			written.push_back(message);
+
+			for (Channel *child : c->qlChannels) {
+				q.enqueue(child);
+			}
+		}
+
+		for (Channel *c : chans) {
+			if (!c->qhLinks.isEmpty()) {
+				mpcs.Clear();
+				mpcs.set_channel_id(c->iId);
+				for (Channel *l : c->qhLinks.keys()) {
+					mpcs.add_links(l->iId);
+				}
+
+				QByteArray message;
+				Connection::messageToNetwork(mpcs, Mumble::Protocol::TCPMessageType::ChannelState, message);
+				written.push_back(message);
+			}
+		}
+
+		benchmark::DoNotOptimize(written.data());
+	}
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_cache)(::benchmark::State &state) {
+	for (auto _ : state) {
+		QByteArray stream;
+		cache.write(*root, true, &Fixture::describe, &Fixture::canEnter, stream);
+
+		benchmark::DoNotOptimize(stream.data());
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_serializePerLogin)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK_REGISTER_F(Fixture, BM_cache)->RangeMultiplier(4)->Range(64, 4096);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,247 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "DatabaseCache.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTemporaryDir>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+
+// These benchmarks measure the lookups the client does for every user showing up while synchronizing with a server
+// (whether they are ignored or muted, their volume and nickname and whether their comment has been seen before).
+// These used to be separate queries against the SQLite database for every user, run on the GUI thread, while
+// DatabaseCache answers them from memory.
+
+static QString userHash(int user) {
+	return QString::fromLatin1("%1").arg(user, 40, 16, QLatin1Char('0'));
+}
+
+/// A database containing the tables consulted for every user, where every tenth user is muted and has their volume
+/// adjusted and every fifth one has a comment that has been seen before
+struct MockDatabase {
+	QTemporaryDir dir;
+	QSqlDatabase db;
+
+	explicit MockDatabase(int users) {
+		db = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"));
+		db.setDatabaseName(dir.filePath(QLatin1String("mumble.sqlite")));
+		if (!db.open()) {
+			qFatal("Failed to open database");
+		}
+
+		QSqlQuery query(db);
+		query.exec(QLatin1String("CREATE TABLE `comments` (`who` TEXT, `comment` BLOB, `seen` DATE)"));
+		query.exec(QLatin1String("CREATE UNIQUE INDEX `comments_comment` ON `comments`(`who`, `comment`)"));
+		query.exec(QLatin1String("CREATE TABLE `ignored` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `hash` TEXT)"));
+		query.exec(QLatin1String("CREATE UNIQUE INDEX `ignored_hash` ON `ignored`(`hash`)"));
+		query.exec(QLatin1String("CREATE TABLE `ignored_tts` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `hash` TEXT)"));
+		query.exec(QLatin1String("CREATE UNIQUE INDEX `ignored_tts_hash` ON `ignored_tts`(`hash`)"));
+		query.exec(QLatin1String("CREATE TABLE `muted` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `hash` TEXT)"));
+		query.exec(QLatin1String("CREATE UNIQUE INDEX `muted_hash` ON `muted`(`hash`)"));
+		query.exec(QLatin1String(
+			"CREATE TABLE `volume` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `hash` TEXT, `volume` FLOAT)"));
+		query.exec(QLatin1String("CREATE UNIQUE INDEX `volume_hash` ON `volume`(`hash`)"));
+		query.exec(QLatin1String(
+			"CREATE TABLE `nicknames` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `hash` TEXT, `nickname` TEXT)"));
+		query.exec(QLatin1String("CREATE UNIQUE INDEX `nicknames_hash` ON `nicknames`(`hash`)"));
+		query.exec(QLatin1String("CREATE TABLE `filtered_channels` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, "
+								 "`server_cert_digest` TEXT NOT NULL, `channel_id` INTEGER NOT NULL, "
+								 "`filter_mode` INTEGER DEFAULT 1)"));
+
+		db.transaction();
+		for (int i = 0; i < users; ++i) {
+			if (i % 10 == 0) {
+				query.prepare(QLatin1String("INSERT INTO `muted` (`hash`) VALUES (?)"));
+				query.addBindValue(userHash(i));
+				query.exec();
+
+				query.prepare(QLatin1String("INSERT INTO `volume` (`hash`, `volume`) VALUES (?, ?)"));
+				query.addBindValue(userHash(i));
+				query.addBindValue(QLatin1String("0.5"));
+				query.exec();
+			}
+			if (i % 5 == 0) {
+				query.prepare(
+					QLatin1String("INSERT INTO `comments` (`who`, `comment`, `seen`) VALUES (?, ?, datetime('now'))"));
+				query.addBindValue(userHash(i));
+				query.addBindValue(QByteArray::number(i));
+				query.exec();
+			}
+		}
+		db.commit();
+	}
+
+	~MockDatabase() {
+		const QString name = db.connectionName();
+		db.close();
+		db = QSqlDatabase();
+		QSqlDatabase::removeDatabase(name);
+	}
+};
+
+/// The way Database used to answer whether the given table contains the given hash
+static bool containsHashDirectly(QSqlDatabase &db, const QString &table, const QString &hash) {
+	QSqlQuery query(db);
+	query.prepare(QString::fromLatin1("SELECT `hash` FROM `%1` WHERE `hash` = ?").arg(table));
+	query.addBindValue(hash);
+	query.exec();
+	return query.next();
+}
+
+/// The way Database::getUserLocalVolume used to look up the volume
+static float getUserLocalVolumeDirectly(QSqlDatabase &db, const QString &hash) {
+	QSqlQuery query(db);
+	query.prepare(QLatin1String("SELECT `volume` FROM `volume` WHERE `hash` = ?"));
+	query.addBindValue(hash);
+	query.exec();
+	if (query.next()) {
+		return query.value(0).toFloat();
+	}
+	return 1.0f;
+}
+
+/// The way Database::getUserLocalNickname used to look up the nickname
+static QString getUserLocalNicknameDirectly(QSqlDatabase &db, const QString &hash) {
+	QSqlQuery query(db);
+	query.prepare(QLatin1String("SELECT `nickname` FROM `nicknames` WHERE `hash` = ?"));
+	query.addBindValue(hash);
+	query.exec();
+	if (query.next()) {
+		return query.value(0).toString();
+	}
+	return QString();
+}
+
+/// The way Database::seenComment used to check for and update a seen comment
+static bool seenCommentDirectly(QSqlDatabase &db, const QString &hash, const QByteArray &commenthash) {
+	QSqlQuery query(db);
+	query.prepare(QLatin1String("SELECT COUNT(*) FROM `comments` WHERE `who` = ? AND `comment` = ?"));
+	query.addBindValue(hash);
+	query.addBindValue(commenthash);
+	query.exec();
+	if (query.next() && query.value(0).toInt() > 0) {
+		query.prepare(
+			QLatin1String("UPDATE `comments` SET `seen` = datetime('now') WHERE `who` = ? AND `comment` = ?"));
+		query.addBindValue(hash);
+		query.addBindValue(commenthash);
+		query.exec();
+		return true;
+	}
+	return false;
+}
+
+static void BM_sync_direct(::benchmark::State &state) {
+	const int users = static_cast< int >(state.range(0));
+
+	MockDatabase database(users);
+
+	for (auto _ : state) {
+		for (int i = 0; i < users; ++i) {
+			const QString hash = userHash(i);
+
+			benchmark::DoNotOptimize(containsHashDirectly(database.db, QLatin1String("ignored"), hash));
+			benchmark::DoNotOptimize(containsHashDirectly(database.db, QLatin1String("ignored_tts"), hash));
+			benchmark::DoNotOptimize(containsHashDirectly(database.db, QLatin1String("muted"), hash));
+			benchmark::DoNotOptimize(getUserLocalVolumeDirectly(database.db, hash));
+			benchmark::DoNotOptimize(getUserLocalNicknameDirectly(database.db, hash));
+			benchmark::DoNotOptimize(seenCommentDirectly(database.db, hash, QByteArray::number(i)));
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()) * users);
+}
+
+/// Measures the time the GUI thread is blocked for during the synchronization, which doesn't include writing the
+/// updated comments, as that happens once the synchronization is over
+static void BM_sync_cached(::benchmark::State &state) {
+	const int users = static_cast< int >(state.range(0));
+
+	MockDatabase database(users);
+	DatabaseCache cache;
+	cache.load(database.db);
+
+	for (auto _ : state) {
+		for (int i = 0; i < users; ++i) {
+			const QString hash = userHash(i);
+
+			benchmark::DoNotOptimize(cache.isLocalIgnored(hash));
+			benchmark::DoNotOptimize(cache.isLocalIgnoredTTS(hash));
+			benchmark::DoNotOptimize(cache.isLocalMuted(hash));
+			benchmark::DoNotOptimize(cache.getUserLocalVolume(hash));
+			benchmark::DoNotOptimize(cache.getUserLocalNickname(hash));
+			benchmark::DoNotOptimize(cache.seenComment(hash, QByteArray::number(i)));
+		}
+
+		state.PauseTiming();
+		cache.flush(database.db);
+		state.ResumeTiming();
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()) * users);
+}
+
+/// Measures the time until the updated comments have been written as well
+static void BM_sync_cachedFlushed(::benchmark::State &state) {
+	const int users = static_cast< int >(state.range(0));
+
+	MockDatabase database(users);
+	DatabaseCache cache;
+	cache.load(database.db);
+
+	for (auto _ : state) {
+		for (int i = 0; i < users; ++i) {
+			const QString hash = userHash(i);
+
+			benchmark::DoNotOptimize(cache.isLocalIgnored(hash));
+			benchmark::DoNotOptimize(cache.isLocalIgnoredTTS(hash));
+			benchmark::DoNotOptimize(cache.isLocalMuted(hash));
+			benchmark::DoNotOptimize(cache.getUserLocalVolume(hash));
+			benchmark::DoNotOptimize(cache.getUserLocalNickname(hash));
+			benchmark::DoNotOptimize(cache.seenComment(hash, QByteArray::number(i)));
+		}
+
+		cache.flush(database.db);
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()) * users);
+}
+
+/// Measures reading the tables when the client starts
+static void BM_load(::benchmark::State &state) {
+	const int users = static_cast< int >(state.range(0));
+
+	MockDatabase database(users);
+
+	for (auto _ : state) {
+		DatabaseCache cache;
+		cache.load(database.db);
+		benchmark::DoNotOptimize(cache);
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()) * users);
+}
+
+BENCHMARK(BM_sync_direct)->Arg(100)->Arg(500)->Arg(2000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_sync_cached)->Arg(100)->Arg(500)->Arg(2000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_sync_cachedFlushed)->Arg(100)->Arg(500)->Arg(2000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_load)->Arg(100)->Arg(500)->Arg(2000)->Unit(benchmark::kMillisecond);
+
+
+int main(int argc, char **argv) {
+	// Required for loading the SQL driver plugins
+	QCoreApplication app(argc, argv);
+
+	::benchmark::Initialize(&argc, argv);
+	if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+		return 1;
+	}
+	::benchmark::RunSpecifiedBenchmarks();
+	::benchmark::Shutdown();
+
+	return 0;
+}
@@ -0,0 +1,89 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "HTMLFilter.h"
+
+#include <QtCore/QString>
+#include <QtCore/QXmlStreamReader>
+#include <QtCore/QXmlStreamWriter>
+
+// These benchmarks check the length of text messages that embed an image (as a base64-encoded data URL) the way
+// Server::isTextAllowed does once a message exceeds the text message length.
+
+constexpr int IMAGE_SIZE_RANGE = 0;
+
+static QString message(int imageSize) {
+	return QString::fromLatin1("<p>Have a look at this:</p><img src=\"data:image/png;base64,%1\"/><p>Nice, right?</p>")
+		.arg(QString(imageSize, QLatin1Char('A')));
+}
+
+/// The text length as Server::isTextAllowed used to determine it, by re-writing the message without the images
+static qsizetype xmlTextLength(const QString &text) {
+	QString qsOut;
+	QXmlStreamReader qxsr(QString::fromLatin1("<document>%1</document>").arg(text));
+	QXmlStreamWriter qxsw(&qsOut);
+	while (!qxsr.atEnd()) {
+		switch (qxsr.readNext()) {
+			case QXmlStreamReader::Invalid:
+				return -1;
+			case QXmlStreamReader::StartElement: {
+				if (qxsr.name() == QLatin1String("img")) {
+					qxsw.writeStartElement(qxsr.namespaceUri().toString(), qxsr.name().toString());
+					for (const QXmlStreamAttribute &a : qxsr.attributes())
+						if (a.name() != QLatin1String("src"))
+							qxsw.writeAttribute(a);
+				} else {
+					qxsw.writeCurrentToken(qxsr);
+				}
+			} break;
+			default:
+				qxsw.writeCurrentToken(qxsr);
+				break;
+		}
+	}
+
+	return qsOut.length();
+}
+
+static void BM_xmlStreamRewrite(::benchmark::State &state) {
+	const QString text = message(static_cast< int >(state.range(IMAGE_SIZE_RANGE)));
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(xmlTextLength(text));
+	}
+
+	state.SetBytesProcessed(static_cast< int64_t >(state.iterations()) * text.size());
+}
+
+static void BM_measure(::benchmark::State &state) {
+	const QString text = message(static_cast< int >(state.range(IMAGE_SIZE_RANGE)));
+
+	for (auto _ : state) {
+		HTMLFilter::Measurement measurement;
+		benchmark::DoNotOptimize(HTMLFilter::measure(text, measurement));
+		benchmark::DoNotOptimize(measurement);
+	}
+
+	state.SetBytesProcessed(static_cast< int64_t >(state.iterations()) * text.size());
+}
+
+static void BM_filter(::benchmark::State &state) {
+	const QString text = message(static_cast< int >(state.range(IMAGE_SIZE_RANGE)));
+
+	for (auto _ : state) {
+		QString out;
+		benchmark::DoNotOptimize(HTMLFilter::filter(text, out));
+	}
+
+	state.SetBytesProcessed(static_cast< int64_t >(state.iterations()) * text.size());
+}
+
+BENCHMARK(BM_xmlStreamRewrite)->RangeMultiplier(16)->Range(1024, 1024 * 1024)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_measure)->RangeMultiplier(16)->Range(1024, 1024 * 1024)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_filter)->RangeMultiplier(16)->Range(1024, 1024 * 1024)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
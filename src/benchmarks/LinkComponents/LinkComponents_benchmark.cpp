@@ -0,0 +1,112 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "LinkComponents.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QSet>
+
+// These benchmarks compare the work done for every audio packet sent in one of a ring of linked channels: Walking the
+// links (as Channel::allLinks does) against looking up the channel's precomputed component. The cost of changing the
+// links is measured as well, as the components have to be kept up to date.
+
+constexpr int CHANNEL_COUNT_RANGE = 0;
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	/// The channels every channel is linked to directly (like Channel::qsPermLinks)
+	QHash< unsigned int, QSet< unsigned int > > links;
+	LinkComponents components;
+	unsigned int channelCount = 0;
+
+	void SetUp(const ::benchmark::State &state) override {
+		channelCount = static_cast< unsigned int >(state.range(CHANNEL_COUNT_RANGE));
+
+		links.clear();
+		components.clear();
+		for (unsigned int i = 0; i < channelCount; ++i) {
+			link(i, (i + 1) % channelCount);
+		}
+	}
+
+	void TearDown(const ::benchmark::State &) override {
+		links.clear();
+		components.clear();
+	}
+
+	void link(unsigned int a, unsigned int b) {
+		if (a != b) {
+			links[a].insert(b);
+			links[b].insert(a);
+		}
+		components.link(a, b);
+	}
+
+	void unlink(unsigned int a, unsigned int b) {
+		links[a].remove(b);
+		links[b].remove(a);
+		components.unlink(a, b);
+	}
+
+	/// Mirrors Channel::allLinks
+	QSet< unsigned int > allLinks(unsigned int channel) const {
+		QSet< unsigned int > seen;
+		seen.insert(channel);
+
+		QList< unsigned int > stack;
+		stack.append(channel);
+		while (!stack.isEmpty()) {
+			for (unsigned int l : links.value(stack.takeLast())) {
+				if (!seen.contains(l)) {
+					seen.insert(l);
+					stack.append(l);
+				}
+			}
+		}
+		return seen;
+	}
+};
+
+BENCHMARK_DEFINE_F(Fixture, BM_allLinks)(::benchmark::State &state) {
+	unsigned int speaker = 0;
+	for (auto _ : state) {
+		const QSet< unsigned int > channels = allLinks(speaker);
+		for (unsigned int channel : channels) {
+			benchmark::DoNotOptimize(channel);
+		}
+		speaker = (speaker + 1) % channelCount;
+	}
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_linkedChannels)(::benchmark::State &state) {
+	unsigned int speaker = 0;
+	for (auto _ : state) {
+		for (unsigned int channel : components.linkedChannels(speaker)) {
+			benchmark::DoNotOptimize(channel);
+		}
+		speaker = (speaker + 1) % channelCount;
+	}
+}
+
+/// Breaks the ring open and closes it again, which splits the component and merges it back together
+BENCHMARK_DEFINE_F(Fixture, BM_relink)(::benchmark::State &state) {
+	unsigned int channel = 0;
+	for (auto _ : state) {
+		unlink(channel, (channel + 1) % channelCount);
+		unlink(channel, (channel + channelCount - 1) % channelCount);
+		link(channel, (channel + 1) % channelCount);
+		link(channel, (channel + channelCount - 1) % channelCount);
+		channel = (channel + 1) % channelCount;
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_allLinks)->RangeMultiplier(4)->Range(2, 1024);
+BENCHMARK_REGISTER_F(Fixture, BM_linkedChannels)->RangeMultiplier(4)->Range(2, 1024);
+BENCHMARK_REGISTER_F(Fixture, BM_relink)->RangeMultiplier(4)->Range(2, 1024);
+
+BENCHMARK_MAIN();
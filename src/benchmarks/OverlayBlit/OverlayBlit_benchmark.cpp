@@ -0,0 +1,169 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "OverlayBlit.h"
+
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include <QtWidgets/QApplication>
+#include <QtWidgets/QGraphicsRectItem>
+#include <QtWidgets/QGraphicsScene>
+
+#include <memory>
+
+// These benchmarks update the overlay image of a 1080p game the way OverlayClient::render does, for a fixed scene (a
+// list of users in the top left corner and the FPS counter in the bottom right one) and fixed patterns of changes to
+// it. Besides the time, they report how many bytes of the image the game has to upload per render ("bytes") in how
+// many blits ("blits").
+
+constexpr int WIDTH     = 1920;
+constexpr int HEIGHT    = 1080;
+constexpr int USERS     = 10;
+constexpr int ROW_SPACE = 30;
+
+constexpr int PATTERN_RANGE = 0;
+
+static QRectF userRow(int user) {
+	return QRectF(20, 20 + user * ROW_SPACE, 220, 28);
+}
+
+static QRectF talkingIndicator(int user) {
+	return QRectF(20, 20 + user * ROW_SPACE, 28, 28);
+}
+
+static const QRectF FPS_COUNTER(WIDTH - 100, HEIGHT - 30, 80, 20);
+
+struct Pattern {
+	const char *name;
+	QList< QRectF > dirty;
+};
+
+static const QList< Pattern > &patterns() {
+	static const QList< Pattern > patterns = []() {
+		QList< Pattern > list;
+
+		// A user starts talking while the FPS counter is updated
+		list.append({ "corners", { talkingIndicator(0), FPS_COUNTER } });
+
+		// Several users in a row start talking
+		list.append({ "adjacent", { talkingIndicator(2), talkingIndicator(3), talkingIndicator(4) } });
+
+		// A user's row changes as a whole
+		list.append({ "single", { userRow(5) } });
+
+		// Changes all over the screen
+		QList< QRectF > scattered;
+		for (int y = 0; y < 3; ++y) {
+			for (int x = 0; x < 4; ++x) {
+				scattered.append(QRectF(100 + x * 500, 100 + y * 400, 40, 40));
+			}
+		}
+		list.append({ "scattered", scattered });
+
+		return list;
+	}();
+
+	return patterns;
+}
+
+static std::unique_ptr< QGraphicsScene > createScene() {
+	auto scene = std::make_unique< QGraphicsScene >(0, 0, WIDTH, HEIGHT);
+
+	for (int i = 0; i < USERS; ++i) {
+		scene->addRect(userRow(i), QPen(Qt::NoPen), QColor(0, 0, 0, 128));
+		scene->addRect(talkingIndicator(i), QPen(Qt::NoPen), QColor(0, 255, 0, 255));
+	}
+	scene->addRect(FPS_COUNTER, QPen(Qt::NoPen), QColor(255, 255, 255, 192));
+
+	return scene;
+}
+
+static qint64 bytes(const QList< QRect > &rects) {
+	qint64 total = 0;
+	for (const QRect &rect : rects) {
+		total += static_cast< qint64 >(rect.width()) * rect.height() * 4;
+	}
+	return total;
+}
+
+/// The way OverlayClient::render used to update the image: The bounding rect of all changes is rendered into a
+/// temporary image, which is then copied into the image as a single blit
+static QList< QRect > renderBoundingRect(QGraphicsScene &scene, QImage &image, const QList< QRectF > &region) {
+	QRectF dirtyf;
+	for (const QRectF &r : region) {
+		dirtyf |= r;
+	}
+
+	const QRect dirty = dirtyf.toAlignedRect().intersected(QRect(0, 0, WIDTH, HEIGHT));
+
+	QRect target = dirty;
+	target.moveTo(0, 0);
+
+	QImage qi(target.size(), QImage::Format_ARGB32_Premultiplied);
+	qi.fill(0);
+
+	QPainter p;
+	p.begin(&qi);
+	p.setRenderHints(p.renderHints(), false);
+	p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+	scene.render(&p, target, dirty, Qt::IgnoreAspectRatio);
+	p.end();
+
+	p.begin(&image);
+	p.setRenderHints(p.renderHints(), false);
+	p.setCompositionMode(QPainter::CompositionMode_Source);
+	p.drawImage(dirty.x(), dirty.y(), qi);
+	p.end();
+
+	return { dirty };
+}
+
+static QList< QRect > renderCoalesced(QGraphicsScene &scene, QImage &image, const QList< QRectF > &region) {
+	const QList< QRect > rects = Mumble::OverlayBlit::coalesceDirtyRects(region, QRect(0, 0, WIDTH, HEIGHT));
+	Mumble::OverlayBlit::render(scene, image, rects);
+
+	return rects;
+}
+
+template< QList< QRect > (*Render)(QGraphicsScene &, QImage &, const QList< QRectF > &) >
+static void BM_render(::benchmark::State &state) {
+	const Pattern &pattern = patterns().at(static_cast< int >(state.range(PATTERN_RANGE)));
+
+	std::unique_ptr< QGraphicsScene > scene = createScene();
+	QImage image(WIDTH, HEIGHT, QImage::Format_ARGB32_Premultiplied);
+	image.fill(0);
+
+	QList< QRect > blits;
+	for (auto _ : state) {
+		blits = Render(*scene, image, pattern.dirty);
+		benchmark::DoNotOptimize(image.constBits());
+	}
+
+	state.SetLabel(pattern.name);
+	state.counters["blits"] = static_cast< double >(blits.size());
+	state.counters["bytes"] = static_cast< double >(bytes(blits));
+}
+
+static void patternArguments(::benchmark::internal::Benchmark *benchmark) {
+	for (int i = 0; i < patterns().size(); ++i) {
+		benchmark->Arg(i);
+	}
+}
+
+BENCHMARK_TEMPLATE(BM_render, renderBoundingRect)->Apply(patternArguments)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_render, renderCoalesced)->Apply(patternArguments)->Unit(benchmark::kMicrosecond);
+
+int main(int argc, char **argv) {
+	// The scene requires an application, which mustn't depend on there being a display
+	qputenv("QT_QPA_PLATFORM", "offscreen");
+	QApplication app(argc, argv);
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+
+	return 0;
+}
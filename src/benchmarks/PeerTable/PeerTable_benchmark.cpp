@@ -0,0 +1,225 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "HostAddress.h"
+#include "PeerTable.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QReadWriteLock>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+#	include <winsock2.h>
+#	include <ws2tcpip.h>
+#else
+#	include <arpa/inet.h>
+#	include <netinet/in.h>
+#	include <sys/socket.h>
+#endif
+
+// These benchmarks compare the peer lookup of the UDP voice path (PeerTable) with the previous approach of
+// a QHash protected by Server::qrwlVoiceThread. The churn thread simulates users joining and leaving, which
+// is what the main thread does to the table (under the write lock in case of the QHash).
+
+// NOTE: This is merely a mock of the ServerUser class
+class ServerUser {
+public:
+	unsigned int uiSession;
+};
+
+constexpr const int PEER_RANGE   = 0;
+constexpr const int READER_RANGE = 1;
+constexpr const int CHURN_RANGE  = 2;
+
+constexpr const int PEER_COUNT_BEGIN = 16;
+constexpr const int PEER_COUNT_END   = 4096;
+constexpr const int MULTIPLIER       = 16;
+
+/// The amount of addresses that are looked up per iteration
+constexpr const std::size_t LOOKUPS = 1024;
+
+using PeerKey = QPair< HostAddress, quint16 >;
+
+static sockaddr_storage makeAddress(unsigned int index) {
+	sockaddr_storage address;
+	memset(&address, 0, sizeof(address));
+
+	// Spread the peers over a couple of NATs, each with many ports in use
+	sockaddr_in *in     = reinterpret_cast< sockaddr_in * >(&address);
+	in->sin_family      = AF_INET;
+	in->sin_addr.s_addr = htonl(0x0A000000 | (index / 64));
+	in->sin_port        = htons(static_cast< quint16 >(40000 + index % 64));
+
+	return address;
+}
+
+static PeerKey makeKey(const sockaddr_storage &address) {
+	return PeerKey(HostAddress(address), reinterpret_cast< const sockaddr_in * >(&address)->sin_port);
+}
+
+/// The baseline: the peer table as it has been used before PeerTable
+struct LockedPeerTable {
+	QReadWriteLock lock;
+	QHash< PeerKey, ServerUser * > peers;
+
+	// All readers share the same lock
+	explicit LockedPeerTable(std::size_t) {}
+
+	ServerUser *find(const sockaddr_storage &address, std::size_t) {
+		QReadLocker locker(&lock);
+
+		return peers.value(makeKey(address));
+	}
+
+	void insert(const sockaddr_storage &address, ServerUser *user) {
+		QWriteLocker locker(&lock);
+
+		peers.insert(makeKey(address), user);
+	}
+
+	void remove(const sockaddr_storage &address) {
+		QWriteLocker locker(&lock);
+
+		peers.remove(makeKey(address));
+	}
+};
+
+struct LockFreePeerTable {
+	PeerTable peers;
+
+	explicit LockFreePeerTable(std::size_t readers) : peers(readers) {}
+
+	ServerUser *find(const sockaddr_storage &address, std::size_t reader) { return peers.find(address, reader).user; }
+
+	void insert(const sockaddr_storage &address, ServerUser *user) { peers.insert(address, user, user->uiSession); }
+
+	void remove(const sockaddr_storage &address) { peers.remove(address); }
+};
+
+template< typename Table > static void BM_lookup(::benchmark::State &state) {
+	const std::size_t peerCount   = static_cast< std::size_t >(state.range(PEER_RANGE));
+	const std::size_t readerCount = static_cast< std::size_t >(state.range(READER_RANGE));
+	// The pause between two modifications of the table in microseconds. 0 disables the churn.
+	const int churnInterval = static_cast< int >(state.range(CHURN_RANGE));
+
+	std::unique_ptr< Table > table = std::make_unique< Table >(readerCount + 1);
+
+	std::vector< ServerUser > users(peerCount * 2);
+	std::vector< sockaddr_storage > addresses;
+	for (unsigned int i = 0; i < users.size(); ++i) {
+		users[i].uiSession = i + 1;
+		addresses.push_back(makeAddress(i));
+	}
+
+	// Only the first half of the users is connected initially. The churn thread replaces them one by one.
+	for (std::size_t i = 0; i < peerCount; ++i) {
+		table->insert(addresses[i], &users[i]);
+	}
+
+	std::vector< std::size_t > lookupOrder(LOOKUPS);
+	std::mt19937 rng(42);
+	std::uniform_int_distribution< std::size_t > random_peer(0, users.size() - 1);
+	for (std::size_t &index : lookupOrder) {
+		index = random_peer(rng);
+	}
+
+	std::atomic< bool > stop(false);
+	std::atomic< std::size_t > modifications(0);
+	std::vector< std::thread > threads;
+
+	// Additional voice threads looking up peers
+	for (std::size_t reader = 1; reader <= readerCount; ++reader) {
+		threads.emplace_back([&, reader]() {
+			std::size_t i = reader;
+			while (!stop.load(std::memory_order_relaxed)) {
+				benchmark::DoNotOptimize(table->find(addresses[lookupOrder[i++ % LOOKUPS]], reader));
+			}
+		});
+	}
+
+	if (churnInterval > 0) {
+		threads.emplace_back([&]() {
+			std::size_t leaving = 0;
+			std::size_t joining = peerCount;
+			while (!stop.load(std::memory_order_relaxed)) {
+				table->remove(addresses[leaving]);
+				table->insert(addresses[joining], &users[joining]);
+				leaving = (leaving + 1) % users.size();
+				joining = (joining + 1) % users.size();
+				modifications.fetch_add(2, std::memory_order_relaxed);
+
+				std::this_thread::sleep_for(std::chrono::microseconds(churnInterval));
+			}
+		});
+	}
+
+	for (auto _ : state) {
+		for (std::size_t index : lookupOrder) {
+			benchmark::DoNotOptimize(table->find(addresses[index], 0));
+		}
+	}
+
+	stop.store(true);
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * LOOKUPS));
+	state.counters["modifications"] = static_cast< double >(modifications.load());
+}
+
+static void lookupArguments(::benchmark::internal::Benchmark *benchmark) {
+	benchmark->ArgsProduct({ benchmark::CreateRange(PEER_COUNT_BEGIN, PEER_COUNT_END, /*multi=*/MULTIPLIER),
+							 { 0, 1, 3 },
+							 { 0, 100, 10 } });
+	benchmark->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_lookup, LockedPeerTable)->Apply(lookupArguments);
+BENCHMARK_TEMPLATE(BM_lookup, LockFreePeerTable)->Apply(lookupArguments);
+
+
+template< typename Table > static void BM_churn(::benchmark::State &state) {
+	const std::size_t peerCount = static_cast< std::size_t >(state.range(PEER_RANGE));
+
+	std::unique_ptr< Table > table = std::make_unique< Table >(1);
+
+	std::vector< ServerUser > users(peerCount + 1);
+	std::vector< sockaddr_storage > addresses;
+	for (unsigned int i = 0; i < users.size(); ++i) {
+		users[i].uiSession = i + 1;
+		addresses.push_back(makeAddress(i));
+	}
+
+	for (std::size_t i = 0; i < peerCount; ++i) {
+		table->insert(addresses[i], &users[i]);
+	}
+
+	// A user joining and leaving again, as seen by the main thread
+	for (auto _ : state) {
+		table->insert(addresses[peerCount], &users[peerCount]);
+		table->remove(addresses[peerCount]);
+	}
+}
+
+BENCHMARK_TEMPLATE(BM_churn, LockedPeerTable)
+	->RangeMultiplier(MULTIPLIER)
+	->Range(PEER_COUNT_BEGIN, PEER_COUNT_END);
+BENCHMARK_TEMPLATE(BM_churn, LockFreePeerTable)
+	->RangeMultiplier(MULTIPLIER)
+	->Range(PEER_COUNT_BEGIN, PEER_COUNT_END);
+
+
+BENCHMARK_MAIN();
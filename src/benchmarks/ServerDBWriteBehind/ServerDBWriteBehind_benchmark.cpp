@@ -0,0 +1,150 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "ServerDBWriteBehind.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTemporaryDir>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+
+#include <memory>
+
+// These benchmarks measure a mass channel move (e.g. an admin dragging a full channel into another one) on a server
+// with an SQLite database: every moved user's last channel is updated. This used to be done with one transaction per
+// user on the main thread, while ServerDBWriteBehind collects the updates and writes them in a single transaction on
+// a background thread.
+
+constexpr const int SERVER_ID = 1;
+
+/// A database containing the users table of a single server
+struct MockDatabase {
+	QTemporaryDir dir;
+	QSqlDatabase db;
+
+	explicit MockDatabase(int users) {
+		db = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"));
+		db.setDatabaseName(dir.filePath(QLatin1String("mumble-server.sqlite")));
+		if (!db.open()) {
+			qFatal("Failed to open database");
+		}
+
+		QSqlQuery query(db);
+		query.exec(QLatin1String("CREATE TABLE `users` (`server_id` INTEGER NOT NULL, `user_id` INTEGER NOT NULL, "
+								 "`name` TEXT NOT NULL, `lastchannel` INTEGER, `last_disconnect` DATE)"));
+		query.exec(QLatin1String("CREATE UNIQUE INDEX `users_id` ON `users` (`server_id`, `user_id`)"));
+
+		db.transaction();
+		query.prepare(QLatin1String("INSERT INTO `users` (`server_id`, `user_id`, `name`) VALUES (?, ?, ?)"));
+		for (int i = 0; i < users; ++i) {
+			query.addBindValue(SERVER_ID);
+			query.addBindValue(i);
+			query.addBindValue(QString::number(i));
+			query.exec();
+		}
+		db.commit();
+	}
+
+	~MockDatabase() {
+		const QString name = db.connectionName();
+		db.close();
+		db = QSqlDatabase();
+		QSqlDatabase::removeDatabase(name);
+	}
+};
+
+/// The way Server::setLastChannel used to write the update
+static void setLastChannelDirectly(QSqlDatabase &db, int userID, unsigned int channelID) {
+	db.transaction();
+
+	QSqlQuery query(db);
+	query.prepare(QLatin1String("UPDATE `users` SET `lastchannel`=? WHERE `server_id` = ? AND `user_id` = ?"));
+	query.addBindValue(channelID);
+	query.addBindValue(SERVER_ID);
+	query.addBindValue(userID);
+	query.exec();
+	query.clear();
+
+	db.commit();
+}
+
+static void BM_massMove_direct(::benchmark::State &state) {
+	const int users = static_cast< int >(state.range(0));
+
+	MockDatabase database(users);
+
+	unsigned int channel = 0;
+	for (auto _ : state) {
+		++channel;
+		for (int i = 0; i < users; ++i) {
+			setLastChannelDirectly(database.db, i, channel);
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()) * users);
+}
+
+/// Measures the time the main thread is blocked for, which is the time it takes to queue the updates
+static void BM_massMove_writeBehind(::benchmark::State &state) {
+	const int users = static_cast< int >(state.range(0));
+
+	MockDatabase database(users);
+	ServerDBWriteBehind writeBehind(database.db.connectionName(), QLatin1String("QSQLITE"), QString(), 1000);
+
+	unsigned int channel = 0;
+	for (auto _ : state) {
+		++channel;
+		for (int i = 0; i < users; ++i) {
+			writeBehind.setLastChannel(SERVER_ID, i, channel);
+		}
+
+		state.PauseTiming();
+		writeBehind.flush();
+		state.ResumeTiming();
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()) * users);
+}
+
+/// Measures the time until all updates have been written to the database
+static void BM_massMove_writeBehindFlushed(::benchmark::State &state) {
+	const int users = static_cast< int >(state.range(0));
+
+	MockDatabase database(users);
+	ServerDBWriteBehind writeBehind(database.db.connectionName(), QLatin1String("QSQLITE"), QString(), 1000);
+
+	unsigned int channel = 0;
+	for (auto _ : state) {
+		++channel;
+		for (int i = 0; i < users; ++i) {
+			writeBehind.setLastChannel(SERVER_ID, i, channel);
+		}
+
+		writeBehind.flush();
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()) * users);
+}
+
+BENCHMARK(BM_massMove_direct)->Arg(10)->Arg(100)->Arg(500)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_massMove_writeBehind)->Arg(10)->Arg(100)->Arg(500)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_massMove_writeBehindFlushed)->Arg(10)->Arg(100)->Arg(500)->Unit(benchmark::kMillisecond);
+
+
+int main(int argc, char **argv) {
+	// Required for loading the SQL driver plugins
+	QCoreApplication app(argc, argv);
+
+	::benchmark::Initialize(&argc, argv);
+	if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+		return 1;
+	}
+	::benchmark::RunSpecifiedBenchmarks();
+	::benchmark::Shutdown();
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "Mumble.pb.h"
+#include "MumbleProtocol.h"
+#include "TCPMessageReader.h"
+
+#include <QtCore/QBuffer>
+#include <QtCore/QByteArray>
+#include <QtCore/QtEndian>
+
+#include <string>
+
+// These benchmarks measure splitting up (and parsing) the burst of messages a client receives while connecting to a
+// server (and the server receives from its clients during heavy activity): the state of every channel and user
+// followed by ServerSync. An in-memory device stands in for the socket, so only the work done by Connection (instead
+// of the network and TLS) is measured.
+
+constexpr int USERS_RANGE = 0;
+
+static void appendMessage(QByteArray &stream, Mumble::Protocol::TCPMessageType type,
+						  const ::google::protobuf::Message &msg) {
+	const std::string payload = msg.SerializeAsString();
+
+	unsigned char header[TCPMessageReader::HEADER_SIZE];
+	qToBigEndian< quint16 >(static_cast< quint16 >(type), &header[0]);
+	qToBigEndian< quint32 >(static_cast< quint32 >(payload.size()), &header[2]);
+
+	stream.append(reinterpret_cast< const char * >(header), sizeof(header));
+	stream.append(payload.data(), static_cast< int >(payload.size()));
+}
+
+/// The messages a server sends to synchronize a client with the given amount of users (and a fifth as many channels)
+static QByteArray createSyncBurst(int users) {
+	QByteArray stream;
+
+	const int channels = users / 5 + 1;
+	for (int i = 0; i < channels; ++i) {
+		MumbleProto::ChannelState msg;
+		msg.set_channel_id(static_cast< unsigned int >(i));
+		if (i > 0) {
+			msg.set_parent(static_cast< unsigned int >((i - 1) / 4));
+		}
+		msg.set_name("Channel " + std::to_string(i));
+		msg.set_description("A channel for everything related to topic number " + std::to_string(i));
+		msg.set_position(i);
+		appendMessage(stream, Mumble::Protocol::TCPMessageType::ChannelState, msg);
+	}
+
+	for (int i = 0; i < users; ++i) {
+		MumbleProto::UserState msg;
+		msg.set_session(static_cast< unsigned int >(i + 1));
+		msg.set_name("User " + std::to_string(i));
+		msg.set_user_id(static_cast< unsigned int >(i));
+		msg.set_channel_id(static_cast< unsigned int >(i % channels));
+		msg.set_hash(std::string(40, static_cast< char >('a' + i % 26)));
+		msg.set_comment_hash(std::string(20, '\x17'));
+		appendMessage(stream, Mumble::Protocol::TCPMessageType::UserState, msg);
+	}
+
+	MumbleProto::ServerSync sync;
+	sync.set_session(1);
+	sync.set_max_bandwidth(558000);
+	sync.set_welcome_text("Welcome to this server");
+	appendMessage(stream, Mumble::Protocol::TCPMessageType::ServerSync, sync);
+
+	return stream;
+}
+
+/// Parses the message, as its handler would
+static void handleMessage(Mumble::Protocol::TCPMessageType type, const QByteArray &payload) {
+	if (type == Mumble::Protocol::TCPMessageType::UserState) {
+		MumbleProto::UserState msg;
+		benchmark::DoNotOptimize(msg.ParseFromArray(payload.constData(), static_cast< int >(payload.size())));
+	} else if (type == Mumble::Protocol::TCPMessageType::ChannelState) {
+		MumbleProto::ChannelState msg;
+		benchmark::DoNotOptimize(msg.ParseFromArray(payload.constData(), static_cast< int >(payload.size())));
+	} else {
+		MumbleProto::ServerSync msg;
+		benchmark::DoNotOptimize(msg.ParseFromArray(payload.constData(), static_cast< int >(payload.size())));
+	}
+}
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	QByteArray stream;
+	int messages = 0;
+
+	void SetUp(const ::benchmark::State &state) override {
+		const int users = static_cast< int >(state.range(USERS_RANGE));
+
+		stream   = createSyncBurst(users);
+		messages = users + users / 5 + 2;
+	}
+
+	void TearDown(const ::benchmark::State &) override { stream.clear(); }
+};
+
+/// Reads the header and then the payload of every message on its own, as Connection::socketRead used to do
+BENCHMARK_DEFINE_F(Fixture, BM_readPerMessage)(::benchmark::State &state) {
+	for (auto _ : state) {
+		QBuffer socket(&stream);
+		socket.open(QIODevice::ReadOnly);
+
+		while (socket.bytesAvailable() >= static_cast< qint64 >(TCPMessageReader::HEADER_SIZE)) {
+			unsigned char header[TCPMessageReader::HEADER_SIZE];
+			socket.read(reinterpret_cast< char * >(header), sizeof(header));
+
+			const auto type   = static_cast< Mumble::Protocol::TCPMessageType >(qFromBigEndian< quint16 >(&header[0]));
+			const int length  = qFromBigEndian< int >(&header[2]);
+			QByteArray buffer = socket.read(length);
+
+			handleMessage(type, buffer);
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * messages));
+	state.SetBytesProcessed(static_cast< int64_t >(state.iterations() * stream.size()));
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_readBuffered)(::benchmark::State &state) {
+	TCPMessageReader reader;
+
+	for (auto _ : state) {
+		QBuffer socket(&stream);
+		socket.open(QIODevice::ReadOnly);
+
+		while (socket.bytesAvailable() > 0) {
+			const gsl::span< char > buffer = reader.writeBuffer();
+			reader.commit(static_cast< std::size_t >(socket.read(buffer.data(), static_cast< qint64 >(buffer.size()))));
+
+			Mumble::Protocol::TCPMessageType type;
+			QByteArray payload;
+			while (reader.next(type, payload) == TCPMessageReader::Status::Message) {
+				handleMessage(type, payload);
+			}
+		}
+
+		reader.release();
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * messages));
+	state.SetBytesProcessed(static_cast< int64_t >(state.iterations() * stream.size()));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_readPerMessage)->RangeMultiplier(10)->Range(100, 10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK_REGISTER_F(Fixture, BM_readBuffered)->RangeMultiplier(10)->Range(100, 10000)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,180 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "WhisperTargetDependencies.h"
+
+#include <QtCore/QSet>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+// These benchmarks compare the ways of keeping the cached whisper targets up to date on a busy server, on which many
+// users are shouting to their channel (and the linked ones) while other users keep moving between channels. Every
+// iteration, one user moves to another channel and every shouter sends an audio packet.
+//
+// Before the targets' dependencies were tracked, every move cleared all cached targets, so every shouter's next
+// packet had to rebuild its target on the voice thread (while holding the voice lock exclusively). Now, only the
+// targets that depend on the channel or user are rebuilt, on the main thread.
+
+constexpr const unsigned int CHANNEL_COUNT = 500;
+constexpr const unsigned int USER_COUNT    = 2000;
+/// The amount of channels every shout reaches (the target channel and the ones linked to it)
+constexpr const unsigned int LINKED_CHANNELS = 4;
+
+constexpr int SHOUTERS_RANGE = 0;
+
+// NOTE: This is merely a mock of WhisperTargetCache
+struct MockTargetCache {
+	QSet< unsigned int > receivers;
+	WhisperTargetDependencies dependencies;
+};
+
+class WhisperFixture : public ::benchmark::Fixture {
+public:
+	std::mt19937 rng;
+	/// The channel of every user, by session
+	std::vector< unsigned int > userChannels;
+	/// The sessions of the users in every channel
+	std::vector< QSet< unsigned int > > channelUsers;
+	/// The channels reached by every shouter's target
+	std::vector< std::vector< unsigned int > > targets;
+	/// The cached targets of every shouter (or nullptr, if the target isn't cached)
+	std::vector< std::unique_ptr< MockTargetCache > > caches;
+
+	std::size_t rebuilds      = 0;
+	std::size_t voiceRebuilds = 0;
+
+	void SetUp(const ::benchmark::State &state) override {
+		rng.seed(42);
+
+		userChannels.clear();
+		channelUsers.assign(CHANNEL_COUNT, {});
+		for (unsigned int session = 0; session < USER_COUNT; ++session) {
+			const unsigned int channel = rng() % CHANNEL_COUNT;
+			userChannels.push_back(channel);
+			channelUsers[channel].insert(session);
+		}
+
+		// The first users are the shouters
+		targets.clear();
+		caches.clear();
+		for (int64_t i = 0; i < state.range(SHOUTERS_RANGE); ++i) {
+			std::vector< unsigned int > channels;
+			const unsigned int first = rng() % CHANNEL_COUNT;
+			for (unsigned int j = 0; j < LINKED_CHANNELS; ++j) {
+				channels.push_back((first + j * 7) % CHANNEL_COUNT);
+			}
+
+			targets.push_back(std::move(channels));
+			caches.push_back(build(static_cast< unsigned int >(i)));
+		}
+
+		rebuilds      = 0;
+		voiceRebuilds = 0;
+	}
+
+	void TearDown(const ::benchmark::State &) override {
+		caches.clear();
+		targets.clear();
+	}
+
+	/// Stands in for Server::createWhisperTargetCacheFor
+	std::unique_ptr< MockTargetCache > build(unsigned int shouter) {
+		auto cache = std::make_unique< MockTargetCache >();
+
+		for (unsigned int channel : targets[shouter]) {
+			cache->dependencies.channels.insert(channel);
+
+			for (unsigned int session : channelUsers[channel]) {
+				if (session != shouter) {
+					cache->receivers.insert(session);
+					cache->dependencies.sessions.insert(session);
+				}
+			}
+		}
+
+		rebuilds++;
+
+		return cache;
+	}
+
+	/// Moves a random user to a random channel and returns their session
+	unsigned int moveUser() {
+		const unsigned int session = rng() % USER_COUNT;
+		const unsigned int channel = rng() % CHANNEL_COUNT;
+
+		channelUsers[userChannels[session]].remove(session);
+		channelUsers[channel].insert(session);
+		userChannels[session] = channel;
+
+		return session;
+	}
+
+	/// Every shouter sends a packet
+	void sendAudio() {
+		for (unsigned int shouter = 0; shouter < caches.size(); ++shouter) {
+			if (!caches[shouter]) {
+				// This used to happen on the voice thread, while holding the voice lock exclusively
+				caches[shouter] = build(shouter);
+				voiceRebuilds++;
+			}
+
+			benchmark::DoNotOptimize(caches[shouter]->receivers.size());
+		}
+	}
+
+	void setCounters(::benchmark::State &state) {
+		state.counters["rebuilds"] =
+			benchmark::Counter(static_cast< double >(rebuilds), benchmark::Counter::kAvgIterations);
+		state.counters["voiceRebuilds"] =
+			benchmark::Counter(static_cast< double >(voiceRebuilds), benchmark::Counter::kAvgIterations);
+	}
+};
+
+BENCHMARK_DEFINE_F(WhisperFixture, BM_clearAll)(::benchmark::State &state) {
+	for (auto _ : state) {
+		moveUser();
+
+		// What Server::clearWhisperTargetCache used to do
+		for (std::unique_ptr< MockTargetCache > &cache : caches) {
+			cache.reset();
+		}
+
+		sendAudio();
+	}
+
+	setCounters(state);
+}
+
+BENCHMARK_DEFINE_F(WhisperFixture, BM_trackDependencies)(::benchmark::State &state) {
+	for (auto _ : state) {
+		const unsigned int session = moveUser();
+
+		// What Server::clearACLCache does for the user that has moved
+		const QSet< unsigned int > changedChannels = { userChannels[session] };
+		const QSet< unsigned int > changedSessions = { session };
+
+		for (unsigned int shouter = 0; shouter < caches.size(); ++shouter) {
+			if (shouter == session || caches[shouter]->dependencies.dependsOn(changedChannels, changedSessions)) {
+				caches[shouter] = build(shouter);
+			}
+		}
+
+		sendAudio();
+	}
+
+	setCounters(state);
+}
+
+BENCHMARK_REGISTER_F(WhisperFixture, BM_clearAll)->RangeMultiplier(4)->Range(16, 1024)->Unit(benchmark::kMicrosecond);
+BENCHMARK_REGISTER_F(WhisperFixture, BM_trackDependencies)
+	->RangeMultiplier(4)
+	->Range(16, 1024)
+	->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
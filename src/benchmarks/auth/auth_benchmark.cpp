@@ -0,0 +1,144 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "PBKDF2.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEvent>
+#include <QtCore/QEventLoop>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
+
+#include <algorithm>
+#include <functional>
+
+// These benchmarks replay N users logging in at the same time (e.g. after a restart of the server) and measure how
+// long the main loop is blocked by checking their passwords. While it is blocked, the server can't process any other
+// control channel message. The passwords are either hashed on the main thread (as it has been done before) or on a
+// thread pool, with the result being posted back to the main thread (like Server::msgAuthenticate does it).
+
+/// The amount of PBKDF2 iterations used for the stored passwords (determined like a new server would do it)
+static int kdfIterations = 0;
+
+/// Stands in for the ExecEvent the server uses to run a function on its thread
+class RunEvent : public QEvent {
+public:
+	static const QEvent::Type TYPE = static_cast< QEvent::Type >(QEvent::User + 1);
+
+	std::function< void() > function;
+
+	RunEvent(std::function< void() > function) : QEvent(TYPE), function(std::move(function)) {}
+};
+
+/// Stands in for the server
+class MockServer : public QObject {
+public:
+	QThreadPool pool;
+
+	/// Logins that have not been finished yet
+	int pending = 0;
+	QEventLoop loop;
+
+	void login(bool async) {
+		const QString salt     = PBKDF2::getSalt();
+		const QString password = QLatin1String("password");
+
+		if (!async) {
+			finish(PBKDF2::getHash(salt, password, kdfIterations));
+			return;
+		}
+
+		pool.start([this, salt, password]() {
+			const QString hash = PBKDF2::getHash(salt, password, kdfIterations);
+
+			QCoreApplication::postEvent(this, new RunEvent([this, hash]() { finish(hash); }));
+		});
+	}
+
+	void finish(const QString &hash) {
+		benchmark::DoNotOptimize(hash);
+
+		if (--pending == 0) {
+			loop.quit();
+		}
+	}
+
+protected:
+	void customEvent(QEvent *event) override {
+		if (event->type() == RunEvent::TYPE) {
+			static_cast< RunEvent * >(event)->function();
+		}
+	}
+};
+
+static void BM_logins(::benchmark::State &state) {
+	const bool async = state.range(0) != 0;
+	const int logins = static_cast< int >(state.range(1));
+
+	MockServer server;
+
+	// The longest time the main loop has been blocked and the sum of all those times
+	qint64 maxStall   = 0;
+	qint64 totalStall = 0;
+	qint64 ticks      = 0;
+
+	for (auto _ : state) {
+		server.pending = logins;
+
+		// The logins arrive as individual messages that are processed by the main loop
+		for (int i = 0; i < logins; ++i) {
+			QCoreApplication::postEvent(&server, new RunEvent([&server, async]() { server.login(async); }));
+		}
+
+		// Measures how late a timer that should fire every millisecond is, which is how long other messages
+		// would be delayed
+		QElapsedTimer elapsed;
+		QTimer tick;
+		tick.setTimerType(Qt::PreciseTimer);
+		tick.setInterval(1);
+		QObject::connect(&tick, &QTimer::timeout, [&]() {
+			const qint64 stall = std::max< qint64 >(elapsed.nsecsElapsed() - 1000000, 0);
+			maxStall           = std::max(maxStall, stall);
+			totalStall += stall;
+			ticks++;
+
+			elapsed.restart();
+		});
+
+		elapsed.start();
+		tick.start();
+		server.loop.exec();
+		tick.stop();
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()) * logins);
+	state.counters["max_stall_ms"]  = static_cast< double >(maxStall) / 1e6;
+	state.counters["mean_stall_ms"] = ticks > 0 ? static_cast< double >(totalStall) / 1e6 / ticks : 0.0;
+}
+
+BENCHMARK(BM_logins)
+	->ArgsProduct({ { 0, 1 }, { 10, 100, 500 } })
+	->ArgNames({ "async", "logins" })
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+
+int main(int argc, char **argv) {
+	QCoreApplication app(argc, argv);
+
+	kdfIterations = PBKDF2::benchmark();
+
+	::benchmark::Initialize(&argc, argv);
+	if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+		return 1;
+	}
+	::benchmark::RunSpecifiedBenchmarks();
+	::benchmark::Shutdown();
+
+	return 0;
+}
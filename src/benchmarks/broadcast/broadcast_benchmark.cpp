@@ -0,0 +1,192 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "Connection.h"
+#include "Mumble.pb.h"
+#include "SelfSignedCertificate.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QThread>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QSslKey>
+#include <QtNetwork/QSslSocket>
+#include <QtNetwork/QTcpServer>
+
+#include <memory>
+#include <vector>
+
+// These benchmarks measure how long the server's thread is busy with fanning out UserState messages (e.g. users
+// toggling their mute state) to N clients connected via TLS, including the time its event loop takes to write
+// everything to the sockets. The messages are
+// - serialized for every recipient and written right away,
+// - serialized once and written to every recipient right away (as Server::sendProtoExcept used to do it) or
+// - serialized once and queued, so that all messages for one client are written (and encrypted) together once
+//   control returns to the event loop (as Server::sendProtoExcept does it now).
+
+/// The amount of messages that are broadcast in one iteration of the event loop
+constexpr const int MESSAGES_PER_ITERATION = 16;
+
+enum class Mode { SerializePerRecipient, SerializeOnce, SerializeOnceQueued };
+
+static QSslCertificate certificate;
+static QSslKey privateKey;
+
+/// The server's end of a connection
+class ServerConnection : public Connection {
+public:
+	using Connection::Connection;
+
+	bool isEncrypted() const { return qtsSocket->isEncrypted(); }
+	bool hasPendingData() const { return qtsSocket->bytesToWrite() > 0 || qtsSocket->encryptedBytesToWrite() > 0; }
+};
+
+class Server : public QTcpServer {
+public:
+	std::vector< std::unique_ptr< ServerConnection > > connections;
+
+protected:
+	void incomingConnection(qintptr socketDescriptor) override {
+		QSslSocket *socket = new QSslSocket();
+		socket->setSocketDescriptor(socketDescriptor);
+		socket->setLocalCertificate(certificate);
+		socket->setPrivateKey(privateKey);
+
+		connections.push_back(std::make_unique< ServerConnection >(nullptr, socket));
+
+		socket->startServerEncryption();
+	}
+};
+
+/// The clients, which live on their own thread, so that reading the data doesn't take any time from the server's
+/// thread
+class Clients : public QObject {
+public:
+	void connectTo(quint16 port, int count) {
+		for (int i = 0; i < count; ++i) {
+			QSslSocket *socket = new QSslSocket(this);
+			socket->setPeerVerifyMode(QSslSocket::VerifyNone);
+			QObject::connect(socket, &QSslSocket::readyRead, socket, [socket]() { socket->readAll(); });
+
+			socket->connectToHostEncrypted(QHostAddress(QHostAddress::LocalHost).toString(), port);
+		}
+	}
+};
+
+static void BM_broadcastUserState(::benchmark::State &state) {
+	const Mode mode = static_cast< Mode >(state.range(0));
+	const int users = static_cast< int >(state.range(1));
+
+	Server server;
+	if (!server.listen(QHostAddress::LocalHost)) {
+		state.SkipWithError("Failed to listen");
+		return;
+	}
+
+	QThread clientThread;
+	clientThread.start();
+
+	Clients *clients = new Clients();
+	clients->moveToThread(&clientThread);
+	QMetaObject::invokeMethod(
+		clients, [clients, &server, users]() { clients->connectTo(server.serverPort(), users); },
+		Qt::BlockingQueuedConnection);
+
+	auto allEncrypted = [&server, users]() {
+		if (server.connections.size() < static_cast< std::size_t >(users)) {
+			return false;
+		}
+		for (const std::unique_ptr< ServerConnection > &connection : server.connections) {
+			if (!connection->isEncrypted()) {
+				return false;
+			}
+		}
+		return true;
+	};
+	while (!allEncrypted()) {
+		QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+	}
+
+	auto hasPendingData = [&server]() {
+		for (const std::unique_ptr< ServerConnection > &connection : server.connections) {
+			if (connection->hasPendingData()) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	MumbleProto::UserState msg;
+	msg.set_channel_id(1);
+
+	bool mute = false;
+
+	for (auto _ : state) {
+		mute = !mute;
+
+		for (unsigned int session = 1; session <= MESSAGES_PER_ITERATION; ++session) {
+			msg.set_session(session);
+			msg.set_self_mute(mute);
+
+			QByteArray cache;
+			for (const std::unique_ptr< ServerConnection > &connection : server.connections) {
+				switch (mode) {
+					case Mode::SerializePerRecipient:
+						cache.clear();
+						connection->sendMessage(msg, Mumble::Protocol::TCPMessageType::UserState, cache);
+						break;
+					case Mode::SerializeOnce:
+						connection->sendMessage(msg, Mumble::Protocol::TCPMessageType::UserState, cache);
+						break;
+					case Mode::SerializeOnceQueued:
+						if (cache.isEmpty()) {
+							Connection::messageToNetwork(msg, Mumble::Protocol::TCPMessageType::UserState, cache);
+						}
+						connection->queueMessage(cache);
+						break;
+				}
+			}
+		}
+
+		// Run the event loop until everything has been written to the sockets
+		do {
+			QCoreApplication::processEvents();
+		} while (hasPendingData());
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()) * MESSAGES_PER_ITERATION * users);
+
+	QMetaObject::invokeMethod(
+		clients, [clients]() { delete clients; }, Qt::BlockingQueuedConnection);
+	clientThread.quit();
+	clientThread.wait();
+}
+
+BENCHMARK(BM_broadcastUserState)
+	->ArgsProduct({ { static_cast< int >(Mode::SerializePerRecipient), static_cast< int >(Mode::SerializeOnce),
+					  static_cast< int >(Mode::SerializeOnceQueued) },
+					{ 10, 50, 250 } })
+	->ArgNames({ "mode", "users" })
+	->Unit(benchmark::kMicrosecond)
+	->UseRealTime();
+
+
+int main(int argc, char **argv) {
+	QCoreApplication app(argc, argv);
+
+	if (!SelfSignedCertificate::generateMurmurV2Certificate(certificate, privateKey)) {
+		qFatal("Failed to generate a certificate");
+	}
+
+	::benchmark::Initialize(&argc, argv);
+	if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+		return 1;
+	}
+	::benchmark::RunSpecifiedBenchmarks();
+	::benchmark::Shutdown();
+
+	return 0;
+}
@@ -0,0 +1,158 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "crypto/CryptStateOCB2.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+// Measures the cost of encrypting and decrypting a single voice packet. Typical Opus frames are 60 to 120 bytes.
+// BM_fanout measures the cost per receiver of encrypting one packet for many receivers, as the server does for
+// every audio packet it relays.
+
+std::random_device rd;
+std::mt19937 rng(rd());
+std::uniform_int_distribution< unsigned int > random_byte(0, 255);
+
+constexpr const int PACKET_SIZE_RANGE = 0;
+constexpr const int HARDWARE_RANGE    = 1;
+
+constexpr const int RECEIVER_RANGE = 0;
+constexpr const int BATCH_RANGE    = 1;
+
+constexpr const int PACKET_SIZE_BEGIN = 60;
+constexpr const int PACKET_SIZE_END   = 120;
+constexpr const int PACKET_SIZE_STEP  = 20;
+
+constexpr const int RECEIVERS_BEGIN = 1;
+constexpr const int RECEIVERS_END   = 128;
+
+/// The size of the packet used by BM_fanout
+constexpr const unsigned int FANOUT_PACKET_SIZE = 100;
+
+static void setLabel(::benchmark::State &state, const CryptStateOCB2 &cs) {
+	state.SetLabel(cs.usesHardwareAES() ? "hardware" : "OpenSSL");
+}
+
+static std::vector< unsigned char > randomPacket(std::size_t size) {
+	std::vector< unsigned char > packet(size);
+	for (unsigned char &byte : packet) {
+		byte = static_cast< unsigned char >(random_byte(rng));
+	}
+
+	return packet;
+}
+
+static void BM_encrypt(::benchmark::State &state) {
+	const unsigned int size = static_cast< unsigned int >(state.range(PACKET_SIZE_RANGE));
+
+	CryptStateOCB2 cs(state.range(HARDWARE_RANGE) != 0);
+	cs.genKey();
+	setLabel(state, cs);
+
+	std::vector< unsigned char > plain = randomPacket(size);
+	std::vector< unsigned char > encrypted(size + 4);
+
+	for (auto _ : state) {
+		cs.encrypt(plain.data(), encrypted.data(), size);
+		benchmark::DoNotOptimize(encrypted.data());
+	}
+
+	state.SetBytesProcessed(static_cast< int64_t >(state.iterations() * size));
+	state.counters["time_per_packet"] = benchmark::Counter(static_cast< double >(state.iterations()),
+														   benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+static void BM_decrypt(::benchmark::State &state) {
+	const unsigned int size = static_cast< unsigned int >(state.range(PACKET_SIZE_RANGE));
+
+	CryptStateOCB2 encryptor(state.range(HARDWARE_RANGE) != 0);
+	CryptStateOCB2 decryptor(state.range(HARDWARE_RANGE) != 0);
+	encryptor.genKey();
+	decryptor.setKey(encryptor.getRawKey(), encryptor.getDecryptIV(), encryptor.getEncryptIV());
+	setLabel(state, decryptor);
+
+	std::vector< unsigned char > plain = randomPacket(size);
+	std::vector< unsigned char > decrypted(size);
+
+	// Every packet can only be decrypted once (replay protection), so a whole batch of them is prepared
+	// up front
+	constexpr const std::size_t PACKETS = 256;
+	std::vector< std::vector< unsigned char > > packets(PACKETS, std::vector< unsigned char >(size + 4));
+
+	std::size_t next = PACKETS;
+	for (auto _ : state) {
+		if (next == PACKETS) {
+			state.PauseTiming();
+			for (std::vector< unsigned char > &packet : packets) {
+				encryptor.encrypt(plain.data(), packet.data(), size);
+			}
+			next = 0;
+			state.ResumeTiming();
+		}
+
+		if (!decryptor.decrypt(packets[next++].data(), decrypted.data(), size + 4)) {
+			state.SkipWithError("Decryption failed");
+			break;
+		}
+	}
+
+	state.SetBytesProcessed(static_cast< int64_t >(state.iterations() * size));
+	state.counters["time_per_packet"] = benchmark::Counter(static_cast< double >(state.iterations()),
+														   benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+static void packetArguments(::benchmark::internal::Benchmark *benchmark) {
+	for (int size = PACKET_SIZE_BEGIN; size <= PACKET_SIZE_END; size += PACKET_SIZE_STEP) {
+		benchmark->Args({ size, 0 });
+		benchmark->Args({ size, 1 });
+	}
+}
+
+static void BM_fanout(::benchmark::State &state) {
+	const std::size_t receivers = static_cast< std::size_t >(state.range(RECEIVER_RANGE));
+	const bool batch            = state.range(BATCH_RANGE) != 0;
+
+	state.SetLabel(batch ? "batch" : "sequential");
+
+	std::vector< std::unique_ptr< CryptStateOCB2 > > states;
+	std::vector< CryptStateOCB2 * > statePointers;
+	std::vector< std::vector< unsigned char > > buffers(receivers,
+														std::vector< unsigned char >(FANOUT_PACKET_SIZE + 4));
+	std::vector< unsigned char * > bufferPointers;
+	for (std::size_t i = 0; i < receivers; ++i) {
+		states.push_back(std::make_unique< CryptStateOCB2 >());
+		states.back()->genKey();
+		statePointers.push_back(states.back().get());
+		bufferPointers.push_back(buffers[i].data());
+	}
+
+	std::vector< unsigned char > plain = randomPacket(FANOUT_PACKET_SIZE);
+
+	for (auto _ : state) {
+		if (batch) {
+			CryptStateOCB2::encryptBatch(statePointers.data(), bufferPointers.data(), receivers, plain.data(),
+										 FANOUT_PACKET_SIZE);
+		} else {
+			for (std::size_t i = 0; i < receivers; ++i) {
+				statePointers[i]->encrypt(plain.data(), bufferPointers[i], FANOUT_PACKET_SIZE);
+			}
+		}
+		benchmark::ClobberMemory();
+	}
+
+	state.counters["time_per_receiver"] =
+		benchmark::Counter(static_cast< double >(state.iterations() * receivers),
+						   benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+BENCHMARK(BM_encrypt)->Apply(packetArguments);
+BENCHMARK(BM_decrypt)->Apply(packetArguments);
+BENCHMARK(BM_fanout)->ArgsProduct({ benchmark::CreateRange(RECEIVERS_BEGIN, RECEIVERS_END, /*multi=*/2), { 0, 1 } });
+
+BENCHMARK_MAIN();
@@ -0,0 +1,82 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "LatencyHistogram.h"
+
+#include <QtCore/QtAlgorithms>
+
+#include <algorithm>
+#include <cmath>
+
+// SUB_BUCKETS == 1 << SUB_BUCKET_BITS
+static constexpr unsigned int SUB_BUCKET_BITS = 4;
+
+std::size_t LatencyHistogram::bucketOf(quint64 usecs) {
+	if (usecs < SUB_BUCKETS) {
+		return static_cast< std::size_t >(usecs);
+	}
+
+	const unsigned int exponent = 63 - qCountLeadingZeroBits(usecs);
+	const unsigned int shift    = exponent - SUB_BUCKET_BITS;
+
+	return (shift + 1) * SUB_BUCKETS + static_cast< std::size_t >((usecs >> shift) & (SUB_BUCKETS - 1));
+}
+
+quint64 LatencyHistogram::lowestValueOf(std::size_t bucket) {
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+
+	const std::size_t shift = bucket / SUB_BUCKETS - 1;
+
+	return static_cast< quint64 >(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+}
+
+void LatencyHistogram::add(quint64 usecs) {
+	m_buckets[bucketOf(usecs)]++;
+	m_count++;
+	m_max = std::max(m_max, usecs);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+	for (std::size_t i = 0; i < m_buckets.size(); ++i) {
+		m_buckets[i] += other.m_buckets[i];
+	}
+
+	m_count += other.m_count;
+	m_max = std::max(m_max, other.m_max);
+}
+
+void LatencyHistogram::clear() {
+	m_buckets.fill(0);
+	m_count = 0;
+	m_max   = 0;
+}
+
+quint64 LatencyHistogram::count() const {
+	return m_count;
+}
+
+quint64 LatencyHistogram::max() const {
+	return m_max;
+}
+
+quint64 LatencyHistogram::percentile(double fraction) const {
+	if (m_count == 0) {
+		return 0;
+	}
+
+	const quint64 rank = std::max< quint64 >(1, static_cast< quint64 >(std::ceil(fraction * m_count)));
+
+	quint64 seen = 0;
+	for (std::size_t i = 0; i < m_buckets.size(); ++i) {
+		seen += m_buckets[i];
+		if (seen >= rank) {
+			return std::min(lowestValueOf(i), m_max);
+		}
+	}
+
+	return m_max;
+}
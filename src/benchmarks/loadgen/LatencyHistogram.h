@@ -0,0 +1,45 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_LOADGEN_LATENCYHISTOGRAM_H_
+#define MUMBLE_LOADGEN_LATENCYHISTOGRAM_H_
+
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <cstddef>
+
+/// Records latencies (in microseconds) with a constant amount of memory, so that percentiles can be computed over
+/// millions of samples.
+///
+/// Every power of two is split into SUB_BUCKETS buckets, so the reported values are off by less than 1/SUB_BUCKETS
+/// (about 6%).
+class LatencyHistogram {
+public:
+	static constexpr std::size_t SUB_BUCKETS = 16;
+
+	void add(quint64 usecs);
+	void merge(const LatencyHistogram &other);
+	void clear();
+
+	quint64 count() const;
+	quint64 max() const;
+	/// @param fraction The fraction of samples that are smaller than or equal to the returned value (e.g. 0.99)
+	/// @returns The (approximate) latency below which the given fraction of samples lies, or 0 if there are no samples
+	quint64 percentile(double fraction) const;
+
+protected:
+	/// Values below SUB_BUCKETS get a bucket of their own, larger ones share a bucket with the values that have the
+	/// same highest log2(SUB_BUCKETS) + 1 bits.
+	static std::size_t bucketOf(quint64 usecs);
+	/// @returns The smallest value stored in the given bucket
+	static quint64 lowestValueOf(std::size_t bucket);
+
+	std::array< quint64, (64 - 3) * SUB_BUCKETS > m_buckets = {};
+	quint64 m_count = 0;
+	quint64 m_max   = 0;
+};
+
+#endif // MUMBLE_LOADGEN_LATENCYHISTOGRAM_H_
@@ -0,0 +1,399 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "LoadClient.h"
+
+#include "Connection.h"
+#include "Mumble.pb.h"
+#include "ProtoUtils.h"
+#include "QtUtils.h"
+#include "Version.h"
+#include "crypto/CryptState.h"
+
+#include <QtCore/QtEndian>
+#include <QtNetwork/QSslConfiguration>
+#include <QtNetwork/QSslSocket>
+#include <QtNetwork/QUdpSocket>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+
+void LoadStatistics::merge(const LoadStatistics &other) {
+	sent += other.sent;
+	received += other.received;
+	expected += other.expected;
+	latency.merge(other.latency);
+}
+
+void LoadStatistics::clear() {
+	sent     = 0;
+	received = 0;
+	expected = 0;
+	latency.clear();
+}
+
+LoadClient::LoadClient(const LoadConfig &config, const QString &name, int framing, Target target, bool useUdp,
+					   LoadStatistics &statistics, ServerView &view, bool observer, QObject *parent)
+	: QObject(parent), m_config(config), m_name(name), m_framing(framing), m_target(target), m_useUdp(useUdp),
+	  m_statistics(statistics), m_view(view), m_observer(observer),
+	  m_random(static_cast< std::minstd_rand::result_type >(qHash(name))) {
+	setObjectName(name);
+
+	// The payload starts with the time it was sent at, the rest of it is never looked at
+	m_payload.resize(std::max< std::size_t >(sizeof(quint64), static_cast< std::size_t >(config.payloadSize)), 0);
+}
+
+LoadClient::~LoadClient() = default;
+
+void LoadClient::connectToServer() {
+	QSslSocket *socket = new QSslSocket(this);
+	socket->setPeerVerifyMode(QSslSocket::VerifyNone);
+
+	m_connection = new Connection(this, socket);
+
+	connect(m_connection, &Connection::encrypted, this, &LoadClient::encrypted);
+	connect(m_connection, &Connection::message, this, &LoadClient::message);
+	connect(m_connection, &Connection::connectionClosed, this, &LoadClient::connectionClosed);
+
+	socket->connectToHostEncrypted(m_config.host.toString(), m_config.port);
+}
+
+bool LoadClient::isSynchronized() const {
+	return m_synchronized;
+}
+
+int LoadClient::framing() const {
+	return m_framing;
+}
+
+quint64 LoadClient::now() {
+	return static_cast< quint64 >(
+		std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now().time_since_epoch())
+			.count());
+}
+
+void LoadClient::encrypted() {
+	MumbleProto::Version mpv;
+	mpv.set_release(u8(Version::getRelease()));
+	MumbleProto::setVersion(mpv, Version::get());
+	sendMessage(mpv, Mumble::Protocol::TCPMessageType::Version);
+
+	MumbleProto::Authenticate mpa;
+	mpa.set_username(u8(m_name));
+	mpa.set_password(u8(m_config.password));
+	mpa.set_opus(true);
+	sendMessage(mpa, Mumble::Protocol::TCPMessageType::Authenticate);
+
+	if (m_useUdp) {
+		m_udp = new QUdpSocket(this);
+		connect(m_udp, &QUdpSocket::readyRead, this, &LoadClient::udpReadyRead);
+		m_udp->connectToHost(m_config.host, m_config.port);
+	}
+}
+
+void LoadClient::message(Mumble::Protocol::TCPMessageType type, const QByteArray &payload) {
+	using Mumble::Protocol::TCPMessageType;
+
+	switch (type) {
+		case TCPMessageType::UDPTunnel: {
+			if (m_tunnelDecoder.decode({ reinterpret_cast< const Mumble::Protocol::byte * >(payload.constData()),
+										 static_cast< std::size_t >(payload.size()) })
+				&& m_tunnelDecoder.getMessageType() == Mumble::Protocol::UDPMessageType::Audio) {
+				handleAudio(m_tunnelDecoder.getAudioData());
+			}
+			break;
+		}
+		case TCPMessageType::Version: {
+			MumbleProto::Version msg;
+			if (msg.ParseFromArray(payload.constData(), static_cast< int >(payload.size()))) {
+				const Version::full_t version = MumbleProto::getVersion(msg);
+
+				m_audioEncoder.setProtocolVersion(version);
+				m_pingEncoder.setProtocolVersion(version);
+				m_udpDecoder.setProtocolVersion(version);
+				m_tunnelDecoder.setProtocolVersion(version);
+			}
+			break;
+		}
+		case TCPMessageType::CryptSetup: {
+			MumbleProto::CryptSetup msg;
+			if (!msg.ParseFromArray(payload.constData(), static_cast< int >(payload.size()))) {
+				break;
+			}
+
+			if (msg.has_key() && msg.has_client_nonce() && msg.has_server_nonce()) {
+				m_connection->csCrypt->setKey(msg.key(), msg.client_nonce(), msg.server_nonce());
+			} else if (msg.has_server_nonce()) {
+				m_connection->csCrypt->setDecryptIV(msg.server_nonce());
+			} else {
+				MumbleProto::CryptSetup mpcs;
+				mpcs.set_client_nonce(m_connection->csCrypt->getEncryptIV());
+				sendMessage(mpcs, TCPMessageType::CryptSetup);
+			}
+			break;
+		}
+		case TCPMessageType::ServerSync: {
+			MumbleProto::ServerSync msg;
+			if (!msg.ParseFromArray(payload.constData(), static_cast< int >(payload.size()))) {
+				break;
+			}
+
+			m_session      = msg.session();
+			m_synchronized = true;
+
+			// Lets the server know our UDP address (it won't send us any audio through UDP before that)
+			ping();
+			updateVoiceTarget();
+
+			emit synchronized();
+			break;
+		}
+		case TCPMessageType::UserState: {
+			MumbleProto::UserState msg;
+			if (!msg.ParseFromArray(payload.constData(), static_cast< int >(payload.size()))) {
+				break;
+			}
+
+			if (m_observer) {
+				m_view.sessions.insert(msg.session());
+			}
+			// Before the ServerSync our own session is unknown, but our name is unique
+			if (msg.has_channel_id()
+				&& ((m_synchronized && msg.session() == m_session) || (!m_synchronized && u8(msg.name()) == m_name))) {
+				m_channel = msg.channel_id();
+			}
+			break;
+		}
+		case TCPMessageType::UserRemove: {
+			MumbleProto::UserRemove msg;
+			if (m_observer && msg.ParseFromArray(payload.constData(), static_cast< int >(payload.size()))) {
+				m_view.sessions.remove(msg.session());
+			}
+			break;
+		}
+		case TCPMessageType::ChannelState: {
+			MumbleProto::ChannelState msg;
+			if (m_observer && msg.ParseFromArray(payload.constData(), static_cast< int >(payload.size()))) {
+				m_view.channels.insert(msg.channel_id());
+			}
+			break;
+		}
+		case TCPMessageType::ChannelRemove: {
+			MumbleProto::ChannelRemove msg;
+			if (m_observer && msg.ParseFromArray(payload.constData(), static_cast< int >(payload.size()))) {
+				m_view.channels.remove(msg.channel_id());
+			}
+			break;
+		}
+		case TCPMessageType::Reject: {
+			MumbleProto::Reject msg;
+			msg.ParseFromArray(payload.constData(), static_cast< int >(payload.size()));
+			connectionClosed(QAbstractSocket::UnknownSocketError, u8(msg.reason()));
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+void LoadClient::connectionClosed(QAbstractSocket::SocketError, const QString &reason) {
+	// A socket error is usually followed by the disconnect, both of which end up here
+	if (m_closed) {
+		return;
+	}
+
+	m_closed       = true;
+	m_synchronized = false;
+
+	if (m_udp) {
+		m_udp->close();
+	}
+	m_connection->disconnectSocket(true);
+
+	emit disconnected(reason);
+}
+
+void LoadClient::udpReadyRead() {
+	char encrypted[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+
+	while (m_udp->hasPendingDatagrams()) {
+		const qint64 size = m_udp->readDatagram(encrypted, sizeof(encrypted));
+
+		// 4 bytes is the overhead of the encryption
+		if (size < 5 || !m_connection->csCrypt->isValid()) {
+			continue;
+		}
+
+		gsl::span< Mumble::Protocol::byte > buffer = m_udpDecoder.getBuffer();
+
+		if (!m_connection->csCrypt->decrypt(reinterpret_cast< const unsigned char * >(encrypted), buffer.data(),
+											static_cast< unsigned int >(size))) {
+			continue;
+		}
+
+		if (m_udpDecoder.decode(buffer.subspan(0, static_cast< std::size_t >(size - 4)))
+			&& m_udpDecoder.getMessageType() == Mumble::Protocol::UDPMessageType::Audio) {
+			handleAudio(m_udpDecoder.getAudioData());
+		}
+	}
+}
+
+void LoadClient::speak() {
+	if (!m_synchronized || m_framing == 0) {
+		return;
+	}
+
+	const quint64 timestamp = now();
+	std::memcpy(m_payload.data(), &timestamp, sizeof(timestamp));
+
+	Mumble::Protocol::AudioData audio;
+	switch (m_target) {
+		case Target::Normal:
+			audio.targetOrContext = Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH;
+			break;
+		case Target::Whisper:
+			audio.targetOrContext = WHISPER_TARGET;
+			break;
+		case Target::Shout:
+			audio.targetOrContext = SHOUT_TARGET;
+			break;
+	}
+	audio.usedCodec   = Mumble::Protocol::AudioCodec::Opus;
+	audio.frameNumber = ++m_frameNumber;
+	audio.payload     = m_payload;
+
+	gsl::span< const Mumble::Protocol::byte > packet = m_audioEncoder.encodeAudioPacket(audio);
+
+	if (m_useUdp) {
+		sendUdp(packet);
+	} else {
+		QByteArray frame(static_cast< int >(packet.size() + 6), Qt::Uninitialized);
+		unsigned char *uc = reinterpret_cast< unsigned char * >(frame.data());
+		qToBigEndian(static_cast< quint16 >(Mumble::Protocol::TCPMessageType::UDPTunnel), uc);
+		qToBigEndian(static_cast< quint32 >(packet.size()), uc + 2);
+		std::memcpy(uc + 6, packet.data(), packet.size());
+
+		m_connection->sendMessage(frame);
+	}
+
+	m_statistics.sent++;
+}
+
+void LoadClient::ping() {
+	if (!m_synchronized) {
+		return;
+	}
+
+	MumbleProto::Ping mpp;
+	mpp.set_timestamp(now());
+	sendMessage(mpp, Mumble::Protocol::TCPMessageType::Ping);
+
+	if (m_useUdp) {
+		Mumble::Protocol::PingData pingData;
+		pingData.timestamp = now();
+
+		sendUdp(m_pingEncoder.encodePingPacket(pingData));
+	}
+}
+
+void LoadClient::hop() {
+	if (!m_synchronized || m_view.channels.size() < 2) {
+		return;
+	}
+
+	std::uniform_int_distribution< int > distribution(0, static_cast< int >(m_view.channels.size()) - 1);
+	const unsigned int channel = *std::next(m_view.channels.cbegin(), distribution(m_random));
+	if (channel == m_channel) {
+		return;
+	}
+
+	MumbleProto::UserState mpus;
+	mpus.set_session(m_session);
+	mpus.set_channel_id(channel);
+	sendMessage(mpus, Mumble::Protocol::TCPMessageType::UserState);
+
+	// Shouting is relative to the channel we (are about to) be in
+	m_channel = channel;
+	updateVoiceTarget();
+}
+
+void LoadClient::updateVoiceTarget() {
+	if (!m_synchronized || m_target == Target::Normal) {
+		return;
+	}
+
+	MumbleProto::VoiceTarget mpvt;
+	MumbleProto::VoiceTarget_Target *target = mpvt.add_targets();
+
+	if (m_target == Target::Whisper) {
+		mpvt.set_id(WHISPER_TARGET);
+
+		if (!m_view.sessions.isEmpty()) {
+			std::uniform_int_distribution< int > distribution(0, static_cast< int >(m_view.sessions.size()) - 1);
+			for (int i = 0; i < WHISPER_RECEIVERS; ++i) {
+				target->add_session(*std::next(m_view.sessions.cbegin(), distribution(m_random)));
+			}
+		}
+	} else {
+		mpvt.set_id(SHOUT_TARGET);
+
+		target->set_channel_id(m_channel);
+		target->set_children(true);
+	}
+
+	sendMessage(mpvt, Mumble::Protocol::TCPMessageType::VoiceTarget);
+}
+
+void LoadClient::sendMessage(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type) {
+	QByteArray cache;
+	m_connection->sendMessage(msg, type, cache);
+}
+
+void LoadClient::sendUdp(gsl::span< const Mumble::Protocol::byte > packet) {
+	if (!m_udp || !m_connection->csCrypt->isValid()) {
+		return;
+	}
+
+	// 4 bytes is the overhead of the encryption
+	m_cryptBuffer.resize(packet.size() + 4);
+	if (!m_connection->csCrypt->encrypt(packet.data(), m_cryptBuffer.data(),
+										static_cast< unsigned int >(packet.size()))) {
+		return;
+	}
+
+	m_udp->write(reinterpret_cast< const char * >(m_cryptBuffer.data()), static_cast< qint64 >(m_cryptBuffer.size()));
+}
+
+void LoadClient::handleAudio(const Mumble::Protocol::AudioData &audio) {
+	if (audio.payload.size() >= sizeof(quint64)) {
+		quint64 timestamp;
+		std::memcpy(&timestamp, audio.payload.data(), sizeof(timestamp));
+
+		const quint64 time = now();
+		m_statistics.latency.add(time > timestamp ? time - timestamp : 0);
+	}
+
+	m_statistics.received++;
+
+	auto it = m_streams.find(audio.senderSession);
+	if (it == m_streams.end()) {
+		it = m_streams.insert(audio.senderSession, Stream());
+		m_statistics.expected++;
+	} else if (audio.frameNumber > it->lastFrame && audio.frameNumber - it->lastFrame <= MAX_FRAME_GAP) {
+		m_statistics.expected += audio.frameNumber - it->lastFrame;
+	} else if (audio.frameNumber <= it->lastFrame) {
+		// Reordered (and thus already accounted for) or the speaker reconnected
+		if (it->lastFrame - audio.frameNumber <= MAX_FRAME_GAP) {
+			return;
+		}
+		m_statistics.expected++;
+	} else {
+		m_statistics.expected++;
+	}
+
+	it->lastFrame = audio.frameNumber;
+}
@@ -0,0 +1,169 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_LOADGEN_LOADCLIENT_H_
+#define MUMBLE_LOADGEN_LOADCLIENT_H_
+
+#include "LatencyHistogram.h"
+#include "MumbleProtocol.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtNetwork/QAbstractSocket>
+#include <QtNetwork/QHostAddress>
+
+#include <random>
+#include <vector>
+
+class Connection;
+class QUdpSocket;
+
+namespace google {
+namespace protobuf {
+	class Message;
+}
+} // namespace google
+
+/// The settings of a load test
+struct LoadConfig {
+	QHostAddress host;
+	quint16 port = 64738;
+	QString password;
+	/// The prefix of the simulated users' names
+	QString namePrefix = QStringLiteral("loadgen");
+
+	int clients  = 100;
+	int speakers = 10;
+	int threads  = 1;
+	/// The framing (in milliseconds) of the speakers' audio packets. The speakers are spread evenly across them.
+	QList< int > framings = { 20 };
+	/// The percentage of speakers that whisper to a few other users and that shout to their channel (including its
+	/// children). The others speak normally.
+	int whisperPercent = 0;
+	int shoutPercent   = 0;
+	/// The percentage of clients that don't use UDP (and thus send and receive audio through the TCP connection)
+	int tcpPercent = 0;
+	/// The average amount of seconds between two channel changes of a client, or 0 to stay in a channel
+	int hopInterval = 0;
+	/// The size of the (fake) Opus payload of every audio packet
+	int payloadSize = 60;
+	/// The amount of clients that are connected per second
+	int connectRate = 100;
+};
+
+/// The statistics collected by the clients. The latency is the time between a speaker handing a packet to the socket
+/// and a receiver reading it from its socket, which is dominated by the time the server takes to fan it out.
+struct LoadStatistics {
+	quint64 sent     = 0;
+	quint64 received = 0;
+	/// The amount of packets that should have been received, derived from the frame numbers
+	quint64 expected = 0;
+	LatencyHistogram latency;
+
+	void merge(const LoadStatistics &other);
+	void clear();
+};
+
+/// What the clients of a worker know about the server, collected by one of them (so that the clients don't have to
+/// keep track of thousands of users on their own)
+struct ServerView {
+	QSet< unsigned int > sessions;
+	QSet< unsigned int > channels;
+};
+
+/// A simulated user: a TLS control connection, a UDP socket for audio (unless it uses TCP only) and the audio it sends
+/// as a speaker. Everything happens in the event loop of the thread the client lives in.
+class LoadClient : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(LoadClient)
+
+public:
+	enum class Target { Normal, Whisper, Shout };
+
+	/// The VoiceTarget IDs used for whispering and shouting
+	static constexpr std::uint32_t WHISPER_TARGET = 1;
+	static constexpr std::uint32_t SHOUT_TARGET   = 2;
+	/// The amount of users a whispering client whispers to
+	static constexpr int WHISPER_RECEIVERS = 5;
+
+	/// @param framing The framing (in milliseconds) of the client's audio packets, or 0 if the client doesn't speak
+	/// @param observer Whether the client keeps the given view of the server up to date
+	LoadClient(const LoadConfig &config, const QString &name, int framing, Target target, bool useUdp,
+			   LoadStatistics &statistics, ServerView &view, bool observer, QObject *parent = nullptr);
+	~LoadClient() override;
+
+	void connectToServer();
+
+	bool isSynchronized() const;
+	int framing() const;
+
+	/// Sends the next audio packet
+	void speak();
+	/// Sends a ping through the TCP connection and through UDP (which also keeps the UDP "connection" alive)
+	void ping();
+	/// Moves to a random channel
+	void hop();
+	/// (Re-)registers the client's voice target, as the users and channels it refers to change
+	void updateVoiceTarget();
+
+	/// @returns The current time in microseconds, on a clock shared by all threads
+	static quint64 now();
+
+signals:
+	void synchronized();
+	void disconnected(const QString &reason);
+
+protected slots:
+	void encrypted();
+	void message(Mumble::Protocol::TCPMessageType type, const QByteArray &payload);
+	void connectionClosed(QAbstractSocket::SocketError error, const QString &reason);
+	void udpReadyRead();
+
+protected:
+	/// The state of the audio stream received from one speaker
+	struct Stream {
+		std::uint64_t lastFrame = 0;
+	};
+
+	/// Frames that arrive more than this many frames after the previous one from the same speaker start a new stream
+	/// (e.g. after one of them has changed channels), instead of being counted as lost
+	static constexpr std::uint64_t MAX_FRAME_GAP = 50;
+
+	void sendMessage(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type);
+	void sendUdp(gsl::span< const Mumble::Protocol::byte > packet);
+	void handleAudio(const Mumble::Protocol::AudioData &audio);
+
+	const LoadConfig &m_config;
+	QString m_name;
+	int m_framing;
+	Target m_target;
+	bool m_useUdp;
+	LoadStatistics &m_statistics;
+	ServerView &m_view;
+	bool m_observer;
+
+	Connection *m_connection = nullptr;
+	QUdpSocket *m_udp        = nullptr;
+	bool m_synchronized      = false;
+	bool m_closed            = false;
+	unsigned int m_session   = 0;
+	unsigned int m_channel   = 0;
+	std::minstd_rand m_random;
+
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Client > m_audioEncoder;
+	Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Client > m_pingEncoder;
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > m_udpDecoder;
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > m_tunnelDecoder;
+
+	std::uint64_t m_frameNumber = 0;
+	std::vector< Mumble::Protocol::byte > m_payload;
+	std::vector< unsigned char > m_cryptBuffer;
+	QHash< unsigned int, Stream > m_streams;
+};
+
+#endif // MUMBLE_LOADGEN_LOADCLIENT_H_
@@ -0,0 +1,166 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "LoadWorker.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QTimer>
+
+#include <algorithm>
+
+LoadWorker::LoadWorker(const LoadConfig &config, int index, QObject *parent)
+	: QObject(parent), m_config(config), m_index(index), m_random(static_cast< std::mt19937::result_type >(index)),
+	  m_synchronizedClients(0) {
+	// The users are dealt out to the workers round-robin, so that every worker gets its share of the speakers
+	for (int user = index; user < config.clients; user += config.threads) {
+		m_users << user;
+	}
+}
+
+LoadWorker::~LoadWorker() = default;
+
+LoadStatistics LoadWorker::takeStatistics() {
+	QMutexLocker lock(&m_statisticsMutex);
+
+	LoadStatistics statistics = m_statistics;
+	m_statistics.clear();
+
+	return statistics;
+}
+
+int LoadWorker::synchronizedClients() const {
+	return m_synchronizedClients.load(std::memory_order_relaxed);
+}
+
+void LoadWorker::start() {
+	m_connectTimer = new QTimer(this);
+	m_connectTimer->setInterval(std::max(1, 1000 * m_config.threads / std::max(1, m_config.connectRate)));
+	connect(m_connectTimer, &QTimer::timeout, this, &LoadWorker::connectNext);
+	m_connectTimer->start();
+
+	for (int framing : m_config.framings) {
+		QTimer *timer = new QTimer(this);
+		timer->setTimerType(Qt::PreciseTimer);
+		timer->setInterval(framing);
+		connect(timer, &QTimer::timeout, this, [this, framing]() { speak(framing); });
+		timer->start();
+		m_timers << timer;
+	}
+
+	QTimer *timer = new QTimer(this);
+	timer->setInterval(PING_INTERVAL);
+	connect(timer, &QTimer::timeout, this, &LoadWorker::ping);
+	timer->start();
+	m_timers << timer;
+
+	if (m_config.hopInterval > 0) {
+		timer = new QTimer(this);
+		timer->setInterval(HOP_INTERVAL);
+		connect(timer, &QTimer::timeout, this, &LoadWorker::hop);
+		timer->start();
+		m_timers << timer;
+	}
+
+	timer = new QTimer(this);
+	timer->setInterval(PUBLISH_INTERVAL);
+	connect(timer, &QTimer::timeout, this, &LoadWorker::publishStatistics);
+	timer->start();
+	m_timers << timer;
+}
+
+void LoadWorker::stop() {
+	if (m_connectTimer) {
+		m_connectTimer->stop();
+	}
+	for (QTimer *timer : m_timers) {
+		timer->stop();
+	}
+
+	publishStatistics();
+
+	qDeleteAll(m_clients);
+	m_clients.clear();
+	m_synchronizedClients.store(0, std::memory_order_relaxed);
+}
+
+void LoadWorker::connectNext() {
+	if (m_clients.size() >= m_users.size()) {
+		m_connectTimer->stop();
+		return;
+	}
+
+	const int user = m_users[m_clients.size()];
+
+	// The speakers are spread evenly across the framings and the different kinds of targets
+	int framing               = 0;
+	LoadClient::Target target = LoadClient::Target::Normal;
+	if (user < m_config.speakers) {
+		framing = m_config.framings[user % m_config.framings.size()];
+
+		const int slot = user * 100 / m_config.speakers;
+		if (slot < m_config.whisperPercent) {
+			target = LoadClient::Target::Whisper;
+		} else if (slot < m_config.whisperPercent + m_config.shoutPercent) {
+			target = LoadClient::Target::Shout;
+		}
+	}
+	const bool useUdp = user * 100 / m_config.clients >= m_config.tcpPercent;
+
+	// The first client of every worker keeps track of the server's users and channels for all of them
+	LoadClient *client = new LoadClient(m_config, QString::fromLatin1("%1-%2").arg(m_config.namePrefix).arg(user),
+										framing, target, useUdp, m_localStatistics, m_view, m_clients.isEmpty(), this);
+	connect(client, &LoadClient::synchronized, this, &LoadWorker::clientSynchronized);
+	connect(client, &LoadClient::disconnected, this, &LoadWorker::clientDisconnected);
+
+	m_clients << client;
+	client->connectToServer();
+}
+
+void LoadWorker::speak(int framing) {
+	for (LoadClient *client : m_clients) {
+		if (client->framing() == framing) {
+			client->speak();
+		}
+	}
+}
+
+void LoadWorker::ping() {
+	for (LoadClient *client : m_clients) {
+		client->ping();
+		// Whisper to the users that have connected (or stay away from the ones that have left) in the meantime
+		client->updateVoiceTarget();
+	}
+}
+
+void LoadWorker::hop() {
+	std::bernoulli_distribution hopping(1.0 / m_config.hopInterval);
+
+	for (LoadClient *client : m_clients) {
+		if (hopping(m_random)) {
+			client->hop();
+		}
+	}
+}
+
+void LoadWorker::publishStatistics() {
+	QMutexLocker lock(&m_statisticsMutex);
+
+	m_statistics.merge(m_localStatistics);
+	m_localStatistics.clear();
+}
+
+void LoadWorker::clientSynchronized() {
+	m_synchronizedClients.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoadWorker::clientDisconnected(const QString &reason) {
+	LoadClient *client = qobject_cast< LoadClient * >(sender());
+
+	qWarning("%s: Disconnected: %s", qPrintable(client ? client->objectName() : QString()), qPrintable(reason));
+
+	const auto synchronized = std::count_if(m_clients.cbegin(), m_clients.cend(),
+											[](const LoadClient *c) { return c->isSynchronized(); });
+	m_synchronizedClients.store(static_cast< int >(synchronized), std::memory_order_relaxed);
+}
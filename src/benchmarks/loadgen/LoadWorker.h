@@ -0,0 +1,77 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_LOADGEN_LOADWORKER_H_
+#define MUMBLE_LOADGEN_LOADWORKER_H_
+
+#include "LoadClient.h"
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+
+#include <atomic>
+#include <random>
+
+class QTimer;
+
+/// The clients a single thread takes care of. All of them are driven by a handful of timers of the worker, instead of
+/// each of them having a thread (or even timers) of its own, so that a single process can simulate thousands of users.
+class LoadWorker : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(LoadWorker)
+
+public:
+	/// @param index The index of the worker, which determines which of the simulated users it takes care of
+	LoadWorker(const LoadConfig &config, int index, QObject *parent = nullptr);
+	~LoadWorker() override;
+
+	/// @returns The statistics collected since the last call (thread-safe)
+	LoadStatistics takeStatistics();
+	/// @returns The amount of clients that are connected to the server (thread-safe)
+	int synchronizedClients() const;
+
+public slots:
+	/// Starts connecting the clients
+	void start();
+	/// Disconnects all clients
+	void stop();
+
+protected slots:
+	void connectNext();
+	void speak(int framing);
+	void ping();
+	void hop();
+	void publishStatistics();
+	void clientSynchronized();
+	void clientDisconnected(const QString &reason);
+
+protected:
+	/// The time (in milliseconds) between publishing the statistics collected by the clients
+	static constexpr int PUBLISH_INTERVAL = 250;
+	static constexpr int PING_INTERVAL    = 5000;
+	static constexpr int HOP_INTERVAL     = 1000;
+
+	const LoadConfig &m_config;
+	int m_index;
+
+	/// The indices (among all simulated users) of the clients of this worker
+	QList< int > m_users;
+	QList< LoadClient * > m_clients;
+	QList< QTimer * > m_timers;
+	QTimer *m_connectTimer = nullptr;
+
+	ServerView m_view;
+	/// Only ever accessed by the worker's thread
+	LoadStatistics m_localStatistics;
+	std::mt19937 m_random;
+
+	mutable QMutex m_statisticsMutex;
+	LoadStatistics m_statistics;
+	std::atomic< int > m_synchronizedClients;
+};
+
+#endif // MUMBLE_LOADGEN_LOADWORKER_H_
@@ -0,0 +1,188 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+/**
+ * Simulates a configurable amount of users connecting to a server and speaking, and reports the server's throughput,
+ * the latency of the audio packets and the fraction of packets that got lost.
+ */
+
+#include "LoadWorker.h"
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtNetwork/QHostInfo>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+/// Prints the statistics collected over the given amount of seconds
+static void report(const LoadStatistics &statistics, int connected, double seconds) {
+	// Packets can be received more than once (e.g. by a user that just changed channels)
+	const quint64 lost = statistics.expected - std::min(statistics.expected, statistics.received);
+	const double loss  = statistics.expected > 0
+							? 100.0 * static_cast< double >(lost) / static_cast< double >(statistics.expected)
+							: 0.0;
+
+	std::printf("%6d connected  %9.0f sent/s  %9.0f recv/s  latency (ms) p50 %7.2f  p90 %7.2f  p99 %7.2f  p99.9 %7.2f  "
+				"max %7.2f  loss %5.2f%%\n",
+				connected, static_cast< double >(statistics.sent) / seconds,
+				static_cast< double >(statistics.received) / seconds, statistics.latency.percentile(0.5) / 1000.0,
+				statistics.latency.percentile(0.9) / 1000.0, statistics.latency.percentile(0.99) / 1000.0,
+				statistics.latency.percentile(0.999) / 1000.0, statistics.latency.max() / 1000.0, loss);
+	std::fflush(stdout);
+}
+
+static int parseInt(const QCommandLineParser &parser, const QString &option) {
+	bool ok;
+	const int value = parser.value(option).toInt(&ok);
+	if (!ok || value < 0) {
+		qFatal("Invalid value for --%s: %s", qPrintable(option), qPrintable(parser.value(option)));
+	}
+	return value;
+}
+
+int main(int argc, char **argv) {
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName(QLatin1String("murmur_loadgen"));
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QLatin1String("Generates voice traffic against a Mumble server"));
+	parser.addHelpOption();
+	parser.addPositionalArgument(QLatin1String("host"), QLatin1String("The server to connect to"));
+	parser.addOptions({
+		{ { QLatin1String("p"), QLatin1String("port") }, QLatin1String("The server's port"), QLatin1String("port"),
+		  QLatin1String("64738") },
+		{ QLatin1String("password"), QLatin1String("The server password"), QLatin1String("password") },
+		{ { QLatin1String("c"), QLatin1String("clients") }, QLatin1String("The amount of simulated users"),
+		  QLatin1String("count"), QLatin1String("100") },
+		{ { QLatin1String("s"), QLatin1String("speakers") }, QLatin1String("The amount of users that speak"),
+		  QLatin1String("count"), QLatin1String("10") },
+		{ { QLatin1String("t"), QLatin1String("threads") }, QLatin1String("The amount of threads to spread users over"),
+		  QLatin1String("count"), QString::number(std::max(1, QThread::idealThreadCount() / 2)) },
+		{ QLatin1String("framing"), QLatin1String("Comma-separated audio framings (in ms) to spread speakers over"),
+		  QLatin1String("ms"), QLatin1String("20") },
+		{ QLatin1String("whisper"), QLatin1String("The percentage of speakers that whisper to a few users"),
+		  QLatin1String("percent"), QLatin1String("0") },
+		{ QLatin1String("shout"), QLatin1String("The percentage of speakers that shout to their channel's subtree"),
+		  QLatin1String("percent"), QLatin1String("0") },
+		{ QLatin1String("tcp"), QLatin1String("The percentage of users that tunnel their audio through TCP"),
+		  QLatin1String("percent"), QLatin1String("0") },
+		{ QLatin1String("hop"), QLatin1String("The average time between two channel changes of a user (0 = never)"),
+		  QLatin1String("seconds"), QLatin1String("0") },
+		{ QLatin1String("payload"), QLatin1String("The size of the audio payload of every packet"),
+		  QLatin1String("bytes"), QLatin1String("60") },
+		{ QLatin1String("rate"), QLatin1String("The amount of users that connect per second"), QLatin1String("count"),
+		  QLatin1String("100") },
+		{ { QLatin1String("d"), QLatin1String("duration") }, QLatin1String("How long to run for (0 = until killed)"),
+		  QLatin1String("seconds"), QLatin1String("0") },
+		{ QLatin1String("interval"), QLatin1String("The time between two reports"), QLatin1String("seconds"),
+		  QLatin1String("5") },
+	});
+	parser.process(app);
+
+	if (parser.positionalArguments().size() != 1) {
+		parser.showHelp(1);
+	}
+
+	LoadConfig config;
+
+	const QHostInfo hostInfo = QHostInfo::fromName(parser.positionalArguments().first());
+	if (hostInfo.addresses().isEmpty()) {
+		qFatal("Unable to resolve %s: %s", qPrintable(hostInfo.hostName()), qPrintable(hostInfo.errorString()));
+	}
+	config.host           = hostInfo.addresses().first();
+	config.port           = static_cast< quint16 >(parseInt(parser, QLatin1String("port")));
+	config.password       = parser.value(QLatin1String("password"));
+	config.clients        = parseInt(parser, QLatin1String("clients"));
+	config.speakers       = std::min(config.clients, parseInt(parser, QLatin1String("speakers")));
+	config.threads        = std::max(1, std::min(config.clients, parseInt(parser, QLatin1String("threads"))));
+	config.whisperPercent = parseInt(parser, QLatin1String("whisper"));
+	config.shoutPercent   = parseInt(parser, QLatin1String("shout"));
+	config.tcpPercent     = parseInt(parser, QLatin1String("tcp"));
+	config.hopInterval    = parseInt(parser, QLatin1String("hop"));
+	config.payloadSize    = parseInt(parser, QLatin1String("payload"));
+	config.connectRate    = std::max(1, parseInt(parser, QLatin1String("rate")));
+
+	config.framings.clear();
+	for (const QString &framing : parser.value(QLatin1String("framing")).split(QLatin1Char(','))) {
+		bool ok;
+		const int value = framing.toInt(&ok);
+		if (!ok || value <= 0) {
+			qFatal("Invalid framing: %s", qPrintable(framing));
+		}
+		config.framings << value;
+	}
+
+	const int duration = parseInt(parser, QLatin1String("duration"));
+	const int interval = std::max(1, parseInt(parser, QLatin1String("interval")));
+
+	std::vector< QThread * > threads;
+	std::vector< LoadWorker * > workers;
+	for (int i = 0; i < config.threads; ++i) {
+		QThread *thread    = new QThread();
+		LoadWorker *worker = new LoadWorker(config, i);
+		worker->moveToThread(thread);
+		QObject::connect(thread, &QThread::started, worker, &LoadWorker::start);
+
+		threads.push_back(thread);
+		workers.push_back(worker);
+	}
+
+	LoadStatistics total;
+	QElapsedTimer elapsed;
+	QElapsedTimer sinceReport;
+
+	auto collect = [&]() {
+		LoadStatistics statistics;
+		int connected = 0;
+		for (LoadWorker *worker : workers) {
+			statistics.merge(worker->takeStatistics());
+			connected += worker->synchronizedClients();
+		}
+
+		report(statistics, connected, static_cast< double >(sinceReport.restart()) / 1000.0);
+		total.merge(statistics);
+	};
+
+	QTimer reportTimer;
+	reportTimer.setInterval(interval * 1000);
+	QObject::connect(&reportTimer, &QTimer::timeout, collect);
+
+	QObject::connect(&app, &QCoreApplication::aboutToQuit, [&]() {
+		reportTimer.stop();
+
+		for (LoadWorker *worker : workers) {
+			QMetaObject::invokeMethod(worker, &LoadWorker::stop, Qt::BlockingQueuedConnection);
+		}
+		collect();
+
+		std::printf("\nTotal over %.1f s:\n", static_cast< double >(elapsed.elapsed()) / 1000.0);
+		report(total, 0, static_cast< double >(elapsed.elapsed()) / 1000.0);
+
+		for (std::size_t i = 0; i < threads.size(); ++i) {
+			threads[i]->quit();
+			threads[i]->wait();
+			delete workers[i];
+			delete threads[i];
+		}
+	});
+
+	if (duration > 0) {
+		QTimer::singleShot(duration * 1000, &app, &QCoreApplication::quit);
+	}
+
+	elapsed.start();
+	sinceReport.start();
+	reportTimer.start();
+	for (QThread *thread : threads) {
+		thread->start();
+	}
+
+	return app.exec();
+}
@@ -6,6 +6,7 @@
 #include <benchmark/benchmark.h>
 
 #include "MumbleProtocol.h"
+#include "MumbleUDP.pb.h"
 #include "PacketDataStream.h"
 
 #include <limits>
@@ -28,6 +29,9 @@ Mumble::Protocol::AudioData audioData;
 
 Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > encoder;
 
+std::vector< Mumble::Protocol::byte > encodedLegacy;
+std::vector< Mumble::Protocol::byte > encodedNew;
+
 class Fixture : public ::benchmark::Fixture {
 public:
 	void SetUp(const ::benchmark::State &state) {
@@ -47,9 +51,11 @@ public:
 		audioData.containsPositionalData = true;
 
 		encoder.setProtocolVersion(Version::fromComponents(1, 3, 0));
-		encoder.encodeAudioPacket(audioData);
+		gsl::span< const Mumble::Protocol::byte > encoded = encoder.encodeAudioPacket(audioData);
+		encodedLegacy.assign(encoded.begin(), encoded.end());
 		encoder.setProtocolVersion(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
-		encoder.encodeAudioPacket(audioData);
+		encoded = encoder.encodeAudioPacket(audioData);
+		encodedNew.assign(encoded.begin(), encoded.end());
 	}
 };
 
@@ -127,5 +133,46 @@ BENCHMARK_REGISTER_F(Fixture, BM_encodeNew_UpdateOnly)
 	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
 	->Range(FROM_PAYLOAD_SIZE, TO_PAYLOAD_SIZE);
 
+BENCHMARK_DEFINE_F(Fixture, BM_decodeLegacy)(::benchmark::State &state) {
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > decoder(Version::fromComponents(1, 3, 0));
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(decoder.decode(encodedLegacy));
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_decodeLegacy)
+	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
+	->Range(FROM_PAYLOAD_SIZE, TO_PAYLOAD_SIZE);
+
+BENCHMARK_DEFINE_F(Fixture, BM_decodeNew)(::benchmark::State &state) {
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > decoder(
+		Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(decoder.decode(encodedNew));
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_decodeNew)
+	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
+	->Range(FROM_PAYLOAD_SIZE, TO_PAYLOAD_SIZE);
+
+/// The way UDPDecoder used to decode audio packets in the new format: parsing them into a Protobuf object
+BENCHMARK_DEFINE_F(Fixture, BM_decodeNew_ProtobufObject)(::benchmark::State &state) {
+	MumbleUDP::Audio message;
+
+	for (auto _ : state) {
+		// Skip the header byte
+		benchmark::DoNotOptimize(
+			message.ParseFromArray(encodedNew.data() + 1, static_cast< int >(encodedNew.size() - 1)));
+		benchmark::DoNotOptimize(message.opus_data().data());
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_decodeNew_ProtobufObject)
+	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
+	->Range(FROM_PAYLOAD_SIZE, TO_PAYLOAD_SIZE);
+
 
 BENCHMARK_MAIN();
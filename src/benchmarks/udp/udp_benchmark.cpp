@@ -0,0 +1,485 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "HostAddress.h"
+#include "MumbleProtocol.h"
+#include "UDPBatch.h"
+#include "VoiceEventLoop.h"
+#include "crypto/CryptStateOCB2.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// These benchmarks mimic the UDP voice path of the server on the loopback interface: every received datagram
+// is forwarded once per receiver (the fan-out of a single speaker to a channel).
+
+constexpr const std::size_t PACKET_SIZE      = 80;
+constexpr const std::size_t FANOUT           = 8;
+constexpr const std::size_t SENDER_SOCKETS   = 64;
+constexpr const std::size_t PACKETS_PER_SEND = 256;
+constexpr const int IDLE_TIMEOUT_MS          = 50;
+constexpr const int RECEIVE_BUFFER_SIZE      = 8 * 1024 * 1024;
+
+constexpr const int WORKER_RANGE = 0;
+constexpr const int FANOUT_RANGE = 0;
+constexpr const int BACKEND_RANGE = 0;
+constexpr const int PACKET_RANGE  = 1;
+
+static int createSocket(bool reusePort) {
+	int sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+
+	int val = 1;
+	if (reusePort) {
+		setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val));
+	}
+
+	val = RECEIVE_BUFFER_SIZE;
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val));
+
+	return sock;
+}
+
+static sockaddr_in loopbackAddress(unsigned short port = 0) {
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port        = htons(port);
+
+	return addr;
+}
+
+/// Opens one SO_REUSEPORT socket per worker, all bound to the same (random) port on the loopback interface
+static std::vector< int > bindWorkerSockets(std::size_t workers, unsigned short &port) {
+	std::vector< int > sockets;
+
+	sockaddr_in addr = loopbackAddress(0);
+	for (std::size_t i = 0; i < workers; ++i) {
+		int sock = createSocket(true);
+
+		if (::bind(sock, reinterpret_cast< sockaddr * >(&addr), sizeof(addr)) != 0) {
+			::close(sock);
+			break;
+		}
+
+		if (i == 0) {
+			socklen_t len = sizeof(addr);
+			getsockname(sock, reinterpret_cast< sockaddr * >(&addr), &len);
+			port = ntohs(addr.sin_port);
+		}
+
+		sockets.push_back(sock);
+	}
+
+	return sockets;
+}
+
+static void processPacket(CryptStateOCB2 &decryptState, CryptStateOCB2 &encryptState, const unsigned char *data,
+						  unsigned int len) {
+	unsigned char plain[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+	unsigned char encrypted[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 4];
+
+	// The packets aren't actually encrypted with this key, so this will fail. It still does all of the work though.
+	benchmark::DoNotOptimize(decryptState.decrypt(data, plain, len));
+
+	for (std::size_t i = 0; i < FANOUT; ++i) {
+		encryptState.encrypt(data, encrypted, len - 4);
+		benchmark::DoNotOptimize(encrypted);
+	}
+}
+
+using clock_type = std::chrono::steady_clock;
+
+static void receiveLoop(int sock, const std::atomic< bool > &sendingDone, std::atomic< std::size_t > &processed,
+						clock_type::time_point &lastProcessed) {
+	CryptStateOCB2 decryptState;
+	CryptStateOCB2 encryptState;
+	decryptState.genKey();
+	encryptState.genKey();
+
+	unsigned char buffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+
+	pollfd fd;
+	fd.fd     = sock;
+	fd.events = POLLIN;
+
+	std::size_t count = 0;
+	while (true) {
+		fd.revents = 0;
+		if (poll(&fd, 1, IDLE_TIMEOUT_MS) <= 0) {
+			if (sendingDone.load()) {
+				break;
+			}
+			continue;
+		}
+
+		ssize_t len = ::recv(sock, buffer, sizeof(buffer), MSG_DONTWAIT);
+		if (len > 4) {
+			processPacket(decryptState, encryptState, buffer, static_cast< unsigned int >(len));
+			++count;
+			lastProcessed = clock_type::now();
+		}
+	}
+
+	processed += count;
+}
+
+static void sendLoop(unsigned short port, std::size_t senders) {
+	std::vector< int > sockets;
+	sockaddr_in addr = loopbackAddress(port);
+
+	for (std::size_t i = 0; i < senders; ++i) {
+		// Every socket gets its own source port, which is what the kernel's SO_REUSEPORT hash is based on
+		int sock = createSocket(false);
+		::connect(sock, reinterpret_cast< sockaddr * >(&addr), sizeof(addr));
+		sockets.push_back(sock);
+	}
+
+	unsigned char packet[PACKET_SIZE];
+	memset(packet, 0x42, sizeof(packet));
+
+	for (std::size_t i = 0; i < PACKETS_PER_SEND; ++i) {
+		for (int sock : sockets) {
+			::send(sock, packet, sizeof(packet), 0);
+		}
+	}
+
+	for (int sock : sockets) {
+		::close(sock);
+	}
+}
+
+/// Distributes the datagrams of many clients over a varying amount of SO_REUSEPORT workers, each of which decrypts
+/// every datagram and re-encrypts it once per receiver
+static void BM_reusePortWorkers(::benchmark::State &state) {
+	const std::size_t workers = static_cast< std::size_t >(state.range(WORKER_RANGE));
+
+	unsigned short port              = 0;
+	const std::vector< int > sockets = bindWorkerSockets(workers, port);
+	if (sockets.size() != workers) {
+		for (int sock : sockets) {
+			::close(sock);
+		}
+		state.SkipWithError("Failed to bind SO_REUSEPORT sockets");
+		return;
+	}
+
+	std::size_t totalSent = 0;
+	std::atomic< std::size_t > processed(0);
+
+	for (auto _ : state) {
+		std::atomic< bool > sendingDone(false);
+		std::vector< clock_type::time_point > lastProcessed(workers);
+
+		const clock_type::time_point start = clock_type::now();
+
+		std::vector< std::thread > receivers;
+		for (std::size_t i = 0; i < workers; ++i) {
+			lastProcessed[i] = start;
+			receivers.emplace_back(receiveLoop, sockets[i], std::cref(sendingDone), std::ref(processed),
+								   std::ref(lastProcessed[i]));
+		}
+
+		// Use as many sending threads as there are workers, so that the sending side doesn't become the bottleneck
+		std::vector< std::thread > senders;
+		for (std::size_t i = 0; i < workers; ++i) {
+			senders.emplace_back(sendLoop, port, SENDER_SOCKETS / workers + 1);
+			totalSent += (SENDER_SOCKETS / workers + 1) * PACKETS_PER_SEND;
+		}
+
+		for (std::thread &current : senders) {
+			current.join();
+		}
+		sendingDone = true;
+
+		for (std::thread &current : receivers) {
+			current.join();
+		}
+
+		// Don't account for the time the workers spent waiting for more packets after the last one
+		const clock_type::time_point end = *std::max_element(lastProcessed.begin(), lastProcessed.end());
+		state.SetIterationTime(std::chrono::duration< double >(end - start).count());
+	}
+
+	for (int sock : sockets) {
+		::close(sock);
+	}
+
+	// Reported as items_per_second (processed packets per second)
+	state.SetItemsProcessed(static_cast< int64_t >(processed.load()));
+	state.counters["loss"] =
+		totalSent > 0 ? 1.0 - static_cast< double >(processed.load()) / static_cast< double >(totalSent) : 0.0;
+}
+
+BENCHMARK(BM_reusePortWorkers)
+	->RangeMultiplier(2)
+	->Range(1, 16)
+	->UseManualTime()
+	->Unit(benchmark::kMillisecond);
+
+
+/// The sockets used by the batching benchmarks: the client sends datagrams to the server, which forwards each of them
+/// to the sink a given amount of times.
+struct BatchFixture {
+	int server;
+	int client;
+	int sink;
+	sockaddr_storage sinkAddress;
+	HostAddress serverAddress;
+
+	BatchFixture() {
+		sockaddr_in addr = loopbackAddress();
+
+		server = createSocket(false);
+		sink   = createSocket(false);
+		::bind(server, reinterpret_cast< sockaddr * >(&addr), sizeof(addr));
+		::bind(sink, reinterpret_cast< sockaddr * >(&addr), sizeof(addr));
+
+		sockaddr_storage serverStorage;
+		socklen_t len = sizeof(serverStorage);
+		getsockname(server, reinterpret_cast< sockaddr * >(&serverStorage), &len);
+		serverAddress = HostAddress(serverStorage);
+
+		len = sizeof(sinkAddress);
+		getsockname(sink, reinterpret_cast< sockaddr * >(&sinkAddress), &len);
+
+		client = createSocket(false);
+		::connect(client, reinterpret_cast< sockaddr * >(&serverStorage), sizeof(sockaddr_in));
+	}
+
+	~BatchFixture() {
+		::close(server);
+		::close(client);
+		::close(sink);
+	}
+
+	/// Queues UDPReceiveBatch::BATCH_SIZE datagrams on the server socket and empties the sink
+	void prepare() {
+		unsigned char packet[PACKET_SIZE];
+		memset(packet, 0x42, sizeof(packet));
+
+		for (std::size_t i = 0; i < UDPReceiveBatch::BATCH_SIZE; ++i) {
+			::send(client, packet, sizeof(packet), 0);
+		}
+
+		unsigned char buffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+		while (::recv(sink, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+		}
+	}
+};
+
+/// Handles every datagram with one poll, one recvmsg and one sendmsg per receiver (the way the voice thread used to)
+static void BM_unbatchedFanout(::benchmark::State &state) {
+	const std::size_t fanout = static_cast< std::size_t >(state.range(FANOUT_RANGE));
+
+	BatchFixture fixture;
+
+	std::size_t packets  = 0;
+	std::size_t syscalls = 0;
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		fixture.prepare();
+		state.ResumeTiming();
+
+		pollfd fd;
+		fd.fd     = fixture.server;
+		fd.events = POLLIN;
+
+		for (std::size_t i = 0; i < UDPReceiveBatch::BATCH_SIZE; ++i) {
+			fd.revents = 0;
+			poll(&fd, 1, IDLE_TIMEOUT_MS);
+
+			unsigned char buffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+			sockaddr_storage from;
+			iovec iov;
+			iov.iov_base = buffer;
+			iov.iov_len  = sizeof(buffer);
+
+			msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_name    = &from;
+			msg.msg_namelen = sizeof(from);
+			msg.msg_iov     = &iov;
+			msg.msg_iovlen  = 1;
+
+			ssize_t len = ::recvmsg(fixture.server, &msg, MSG_TRUNC);
+			syscalls += 2;
+
+			if (len <= 0) {
+				continue;
+			}
+			++packets;
+
+			for (std::size_t j = 0; j < fanout; ++j) {
+				uint8_t controldata[CMSG_SPACE(sizeof(struct in_pktinfo))];
+				memset(controldata, 0, sizeof(controldata));
+
+				msg.msg_name       = &fixture.sinkAddress;
+				msg.msg_namelen    = sizeof(sockaddr_in);
+				msg.msg_control    = controldata;
+				msg.msg_controllen = sizeof(controldata);
+				iov.iov_len        = static_cast< std::size_t >(len);
+
+				struct cmsghdr *cmsg         = CMSG_FIRSTHDR(&msg);
+				cmsg->cmsg_level             = IPPROTO_IP;
+				cmsg->cmsg_type              = IP_PKTINFO;
+				cmsg->cmsg_len               = CMSG_LEN(sizeof(struct in_pktinfo));
+				struct in_pktinfo *pktinfo   = reinterpret_cast< struct in_pktinfo * >(CMSG_DATA(cmsg));
+				pktinfo->ipi_spec_dst.s_addr = fixture.serverAddress.toIPv4();
+
+				::sendmsg(fixture.server, &msg, 0);
+				++syscalls;
+			}
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(packets));
+	state.counters["syscalls_per_packet"] =
+		packets > 0 ? static_cast< double >(syscalls) / static_cast< double >(packets) : 0.0;
+}
+
+/// Handles all queued datagrams with one poll and one recvmmsg and sends the entire fan-out using sendmmsg
+static void BM_batchedFanout(::benchmark::State &state) {
+	const std::size_t fanout = static_cast< std::size_t >(state.range(FANOUT_RANGE));
+
+	BatchFixture fixture;
+	UDPReceiveBatch receiveBatch;
+	UDPSendBatch sendBatch;
+
+	std::size_t packets  = 0;
+	std::size_t syscalls = 0;
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		fixture.prepare();
+		state.ResumeTiming();
+
+		pollfd fd;
+		fd.fd     = fixture.server;
+		fd.events = POLLIN;
+
+		std::size_t received = 0;
+		while (received < UDPReceiveBatch::BATCH_SIZE) {
+			fd.revents = 0;
+			poll(&fd, 1, IDLE_TIMEOUT_MS);
+
+			const std::size_t count = receiveBatch.receive(fixture.server);
+			syscalls += 2;
+
+			if (count == 0) {
+				break;
+			}
+
+			for (std::size_t i = 0; i < count; ++i) {
+				for (std::size_t j = 0; j < fanout; ++j) {
+					if (sendBatch.size() + 1 == UDPSendBatch::BATCH_SIZE) {
+						// This commit is going to flush the batch
+						++syscalls;
+					}
+
+					memcpy(sendBatch.getBuffer(), receiveBatch.getData(i), receiveBatch.getLength(i));
+					sendBatch.commit(fixture.server, fixture.sinkAddress, fixture.serverAddress,
+									 receiveBatch.getLength(i));
+				}
+			}
+
+			syscalls += sendBatch.flush();
+
+			received += count;
+		}
+
+		packets += received;
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(packets));
+	state.counters["syscalls_per_packet"] =
+		packets > 0 ? static_cast< double >(syscalls) / static_cast< double >(packets) : 0.0;
+}
+
+BENCHMARK(BM_unbatchedFanout)->RangeMultiplier(4)->Range(1, 64);
+BENCHMARK(BM_batchedFanout)->RangeMultiplier(4)->Range(1, 64);
+
+/// Measures how long it takes the voice event loop backends to deliver a given amount of queued datagrams
+static void BM_eventLoop(::benchmark::State &state) {
+	const VoiceEventLoop::Backend backend = static_cast< VoiceEventLoop::Backend >(state.range(BACKEND_RANGE));
+	const std::size_t count               = static_cast< std::size_t >(state.range(PACKET_RANGE));
+
+	state.SetLabel(VoiceEventLoop::toString(backend));
+
+	BatchFixture fixture;
+
+	int notify[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, notify) != 0) {
+		state.SkipWithError("Failed to create notify sockets");
+		return;
+	}
+
+	std::unique_ptr< VoiceEventLoop > loop = VoiceEventLoop::create(backend, { fixture.server }, notify[0]);
+	if (!loop) {
+		::close(notify[0]);
+		::close(notify[1]);
+		state.SkipWithError("Backend not available");
+		return;
+	}
+
+	unsigned char packet[PACKET_SIZE];
+	memset(packet, 0x42, sizeof(packet));
+
+	std::size_t packets = 0;
+	std::size_t wakeups = 0;
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		for (std::size_t i = 0; i < count; ++i) {
+			::send(fixture.client, packet, sizeof(packet), 0);
+		}
+		state.ResumeTiming();
+
+		std::size_t received = 0;
+		while (received < count) {
+			if (loop->wait() != VoiceEventLoop::Status::Ready) {
+				break;
+			}
+			++wakeups;
+
+			for (const ReceivedDatagram &datagram : loop->getDatagrams()) {
+				benchmark::DoNotOptimize(datagram.data[0]);
+			}
+			received += loop->getDatagrams().size();
+		}
+
+		packets += received;
+	}
+
+	loop.reset();
+	::close(notify[0]);
+	::close(notify[1]);
+
+	state.SetItemsProcessed(static_cast< int64_t >(packets));
+	state.counters["packets_per_wakeup"] =
+		wakeups > 0 ? static_cast< double >(packets) / static_cast< double >(wakeups) : 0.0;
+}
+
+BENCHMARK(BM_eventLoop)
+	->ArgsProduct({ { static_cast< int64_t >(VoiceEventLoop::Backend::Poll),
+					  static_cast< int64_t >(VoiceEventLoop::Backend::Epoll),
+					  static_cast< int64_t >(VoiceEventLoop::Backend::IoUring) },
+					{ 1, 16, 128 } });
+
+
+BENCHMARK_MAIN();
@@ -25,17 +25,20 @@
 #include "CryptStateOCB2.h"
 #include "CryptographicRandom.h"
 
+#include <algorithm>
 #include <cstring>
 #include <openssl/rand.h>
 
-CryptStateOCB2::CryptStateOCB2()
+CryptStateOCB2::CryptStateOCB2(bool allowHardwareAES)
 	: CryptState(), enc_ctx_ocb_enc(EVP_CIPHER_CTX_new()), dec_ctx_ocb_enc(EVP_CIPHER_CTX_new()),
-	  enc_ctx_ocb_dec(EVP_CIPHER_CTX_new()), dec_ctx_ocb_dec(EVP_CIPHER_CTX_new()) {
+	  enc_ctx_ocb_dec(EVP_CIPHER_CTX_new()), dec_ctx_ocb_dec(EVP_CIPHER_CTX_new()),
+	  m_useHardwareAES(allowHardwareAES && HardwareAES::isSupported()) {
 	for (int i = 0; i < 0x100; i++)
 		decrypt_history[i] = 0;
 	memset(raw_key, 0, AES_KEY_SIZE_BYTES);
 	memset(encrypt_iv, 0, AES_BLOCK_SIZE);
 	memset(decrypt_iv, 0, AES_BLOCK_SIZE);
+	keyChanged();
 }
 
 CryptStateOCB2::~CryptStateOCB2() noexcept {
@@ -49,10 +52,21 @@ bool CryptStateOCB2::isValid() const {
 	return bInit;
 }
 
+bool CryptStateOCB2::usesHardwareAES() const {
+	return m_useHardwareAES;
+}
+
+void CryptStateOCB2::keyChanged() {
+	if (m_useHardwareAES) {
+		m_hardwareAES.setKey(raw_key);
+	}
+}
+
 void CryptStateOCB2::genKey() {
 	CryptographicRandom::fillBuffer(raw_key, AES_KEY_SIZE_BYTES);
 	CryptographicRandom::fillBuffer(encrypt_iv, AES_BLOCK_SIZE);
 	CryptographicRandom::fillBuffer(decrypt_iv, AES_BLOCK_SIZE);
+	keyChanged();
 	bInit = true;
 }
 
@@ -61,6 +75,7 @@ bool CryptStateOCB2::setKey(const std::string &rkey, const std::string &eiv, con
 		memcpy(raw_key, rkey.data(), AES_KEY_SIZE_BYTES);
 		memcpy(encrypt_iv, eiv.data(), AES_BLOCK_SIZE);
 		memcpy(decrypt_iv, div.data(), AES_BLOCK_SIZE);
+		keyChanged();
 		bInit = true;
 		return true;
 	}
@@ -70,6 +85,7 @@ bool CryptStateOCB2::setKey(const std::string &rkey, const std::string &eiv, con
 bool CryptStateOCB2::setRawKey(const std::string &rkey) {
 	if (rkey.length() == AES_KEY_SIZE_BYTES) {
 		memcpy(raw_key, rkey.data(), AES_KEY_SIZE_BYTES);
+		keyChanged();
 		return true;
 	}
 	return false;
@@ -289,64 +305,110 @@ static void inline ZERO(keyblock &block) {
 		EVP_DecryptFinal_ex(dec_ctx, reinterpret_cast< unsigned char * >((dst) + outlen), &outlen); \
 	}
 
-#define AESencrypt(src, dst, key) AESencrypt_ctx(src, dst, key, enc_ctx_ocb_enc)
-#define AESdecrypt(src, dst, key) AESdecrypt_ctx(src, dst, key, dec_ctx_ocb_enc)
+void CryptStateOCB2::aesEncrypt(const unsigned char *source, unsigned char *destination, unsigned int blocks,
+								EVP_CIPHER_CTX *ctx) {
+	if (m_useHardwareAES) {
+		m_hardwareAES.encrypt(source, destination, blocks);
+		return;
+	}
+
+	for (unsigned int i = 0; i < blocks; ++i) {
+		AESencrypt_ctx(source + i * AES_BLOCK_SIZE, destination + i * AES_BLOCK_SIZE, raw_key, ctx);
+	}
+}
+
+void CryptStateOCB2::aesDecrypt(const unsigned char *source, unsigned char *destination, unsigned int blocks,
+								EVP_CIPHER_CTX *ctx) {
+	if (m_useHardwareAES) {
+		m_hardwareAES.decrypt(source, destination, blocks);
+		return;
+	}
+
+	for (unsigned int i = 0; i < blocks; ++i) {
+		AESdecrypt_ctx(source + i * AES_BLOCK_SIZE, destination + i * AES_BLOCK_SIZE, raw_key, ctx);
+	}
+}
+
+// The amount of blocks passed to aesEncrypt/aesDecrypt at once
+constexpr static const unsigned int PIPELINE_BLOCKS = HardwareAES::PIPELINE_BLOCKS;
+
+#define AESencrypt(src, dst, blocks)                                                                             \
+	aesEncrypt(reinterpret_cast< const unsigned char * >(src), reinterpret_cast< unsigned char * >(dst), blocks, \
+			   enc_ctx_ocb_enc)
+#define AESdecrypt(src, dst, blocks)                                                                             \
+	aesDecrypt(reinterpret_cast< const unsigned char * >(src), reinterpret_cast< unsigned char * >(dst), blocks, \
+			   dec_ctx_ocb_enc)
 
 bool CryptStateOCB2::ocb_encrypt(const unsigned char *plain, unsigned char *encrypted, unsigned int len,
 								 const unsigned char *nonce, unsigned char *tag, bool modifyPlainOnXEXStarAttack) {
 	keyblock checksum, delta, tmp, pad;
+	keyblock deltas[PIPELINE_BLOCKS], tmps[PIPELINE_BLOCKS];
 	bool success = true;
 
 	// Initialize
-	AESencrypt(nonce, delta, raw_key);
+	AESencrypt(nonce, delta, 1);
 	ZERO(checksum);
 
 	while (len > AES_BLOCK_SIZE) {
-		// Counter-cryptanalysis described in section 9 of https://eprint.iacr.org/2019/311
-		// For an attack, the second to last block (i.e. the last iteration of this loop)
-		// must be all 0 except for the last byte (which may be 0 - 128).
-		bool flipABit = false; // *plain is const, so we can't directly modify it
-		if (len - AES_BLOCK_SIZE <= AES_BLOCK_SIZE) {
-			unsigned char sum = 0;
-			for (int i = 0; i < AES_BLOCK_SIZE - 1; ++i) {
-				sum |= plain[i];
-			}
-			if (sum == 0) {
-				if (modifyPlainOnXEXStarAttack) {
-					// The assumption that critical packets do not turn up by pure chance turned out to be incorrect
-					// since digital silence appears to produce them in mass.
-					// So instead we now modify the packet in a way which should not affect the audio but will
-					// prevent the attack.
-					flipABit = true;
-				} else {
-					// This option still exists but only to allow us to test ocb_decrypt's detection.
-					success = false;
+		// All full blocks but the last one of the message are independent of each other (apart from the cheap
+		// delta update), so several of them can be encrypted at once.
+		const unsigned int blocks = std::min((len - 1) / AES_BLOCK_SIZE, PIPELINE_BLOCKS);
+
+		for (unsigned int i = 0; i < blocks; ++i) {
+			const unsigned char *block   = plain + i * AES_BLOCK_SIZE;
+			const unsigned int remaining = len - i * AES_BLOCK_SIZE;
+
+			// Counter-cryptanalysis described in section 9 of https://eprint.iacr.org/2019/311
+			// For an attack, the second to last block (i.e. the last iteration of this loop)
+			// must be all 0 except for the last byte (which may be 0 - 128).
+			bool flipABit = false; // *plain is const, so we can't directly modify it
+			if (remaining - AES_BLOCK_SIZE <= AES_BLOCK_SIZE) {
+				unsigned char sum = 0;
+				for (int j = 0; j < AES_BLOCK_SIZE - 1; ++j) {
+					sum |= block[j];
+				}
+				if (sum == 0) {
+					if (modifyPlainOnXEXStarAttack) {
+						// The assumption that critical packets do not turn up by pure chance turned out to be
+						// incorrect since digital silence appears to produce them in mass.
+						// So instead we now modify the packet in a way which should not affect the audio but will
+						// prevent the attack.
+						flipABit = true;
+					} else {
+						// This option still exists but only to allow us to test ocb_decrypt's detection.
+						success = false;
+					}
 				}
 			}
-		}
 
-		S2(delta);
-		XOR(tmp, delta, reinterpret_cast< const subblock * >(plain));
-		if (flipABit) {
-			*reinterpret_cast< unsigned char * >(tmp) ^= 1;
+			S2(delta);
+			memcpy(deltas[i], delta, AES_BLOCK_SIZE);
+			XOR(tmps[i], delta, reinterpret_cast< const subblock * >(block));
+			if (flipABit) {
+				*reinterpret_cast< unsigned char * >(tmps[i]) ^= 1;
+			}
+			XOR(checksum, checksum, reinterpret_cast< const subblock * >(block));
+			if (flipABit) {
+				*reinterpret_cast< unsigned char * >(checksum) ^= 1;
+			}
 		}
-		AESencrypt(tmp, tmp, raw_key);
-		XOR(reinterpret_cast< subblock * >(encrypted), delta, tmp);
-		XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain));
-		if (flipABit) {
-			*reinterpret_cast< unsigned char * >(checksum) ^= 1;
+
+		AESencrypt(tmps, tmps, blocks);
+
+		for (unsigned int i = 0; i < blocks; ++i) {
+			XOR(reinterpret_cast< subblock * >(encrypted + i * AES_BLOCK_SIZE), deltas[i], tmps[i]);
 		}
 
-		len -= AES_BLOCK_SIZE;
-		plain += AES_BLOCK_SIZE;
-		encrypted += AES_BLOCK_SIZE;
+		len -= blocks * AES_BLOCK_SIZE;
+		plain += blocks * AES_BLOCK_SIZE;
+		encrypted += blocks * AES_BLOCK_SIZE;
 	}
 
 	S2(delta);
 	ZERO(tmp);
 	tmp[BLOCKSIZE - 1] = SWAPPED(len * 8);
 	XOR(tmp, tmp, delta);
-	AESencrypt(tmp, pad, raw_key);
+	AESencrypt(tmp, pad, 1);
 	memcpy(tmp, plain, len);
 	memcpy(reinterpret_cast< unsigned char * >(tmp) + len, reinterpret_cast< const unsigned char * >(pad) + len,
 		   AES_BLOCK_SIZE - len);
@@ -356,7 +418,7 @@ bool CryptStateOCB2::ocb_encrypt(const unsigned char *plain, unsigned char *encr
 
 	S3(delta);
 	XOR(tmp, delta, checksum);
-	AESencrypt(tmp, tag, raw_key);
+	AESencrypt(tmp, tag, 1);
 
 	return success;
 }
@@ -364,34 +426,51 @@ bool CryptStateOCB2::ocb_encrypt(const unsigned char *plain, unsigned char *encr
 #undef AESencrypt
 #undef AESdecrypt
 
-#define AESencrypt(src, dst, key) AESencrypt_ctx(src, dst, key, enc_ctx_ocb_dec)
-#define AESdecrypt(src, dst, key) AESdecrypt_ctx(src, dst, key, dec_ctx_ocb_dec)
+#define AESencrypt(src, dst, blocks)                                                                             \
+	aesEncrypt(reinterpret_cast< const unsigned char * >(src), reinterpret_cast< unsigned char * >(dst), blocks, \
+			   enc_ctx_ocb_dec)
+#define AESdecrypt(src, dst, blocks)                                                                             \
+	aesDecrypt(reinterpret_cast< const unsigned char * >(src), reinterpret_cast< unsigned char * >(dst), blocks, \
+			   dec_ctx_ocb_dec)
 
 bool CryptStateOCB2::ocb_decrypt(const unsigned char *encrypted, unsigned char *plain, unsigned int len,
 								 const unsigned char *nonce, unsigned char *tag) {
 	keyblock checksum, delta, tmp, pad;
+	keyblock deltas[PIPELINE_BLOCKS], tmps[PIPELINE_BLOCKS];
 	bool success = true;
 
 	// Initialize
-	AESencrypt(nonce, delta, raw_key);
+	AESencrypt(nonce, delta, 1);
 	ZERO(checksum);
 
 	while (len > AES_BLOCK_SIZE) {
-		S2(delta);
-		XOR(tmp, delta, reinterpret_cast< const subblock * >(encrypted));
-		AESdecrypt(tmp, tmp, raw_key);
-		XOR(reinterpret_cast< subblock * >(plain), delta, tmp);
-		XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain));
-		len -= AES_BLOCK_SIZE;
-		plain += AES_BLOCK_SIZE;
-		encrypted += AES_BLOCK_SIZE;
+		// See ocb_encrypt
+		const unsigned int blocks = std::min((len - 1) / AES_BLOCK_SIZE, PIPELINE_BLOCKS);
+
+		for (unsigned int i = 0; i < blocks; ++i) {
+			S2(delta);
+			memcpy(deltas[i], delta, AES_BLOCK_SIZE);
+			XOR(tmps[i], delta, reinterpret_cast< const subblock * >(encrypted + i * AES_BLOCK_SIZE));
+		}
+
+		AESdecrypt(tmps, tmps, blocks);
+
+		for (unsigned int i = 0; i < blocks; ++i) {
+			subblock *block = reinterpret_cast< subblock * >(plain + i * AES_BLOCK_SIZE);
+			XOR(block, deltas[i], tmps[i]);
+			XOR(checksum, checksum, block);
+		}
+
+		len -= blocks * AES_BLOCK_SIZE;
+		plain += blocks * AES_BLOCK_SIZE;
+		encrypted += blocks * AES_BLOCK_SIZE;
 	}
 
 	S2(delta);
 	ZERO(tmp);
 	tmp[BLOCKSIZE - 1] = SWAPPED(len * 8);
 	XOR(tmp, tmp, delta);
-	AESencrypt(tmp, pad, raw_key);
+	AESencrypt(tmp, pad, 1);
 	memset(tmp, 0, AES_BLOCK_SIZE);
 	memcpy(tmp, encrypted, len);
 	XOR(tmp, tmp, pad);
@@ -409,13 +488,145 @@ bool CryptStateOCB2::ocb_decrypt(const unsigned char *encrypted, unsigned char *
 
 	S3(delta);
 	XOR(tmp, delta, checksum);
-	AESencrypt(tmp, tag, raw_key);
+	AESencrypt(tmp, tag, 1);
 
 	return success;
 }
 
 #undef AESencrypt
 #undef AESdecrypt
+
+void CryptStateOCB2::encryptBatch(CryptStateOCB2 *const *states, unsigned char *const *destinations, std::size_t count,
+								  const unsigned char *source, unsigned int plain_length) {
+	for (std::size_t start = 0; start < count; start += MAX_BATCH_SIZE) {
+		CryptStateOCB2 *const *batch            = states + start;
+		unsigned char *const *batchDestinations = destinations + start;
+		const std::size_t batchSize             = std::min(count - start, MAX_BATCH_SIZE);
+
+		if (!std::all_of(batch, batch + batchSize,
+						 [](const CryptStateOCB2 *state) { return state->m_useHardwareAES; })) {
+			// Without the AES instructions there is nothing to be gained from interleaving
+			for (std::size_t i = 0; i < batchSize; ++i) {
+				batch[i]->encrypt(source, batchDestinations[i], plain_length);
+			}
+			continue;
+		}
+
+		keyblock deltas[MAX_BATCH_SIZE], pads[MAX_BATCH_SIZE], tags[MAX_BATCH_SIZE];
+		HardwareAES::Block jobs[MAX_BATCH_SIZE * PIPELINE_BLOCKS];
+		std::size_t jobCount = 0;
+
+		auto addJob = [&](const CryptStateOCB2 *state, const void *src, void *dst) {
+			jobs[jobCount++] = { &state->m_hardwareAES, reinterpret_cast< const unsigned char * >(src),
+								 reinterpret_cast< unsigned char * >(dst) };
+		};
+		auto runJobs = [&]() {
+			HardwareAES::encrypt(jobs, jobCount);
+			jobCount = 0;
+		};
+
+		// The same steps as in encrypt() and ocb_encrypt(), but every AES operation is done for all states at once.
+		// Everything that only depends on the plaintext is computed once for the whole batch.
+		const unsigned int fullBlocks = plain_length > AES_BLOCK_SIZE ? (plain_length - 1) / AES_BLOCK_SIZE : 0;
+		const unsigned int remaining  = plain_length - fullBlocks * AES_BLOCK_SIZE;
+
+		// See ocb_encrypt. Only the last full block can be critical and it is always modified in that case.
+		bool flipABit = false;
+		keyblock plainChecksum;
+		ZERO(plainChecksum);
+		for (unsigned int i = 0; i < fullBlocks; ++i) {
+			XOR(plainChecksum, plainChecksum, reinterpret_cast< const subblock * >(source + i * AES_BLOCK_SIZE));
+		}
+		if (fullBlocks > 0) {
+			const unsigned char *block = source + (fullBlocks - 1) * AES_BLOCK_SIZE;
+			unsigned char sum          = 0;
+			for (int j = 0; j < AES_BLOCK_SIZE - 1; ++j) {
+				sum |= block[j];
+			}
+			flipABit = sum == 0;
+			if (flipABit) {
+				*reinterpret_cast< unsigned char * >(plainChecksum) ^= 1;
+			}
+		}
+
+		// Increase the IVs and encrypt them
+		for (std::size_t s = 0; s < batchSize; ++s) {
+			CryptStateOCB2 *state = batch[s];
+			for (int i = 0; i < AES_BLOCK_SIZE; i++)
+				if (++state->encrypt_iv[i])
+					break;
+
+			addJob(state, state->encrypt_iv, deltas[s]);
+		}
+		runJobs();
+
+		// Encrypt the full blocks, up to PIPELINE_BLOCKS of them per state at once
+		keyblock blockDeltas[MAX_BATCH_SIZE][PIPELINE_BLOCKS], tmps[MAX_BATCH_SIZE][PIPELINE_BLOCKS];
+		for (unsigned int first = 0; first < fullBlocks; first += PIPELINE_BLOCKS) {
+			const unsigned int blocks = std::min(fullBlocks - first, PIPELINE_BLOCKS);
+
+			// The states are iterated in the inner loop, so that consecutive delta updates don't depend on each other
+			for (unsigned int j = 0; j < blocks; ++j) {
+				for (std::size_t s = 0; s < batchSize; ++s) {
+					S2(deltas[s]);
+					memcpy(blockDeltas[s][j], deltas[s], AES_BLOCK_SIZE);
+					XOR(tmps[s][j], deltas[s],
+						reinterpret_cast< const subblock * >(source + (first + j) * AES_BLOCK_SIZE));
+					if (flipABit && first + j == fullBlocks - 1) {
+						*reinterpret_cast< unsigned char * >(tmps[s][j]) ^= 1;
+					}
+					addJob(batch[s], tmps[s][j], tmps[s][j]);
+				}
+			}
+			runJobs();
+
+			for (std::size_t s = 0; s < batchSize; ++s) {
+				unsigned char *encrypted = batchDestinations[s] + 4;
+				for (unsigned int j = 0; j < blocks; ++j) {
+					XOR(reinterpret_cast< subblock * >(encrypted + (first + j) * AES_BLOCK_SIZE), blockDeltas[s][j],
+						tmps[s][j]);
+				}
+			}
+		}
+
+		// Encrypt the pads for the last (partial) blocks
+		for (std::size_t s = 0; s < batchSize; ++s) {
+			S2(deltas[s]);
+			ZERO(pads[s]);
+			pads[s][BLOCKSIZE - 1] = SWAPPED(remaining * 8);
+			XOR(pads[s], pads[s], deltas[s]);
+			addJob(batch[s], pads[s], pads[s]);
+		}
+		runJobs();
+
+		// Finish the ciphertexts and encrypt the tags
+		for (std::size_t s = 0; s < batchSize; ++s) {
+			unsigned char *encrypted = batchDestinations[s] + 4 + fullBlocks * AES_BLOCK_SIZE;
+			keyblock tmp, checksum;
+
+			memcpy(tmp, source + fullBlocks * AES_BLOCK_SIZE, remaining);
+			memcpy(reinterpret_cast< unsigned char * >(tmp) + remaining,
+				   reinterpret_cast< const unsigned char * >(pads[s]) + remaining, AES_BLOCK_SIZE - remaining);
+			XOR(checksum, plainChecksum, tmp);
+			XOR(tmp, pads[s], tmp);
+			memcpy(encrypted, tmp, remaining);
+
+			S3(deltas[s]);
+			XOR(tags[s], deltas[s], checksum);
+			addJob(batch[s], tags[s], tags[s]);
+		}
+		runJobs();
+
+		for (std::size_t s = 0; s < batchSize; ++s) {
+			unsigned char *dst = batchDestinations[s];
+			dst[0]             = batch[s]->encrypt_iv[0];
+			dst[1]             = reinterpret_cast< const unsigned char * >(tags[s])[0];
+			dst[2]             = reinterpret_cast< const unsigned char * >(tags[s])[1];
+			dst[3]             = reinterpret_cast< const unsigned char * >(tags[s])[2];
+		}
+	}
+}
+
 #undef BLOCKSIZE
 #undef SHIFTBITS
 #undef SWAPPED
@@ -7,6 +7,7 @@
 #define MUMBLE_CRYPTSTATEOCB2_H
 
 #include "CryptState.h"
+#include "HardwareAES.h"
 
 #include <openssl/evp.h>
 
@@ -17,9 +18,26 @@
 
 class CryptStateOCB2 : public CryptState {
 public:
-	CryptStateOCB2();
+	/// @param allowHardwareAES Whether the AES instructions of the CPU may be used (if supported). Otherwise all
+	/// 	AES operations go through OpenSSL.
+	explicit CryptStateOCB2(bool allowHardwareAES = true);
 	~CryptStateOCB2() noexcept override;
 
+	/// The amount of states encryptBatch() interleaves at most
+	constexpr static const std::size_t MAX_BATCH_SIZE = 8;
+
+	/// @returns Whether this object uses the AES instructions of the CPU
+	bool usesHardwareAES() const;
+
+	/// Encrypts the same plaintext with each of the given states, which is the same as calling
+	/// states[i]->encrypt(source, destinations[i], plain_length) for every state. However, if the states use
+	/// hardware AES, the AES operations for up to MAX_BATCH_SIZE states are interleaved, which is considerably
+	/// faster than encrypting for one state after the other.
+	///
+	/// As encrypt() can't fail (critical plaintexts are modified instead of being rejected), there is no result.
+	static void encryptBatch(CryptStateOCB2 *const *states, unsigned char *const *destinations, std::size_t count,
+							 const unsigned char *source, unsigned int plain_length);
+
 	virtual bool isValid() const Q_DECL_OVERRIDE;
 	virtual void genKey() Q_DECL_OVERRIDE;
 	virtual bool setKey(const std::string &rkey, const std::string &eiv, const std::string &div) Q_DECL_OVERRIDE;
@@ -39,6 +57,15 @@ public:
 					 unsigned char *tag);
 
 private:
+	/// Has to be called whenever raw_key has been changed
+	void keyChanged();
+	/// Encrypts the given amount of consecutive blocks using either HardwareAES or OpenSSL
+	void aesEncrypt(const unsigned char *source, unsigned char *destination, unsigned int blocks,
+					EVP_CIPHER_CTX *ctx);
+	/// Decrypts the given amount of consecutive blocks using either HardwareAES or OpenSSL
+	void aesDecrypt(const unsigned char *source, unsigned char *destination, unsigned int blocks,
+					EVP_CIPHER_CTX *ctx);
+
 	unsigned char raw_key[AES_KEY_SIZE_BYTES];
 	unsigned char encrypt_iv[AES_BLOCK_SIZE];
 	unsigned char decrypt_iv[AES_BLOCK_SIZE];
@@ -48,6 +75,9 @@ private:
 	EVP_CIPHER_CTX *dec_ctx_ocb_enc;
 	EVP_CIPHER_CTX *enc_ctx_ocb_dec;
 	EVP_CIPHER_CTX *dec_ctx_ocb_dec;
+
+	bool m_useHardwareAES;
+	HardwareAES m_hardwareAES;
 };
 
 
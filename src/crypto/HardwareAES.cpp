@@ -0,0 +1,425 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "HardwareAES.h"
+
+#include <QtCore/QtGlobal>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define HARDWAREAES_X86
+#	include <emmintrin.h>
+#	include <wmmintrin.h>
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#		define HARDWAREAES_TARGET
+#	else
+#		include <cpuid.h>
+// Only the functions using the AES instructions are compiled for them. Whether they may be called is checked at
+// runtime.
+#		define HARDWAREAES_TARGET __attribute__((target("aes,sse2")))
+#	endif
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && (defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO))
+// The cryptography extension is optional in ARMv8, so this is only available if the build targets it (which e.g. is
+// the default for Apple Silicon).
+#	define HARDWAREAES_ARM
+#	include <arm_neon.h>
+#	ifdef Q_OS_LINUX
+#		include <asm/hwcap.h>
+#		include <sys/auxv.h>
+#	endif
+#endif
+
+#ifdef HARDWAREAES_X86
+
+// Computes the next round key from the previous one and the result of _mm_aeskeygenassist_si128
+HARDWAREAES_TARGET static inline __m128i expandKey(__m128i key, __m128i assist) {
+	assist = _mm_shuffle_epi32(assist, _MM_SHUFFLE(3, 3, 3, 3));
+	key    = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key    = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key    = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, assist);
+}
+
+// The round constant has to be an immediate, so this can't be a loop
+#	define EXPAND_KEY(index, rcon) \
+		keys[index] = expandKey(keys[index - 1], _mm_aeskeygenassist_si128(keys[index - 1], rcon))
+
+HARDWAREAES_TARGET static void setKeyX86(const unsigned char *key, unsigned char *encryptionKeys,
+										 unsigned char *decryptionKeys) {
+	__m128i *keys = reinterpret_cast< __m128i * >(encryptionKeys);
+
+	keys[0] = _mm_loadu_si128(reinterpret_cast< const __m128i * >(key));
+	EXPAND_KEY(1, 0x01);
+	EXPAND_KEY(2, 0x02);
+	EXPAND_KEY(3, 0x04);
+	EXPAND_KEY(4, 0x08);
+	EXPAND_KEY(5, 0x10);
+	EXPAND_KEY(6, 0x20);
+	EXPAND_KEY(7, 0x40);
+	EXPAND_KEY(8, 0x80);
+	EXPAND_KEY(9, 0x1B);
+	EXPAND_KEY(10, 0x36);
+
+	// The equivalent inverse cipher uses the round keys in reverse order, with InvMixColumns applied to all
+	// but the first and the last one
+	__m128i *inverseKeys = reinterpret_cast< __m128i * >(decryptionKeys);
+	inverseKeys[0]       = keys[10];
+	for (int i = 1; i < 10; ++i) {
+		inverseKeys[i] = _mm_aesimc_si128(keys[10 - i]);
+	}
+	inverseKeys[10] = keys[0];
+}
+
+#	undef EXPAND_KEY
+
+HARDWAREAES_TARGET static void encryptX86(const unsigned char *roundKeys, const unsigned char *source,
+										  unsigned char *destination, std::size_t blocks) {
+	const __m128i *keys = reinterpret_cast< const __m128i * >(roundKeys);
+	const __m128i *src  = reinterpret_cast< const __m128i * >(source);
+	__m128i *dst        = reinterpret_cast< __m128i * >(destination);
+
+	// Four independent blocks per round keep the AES unit busy while waiting for the result of the previous
+	// instruction
+	for (; blocks >= 4; blocks -= 4, src += 4, dst += 4) {
+		__m128i b0 = _mm_xor_si128(_mm_loadu_si128(src + 0), keys[0]);
+		__m128i b1 = _mm_xor_si128(_mm_loadu_si128(src + 1), keys[0]);
+		__m128i b2 = _mm_xor_si128(_mm_loadu_si128(src + 2), keys[0]);
+		__m128i b3 = _mm_xor_si128(_mm_loadu_si128(src + 3), keys[0]);
+
+		for (int round = 1; round < 10; ++round) {
+			b0 = _mm_aesenc_si128(b0, keys[round]);
+			b1 = _mm_aesenc_si128(b1, keys[round]);
+			b2 = _mm_aesenc_si128(b2, keys[round]);
+			b3 = _mm_aesenc_si128(b3, keys[round]);
+		}
+
+		_mm_storeu_si128(dst + 0, _mm_aesenclast_si128(b0, keys[10]));
+		_mm_storeu_si128(dst + 1, _mm_aesenclast_si128(b1, keys[10]));
+		_mm_storeu_si128(dst + 2, _mm_aesenclast_si128(b2, keys[10]));
+		_mm_storeu_si128(dst + 3, _mm_aesenclast_si128(b3, keys[10]));
+	}
+
+	for (; blocks > 0; --blocks, ++src, ++dst) {
+		__m128i block = _mm_xor_si128(_mm_loadu_si128(src), keys[0]);
+
+		for (int round = 1; round < 10; ++round) {
+			block = _mm_aesenc_si128(block, keys[round]);
+		}
+
+		_mm_storeu_si128(dst, _mm_aesenclast_si128(block, keys[10]));
+	}
+}
+
+HARDWAREAES_TARGET static void decryptX86(const unsigned char *roundKeys, const unsigned char *source,
+										  unsigned char *destination, std::size_t blocks) {
+	const __m128i *keys = reinterpret_cast< const __m128i * >(roundKeys);
+	const __m128i *src  = reinterpret_cast< const __m128i * >(source);
+	__m128i *dst        = reinterpret_cast< __m128i * >(destination);
+
+	for (; blocks >= 4; blocks -= 4, src += 4, dst += 4) {
+		__m128i b0 = _mm_xor_si128(_mm_loadu_si128(src + 0), keys[0]);
+		__m128i b1 = _mm_xor_si128(_mm_loadu_si128(src + 1), keys[0]);
+		__m128i b2 = _mm_xor_si128(_mm_loadu_si128(src + 2), keys[0]);
+		__m128i b3 = _mm_xor_si128(_mm_loadu_si128(src + 3), keys[0]);
+
+		for (int round = 1; round < 10; ++round) {
+			b0 = _mm_aesdec_si128(b0, keys[round]);
+			b1 = _mm_aesdec_si128(b1, keys[round]);
+			b2 = _mm_aesdec_si128(b2, keys[round]);
+			b3 = _mm_aesdec_si128(b3, keys[round]);
+		}
+
+		_mm_storeu_si128(dst + 0, _mm_aesdeclast_si128(b0, keys[10]));
+		_mm_storeu_si128(dst + 1, _mm_aesdeclast_si128(b1, keys[10]));
+		_mm_storeu_si128(dst + 2, _mm_aesdeclast_si128(b2, keys[10]));
+		_mm_storeu_si128(dst + 3, _mm_aesdeclast_si128(b3, keys[10]));
+	}
+
+	for (; blocks > 0; --blocks, ++src, ++dst) {
+		__m128i block = _mm_xor_si128(_mm_loadu_si128(src), keys[0]);
+
+		for (int round = 1; round < 10; ++round) {
+			block = _mm_aesdec_si128(block, keys[round]);
+		}
+
+		_mm_storeu_si128(dst, _mm_aesdeclast_si128(block, keys[10]));
+	}
+}
+
+// Encrypts four blocks, each with its own key schedule
+HARDWAREAES_TARGET static void encryptMultiKeyX86(const unsigned char *const *roundKeys,
+												  const unsigned char *const *sources,
+												  unsigned char *const *destinations) {
+	const __m128i *k0 = reinterpret_cast< const __m128i * >(roundKeys[0]);
+	const __m128i *k1 = reinterpret_cast< const __m128i * >(roundKeys[1]);
+	const __m128i *k2 = reinterpret_cast< const __m128i * >(roundKeys[2]);
+	const __m128i *k3 = reinterpret_cast< const __m128i * >(roundKeys[3]);
+
+	__m128i b0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast< const __m128i * >(sources[0])), k0[0]);
+	__m128i b1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast< const __m128i * >(sources[1])), k1[0]);
+	__m128i b2 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast< const __m128i * >(sources[2])), k2[0]);
+	__m128i b3 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast< const __m128i * >(sources[3])), k3[0]);
+
+	for (int round = 1; round < 10; ++round) {
+		b0 = _mm_aesenc_si128(b0, k0[round]);
+		b1 = _mm_aesenc_si128(b1, k1[round]);
+		b2 = _mm_aesenc_si128(b2, k2[round]);
+		b3 = _mm_aesenc_si128(b3, k3[round]);
+	}
+
+	_mm_storeu_si128(reinterpret_cast< __m128i * >(destinations[0]), _mm_aesenclast_si128(b0, k0[10]));
+	_mm_storeu_si128(reinterpret_cast< __m128i * >(destinations[1]), _mm_aesenclast_si128(b1, k1[10]));
+	_mm_storeu_si128(reinterpret_cast< __m128i * >(destinations[2]), _mm_aesenclast_si128(b2, k2[10]));
+	_mm_storeu_si128(reinterpret_cast< __m128i * >(destinations[3]), _mm_aesenclast_si128(b3, k3[10]));
+}
+
+static bool cpuSupportsAES() {
+#	ifdef _MSC_VER
+	int cpuinfo[4];
+	__cpuid(cpuinfo, 1);
+
+	return (cpuinfo[2] & (1 << 25)) && (cpuinfo[3] & (1 << 26));
+#	else
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return false;
+	}
+
+	return (ecx & bit_AES) && (edx & bit_SSE2);
+#	endif
+}
+
+#endif // HARDWAREAES_X86
+
+#ifdef HARDWAREAES_ARM
+
+// Applies the S-box to each byte of the given word. AESE with a zero key performs SubBytes and ShiftRows, where
+// the latter has no effect if all columns of the state are the same.
+static inline std::uint32_t subWord(std::uint32_t word) {
+	uint8x16_t state = vreinterpretq_u8_u32(vdupq_n_u32(word));
+	state            = vaeseq_u8(state, vdupq_n_u8(0));
+
+	return vgetq_lane_u32(vreinterpretq_u32_u8(state), 0);
+}
+
+static void setKeyARM(const unsigned char *key, unsigned char *encryptionKeys, unsigned char *decryptionKeys) {
+	static const std::uint8_t rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36 };
+
+	// The words are in memory order, i.e. the first byte of a word is its least significant one
+	std::uint32_t words[44];
+	for (int i = 0; i < 4; ++i) {
+		words[i] = static_cast< std::uint32_t >(key[4 * i]) | (static_cast< std::uint32_t >(key[4 * i + 1]) << 8)
+				   | (static_cast< std::uint32_t >(key[4 * i + 2]) << 16)
+				   | (static_cast< std::uint32_t >(key[4 * i + 3]) << 24);
+	}
+
+	for (int i = 4; i < 44; ++i) {
+		std::uint32_t temp = words[i - 1];
+		if (i % 4 == 0) {
+			// RotWord moves the first byte to the end
+			temp = subWord((temp >> 8) | (temp << 24)) ^ rcon[i / 4 - 1];
+		}
+		words[i] = words[i - 4] ^ temp;
+	}
+
+	uint8x16_t *keys = reinterpret_cast< uint8x16_t * >(encryptionKeys);
+	for (int i = 0; i < 11; ++i) {
+		keys[i] = vreinterpretq_u8_u32(vld1q_u32(&words[4 * i]));
+	}
+
+	// See setKeyX86
+	uint8x16_t *inverseKeys = reinterpret_cast< uint8x16_t * >(decryptionKeys);
+	inverseKeys[0]          = keys[10];
+	for (int i = 1; i < 10; ++i) {
+		inverseKeys[i] = vaesimcq_u8(keys[10 - i]);
+	}
+	inverseKeys[10] = keys[0];
+}
+
+// AESE/AESD include the AddRoundKey step at their beginning, whereas AESENC/AESDEC on x86 do it at the end. Thus the
+// rounds are shifted by one compared to the x86 implementation.
+static void encryptARM(const unsigned char *roundKeys, const unsigned char *source, unsigned char *destination,
+					   std::size_t blocks) {
+	const uint8x16_t *keys = reinterpret_cast< const uint8x16_t * >(roundKeys);
+
+	for (; blocks >= 4; blocks -= 4, source += 64, destination += 64) {
+		uint8x16_t b0 = vld1q_u8(source + 0);
+		uint8x16_t b1 = vld1q_u8(source + 16);
+		uint8x16_t b2 = vld1q_u8(source + 32);
+		uint8x16_t b3 = vld1q_u8(source + 48);
+
+		for (int round = 0; round < 9; ++round) {
+			b0 = vaesmcq_u8(vaeseq_u8(b0, keys[round]));
+			b1 = vaesmcq_u8(vaeseq_u8(b1, keys[round]));
+			b2 = vaesmcq_u8(vaeseq_u8(b2, keys[round]));
+			b3 = vaesmcq_u8(vaeseq_u8(b3, keys[round]));
+		}
+
+		vst1q_u8(destination + 0, veorq_u8(vaeseq_u8(b0, keys[9]), keys[10]));
+		vst1q_u8(destination + 16, veorq_u8(vaeseq_u8(b1, keys[9]), keys[10]));
+		vst1q_u8(destination + 32, veorq_u8(vaeseq_u8(b2, keys[9]), keys[10]));
+		vst1q_u8(destination + 48, veorq_u8(vaeseq_u8(b3, keys[9]), keys[10]));
+	}
+
+	for (; blocks > 0; --blocks, source += 16, destination += 16) {
+		uint8x16_t block = vld1q_u8(source);
+
+		for (int round = 0; round < 9; ++round) {
+			block = vaesmcq_u8(vaeseq_u8(block, keys[round]));
+		}
+
+		vst1q_u8(destination, veorq_u8(vaeseq_u8(block, keys[9]), keys[10]));
+	}
+}
+
+static void decryptARM(const unsigned char *roundKeys, const unsigned char *source, unsigned char *destination,
+					   std::size_t blocks) {
+	const uint8x16_t *keys = reinterpret_cast< const uint8x16_t * >(roundKeys);
+
+	for (; blocks >= 4; blocks -= 4, source += 64, destination += 64) {
+		uint8x16_t b0 = vld1q_u8(source + 0);
+		uint8x16_t b1 = vld1q_u8(source + 16);
+		uint8x16_t b2 = vld1q_u8(source + 32);
+		uint8x16_t b3 = vld1q_u8(source + 48);
+
+		for (int round = 0; round < 9; ++round) {
+			b0 = vaesimcq_u8(vaesdq_u8(b0, keys[round]));
+			b1 = vaesimcq_u8(vaesdq_u8(b1, keys[round]));
+			b2 = vaesimcq_u8(vaesdq_u8(b2, keys[round]));
+			b3 = vaesimcq_u8(vaesdq_u8(b3, keys[round]));
+		}
+
+		vst1q_u8(destination + 0, veorq_u8(vaesdq_u8(b0, keys[9]), keys[10]));
+		vst1q_u8(destination + 16, veorq_u8(vaesdq_u8(b1, keys[9]), keys[10]));
+		vst1q_u8(destination + 32, veorq_u8(vaesdq_u8(b2, keys[9]), keys[10]));
+		vst1q_u8(destination + 48, veorq_u8(vaesdq_u8(b3, keys[9]), keys[10]));
+	}
+
+	for (; blocks > 0; --blocks, source += 16, destination += 16) {
+		uint8x16_t block = vld1q_u8(source);
+
+		for (int round = 0; round < 9; ++round) {
+			block = vaesimcq_u8(vaesdq_u8(block, keys[round]));
+		}
+
+		vst1q_u8(destination, veorq_u8(vaesdq_u8(block, keys[9]), keys[10]));
+	}
+}
+
+// Encrypts four blocks, each with its own key schedule
+static void encryptMultiKeyARM(const unsigned char *const *roundKeys, const unsigned char *const *sources,
+							   unsigned char *const *destinations) {
+	const uint8x16_t *k0 = reinterpret_cast< const uint8x16_t * >(roundKeys[0]);
+	const uint8x16_t *k1 = reinterpret_cast< const uint8x16_t * >(roundKeys[1]);
+	const uint8x16_t *k2 = reinterpret_cast< const uint8x16_t * >(roundKeys[2]);
+	const uint8x16_t *k3 = reinterpret_cast< const uint8x16_t * >(roundKeys[3]);
+
+	uint8x16_t b0 = vld1q_u8(sources[0]);
+	uint8x16_t b1 = vld1q_u8(sources[1]);
+	uint8x16_t b2 = vld1q_u8(sources[2]);
+	uint8x16_t b3 = vld1q_u8(sources[3]);
+
+	for (int round = 0; round < 9; ++round) {
+		b0 = vaesmcq_u8(vaeseq_u8(b0, k0[round]));
+		b1 = vaesmcq_u8(vaeseq_u8(b1, k1[round]));
+		b2 = vaesmcq_u8(vaeseq_u8(b2, k2[round]));
+		b3 = vaesmcq_u8(vaeseq_u8(b3, k3[round]));
+	}
+
+	vst1q_u8(destinations[0], veorq_u8(vaeseq_u8(b0, k0[9]), k0[10]));
+	vst1q_u8(destinations[1], veorq_u8(vaeseq_u8(b1, k1[9]), k1[10]));
+	vst1q_u8(destinations[2], veorq_u8(vaeseq_u8(b2, k2[9]), k2[10]));
+	vst1q_u8(destinations[3], veorq_u8(vaeseq_u8(b3, k3[9]), k3[10]));
+}
+
+static bool cpuSupportsAES() {
+#	ifdef Q_OS_LINUX
+	return getauxval(AT_HWCAP) & HWCAP_AES;
+#	else
+	// The build targets the cryptography extension, so every CPU this runs on has to support it
+	return true;
+#	endif
+}
+
+#endif // HARDWAREAES_ARM
+
+bool HardwareAES::isSupported() {
+#if defined(HARDWAREAES_X86) || defined(HARDWAREAES_ARM)
+	static const bool supported = cpuSupportsAES();
+
+	return supported;
+#else
+	return false;
+#endif
+}
+
+void HardwareAES::setKey(const unsigned char *key) {
+	assert(isSupported());
+
+#if defined(HARDWAREAES_X86)
+	setKeyX86(key, m_encryptionKeys, m_decryptionKeys);
+#elif defined(HARDWAREAES_ARM)
+	setKeyARM(key, m_encryptionKeys, m_decryptionKeys);
+#else
+	Q_UNUSED(key);
+#endif
+}
+
+void HardwareAES::encrypt(const unsigned char *source, unsigned char *destination, std::size_t blocks) const {
+	assert(isSupported());
+
+#if defined(HARDWAREAES_X86)
+	encryptX86(m_encryptionKeys, source, destination, blocks);
+#elif defined(HARDWAREAES_ARM)
+	encryptARM(m_encryptionKeys, source, destination, blocks);
+#else
+	Q_UNUSED(source);
+	Q_UNUSED(destination);
+	Q_UNUSED(blocks);
+#endif
+}
+
+void HardwareAES::decrypt(const unsigned char *source, unsigned char *destination, std::size_t blocks) const {
+	assert(isSupported());
+
+#if defined(HARDWAREAES_X86)
+	decryptX86(m_decryptionKeys, source, destination, blocks);
+#elif defined(HARDWAREAES_ARM)
+	decryptARM(m_decryptionKeys, source, destination, blocks);
+#else
+	Q_UNUSED(source);
+	Q_UNUSED(destination);
+	Q_UNUSED(blocks);
+#endif
+}
+
+void HardwareAES::encrypt(const Block *blocks, std::size_t count) {
+	assert(isSupported());
+
+	const unsigned char *roundKeys[PIPELINE_BLOCKS];
+	const unsigned char *sources[PIPELINE_BLOCKS];
+	unsigned char *destinations[PIPELINE_BLOCKS];
+
+	for (std::size_t start = 0; start < count; start += PIPELINE_BLOCKS) {
+		// An incomplete group is filled up by repeating its last block. As all blocks are loaded before anything
+		// is stored, this simply writes the same result twice (even if source and destination are the same).
+		for (std::size_t i = 0; i < PIPELINE_BLOCKS; ++i) {
+			const Block &block = blocks[std::min(start + i, count - 1)];
+			roundKeys[i]       = block.cipher->m_encryptionKeys;
+			sources[i]         = block.source;
+			destinations[i]    = block.destination;
+		}
+
+#if defined(HARDWAREAES_X86)
+		encryptMultiKeyX86(roundKeys, sources, destinations);
+#elif defined(HARDWAREAES_ARM)
+		encryptMultiKeyARM(roundKeys, sources, destinations);
+#endif
+	}
+}
@@ -0,0 +1,53 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_HARDWAREAES_H_
+#define MUMBLE_HARDWAREAES_H_
+
+#include <cstddef>
+
+/// AES-128 (in ECB mode) using the AES instructions of the CPU. On x86 these are the AES-NI instructions
+/// and on ARMv8 the ones of the cryptography extension.
+///
+/// In contrast to going through OpenSSL's EVP interface, the expanded key schedules are computed once per
+/// key and multiple blocks are processed interleaved, so that the latency of the AES instructions is hidden.
+class HardwareAES {
+public:
+	/// The amount of blocks that are processed in parallel. Callers get the most out of this class if they
+	/// pass (at least) this many blocks at once.
+	constexpr static const std::size_t PIPELINE_BLOCKS = 4;
+
+	/// @returns Whether this build and the CPU it is running on support the instructions used by this class.
+	/// 	None of the other functions may be used if this returns false.
+	static bool isSupported();
+
+	/// Expands the given 16 byte key into the encryption and decryption key schedules
+	void setKey(const unsigned char *key);
+
+	/// Encrypts the given amount of 16 byte blocks. Source and destination may be the same.
+	void encrypt(const unsigned char *source, unsigned char *destination, std::size_t blocks) const;
+	/// Decrypts the given amount of 16 byte blocks. Source and destination may be the same.
+	void decrypt(const unsigned char *source, unsigned char *destination, std::size_t blocks) const;
+
+	/// A single 16 byte block that is to be encrypted with the key of the given cipher
+	struct Block {
+		const HardwareAES *cipher;
+		const unsigned char *source;
+		unsigned char *destination;
+	};
+
+	/// Encrypts the given blocks, each one with the key of its own cipher. Blocks are interleaved the same way as
+	/// in encrypt(), so this is as fast as encrypting with a single key. Source and destination of a block may be
+	/// the same.
+	static void encrypt(const Block *blocks, std::size_t count);
+
+private:
+	constexpr static const std::size_t ROUND_KEYS = 11;
+
+	alignas(16) unsigned char m_encryptionKeys[ROUND_KEYS * 16];
+	alignas(16) unsigned char m_decryptionKeys[ROUND_KEYS * 16];
+};
+
+#endif // MUMBLE_HARDWAREAES_H_
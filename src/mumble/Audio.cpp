@@ -30,7 +30,15 @@ LoopUser::LoopUser() {
 	tsState                               = Settings::Passive;
 	cChannel                              = nullptr;
 	qetTicker.start();
-	qetLastFetch.start();
+}
+
+qint64 LoopUser::now() const {
+	const qint64 virtualTime = iVirtualTime.load();
+	return virtualTime >= 0 ? virtualTime : qetTicker.elapsed();
+}
+
+void LoopUser::setVirtualTime(qint64 time) {
+	iVirtualTime.store(time);
 }
 
 void LoopUser::addFrame(const Mumble::Protocol::AudioData &audioData) {
@@ -41,9 +49,8 @@ void LoopUser::addFrame(const Mumble::Protocol::AudioData &audioData) {
 
 	{
 		QMutexLocker l(&qmLock);
-		bool restart = (qetLastFetch.elapsed() > 100);
-
-		qint64 time = qetTicker.elapsed();
+		qint64 time  = now();
+		bool restart = (time - iLastFetch > 100);
 
 		float r;
 		if (restart)
@@ -69,7 +76,7 @@ void LoopUser::addFrame(const Mumble::Protocol::AudioData &audioData) {
 	}
 
 	// Restart check
-	if (qetLastFetch.elapsed() > 100) {
+	if (now() - iLastFetch > 100) {
 		AudioOutputPtr ao = Global::get().ao;
 		if (ao) {
 			Mumble::Protocol::AudioData empty;
@@ -87,7 +94,8 @@ void LoopUser::fetchFrames() {
 		return;
 	}
 
-	float cmp = static_cast< float >(qetTicker.elapsed());
+	const qint64 time = now();
+	float cmp         = static_cast< float >(time);
 
 	auto it = m_packets.begin();
 	while (it != m_packets.end()) {
@@ -100,7 +108,7 @@ void LoopUser::fetchFrames() {
 		it = m_packets.erase(it);
 	}
 
-	qetLastFetch.restart();
+	iLastFetch = time;
 }
 
 RecordUser::RecordUser() {
@@ -16,7 +16,8 @@
 #include "ClientUser.h"
 #include "MumbleProtocol.h"
 
-#include <unordered_map>
+#include <atomic>
+#include <map>
 #include <vector>
 
 #define SAMPLE_RATE 48000
@@ -40,14 +41,26 @@ protected:
 	};
 	QMutex qmLock;
 	QElapsedTimer qetTicker;
-	QElapsedTimer qetLastFetch;
-	std::unordered_map< float, AudioPacket > m_packets;
+	/// The time of the last fetch, in milliseconds since the ticker has been started
+	qint64 iLastFetch = 0;
+	/// The time the packets are scheduled by, if it doesn't pass in real time. See setVirtualTime().
+	std::atomic< qint64 > iVirtualTime = { -1 };
+	/// The packets by the time they arrive at. They have to be ordered, as fetching stops at the first packet that
+	/// hasn't arrived yet.
+	std::map< float, AudioPacket > m_packets;
 	LoopUser();
 
+	/// @returns The current time in milliseconds
+	qint64 now() const;
+
 public:
 	static LoopUser lpLoopy;
 	void addFrame(const Mumble::Protocol::AudioData &audioData);
 	void fetchFrames();
+	/// Makes the loopback schedule the packets by the given time (in milliseconds) instead of the real time. This
+	/// allows driving it along with audio that is processed faster than real time. A negative time switches back
+	/// to the real time.
+	void setVirtualTime(qint64 time);
 };
 
 class RecordUser : public ClientUser {
@@ -7,6 +7,7 @@
 
 #include "API.h"
 #include "AudioOutput.h"
+#include "AudioPipelineProfile.h"
 #include "MainWindow.h"
 #include "MumbleProtocol.h"
 #include "NetworkConfig.h"
@@ -590,7 +591,10 @@ void AudioInput::addMic(const void *data, unsigned int nsamp) {
 			if (iEchoChannels > 0) {
 				resync.addMic(psMic);
 			} else {
+				AudioPipelineProfile::Stopwatch stopwatch(m_profile);
+				stopwatch.start();
 				encodeAudioFrame(AudioChunk(psMic));
+				stopwatch.stop(AudioPipelineProfile::Stage::Capture);
 			}
 		}
 	}
@@ -654,7 +658,11 @@ void AudioInput::addEcho(const void *data, unsigned int nsamp) {
 
 			auto chunk = resync.addSpeaker(outbuff);
 			if (!chunk.empty()) {
+				// With echo cancellation, the frames are processed once the matching speaker audio arrives
+				AudioPipelineProfile::Stopwatch stopwatch(m_profile);
+				stopwatch.start();
 				encodeAudioFrame(chunk);
+				stopwatch.stop(AudioPipelineProfile::Stage::Capture);
 				delete[] chunk.mic;
 				delete[] chunk.speaker;
 			}
@@ -889,9 +897,13 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 		m_preprocessor.setNoiseSuppress(Global::get().s.iSpeexNoiseCancelStrength - gainValue);
 	}
 
+	AudioPipelineProfile::Stopwatch stopwatch(m_profile);
+
 	short psClean[iFrameSize];
 	if (sesEcho && chunk.speaker) {
+		stopwatch.start();
 		speex_echo_cancellation(sesEcho, chunk.mic, chunk.speaker, psClean);
+		stopwatch.stop(AudioPipelineProfile::Stage::EchoCancellation);
 		psSource = psClean;
 	} else {
 		psSource = chunk.mic;
@@ -900,16 +912,22 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 #ifdef USE_RENAMENOISE
 	// At the time of writing this code, ReNameNoise only supports a sample rate of 48000 Hz.
 	if (noiseCancel == Settings::NoiseCancelRNN || noiseCancel == Settings::NoiseCancelBoth) {
+		stopwatch.start();
+
 		float denoiseFrames[480];
 		for (unsigned int i = 0; i < 480; i++) {
 			denoiseFrames[i] = psSource[i];
 		}
 
 		renamenoise_process_frame_clamped(denoiseState, psSource, denoiseFrames);
+
+		stopwatch.stop(AudioPipelineProfile::Stage::NoiseSuppression);
 	}
 #endif
 
+	stopwatch.start();
 	m_preprocessor.run(*psSource);
+	stopwatch.stop(AudioPipelineProfile::Stage::Preprocessing);
 
 	sum = 1.0f;
 	for (unsigned int i = 0; i < iFrameSize; i++)
@@ -1105,7 +1123,9 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 
 		Q_ASSERT(iBufferedFrames == iAudioFrames);
 
+		stopwatch.start();
 		len = encodeOpusFrame(&opusBuffer[0], iBufferedFrames * iFrameSize, buffer);
+		stopwatch.stop(AudioPipelineProfile::Stage::Encoding);
 		opusBuffer.clear();
 		if (len <= 0) {
 			iBitrate = 0;
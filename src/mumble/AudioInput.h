@@ -32,6 +32,7 @@
 #include "Timer.h"
 
 class AudioInput;
+class AudioPipelineProfile;
 struct OpusEncoder;
 struct ReNameNoiseDenoiseState;
 typedef boost::shared_ptr< AudioInput > AudioInputPtr;
@@ -227,6 +228,10 @@ protected:
 	AudioPreprocessor m_preprocessor;
 	SpeexEchoState *sesEcho;
 
+	/// Where the durations of the pipeline's stages are recorded, if anywhere. Backends that want to be profiled set
+	/// this before they start feeding in audio.
+	AudioPipelineProfile *m_profile = nullptr;
+
 	/// bResetEncoder is a flag that notifies
 	/// our encoder functions that the encoder
 	/// needs to be reset.
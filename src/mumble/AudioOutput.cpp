@@ -8,6 +8,7 @@
 #include "AudioInput.h"
 #include "AudioOutputSample.h"
 #include "AudioOutputSpeech.h"
+#include "AudioPipelineProfile.h"
 #include "Channel.h"
 #include "ChannelListenerManager.h"
 #include "Log.h"
@@ -468,6 +469,9 @@ bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
 
 		bool prioritySpeakerActive = false;
 
+		AudioPipelineProfile::Stopwatch stopwatch(m_profile);
+		stopwatch.start();
+
 		// Get the users that are currently talking (and are thus serving as an audio source)
 		QMultiHash< const ClientUser *, AudioOutputBuffer * >::const_iterator it = qmOutputs.constBegin();
 		while (it != qmOutputs.constEnd()) {
@@ -485,6 +489,8 @@ bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
 			++it;
 		}
 
+		stopwatch.stop(AudioPipelineProfile::Stage::Decoding);
+
 		haveAudio = !qlMix.empty();
 
 		if (Global::get().prioritySpeakerActiveOverride) {
@@ -43,6 +43,7 @@ class AudioOutput;
 class ClientUser;
 class AudioOutputBuffer;
 class AudioOutputToken;
+class AudioPipelineProfile;
 
 typedef boost::shared_ptr< AudioOutput > AudioOutputPtr;
 
@@ -96,6 +97,10 @@ protected:
 	QReadWriteLock qrwlOutputs;
 	QMultiHash< const ClientUser *, AudioOutputBuffer * > qmOutputs;
 
+	/// Where the durations of the pipeline's stages are recorded, if anywhere. Backends that want to be profiled set
+	/// this before they start mixing.
+	AudioPipelineProfile *m_profile = nullptr;
+
 #ifdef USE_MANUAL_PLUGIN
 	QHash< unsigned int, Position2D > positions;
 #endif
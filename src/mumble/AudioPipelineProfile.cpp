@@ -0,0 +1,172 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioPipelineProfile.h"
+
+#include <algorithm>
+#include <cmath>
+
+static std::size_t index(AudioPipelineProfile::Stage stage) {
+	return static_cast< std::size_t >(stage);
+}
+
+/// Formats the given duration in microseconds, with a precision that is sensible for the durations of a pipeline stage
+static QString formatDuration(std::chrono::nanoseconds duration) {
+	return QString::number(static_cast< double >(duration.count()) / 1000.0, 'f', 1) + QLatin1String(" us");
+}
+
+void AudioPipelineProfile::record(Stage stage, std::chrono::nanoseconds duration) {
+	Histogram &histogram = m_histograms[index(stage)];
+
+	const std::uint64_t ns =
+		static_cast< std::uint64_t >(std::max(duration.count(), std::chrono::nanoseconds::rep(0)));
+
+	histogram.buckets[bucketFor(duration)].fetch_add(1, std::memory_order_relaxed);
+	histogram.count.fetch_add(1, std::memory_order_relaxed);
+	histogram.totalNs.fetch_add(ns, std::memory_order_relaxed);
+
+	std::uint64_t max = histogram.maxNs.load(std::memory_order_relaxed);
+	while (ns > max && !histogram.maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+	}
+}
+
+void AudioPipelineProfile::reset() {
+	for (Histogram &histogram : m_histograms) {
+		for (std::atomic< std::uint64_t > &bucket : histogram.buckets) {
+			bucket.store(0, std::memory_order_relaxed);
+		}
+		histogram.count.store(0, std::memory_order_relaxed);
+		histogram.totalNs.store(0, std::memory_order_relaxed);
+		histogram.maxNs.store(0, std::memory_order_relaxed);
+	}
+}
+
+std::uint64_t AudioPipelineProfile::count(Stage stage) const {
+	return m_histograms[index(stage)].count.load(std::memory_order_relaxed);
+}
+
+std::uint64_t AudioPipelineProfile::bucketCount(Stage stage, std::size_t bucket) const {
+	return m_histograms[index(stage)].buckets[bucket].load(std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds AudioPipelineProfile::total(Stage stage) const {
+	return std::chrono::nanoseconds(m_histograms[index(stage)].totalNs.load(std::memory_order_relaxed));
+}
+
+std::chrono::nanoseconds AudioPipelineProfile::max(Stage stage) const {
+	return std::chrono::nanoseconds(m_histograms[index(stage)].maxNs.load(std::memory_order_relaxed));
+}
+
+std::chrono::nanoseconds AudioPipelineProfile::quantile(Stage stage, double q) const {
+	const std::uint64_t total = count(stage);
+	if (total == 0) {
+		return std::chrono::nanoseconds(0);
+	}
+
+	// The amount of durations that have to be covered by the buckets up to (and including) the one we are looking for
+	const std::uint64_t wanted =
+		std::max(static_cast< std::uint64_t >(std::ceil(q * static_cast< double >(total))), std::uint64_t(1));
+
+	std::uint64_t covered = 0;
+	for (std::size_t bucket = 0; bucket + 1 < BUCKET_COUNT; ++bucket) {
+		covered += bucketCount(stage, bucket);
+		if (covered >= wanted) {
+			return std::min(std::chrono::nanoseconds(std::chrono::microseconds(std::uint64_t(1) << bucket)),
+							max(stage));
+		}
+	}
+
+	return max(stage);
+}
+
+QString AudioPipelineProfile::report() const {
+	QString report = QString::fromLatin1("%1 %2 %3 %4 %5 %6\n")
+						 .arg(QLatin1String("Stage"), -20)
+						 .arg(QLatin1String("Count"), 10)
+						 .arg(QLatin1String("Mean"), 12)
+						 .arg(QLatin1String("p50 <="), 12)
+						 .arg(QLatin1String("p99 <="), 12)
+						 .arg(QLatin1String("Max"), 12);
+
+	for (std::size_t i = 0; i < STAGE_COUNT; ++i) {
+		const Stage stage = static_cast< Stage >(i);
+		if (count(stage) == 0) {
+			continue;
+		}
+
+		const std::chrono::nanoseconds mean(total(stage).count() / static_cast< std::int64_t >(count(stage)));
+
+		report += QString::fromLatin1("%1 %2 %3 %4 %5 %6\n")
+					  .arg(stageName(stage), -20)
+					  .arg(count(stage), 10)
+					  .arg(formatDuration(mean), 12)
+					  .arg(formatDuration(quantile(stage, 0.5)), 12)
+					  .arg(formatDuration(quantile(stage, 0.99)), 12)
+					  .arg(formatDuration(max(stage)), 12);
+	}
+
+	for (std::size_t i = 0; i < STAGE_COUNT; ++i) {
+		const Stage stage = static_cast< Stage >(i);
+		if (count(stage) == 0) {
+			continue;
+		}
+
+		report += QLatin1Char('\n') + stageName(stage) + QLatin1String(":\n");
+
+		for (std::size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+			const std::uint64_t bucketTotal = bucketCount(stage, bucket);
+			if (bucketTotal == 0) {
+				continue;
+			}
+
+			const QString range = bucket + 1 < BUCKET_COUNT
+									  ? QString::fromLatin1("< %1 us").arg(std::uint64_t(1) << bucket)
+									  : QString::fromLatin1(">= %1 us").arg(std::uint64_t(1) << (bucket - 1));
+			const double share = 100.0 * static_cast< double >(bucketTotal) / static_cast< double >(count(stage));
+
+			report += QString::fromLatin1("  %1 %2 %3%\n")
+						  .arg(range, 14)
+						  .arg(bucketTotal, 10)
+						  .arg(share, 6, 'f', 2);
+		}
+	}
+
+	return report;
+}
+
+QString AudioPipelineProfile::stageName(Stage stage) {
+	switch (stage) {
+		case Stage::Capture:
+			return QLatin1String("Capture");
+		case Stage::EchoCancellation:
+			return QLatin1String("Echo cancellation");
+		case Stage::NoiseSuppression:
+			return QLatin1String("Noise suppression");
+		case Stage::Preprocessing:
+			return QLatin1String("Preprocessing");
+		case Stage::Encoding:
+			return QLatin1String("Encoding");
+		case Stage::Playback:
+			return QLatin1String("Playback");
+		case Stage::Decoding:
+			return QLatin1String("Decoding");
+	}
+
+	return QString();
+}
+
+std::size_t AudioPipelineProfile::bucketFor(std::chrono::nanoseconds duration) {
+	std::uint64_t us = static_cast< std::uint64_t >(
+		std::max(std::chrono::duration_cast< std::chrono::microseconds >(duration).count(),
+				 std::chrono::microseconds::rep(0)));
+
+	std::size_t bucket = 0;
+	while (us > 0 && bucket + 1 < BUCKET_COUNT) {
+		us >>= 1;
+		++bucket;
+	}
+
+	return bucket;
+}
@@ -0,0 +1,94 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOPIPELINEPROFILE_H_
+#define MUMBLE_MUMBLE_AUDIOPIPELINEPROFILE_H_
+
+#include <QtCore/QString>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/// Collects how long the stages of the audio pipeline take. Every stage has a histogram whose buckets double in width,
+/// starting at one microsecond, so that recording a duration only takes a few atomic increments and can be done for
+/// every frame.
+///
+/// Recording is thread-safe, as the capture and the playback pipeline usually run on different threads.
+class AudioPipelineProfile {
+public:
+	enum class Stage {
+		/// All of the processing of a frame of microphone input, from the echo cancellation up to sending the packet
+		Capture,
+		EchoCancellation,
+		NoiseSuppression,
+		/// The Speex preprocessor (AGC, denoising and the speech probability used for VAD)
+		Preprocessing,
+		Encoding,
+		/// All of the processing of a chunk of output, from fetching the audio of the speakers up to mixing it
+		Playback,
+		/// Fetching the audio of the speakers (jitter buffer, decoding and resampling)
+		Decoding
+	};
+	static constexpr std::size_t STAGE_COUNT = 7;
+
+	/// Bucket 0 counts the durations below one microsecond, bucket i the ones in [2^(i-1), 2^i) microseconds. The last
+	/// bucket counts everything above as well.
+	static constexpr std::size_t BUCKET_COUNT = 24;
+
+	/// Measures the duration of a stage, if there is a profile to record it in. Otherwise, the clock isn't even read.
+	class Stopwatch {
+	public:
+		explicit Stopwatch(AudioPipelineProfile *profile) : m_profile(profile) {}
+
+		void start() {
+			if (m_profile) {
+				m_start = std::chrono::steady_clock::now();
+			}
+		}
+
+		/// Records the time that has passed since start() as the duration of the given stage
+		void stop(Stage stage) {
+			if (m_profile) {
+				m_profile->record(stage, std::chrono::steady_clock::now() - m_start);
+			}
+		}
+
+	private:
+		AudioPipelineProfile *m_profile;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	void record(Stage stage, std::chrono::nanoseconds duration);
+	void reset();
+
+	std::uint64_t count(Stage stage) const;
+	std::uint64_t bucketCount(Stage stage, std::size_t bucket) const;
+	std::chrono::nanoseconds total(Stage stage) const;
+	std::chrono::nanoseconds max(Stage stage) const;
+	/// @returns The upper bound of the bucket the given quantile (between 0 and 1) of the durations falls into, or
+	/// 	the longest duration if that is in the last bucket
+	std::chrono::nanoseconds quantile(Stage stage, double q) const;
+
+	/// @returns A table summarizing the durations of all stages that have been recorded, followed by their histograms
+	QString report() const;
+
+	static QString stageName(Stage stage);
+	static std::size_t bucketFor(std::chrono::nanoseconds duration);
+
+private:
+	struct Histogram {
+		std::array< std::atomic< std::uint64_t >, BUCKET_COUNT > buckets = {};
+		std::atomic< std::uint64_t > count                             = {};
+		std::atomic< std::uint64_t > totalNs                           = {};
+		std::atomic< std::uint64_t > maxNs                             = {};
+	};
+
+	std::array< Histogram, STAGE_COUNT > m_histograms;
+};
+
+#endif // MUMBLE_MUMBLE_AUDIOPIPELINEPROFILE_H_
@@ -246,9 +246,17 @@ Database::Database(const QString &dbname) {
 	execQueryAndLogFailure(query, QLatin1String("SELECT sqlite_version()"));
 	while (query.next())
 		qWarning() << "Database SQLite:" << query.value(0).toString();
+
+	m_cache.load(db);
+
+	m_flushTimer.setSingleShot(true);
+	m_flushTimer.setInterval(FLUSH_INTERVAL);
+	connect(&m_flushTimer, &QTimer::timeout, this, &Database::flush);
 }
 
 Database::~Database() {
+	flush();
+
 	QSqlQuery query(db);
 	execQueryAndLogFailure(query, QLatin1String("PRAGMA journal_mode = DELETE"));
 	execQueryAndLogFailure(query, QLatin1String("VACUUM"));
@@ -297,151 +305,75 @@ void Database::setFavorites(const QList< FavoriteServer > &servers) {
 	db.commit();
 }
 
-bool Database::isLocalIgnored(const QString &hash) {
-	QSqlQuery query(db);
+void Database::scheduleFlush() {
+	if (!m_flushTimer.isActive()) {
+		m_flushTimer.start();
+	}
+}
 
-	query.prepare(QLatin1String("SELECT `hash` FROM `ignored` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	return query.next();
+void Database::flush() {
+	m_flushTimer.stop();
+	m_cache.flush(db);
 }
 
-void Database::setLocalIgnored(const QString &hash, bool ignored) {
-	QSqlQuery query(db);
+bool Database::isLocalIgnored(const QString &hash) {
+	return m_cache.isLocalIgnored(hash);
+}
 
-	if (ignored)
-		query.prepare(QLatin1String("INSERT INTO `ignored` (`hash`) VALUES (?)"));
-	else
-		query.prepare(QLatin1String("DELETE FROM `ignored` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
+void Database::setLocalIgnored(const QString &hash, bool ignored) {
+	m_cache.setLocalIgnored(hash, ignored);
+	scheduleFlush();
 }
 
 bool Database::isLocalIgnoredTTS(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `hash` FROM `ignored_tts` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	return query.next();
+	return m_cache.isLocalIgnoredTTS(hash);
 }
 
 void Database::setLocalIgnoredTTS(const QString &hash, bool ignoredTTS) {
-	QSqlQuery query(db);
-
-	if (ignoredTTS)
-		query.prepare(QLatin1String("INSERT INTO `ignored_tts` (`hash`) VALUES (?)"));
-	else
-		query.prepare(QLatin1String("DELETE FROM `ignored_tts` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
+	m_cache.setLocalIgnoredTTS(hash, ignoredTTS);
+	scheduleFlush();
 }
 
 bool Database::isLocalMuted(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `hash` FROM `muted` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	return query.next();
+	return m_cache.isLocalMuted(hash);
 }
 
 void Database::setUserLocalVolume(const QString &hash, float volume) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("INSERT OR REPLACE INTO `volume` (`hash`, `volume`) VALUES (?,?)"));
-	query.addBindValue(hash);
-	query.addBindValue(QString::number(volume));
-	execQueryAndLogFailure(query);
+	m_cache.setUserLocalVolume(hash, volume);
+	scheduleFlush();
 }
 
 float Database::getUserLocalVolume(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `volume` FROM `volume` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	if (query.first()) {
-		return query.value(0).toString().toFloat();
-	}
-	return 1.0f;
+	return m_cache.getUserLocalVolume(hash);
 }
 
 void Database::setUserLocalNickname(const QString &hash, const QString &nickname) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("INSERT OR REPLACE INTO `nicknames` (`hash`, `nickname`) VALUES (?,?)"));
-	query.addBindValue(hash);
-	query.addBindValue(nickname);
-	execQueryAndLogFailure(query);
+	m_cache.setUserLocalNickname(hash, nickname);
+	scheduleFlush();
 }
 
 QString Database::getUserLocalNickname(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `nickname` FROM `nicknames` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	if (query.first()) {
-		return query.value(0).toString();
-	}
-	return QString();
+	return m_cache.getUserLocalNickname(hash);
 }
 
 void Database::setLocalMuted(const QString &hash, bool muted) {
-	QSqlQuery query(db);
-
-	if (muted)
-		query.prepare(QLatin1String("INSERT INTO `muted` (`hash`) VALUES (?)"));
-	else
-		query.prepare(QLatin1String("DELETE FROM `muted` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
+	m_cache.setLocalMuted(hash, muted);
+	scheduleFlush();
 }
 
 void Database::clearLocalMuted() {
-	QSqlQuery query(db);
-	query.prepare(QLatin1String("DELETE FROM `muted`"));
-	execQueryAndLogFailure(query);
+	m_cache.clearLocalMuted();
+	scheduleFlush();
 }
 
 ChannelFilterMode Database::getChannelFilterMode(const QByteArray &server_cert_digest, const unsigned int channel_id) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String(
-		"SELECT `filter_mode` FROM `filtered_channels` WHERE `server_cert_digest` = ? AND `channel_id` = ?"));
-	query.addBindValue(server_cert_digest);
-	query.addBindValue(channel_id);
-	execQueryAndLogFailure(query);
-
-	if (query.first()) {
-		return static_cast< ChannelFilterMode >(query.value(0).toInt());
-	}
-
-	return ChannelFilterMode::NORMAL;
+	return m_cache.getChannelFilterMode(server_cert_digest, channel_id);
 }
 
 void Database::setChannelFilterMode(const QByteArray &server_cert_digest, const unsigned int channel_id,
 									const ChannelFilterMode filterMode) {
-	QSqlQuery query(db);
-
-	switch (filterMode) {
-		case ChannelFilterMode::NORMAL:
-			query.prepare(
-				QLatin1String("DELETE FROM `filtered_channels` WHERE `server_cert_digest` = ? AND `channel_id` = ?"));
-			break;
-		case ChannelFilterMode::PIN:
-		case ChannelFilterMode::HIDE:
-			query.prepare(QLatin1String("INSERT OR REPLACE INTO `filtered_channels` (`server_cert_digest`, "
-										"`channel_id`, `filter_mode`) VALUES (?, ?, ?)"));
-			query.bindValue(2, static_cast< int >(filterMode));
-			break;
-	}
-
-	query.bindValue(0, server_cert_digest);
-	query.bindValue(1, channel_id);
-
-	execQueryAndLogFailure(query);
+	m_cache.setChannelFilterMode(server_cert_digest, channel_id, filterMode);
+	scheduleFlush();
 }
 
 QMap< UnresolvedServerAddress, unsigned int > Database::getPingCache() {
@@ -479,32 +411,18 @@ void Database::setPingCache(const QMap< UnresolvedServerAddress, unsigned int >
 }
 
 bool Database::seenComment(const QString &hash, const QByteArray &commenthash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT COUNT(*) FROM `comments` WHERE `who` = ? AND `comment` = ?"));
-	query.addBindValue(hash);
-	query.addBindValue(commenthash);
-	execQueryAndLogFailure(query);
-	if (query.next()) {
-		if (query.value(0).toInt() > 0) {
-			query.prepare(
-				QLatin1String("UPDATE `comments` SET `seen` = datetime('now') WHERE `who` = ? AND `comment` = ?"));
-			query.addBindValue(hash);
-			query.addBindValue(commenthash);
-			execQueryAndLogFailure(query);
-			return true;
-		}
+	if (!m_cache.seenComment(hash, commenthash)) {
+		return false;
 	}
-	return false;
+
+	// The time the comment has been seen at has been updated
+	scheduleFlush();
+	return true;
 }
 
 void Database::setSeenComment(const QString &hash, const QByteArray &commenthash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("REPLACE INTO `comments` (`who`, `comment`, `seen`) VALUES (?, ?, datetime('now'))"));
-	query.addBindValue(hash);
-	query.addBindValue(commenthash);
-	execQueryAndLogFailure(query);
+	m_cache.setSeenComment(hash, commenthash);
+	scheduleFlush();
 }
 
 QByteArray Database::blob(const QByteArray &hash) {
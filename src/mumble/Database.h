@@ -7,9 +7,11 @@
 #define MUMBLE_MUMBLE_DATABASE_H_
 
 #include "Channel.h"
+#include "DatabaseCache.h"
 #include "Settings.h"
 #include "UnresolvedServerAddress.h"
 #include <QSqlDatabase>
+#include <QTimer>
 
 struct FavoriteServer {
 	QString qsName;
@@ -31,6 +33,16 @@ private:
 	/// creates a new one if none was found.
 	bool findOrCreateDatabase();
 
+	/// The tables consulted for every user and channel of a server. The changes made to them are written in batches,
+	/// at most FLUSH_INTERVAL milliseconds after they have been made.
+	DatabaseCache m_cache;
+	QTimer m_flushTimer;
+	static constexpr int FLUSH_INTERVAL = 1000;
+
+	/// Makes sure the changes made to the cache are written soon
+	void scheduleFlush();
+	void flush();
+
 public:
 	Database(const QString &dbname);
 	~Database() Q_DECL_OVERRIDE;
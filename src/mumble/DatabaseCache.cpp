@@ -0,0 +1,231 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "DatabaseCache.h"
+
+#include <QtCore/QDebug>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+
+static void logSQLError(const QSqlQuery &query, const QString &statement) {
+	qWarning() << "SQL Query failed" << statement;
+	qWarning() << query.lastError().nativeErrorCode() << query.lastError().text();
+}
+
+static bool execAndLogFailure(QSqlQuery &query, const QString &statement) {
+	if (!query.exec(statement)) {
+		logSQLError(query, statement);
+		return false;
+	}
+	return true;
+}
+
+void DatabaseCache::load(QSqlDatabase &db) {
+	m_ignored.clear();
+	m_ignoredTTS.clear();
+	m_muted.clear();
+	m_volumes.clear();
+	m_nicknames.clear();
+	m_filterModes.clear();
+	m_seenComments.clear();
+
+	QSqlQuery query(db);
+	// The whole tables are read at once, so there's no need to be able to go back
+	query.setForwardOnly(true);
+
+	if (execAndLogFailure(query, QLatin1String("SELECT `hash` FROM `ignored`"))) {
+		while (query.next()) {
+			m_ignored.insert(query.value(0).toString());
+		}
+	}
+
+	if (execAndLogFailure(query, QLatin1String("SELECT `hash` FROM `ignored_tts`"))) {
+		while (query.next()) {
+			m_ignoredTTS.insert(query.value(0).toString());
+		}
+	}
+
+	if (execAndLogFailure(query, QLatin1String("SELECT `hash` FROM `muted`"))) {
+		while (query.next()) {
+			m_muted.insert(query.value(0).toString());
+		}
+	}
+
+	if (execAndLogFailure(query, QLatin1String("SELECT `hash`, `volume` FROM `volume`"))) {
+		while (query.next()) {
+			m_volumes.insert(query.value(0).toString(), query.value(1).toString().toFloat());
+		}
+	}
+
+	if (execAndLogFailure(query, QLatin1String("SELECT `hash`, `nickname` FROM `nicknames`"))) {
+		while (query.next()) {
+			m_nicknames.insert(query.value(0).toString(), query.value(1).toString());
+		}
+	}
+
+	if (execAndLogFailure(query, QLatin1String("SELECT `server_cert_digest`, `channel_id`, `filter_mode` FROM "
+											   "`filtered_channels`"))) {
+		while (query.next()) {
+			m_filterModes.insert(qMakePair(query.value(0).toByteArray(), query.value(1).toUInt()),
+								 static_cast< ChannelFilterMode >(query.value(2).toInt()));
+		}
+	}
+
+	if (execAndLogFailure(query, QLatin1String("SELECT `who`, `comment` FROM `comments`"))) {
+		while (query.next()) {
+			m_seenComments[query.value(0).toString()].insert(query.value(1).toByteArray());
+		}
+	}
+}
+
+void DatabaseCache::flush(QSqlDatabase &db) {
+	if (m_pendingWrites.isEmpty()) {
+		return;
+	}
+
+	db.transaction();
+
+	QSqlQuery query(db);
+	for (const Write &write : m_pendingWrites) {
+		query.prepare(write.first);
+		for (const QVariant &value : write.second) {
+			query.addBindValue(value);
+		}
+		if (!query.exec()) {
+			logSQLError(query, write.first);
+		}
+	}
+
+	db.commit();
+
+	m_pendingWrites.clear();
+}
+
+bool DatabaseCache::hasPendingWrites() const {
+	return !m_pendingWrites.isEmpty();
+}
+
+void DatabaseCache::queue(const QString &statement, const QVariantList &values) {
+	m_pendingWrites.append(qMakePair(statement, values));
+}
+
+bool DatabaseCache::isLocalIgnored(const QString &hash) const {
+	return m_ignored.contains(hash);
+}
+
+void DatabaseCache::setLocalIgnored(const QString &hash, bool ignored) {
+	if (ignored == m_ignored.contains(hash)) {
+		return;
+	}
+
+	if (ignored) {
+		m_ignored.insert(hash);
+		queue(QLatin1String("INSERT INTO `ignored` (`hash`) VALUES (?)"), { hash });
+	} else {
+		m_ignored.remove(hash);
+		queue(QLatin1String("DELETE FROM `ignored` WHERE `hash` = ?"), { hash });
+	}
+}
+
+bool DatabaseCache::isLocalIgnoredTTS(const QString &hash) const {
+	return m_ignoredTTS.contains(hash);
+}
+
+void DatabaseCache::setLocalIgnoredTTS(const QString &hash, bool ignoredTTS) {
+	if (ignoredTTS == m_ignoredTTS.contains(hash)) {
+		return;
+	}
+
+	if (ignoredTTS) {
+		m_ignoredTTS.insert(hash);
+		queue(QLatin1String("INSERT INTO `ignored_tts` (`hash`) VALUES (?)"), { hash });
+	} else {
+		m_ignoredTTS.remove(hash);
+		queue(QLatin1String("DELETE FROM `ignored_tts` WHERE `hash` = ?"), { hash });
+	}
+}
+
+bool DatabaseCache::isLocalMuted(const QString &hash) const {
+	return m_muted.contains(hash);
+}
+
+void DatabaseCache::setLocalMuted(const QString &hash, bool muted) {
+	if (muted == m_muted.contains(hash)) {
+		return;
+	}
+
+	if (muted) {
+		m_muted.insert(hash);
+		queue(QLatin1String("INSERT INTO `muted` (`hash`) VALUES (?)"), { hash });
+	} else {
+		m_muted.remove(hash);
+		queue(QLatin1String("DELETE FROM `muted` WHERE `hash` = ?"), { hash });
+	}
+}
+
+void DatabaseCache::clearLocalMuted() {
+	m_muted.clear();
+	queue(QLatin1String("DELETE FROM `muted`"), {});
+}
+
+float DatabaseCache::getUserLocalVolume(const QString &hash) const {
+	return m_volumes.value(hash, 1.0f);
+}
+
+void DatabaseCache::setUserLocalVolume(const QString &hash, float volume) {
+	m_volumes.insert(hash, volume);
+	queue(QLatin1String("INSERT OR REPLACE INTO `volume` (`hash`, `volume`) VALUES (?,?)"),
+		  { hash, QString::number(volume) });
+}
+
+QString DatabaseCache::getUserLocalNickname(const QString &hash) const {
+	return m_nicknames.value(hash);
+}
+
+void DatabaseCache::setUserLocalNickname(const QString &hash, const QString &nickname) {
+	m_nicknames.insert(hash, nickname);
+	queue(QLatin1String("INSERT OR REPLACE INTO `nicknames` (`hash`, `nickname`) VALUES (?,?)"), { hash, nickname });
+}
+
+ChannelFilterMode DatabaseCache::getChannelFilterMode(const QByteArray &server_cert_digest,
+													  unsigned int channel_id) const {
+	return m_filterModes.value(qMakePair(server_cert_digest, channel_id), ChannelFilterMode::NORMAL);
+}
+
+void DatabaseCache::setChannelFilterMode(const QByteArray &server_cert_digest, unsigned int channel_id,
+										 ChannelFilterMode filterMode) {
+	switch (filterMode) {
+		case ChannelFilterMode::NORMAL:
+			m_filterModes.remove(qMakePair(server_cert_digest, channel_id));
+			queue(QLatin1String("DELETE FROM `filtered_channels` WHERE `server_cert_digest` = ? AND `channel_id` = ?"),
+				  { server_cert_digest, channel_id });
+			break;
+		case ChannelFilterMode::PIN:
+		case ChannelFilterMode::HIDE:
+			m_filterModes.insert(qMakePair(server_cert_digest, channel_id), filterMode);
+			queue(QLatin1String("INSERT OR REPLACE INTO `filtered_channels` (`server_cert_digest`, `channel_id`, "
+								"`filter_mode`) VALUES (?, ?, ?)"),
+				  { server_cert_digest, channel_id, static_cast< int >(filterMode) });
+			break;
+	}
+}
+
+bool DatabaseCache::seenComment(const QString &hash, const QByteArray &commenthash) {
+	const auto it = m_seenComments.constFind(hash);
+	if (it == m_seenComments.constEnd() || !it->contains(commenthash)) {
+		return false;
+	}
+
+	queue(QLatin1String("UPDATE `comments` SET `seen` = datetime('now') WHERE `who` = ? AND `comment` = ?"),
+		  { hash, commenthash });
+	return true;
+}
+
+void DatabaseCache::setSeenComment(const QString &hash, const QByteArray &commenthash) {
+	m_seenComments[hash].insert(commenthash);
+	queue(QLatin1String("REPLACE INTO `comments` (`who`, `comment`, `seen`) VALUES (?, ?, datetime('now'))"),
+		  { hash, commenthash });
+}
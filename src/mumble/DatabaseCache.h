@@ -0,0 +1,80 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_DATABASECACHE_H_
+#define MUMBLE_MUMBLE_DATABASECACHE_H_
+
+#include "ChannelFilterMode.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+
+class QSqlDatabase;
+
+/// Keeps the tables of the client's database that are consulted for every user and channel showing up on a server
+/// (whether a user is ignored or muted, their volume and nickname, the channels' filter modes and which comments
+/// have been seen already) in memory. Otherwise, synchronizing with a big server would run hundreds of queries on
+/// the GUI thread.
+///
+/// The tables are read once by load(). Changes are applied to the cache right away, while the statements writing
+/// them to the database are collected until flush() writes all of them in a single transaction.
+class DatabaseCache {
+public:
+	/// Reads the tables from the given database, replacing whatever has been cached before
+	void load(QSqlDatabase &db);
+	/// Writes all changes that haven't been written yet to the given database
+	void flush(QSqlDatabase &db);
+	bool hasPendingWrites() const;
+
+	bool isLocalIgnored(const QString &hash) const;
+	void setLocalIgnored(const QString &hash, bool ignored);
+
+	bool isLocalIgnoredTTS(const QString &hash) const;
+	void setLocalIgnoredTTS(const QString &hash, bool ignoredTTS);
+
+	bool isLocalMuted(const QString &hash) const;
+	void setLocalMuted(const QString &hash, bool muted);
+	void clearLocalMuted();
+
+	float getUserLocalVolume(const QString &hash) const;
+	void setUserLocalVolume(const QString &hash, float volume);
+
+	QString getUserLocalNickname(const QString &hash) const;
+	void setUserLocalNickname(const QString &hash, const QString &nickname);
+
+	ChannelFilterMode getChannelFilterMode(const QByteArray &server_cert_digest, unsigned int channel_id) const;
+	void setChannelFilterMode(const QByteArray &server_cert_digest, unsigned int channel_id,
+							  ChannelFilterMode filterMode);
+
+	/// @returns Whether the given comment of the given user has been seen before. If so, the time it has been seen
+	/// 	at is updated.
+	bool seenComment(const QString &hash, const QByteArray &commenthash);
+	void setSeenComment(const QString &hash, const QByteArray &commenthash);
+
+private:
+	/// A statement along with the values bound to it
+	using Write = QPair< QString, QVariantList >;
+
+	void queue(const QString &statement, const QVariantList &values);
+
+	QSet< QString > m_ignored;
+	QSet< QString > m_ignoredTTS;
+	QSet< QString > m_muted;
+	QHash< QString, float > m_volumes;
+	QHash< QString, QString > m_nicknames;
+	/// Only the channels that aren't filtered normally, by server certificate digest and channel ID
+	QHash< QPair< QByteArray, unsigned int >, ChannelFilterMode > m_filterModes;
+	/// The hashes of the comments that have been seen, by the hash of the user they belong to
+	QHash< QString, QSet< QByteArray > > m_seenComments;
+
+	QList< Write > m_pendingWrites;
+};
+
+#endif
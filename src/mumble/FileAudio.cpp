@@ -0,0 +1,292 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "FileAudio.h"
+
+#include "AudioPipelineProfile.h"
+#include "MainWindow.h"
+#include "Global.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+
+#include <algorithm>
+#include <cstdio>
+
+/// The profile the input and the output record the durations of their stages in
+static AudioPipelineProfile profile;
+
+/// The amount of silence (in chunks of 10 ms) that is fed through the pipeline after the end of the input file, so
+/// that the last packets make it through the loopback and the jitter buffer
+static constexpr unsigned int TAIL_CHUNKS = 100;
+
+/// Quits the client, once it gets back to its event loop. Global::fileAudioSucceeded decides the exit status.
+static void quitClient() {
+	QMetaObject::invokeMethod(Global::get().mw->qaQuit, "trigger", Qt::QueuedConnection);
+}
+
+class FileAudioInputRegistrar : public AudioInputRegistrar {
+public:
+	FileAudioInputRegistrar();
+	virtual AudioInput *create();
+	virtual const QVariant getDeviceChoice();
+	virtual const QList< audioDevice > getDeviceChoices();
+	virtual void setDeviceChoice(const QVariant &, Settings &);
+	virtual bool canEcho(EchoCancelOptionID echoCancelID, const QString &outputSystem) const;
+	virtual bool isMicrophoneAccessDeniedByOS() { return false; };
+};
+
+
+class FileAudioOutputRegistrar : public AudioOutputRegistrar {
+public:
+	FileAudioOutputRegistrar();
+	virtual AudioOutput *create();
+	virtual const QVariant getDeviceChoice();
+	virtual const QList< audioDevice > getDeviceChoices();
+	virtual void setDeviceChoice(const QVariant &, Settings &);
+};
+
+const QString FileAudioInput::name = QLatin1String("File");
+
+static FileAudioInputRegistrar airFile;
+static FileAudioOutputRegistrar aorFile;
+
+// The backend has the lowest priority, so that it is never picked unless it has been asked for explicitly
+FileAudioInputRegistrar::FileAudioInputRegistrar() : AudioInputRegistrar(FileAudioInput::name, -1) {
+	echoOptions.push_back(EchoCancelOptionID::SPEEX_MIXED);
+	echoOptions.push_back(EchoCancelOptionID::SPEEX_MULTICHANNEL);
+}
+
+AudioInput *FileAudioInputRegistrar::create() {
+	return new FileAudioInput();
+}
+
+const QVariant FileAudioInputRegistrar::getDeviceChoice() {
+	return Global::get().fileAudioInput;
+}
+
+const QList< audioDevice > FileAudioInputRegistrar::getDeviceChoices() {
+	QList< audioDevice > choices;
+	if (!Global::get().fileAudioInput.isEmpty()) {
+		choices << audioDevice(Global::get().fileAudioInput, Global::get().fileAudioInput);
+	}
+	return choices;
+}
+
+void FileAudioInputRegistrar::setDeviceChoice(const QVariant &, Settings &) {
+	// The file is given on the command line
+}
+
+bool FileAudioInputRegistrar::canEcho(EchoCancelOptionID echoOption, const QString &outputSystem) const {
+	return (echoOption == EchoCancelOptionID::SPEEX_MIXED || echoOption == EchoCancelOptionID::SPEEX_MULTICHANNEL)
+		   && (outputSystem == name);
+}
+
+FileAudioOutputRegistrar::FileAudioOutputRegistrar() : AudioOutputRegistrar(FileAudioInput::name, -1) {
+}
+
+AudioOutput *FileAudioOutputRegistrar::create() {
+	return new FileAudioOutput();
+}
+
+const QVariant FileAudioOutputRegistrar::getDeviceChoice() {
+	return Global::get().fileAudioOutput;
+}
+
+const QList< audioDevice > FileAudioOutputRegistrar::getDeviceChoices() {
+	QList< audioDevice > choices;
+	if (!Global::get().fileAudioOutput.isEmpty()) {
+		choices << audioDevice(Global::get().fileAudioOutput, Global::get().fileAudioOutput);
+	}
+	return choices;
+}
+
+void FileAudioOutputRegistrar::setDeviceChoice(const QVariant &, Settings &) {
+	// The file is given on the command line
+}
+
+FileAudioInput::FileAudioInput() {
+	m_profile = &profile;
+	bRunning  = true;
+}
+
+FileAudioInput::~FileAudioInput() {
+	// Signal input thread to end
+	bRunning = false;
+	wait();
+}
+
+void FileAudioInput::run() {
+	const QString path = Global::get().fileAudioInput;
+
+	SF_INFO info  = {};
+	SNDFILE *file = sf_open(QFile::encodeName(path).constData(), SFM_READ, &info);
+	if (!file) {
+		qWarning("FileAudioInput: Failed to open %s: %s", qPrintable(path), sf_strerror(nullptr));
+		quitClient();
+		return;
+	}
+
+	// The output is only created once the input has been started. If it is a file as well, it is driven by this
+	// thread and read back for echo cancellation.
+	QElapsedTimer timer;
+	timer.start();
+	while (bRunning && !Global::get().ao && !timer.hasExpired(1000)) {
+		msleep(10);
+	}
+
+	bool echo = false;
+	{
+		AudioOutputPtr ao       = Global::get().ao;
+		FileAudioOutput *output = dynamic_cast< FileAudioOutput * >(ao.get());
+		if (!output || !output->isOpen()) {
+			if (bRunning) {
+				qWarning("FileAudioInput: There is no output file to write to");
+				quitClient();
+			}
+			sf_close(file);
+			return;
+		}
+
+		echo = Global::get().s.echoOption != EchoCancelOptionID::DISABLED;
+	}
+
+	iMicFreq     = static_cast< unsigned int >(info.samplerate);
+	iMicChannels = static_cast< unsigned int >(info.channels);
+	eMicFormat   = SampleFloat;
+
+	if (echo) {
+		iEchoFreq     = SAMPLE_RATE;
+		iEchoChannels = FileAudioOutput::CHANNELS;
+		eEchoFormat   = SampleFloat;
+	}
+
+	initializeMixer();
+
+	qWarning("FileAudioInput: Processing %s", qPrintable(path));
+
+	profile.reset();
+
+	std::vector< float > chunk(iMicLength * iMicChannels);
+	unsigned int chunks     = 0;
+	unsigned int tailChunks = 0;
+
+	timer.restart();
+
+	while (bRunning && tailChunks < TAIL_CHUNKS) {
+		const sf_count_t read = sf_readf_float(file, chunk.data(), iMicLength);
+		if (read < static_cast< sf_count_t >(iMicLength)) {
+			// Pad the end of the file with silence
+			std::fill(chunk.begin() + read * iMicChannels, chunk.end(), 0.0f);
+			++tailChunks;
+		}
+
+		// The input records the processing of the frames itself, as with echo cancellation, that only happens in
+		// addEcho()
+		addMic(chunk.data(), iMicLength);
+
+		++chunks;
+		LoopUser::lpLoopy.setVirtualTime(chunks * 10);
+
+		AudioOutputPtr ao       = Global::get().ao;
+		FileAudioOutput *output = dynamic_cast< FileAudioOutput * >(ao.get());
+		if (output) {
+			const float *mixed = output->process();
+			if (echo) {
+				addEcho(mixed, SAMPLE_RATE / 100);
+			}
+		}
+	}
+
+	LoopUser::lpLoopy.setVirtualTime(-1);
+	sf_close(file);
+
+	if (!bRunning) {
+		// We have been stopped before the whole file has been processed
+		return;
+	}
+
+	{
+		AudioOutputPtr ao                = Global::get().ao;
+		FileAudioOutput *output          = dynamic_cast< FileAudioOutput * >(ao.get());
+		Global::get().fileAudioSucceeded = output && output->isOpen();
+	}
+
+	const double audioSeconds = chunks / 100.0;
+	const double wallSeconds  = static_cast< double >(timer.nsecsElapsed()) / 1000000000.0;
+
+	printf("Processed %.2f s of audio in %.2f s (%.1fx real time)\n\n%s", audioSeconds, wallSeconds,
+		   audioSeconds / std::max(wallSeconds, 0.001), qPrintable(profile.report()));
+	fflush(stdout);
+
+	quitClient();
+}
+
+FileAudioOutput::FileAudioOutput() {
+	m_profile = &profile;
+
+	const QString path = Global::get().fileAudioOutput;
+
+	SF_INFO info    = {};
+	info.samplerate = SAMPLE_RATE;
+	info.channels   = CHANNELS;
+	info.format     = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+
+	m_file = sf_open(QFile::encodeName(path).constData(), SFM_WRITE, &info);
+	if (!m_file) {
+		qWarning("FileAudioOutput: Failed to open %s: %s", qPrintable(path), sf_strerror(nullptr));
+	}
+
+	// The mixer is set up right away (instead of in run()), so that the input can drive it as soon as it exists
+	const unsigned int chanmasks[32] = { SPEAKER_FRONT_LEFT, SPEAKER_FRONT_RIGHT };
+
+	iChannels     = CHANNELS;
+	iMixerFreq    = SAMPLE_RATE;
+	eSampleFormat = SampleFloat;
+
+	initializeMixer(chanmasks);
+
+	m_buffer.resize(iFrameSize * iChannels);
+}
+
+FileAudioOutput::~FileAudioOutput() {
+	bRunning = false;
+	wait();
+
+	if (m_file) {
+		sf_close(m_file);
+	}
+}
+
+void FileAudioOutput::run() {
+	// The input does the mixing. The thread only has to be alive for the output to accept any audio.
+	while (bRunning) {
+		msleep(100);
+	}
+}
+
+const float *FileAudioOutput::process() {
+	AudioPipelineProfile::Stopwatch stopwatch(m_profile);
+
+	// mix() doesn't touch the buffer if the output has been turned all the way down
+	std::fill(m_buffer.begin(), m_buffer.end(), 0.0f);
+
+	stopwatch.start();
+	mix(m_buffer.data(), iFrameSize);
+	stopwatch.stop(AudioPipelineProfile::Stage::Playback);
+
+	if (m_file && sf_writef_float(m_file, m_buffer.data(), iFrameSize) != static_cast< sf_count_t >(iFrameSize)) {
+		qWarning("FileAudioOutput: Failed to write to %s: %s", qPrintable(Global::get().fileAudioOutput),
+				 sf_strerror(m_file));
+		sf_close(m_file);
+		m_file = nullptr;
+	}
+
+	return m_buffer.data();
+}
+
+bool FileAudioOutput::isOpen() const {
+	return m_file != nullptr;
+}
@@ -0,0 +1,65 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_FILEAUDIO_H_
+#define MUMBLE_MUMBLE_FILEAUDIO_H_
+
+#include "AudioInput.h"
+#include "AudioOutput.h"
+
+#include <sndfile.h>
+
+#include <vector>
+
+/// Takes the place of the microphone by reading a WAV file (Global::fileAudioInput), so that the audio pipeline can be
+/// run on machines without any sound devices, e.g. to profile it or to catch regressions in CI.
+///
+/// The file is processed as fast as possible. For every chunk of input, the input also has a FileAudioOutput mix the
+/// same amount of audio, so that both pipelines advance in lockstep on the input's thread. The local loopback is
+/// advanced along with them instead of by the real time. Combined with its simulated packet loss and delay, this runs
+/// the playback pipeline (jitter buffer, decoding, resampling and mixing) on the packets the capture pipeline
+/// produced.
+///
+/// Once the whole file has been processed, the durations of the pipeline's stages are printed and the client quits.
+class FileAudioInput : public AudioInput {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(FileAudioInput)
+public:
+	/// The name the backend is registered under (for both input and output)
+	static const QString name;
+
+	FileAudioInput();
+	~FileAudioInput() Q_DECL_OVERRIDE;
+	void run() Q_DECL_OVERRIDE;
+};
+
+/// Writes the mixed output to a WAV file (Global::fileAudioOutput). It doesn't mix anything by itself, but is driven
+/// by a FileAudioInput.
+class FileAudioOutput : public AudioOutput {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(FileAudioOutput)
+protected:
+	SNDFILE *m_file = nullptr;
+	std::vector< float > m_buffer;
+
+public:
+	/// The amount of channels the output is mixed to
+	static constexpr unsigned int CHANNELS = 2;
+
+	FileAudioOutput();
+	~FileAudioOutput() Q_DECL_OVERRIDE;
+	void run() Q_DECL_OVERRIDE;
+
+	/// @returns Whether the output file is open and everything has been written to it so far
+	bool isOpen() const;
+
+	/// Mixes the next 10 ms of output (CHANNELS interleaved channels at SAMPLE_RATE) and appends them to the file
+	/// @returns The mixed output, which stays valid until the next call
+	const float *process();
+};
+
+#endif
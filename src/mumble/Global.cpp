@@ -136,6 +136,9 @@ Global::Global(const QString &qsConfigPath) {
 	bQuit            = false;
 	bDebugDumpInput  = false;
 	bDebugPrintQueue = false;
+#ifdef USE_FILE_AUDIO
+	fileAudioSucceeded = false;
+#endif
 
 	channelListenerManager = std::make_unique< ChannelListenerManager >();
 
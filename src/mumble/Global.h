@@ -109,6 +109,14 @@ public:
 	QString windowTitlePostfix;
 	bool bDebugDumpInput;
 	bool bDebugPrintQueue;
+#ifdef USE_FILE_AUDIO
+	/// The WAV files the file audio backend reads the input from and writes the output to (see --audio-file)
+	QString fileAudioInput;
+	QString fileAudioOutput;
+	/// Whether the file audio backend has processed the whole input file and written all of the output. This decides
+	/// the client's exit status.
+	bool fileAudioSucceeded;
+#endif
 	std::unique_ptr< ChannelListenerManager > channelListenerManager;
 
 	bool bHappyEaster;
@@ -0,0 +1,71 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "OverlayBlit.h"
+
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include <QtWidgets/QGraphicsScene>
+
+namespace Mumble {
+namespace OverlayBlit {
+
+	static qint64 area(const QRect &rect) { return static_cast< qint64 >(rect.width()) * rect.height(); }
+
+	QList< QRect > coalesceDirtyRects(const QList< QRectF > &dirty, const QRect &bounds) {
+		QList< QRect > rects;
+		for (const QRectF &rectf : dirty) {
+			const QRect rect = rectf.toAlignedRect().intersected(bounds);
+			if ((rect.width() > 0) && (rect.height() > 0)) {
+				rects.append(rect);
+			}
+		}
+
+		bool merged = true;
+		while (merged) {
+			merged = false;
+
+			for (int i = 0; i < rects.size() && !merged; ++i) {
+				for (int j = i + 1; j < rects.size(); ++j) {
+					const QRect united = rects[i].united(rects[j]);
+					if (area(united) <= area(rects[i]) + area(rects[j]) + OVERHEAD_PIXELS) {
+						rects[i] = united;
+						rects.removeAt(j);
+						merged = true;
+						break;
+					}
+				}
+			}
+		}
+
+		if (rects.size() > MAX_BLITS_PER_FRAME) {
+			QRect united;
+			for (const QRect &rect : rects) {
+				united |= rect;
+			}
+			rects = { united };
+		}
+
+		return rects;
+	}
+
+	void render(QGraphicsScene &scene, QImage &image, const QList< QRect > &rects) {
+		QPainter p;
+		p.begin(&image);
+		p.setRenderHints(p.renderHints(), false);
+
+		for (const QRect &rect : rects) {
+			p.setClipRect(rect);
+			p.setCompositionMode(QPainter::CompositionMode_Source);
+			p.fillRect(rect, Qt::transparent);
+			p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+			scene.render(&p, rect, rect, Qt::IgnoreAspectRatio);
+		}
+
+		p.end();
+	}
+
+} // namespace OverlayBlit
+} // namespace Mumble
@@ -0,0 +1,41 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_OVERLAYBLIT_H_
+#define MUMBLE_MUMBLE_OVERLAYBLIT_H_
+
+#include <QtCore/QList>
+#include <QtCore/QRect>
+#include <QtCore/QRectF>
+
+class QGraphicsScene;
+class QImage;
+
+namespace Mumble {
+namespace OverlayBlit {
+
+	/// Dirty rects are only blitted separately if that saves at least this many pixels, as every blit has an
+	/// overhead of its own (a message and a texture upload in the game's process)
+	constexpr qint64 OVERHEAD_PIXELS = 64 * 64;
+	/// If the scene changed in more places than this, it is cheaper to update their bounding rect as a whole
+	constexpr int MAX_BLITS_PER_FRAME = 8;
+
+	/**
+	 * Turns the given dirty rects into a few rects within bounds that cover them. Rects are merged with each other
+	 * for as long as updating their bounding rect is (about) as cheap as updating them separately, so that e.g.
+	 * changes in opposite corners of the screen don't cause the whole screen to be updated.
+	 */
+	QList< QRect > coalesceDirtyRects(const QList< QRectF > &dirty, const QRect &bounds);
+
+	/**
+	 * Clears the given rects of the image and renders the same rects of the scene into them. Nothing outside of
+	 * them is touched.
+	 */
+	void render(QGraphicsScene &scene, QImage &image, const QList< QRect > &rects);
+
+} // namespace OverlayBlit
+} // namespace Mumble
+
+#endif // MUMBLE_MUMBLE_OVERLAYBLIT_H_
@@ -8,6 +8,7 @@
 #include "Database.h"
 #include "MainWindow.h"
 #include "NetworkConfig.h"
+#include "OverlayBlit.h"
 #include "OverlayEditor.h"
 #include "OverlayPositionableItem.h"
 #include "OverlayText.h"
@@ -561,42 +562,23 @@ void OverlayClient::render() {
 		return;
 
 	QRect active;
-	QRectF dirtyf;
 
 	if (region.isEmpty())
 		return;
 
-	foreach (const QRectF &r, region) { dirtyf |= r; }
+	const QList< QRect > dirtyRects = Mumble::OverlayBlit::coalesceDirtyRects(region, QRect(0, 0, iWidth, iHeight));
 
-
-	QRect dirty = dirtyf.toAlignedRect();
-	dirty       = dirty.intersected(QRect(0, 0, iWidth, iHeight));
-
-	if ((dirty.width() <= 0) || (dirty.height() <= 0))
+	if (dirtyRects.isEmpty())
 		return;
 
-	QRect target = dirty;
-	target.moveTo(0, 0);
-
+	// Every region is cleared and rendered right into the shared memory, so that only the pixels the game is told
+	// about are touched
 	QImage img(reinterpret_cast< unsigned char * >(smMem->data()), iWidth, iHeight,
 			   QImage::Format_ARGB32_Premultiplied);
-	QImage qi(target.size(), QImage::Format_ARGB32_Premultiplied);
-	qi.fill(0);
-
-	QPainter p;
-	p.begin(&qi);
-	p.setRenderHints(p.renderHints(), false);
-	p.setCompositionMode(QPainter::CompositionMode_SourceOver);
-	qgs.render(&p, target, dirty, Qt::IgnoreAspectRatio);
-	p.end();
-
-	p.begin(&img);
-	p.setRenderHints(p.renderHints(), false);
-	p.setCompositionMode(QPainter::CompositionMode_Source);
-	p.drawImage(dirty.x(), dirty.y(), qi);
-	p.end();
-
-	if (dirty.isValid()) {
+
+	Mumble::OverlayBlit::render(qgs, img, dirtyRects);
+
+	for (const QRect &dirty : dirtyRects) {
 		OverlayMsg om;
 		om.omh.uiMagic = OVERLAY_MAGIC_NUMBER;
 		om.omh.uiType  = OVERLAY_MSGTYPE_BLIT;
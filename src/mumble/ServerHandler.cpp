@@ -673,7 +673,10 @@ void ServerHandler::message(Mumble::Protocol::TCPMessageType type, const QByteAr
 			}
 		}
 	} else {
-		ServerHandlerMessageEvent *shme = new ServerHandlerMessageEvent(qbaMsg, type, false);
+		// The message refers to the connection's receive buffer, so it has to be copied before handing it to the
+		// main thread
+		ServerHandlerMessageEvent *shme =
+			new ServerHandlerMessageEvent(QByteArray(qbaMsg.constData(), qbaMsg.size()), type, false);
 		QApplication::postEvent(Global::get().mw, shme);
 	}
 }
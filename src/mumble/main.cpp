@@ -51,6 +51,10 @@
 #include "VersionCheck.h"
 #include "Global.h"
 
+#ifdef USE_FILE_AUDIO
+#	include "FileAudio.h"
+#endif
+
 #include "widgets/TrayIcon.h"
 
 #include <QLocale>
@@ -206,6 +210,17 @@ int main(int argc, char **argv) {
 	bool bRpcMode             = false;
 	bool printTranslationDirs = false;
 	bool startHiddenInTray    = false;
+#ifdef USE_FILE_AUDIO
+	bool fileAudioRun    = false;
+	float fileAudioLoss  = 0.0f;
+	float fileAudioDelay = 0.0f;
+
+	// The stored settings that are overridden for the run
+	Settings::AudioTransmit savedTransmit = Settings::Continuous;
+	bool savedMute                        = false;
+#else
+	constexpr bool fileAudioRun = false;
+#endif
 	QString rpcCommand;
 	QUrl url;
 	QDir qdCert(QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation));
@@ -286,6 +301,20 @@ int main(int argc, char **argv) {
 								   "  --hidden\n"
 								   "                Start Mumble hidden in the system tray."
 								   "\n");
+#ifdef USE_FILE_AUDIO
+				helpMessage +=
+					MainWindow::tr("  --audio-file <input> <output>\n"
+								   "                Run the audio pipeline on the WAV file <input> through\n"
+								   "                the local loopback, write what is played back to the\n"
+								   "                WAV file <output>, print how long the stages of the\n"
+								   "                pipeline took and exit.\n"
+								   "  --audio-file-loss <percent>\n"
+								   "                Drop the given percentage of packets in the loopback\n"
+								   "                of --audio-file.\n"
+								   "  --audio-file-delay <ms>\n"
+								   "                Delay the packets in the loopback of --audio-file by\n"
+								   "                a random amount of up to <ms> milliseconds.\n");
+#endif
 				QString rpcHelpBanner = MainWindow::tr("Remote controlling Mumble:\n"
 													   "\n");
 				QString rpcHelpMessage =
@@ -374,6 +403,38 @@ int main(int argc, char **argv) {
 				Global::get().bDebugDumpInput = true;
 			} else if (args.at(i) == QLatin1String("--print-echocancel-queue")) {
 				Global::get().bDebugPrintQueue = true;
+#ifdef USE_FILE_AUDIO
+			} else if (args.at(i) == QLatin1String("--audio-file")) {
+				if (i + 2 < args.count()) {
+					Global::get().fileAudioInput  = args.at(i + 1);
+					Global::get().fileAudioOutput = args.at(i + 2);
+					fileAudioRun                  = true;
+					i += 2;
+				} else {
+					qCritical("Missing arguments for --audio-file!");
+					return 1;
+				}
+			} else if (args.at(i) == QLatin1String("--audio-file-loss")) {
+				bool ok = false;
+				if (i + 1 < args.count()) {
+					fileAudioLoss = args.at(i + 1).toFloat(&ok) / 100.0f;
+					++i;
+				}
+				if (!ok || fileAudioLoss < 0.0f || fileAudioLoss > 1.0f) {
+					qCritical("Missing or invalid argument for --audio-file-loss!");
+					return 1;
+				}
+			} else if (args.at(i) == QLatin1String("--audio-file-delay")) {
+				bool ok = false;
+				if (i + 1 < args.count()) {
+					fileAudioDelay = args.at(i + 1).toFloat(&ok);
+					++i;
+				}
+				if (!ok || fileAudioDelay < 0.0f) {
+					qCritical("Missing or invalid argument for --audio-file-delay!");
+					return 1;
+				}
+#endif
 			} else if (args.at(i) == QLatin1String("-c") || args.at(i) == QLatin1String("--config")) {
 				//	We already parsed these arguments above, so just skip over them here
 				++i;
@@ -737,18 +798,44 @@ int main(int argc, char **argv) {
 
 	Global::get().l->log(Log::Information, MainWindow::tr("Welcome to Mumble."));
 
+#ifdef USE_FILE_AUDIO
+	if (fileAudioRun) {
+		// Feed the file's audio through the local loopback, so that the whole pipeline runs without a server. None of
+		// this is stored in the settings.
+		Global::get().s.lmLoopMode      = Settings::Local;
+		Global::get().s.dPacketLoss     = fileAudioLoss;
+		Global::get().s.dMaxPacketDelay = fileAudioDelay;
+
+		// All of the file has to be sent, regardless of how the profile transmits. These are restored before saving.
+		savedTransmit              = Global::get().s.atTransmit;
+		savedMute                  = Global::get().s.bMute;
+		Global::get().s.atTransmit = Settings::Continuous;
+		Global::get().s.bMute      = false;
+
+		const QString audioInput  = Global::get().s.qsAudioInput;
+		const QString audioOutput = Global::get().s.qsAudioOutput;
+
+		Audio::start(FileAudioInput::name, FileAudioInput::name);
+
+		Global::get().s.qsAudioInput  = audioInput;
+		Global::get().s.qsAudioOutput = audioOutput;
+	} else {
+		Audio::start();
+	}
+#else
 	Audio::start();
+#endif
 
 	a.setQuitOnLastWindowClosed(false);
 
-	if (!Global::get().s.audioWizardShown) {
+	if (!fileAudioRun && !Global::get().s.audioWizardShown) {
 		auto wizard = std::make_unique< AudioWizard >(Global::get().mw);
 		wizard->exec();
 
 		Global::get().s.audioWizardShown = true;
 	}
 
-	if (!CertWizard::validateCert(Global::get().s.kpCertificate)) {
+	if (!fileAudioRun && !CertWizard::validateCert(Global::get().s.kpCertificate)) {
 		QFile qf(qdCert.absoluteFilePath(QLatin1String("MumbleAutomaticCertificateBackup.p12")));
 		if (qf.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
 			Settings::KeyPair kp = CertWizard::importCert(qf.readAll());
@@ -771,7 +858,8 @@ int main(int argc, char **argv) {
 		}
 	}
 
-	if (QDateTime::currentDateTime().daysTo(Global::get().s.kpCertificate.first.first().expiryDate()) < 14)
+	if (!Global::get().s.kpCertificate.first.isEmpty()
+		&& QDateTime::currentDateTime().daysTo(Global::get().s.kpCertificate.first.first().expiryDate()) < 14)
 		Global::get().l->log(
 			Log::Warning,
 			CertWizard::tr("<b>Certificate Expiry:</b> Your certificate is about to expire. You need to renew it, "
@@ -806,13 +894,24 @@ int main(int argc, char **argv) {
 		OpenURLEvent *oue = new OpenURLEvent(a.quLaunchURL);
 		qApp->postEvent(Global::get().mw, oue);
 #endif
-	} else if (!startHiddenInTray || Global::get().s.bAutoConnect) {
+	} else if (!fileAudioRun && (!startHiddenInTray || Global::get().s.bAutoConnect)) {
 		Global::get().mw->on_qaServerConnect_triggered(true);
 	}
 
 	if (!Global::get().bQuit)
 		res = a.exec();
 
+#ifdef USE_FILE_AUDIO
+	if (fileAudioRun) {
+		if (res == 0 && !Global::get().fileAudioSucceeded) {
+			res = 1;
+		}
+
+		Global::get().s.atTransmit = savedTransmit;
+		Global::get().s.bMute      = savedMute;
+	}
+#endif
+
 	// Indicate that this was a regular shutdown
 	Global::get().s.mumbleQuitNormally = true;
 	Global::get().s.save();
@@ -0,0 +1,117 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ACLCache.h"
+
+#include <algorithm>
+
+ACLCache::UserCache::Chunk::Chunk() {
+	for (std::atomic< std::uint64_t > &entry : entries) {
+		entry.store(0, std::memory_order_relaxed);
+	}
+}
+
+ACLCache::UserCache::UserCache() : m_validFrom(0) {
+	for (std::atomic< Chunk * > &chunk : m_chunks) {
+		chunk.store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+ACLCache::UserCache::~UserCache() {
+	for (std::atomic< Chunk * > &chunk : m_chunks) {
+		delete chunk.load();
+	}
+}
+
+std::atomic< std::uint64_t > *ACLCache::UserCache::entry(unsigned int channelID, bool create) {
+	const std::size_t chunkIndex = channelID / CHUNK_SIZE;
+	if (chunkIndex >= MAX_CHUNKS) {
+		return nullptr;
+	}
+
+	Chunk *chunk = m_chunks[chunkIndex].load(std::memory_order_acquire);
+	if (!chunk) {
+		if (!create) {
+			return nullptr;
+		}
+
+		// Another thread may be allocating the same chunk at the same time, in which case its chunk is used
+		Chunk *allocated = new Chunk();
+		if (m_chunks[chunkIndex].compare_exchange_strong(chunk, allocated, std::memory_order_acq_rel)) {
+			chunk = allocated;
+		} else {
+			delete allocated;
+		}
+	}
+
+	return &chunk->entries[channelID % CHUNK_SIZE];
+}
+
+const std::atomic< std::uint64_t > *ACLCache::UserCache::entry(unsigned int channelID) const {
+	return const_cast< UserCache * >(this)->entry(channelID, false);
+}
+
+bool ACLCache::lookup(const UserCache &user, unsigned int channelID, ChanACL::Permissions &permissions) const {
+	const std::atomic< std::uint64_t > *entry = user.entry(channelID);
+	if (!entry) {
+		return false;
+	}
+
+	const std::uint64_t value = entry->load(std::memory_order_acquire);
+
+	if ((value >> PERMISSION_BITS) < validFrom(user)) {
+		return false;
+	}
+
+	permissions = static_cast< ChanACL::Permissions >(static_cast< int >(value & PERMISSION_MASK));
+
+	return true;
+}
+
+std::uint64_t ACLCache::generation() const {
+	return m_generation.load(std::memory_order_acquire);
+}
+
+void ACLCache::store(UserCache &user, unsigned int channelID, ChanACL::Permissions permissions,
+					 std::uint64_t generation) {
+	std::atomic< std::uint64_t > *entry = user.entry(channelID, true);
+	if (!entry) {
+		return;
+	}
+
+	// The Cached flag doesn't fit and is implied anyway
+	entry->store((generation << PERMISSION_BITS) | (static_cast< unsigned int >(permissions) & PERMISSION_MASK),
+				 std::memory_order_release);
+}
+
+const ChanACL::InheritedPermissions *ACLCache::lookupInherited(const UserCache &user, unsigned int channelID) const {
+	auto it = user.m_inherited.constFind(channelID);
+	if (it == user.m_inherited.constEnd() || it->generation < validFrom(user)) {
+		return nullptr;
+	}
+
+	return &it->permissions;
+}
+
+void ACLCache::storeInherited(UserCache &user, unsigned int channelID, const ChanACL::InheritedPermissions &permissions,
+							  std::uint64_t generation) {
+	user.m_inherited.insert(channelID, { generation, permissions });
+}
+
+bool ACLCache::isUpToDate(const UserCache &user, std::uint64_t generation) const {
+	return generation >= validFrom(user);
+}
+
+void ACLCache::invalidate() {
+	m_validFrom.store(m_generation.fetch_add(1) + 1, std::memory_order_release);
+}
+
+void ACLCache::invalidate(UserCache &user) {
+	user.m_validFrom.store(m_generation.fetch_add(1) + 1, std::memory_order_release);
+}
+
+std::uint64_t ACLCache::validFrom(const UserCache &user) const {
+	return std::max(m_validFrom.load(std::memory_order_acquire), user.m_validFrom.load(std::memory_order_acquire));
+}
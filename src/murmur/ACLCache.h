@@ -0,0 +1,122 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_ACLCACHE_H_
+#define MUMBLE_MURMUR_ACLCACHE_H_
+
+#include "ACL.h"
+
+#include <QtCore/QHash>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/// Caches the effective permissions of users in channels (see ChanACL::effectivePermissions).
+///
+/// Every user owns a UserCache, which is a flat array of entries indexed by channel ID. The server hands out
+/// channel IDs densely (the lowest free ID above the highest persistent one), so they are used as a compact
+/// channel index as they are. Each entry holds the permissions together with the generation they have been
+/// computed in. Invalidating the cache (for everyone or for a single user) merely increments a generation
+/// counter, which makes all affected entries stale at once. Stale entries are recomputed lazily the next time
+/// they are looked up.
+///
+/// Looking up and storing entries is lock-free and may happen concurrently from any number of threads.
+class ACLCache {
+public:
+	/// The cached permissions of a single user
+	class UserCache {
+	public:
+		UserCache();
+		~UserCache();
+		UserCache(const UserCache &) = delete;
+		UserCache &operator=(const UserCache &) = delete;
+
+	private:
+		friend class ACLCache;
+
+		constexpr static const std::size_t CHUNK_SIZE = 256;
+		constexpr static const std::size_t MAX_CHUNKS = 256;
+
+		/// The entries are split into chunks that are allocated once the first entry in them is stored. This way
+		/// the array never has to be reallocated, which would be impossible while other threads are reading it.
+		struct Chunk {
+			std::atomic< std::uint64_t > entries[CHUNK_SIZE];
+
+			Chunk();
+		};
+
+		/// @param create Whether the chunk containing the entry should be allocated if it doesn't exist yet
+		/// @returns The entry for the given channel or nullptr if it doesn't exist (or can't be cached at all)
+		std::atomic< std::uint64_t > *entry(unsigned int channelID, bool create);
+		const std::atomic< std::uint64_t > *entry(unsigned int channelID) const;
+
+		struct InheritedEntry {
+			std::uint64_t generation;
+			ChanACL::InheritedPermissions permissions;
+		};
+
+		std::atomic< Chunk * > m_chunks[MAX_CHUNKS];
+		/// Entries of this user that have been computed in an earlier generation are stale
+		std::atomic< std::uint64_t > m_validFrom;
+		/// The inherited permissions per channel ID (see lookupInherited)
+		QHash< unsigned int, InheritedEntry > m_inherited;
+	};
+
+	/// Looks up the cached permissions of the given user in the channel with the given ID
+	///
+	/// @returns Whether up-to-date permissions have been found
+	bool lookup(const UserCache &user, unsigned int channelID, ChanACL::Permissions &permissions) const;
+
+	/// @returns The generation that permissions computed from now on have to be stored with. It has to be obtained
+	/// 	before the computation starts, so that an invalidation happening in the meantime isn't lost.
+	std::uint64_t generation() const;
+
+	/// Caches the given permissions of the given user in the channel with the given ID
+	///
+	/// @param generation The generation as returned by generation() before the permissions have been computed
+	void store(UserCache &user, unsigned int channelID, ChanACL::Permissions permissions, std::uint64_t generation);
+
+	/// Looks up the permissions of the given user that the channel with the given ID hands down to its subchannels.
+	/// They are invalidated together with the regular entries.
+	///
+	/// In contrast to the other functions, this and storeInherited() are not thread-safe. They are only used while
+	/// computing permissions, which happens with Server::qmCache held.
+	///
+	/// @returns The cached inherited permissions or nullptr if there are no up-to-date ones
+	const ChanACL::InheritedPermissions *lookupInherited(const UserCache &user, unsigned int channelID) const;
+
+	/// Caches the permissions the channel with the given ID hands down to its subchannels (see lookupInherited)
+	///
+	/// @param generation The generation as returned by generation() before the permissions have been computed
+	void storeInherited(UserCache &user, unsigned int channelID, const ChanACL::InheritedPermissions &permissions,
+						std::uint64_t generation);
+
+	/// @returns Whether permissions of the given user computed in the given generation (or anything that has been
+	/// 	derived from them) are still up-to-date
+	bool isUpToDate(const UserCache &user, std::uint64_t generation) const;
+
+	/// Invalidates the cached permissions of all users
+	void invalidate();
+	/// Invalidates the cached permissions of the given user
+	void invalidate(UserCache &user);
+
+private:
+	/// The permissions are stored in the lower bits of an entry and the generation in the upper ones. The remaining
+	/// 40 bits of generation last for more than 30 years, even at a thousand invalidations per second.
+	constexpr static const unsigned int PERMISSION_BITS  = 24;
+	constexpr static const std::uint64_t PERMISSION_MASK = (1ULL << PERMISSION_BITS) - 1;
+
+	static_assert(static_cast< std::uint64_t >(ChanACL::All) <= PERMISSION_MASK, "Permissions don't fit into an entry");
+
+	/// @returns The generation that entries of the given user need to have been computed in to be up-to-date
+	std::uint64_t validFrom(const UserCache &user) const;
+
+	std::atomic< std::uint64_t > m_generation{ 1 };
+	/// Entries that have been computed in an earlier generation are stale
+	std::atomic< std::uint64_t > m_validFrom{ 1 };
+};
+
+#endif // MUMBLE_MURMUR_ACLCACHE_H_
@@ -0,0 +1,336 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BanIndex.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QSet>
+
+#include <algorithm>
+#include <cassert>
+
+constexpr const unsigned int ADDRESS_BITS = 128;
+
+BanIndex::BanIndex() {
+	clear();
+}
+
+unsigned int BanIndex::prefixLength(const Ban &ban) {
+	// HostAddress::match compares all bits for masks of 128 bits and more. Negative masks are converted to unsigned
+	// (and thus huge) ones by the same code.
+	return std::min(static_cast< unsigned int >(ban.iMask), ADDRESS_BITS);
+}
+
+unsigned int BanIndex::bitAt(const HostAddress &address, unsigned int bit) {
+	return (address.getByteRepresentation()[bit / 8] >> (7 - bit % 8)) & 1U;
+}
+
+unsigned int BanIndex::commonPrefixLength(const HostAddress &a, const HostAddress &b, unsigned int limit) {
+	const std::array< std::uint8_t, 16 > &bytesA = a.getByteRepresentation();
+	const std::array< std::uint8_t, 16 > &bytesB = b.getByteRepresentation();
+
+	unsigned int length = 0;
+	for (std::size_t i = 0; i < bytesA.size() && length < limit; ++i) {
+		const std::uint8_t difference = bytesA[i] ^ bytesB[i];
+		if (difference == 0) {
+			length += 8;
+			continue;
+		}
+
+		for (std::uint8_t bit = 0x80; (difference & bit) == 0; bit >>= 1) {
+			length++;
+		}
+		break;
+	}
+
+	return std::min(length, limit);
+}
+
+HostAddress BanIndex::maskAddress(const HostAddress &address, unsigned int length) {
+	HostAddress masked = address;
+
+	const std::array< std::uint8_t, 16 > &bytes = address.getByteRepresentation();
+	for (std::size_t i = length / 8; i < bytes.size(); ++i) {
+		const unsigned int keptBits = i == length / 8 ? length % 8 : 0;
+		masked.setByte(i, static_cast< std::uint8_t >(bytes[i] & ~(0xFFU >> keptBits)));
+	}
+
+	return masked;
+}
+
+void BanIndex::update(const QList< Ban > &bans) {
+	const QSet< Ban > newBans(bans.begin(), bans.end());
+
+	QList< Ban > removed;
+	for (auto it = m_slots.cbegin(); it != m_slots.cend(); ++it) {
+		if (!newBans.contains(it.key())) {
+			removed << it.key();
+		}
+	}
+
+	for (const Ban &ban : removed) {
+		remove(ban);
+	}
+
+	for (const Ban &ban : newBans) {
+		add(ban);
+	}
+}
+
+void BanIndex::add(const Ban &ban) {
+	if (m_slots.contains(ban)) {
+		return;
+	}
+
+	Slot slot;
+	if (m_freeSlots.empty()) {
+		slot = static_cast< Slot >(m_entries.size());
+		m_entries.emplace_back();
+	} else {
+		slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+
+	Entry &entry = m_entries[slot];
+	entry.ban    = ban;
+	entry.live   = true;
+
+	m_slots.insert(ban, slot);
+
+	insertIntoTrie(slot);
+
+	m_hashes[ban.qsHash].push_back(slot);
+
+	if (ban.iDuration > 0 && ban.qdtStart.isValid()) {
+		// Ban::isExpired() considers a ban expired once more than iDuration full seconds have passed
+		const qint64 expiry =
+			ban.qdtStart.toMSecsSinceEpoch() + (static_cast< qint64 >(ban.iDuration) + 1) * Q_INT64_C(1000);
+		m_expiries.emplace(expiry, slot, entry.generation);
+	}
+}
+
+bool BanIndex::remove(const Ban &ban) {
+	auto it = m_slots.find(ban);
+	if (it == m_slots.end()) {
+		return false;
+	}
+
+	const Slot slot = it.value();
+	m_slots.erase(it);
+
+	removeFromTrie(slot);
+
+	auto hashIt = m_hashes.find(ban.qsHash);
+	if (hashIt != m_hashes.end()) {
+		std::vector< Slot > &slots = hashIt.value();
+		slots.erase(std::find(slots.begin(), slots.end(), slot));
+		if (slots.empty()) {
+			m_hashes.erase(hashIt);
+		}
+	}
+
+	Entry &entry = m_entries[slot];
+	entry.ban    = Ban{};
+	entry.live   = false;
+	entry.generation++;
+	m_freeSlots.push_back(slot);
+
+	if (m_removedFromTrie > m_slots.size() + 64) {
+		rebuildTrie();
+	}
+
+	return true;
+}
+
+void BanIndex::clear() {
+	m_entries.clear();
+	m_freeSlots.clear();
+	m_slots.clear();
+	m_hashes.clear();
+	m_expiries = decltype(m_expiries)();
+
+	m_nodes.clear();
+	m_nodes.emplace_back();
+	m_nodes.front().prefix.reset();
+	m_removedFromTrie = 0;
+}
+
+QList< Ban > BanIndex::takeExpired() {
+	QList< Ban > expired;
+
+	const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+	while (!m_expiries.empty()) {
+		const Expiry &expiry = m_expiries.top();
+		const Slot slot      = std::get< 1 >(expiry);
+
+		if (!m_entries[slot].live || m_entries[slot].generation != std::get< 2 >(expiry)) {
+			// The ban has been removed in the meantime
+			m_expiries.pop();
+			continue;
+		}
+
+		if (std::get< 0 >(expiry) > now || !m_entries[slot].ban.isExpired()) {
+			break;
+		}
+
+		m_expiries.pop();
+
+		const Ban ban = m_entries[slot].ban;
+		remove(ban);
+		expired << ban;
+	}
+
+	return expired;
+}
+
+const Ban *BanIndex::findAddressBan(const HostAddress &address) const {
+	int index = 0;
+
+	while (index >= 0) {
+		const Node &node = m_nodes[static_cast< std::size_t >(index)];
+		if (commonPrefixLength(address, node.prefix, node.length) < node.length) {
+			break;
+		}
+
+		for (Slot slot : node.bans) {
+			const Ban &ban = m_entries[slot].ban;
+			if (!ban.isExpired()) {
+				return &ban;
+			}
+		}
+
+		if (node.length >= ADDRESS_BITS) {
+			break;
+		}
+
+		index = node.children[bitAt(address, node.length)];
+	}
+
+	return nullptr;
+}
+
+const Ban *BanIndex::findHashBan(const QString &hash) const {
+	auto it = m_hashes.constFind(hash);
+	if (it == m_hashes.cend()) {
+		return nullptr;
+	}
+
+	for (Slot slot : it.value()) {
+		const Ban &ban = m_entries[slot].ban;
+		if (!ban.isExpired()) {
+			return &ban;
+		}
+	}
+
+	return nullptr;
+}
+
+std::size_t BanIndex::size() const {
+	return static_cast< std::size_t >(m_slots.size());
+}
+
+void BanIndex::insertIntoTrie(Slot slot) {
+	const HostAddress &address = m_entries[slot].ban.haAddress;
+	const unsigned int length  = prefixLength(m_entries[slot].ban);
+
+	// Nodes are referred to by index, as adding nodes may reallocate m_nodes
+	std::size_t index = 0;
+
+	while (true) {
+		// The node's prefix is a prefix of the ban's one
+		assert(m_nodes[index].length <= length);
+
+		if (m_nodes[index].length == length) {
+			m_nodes[index].bans.push_back(slot);
+			return;
+		}
+
+		const unsigned int bit = bitAt(address, m_nodes[index].length);
+		const int childIndex   = m_nodes[index].children[bit];
+
+		if (childIndex < 0) {
+			Node leaf;
+			leaf.prefix = maskAddress(address, length);
+			leaf.length = length;
+			leaf.bans.push_back(slot);
+
+			m_nodes[index].children[bit] = static_cast< int >(m_nodes.size());
+			m_nodes.push_back(std::move(leaf));
+			return;
+		}
+
+		const Node &child         = m_nodes[static_cast< std::size_t >(childIndex)];
+		const unsigned int common = commonPrefixLength(address, child.prefix, std::min(length, child.length));
+
+		if (common == child.length) {
+			index = static_cast< std::size_t >(childIndex);
+			continue;
+		}
+
+		// The ban's prefix branches off in the middle of the edge to the child: Split the edge
+		Node split;
+		split.prefix                                = maskAddress(address, common);
+		split.length                                = common;
+		split.children[bitAt(child.prefix, common)] = childIndex;
+
+		const int splitIndex = static_cast< int >(m_nodes.size());
+
+		if (common == length) {
+			split.bans.push_back(slot);
+			m_nodes.push_back(std::move(split));
+		} else {
+			Node leaf;
+			leaf.prefix = maskAddress(address, length);
+			leaf.length = length;
+			leaf.bans.push_back(slot);
+
+			split.children[bitAt(address, common)] = splitIndex + 1;
+			m_nodes.push_back(std::move(split));
+			m_nodes.push_back(std::move(leaf));
+		}
+
+		m_nodes[index].children[bit] = splitIndex;
+		return;
+	}
+}
+
+void BanIndex::removeFromTrie(Slot slot) {
+	const HostAddress &address = m_entries[slot].ban.haAddress;
+	const unsigned int length  = prefixLength(m_entries[slot].ban);
+
+	int index = 0;
+	while (index >= 0) {
+		Node &node = m_nodes[static_cast< std::size_t >(index)];
+
+		if (node.length == length) {
+			auto it = std::find(node.bans.begin(), node.bans.end(), slot);
+			if (it != node.bans.end()) {
+				node.bans.erase(it);
+				m_removedFromTrie++;
+			}
+			return;
+		}
+
+		if (node.length > length) {
+			return;
+		}
+
+		index = node.children[bitAt(address, node.length)];
+	}
+}
+
+void BanIndex::rebuildTrie() {
+	m_nodes.clear();
+	m_nodes.emplace_back();
+	m_nodes.front().prefix.reset();
+	m_removedFromTrie = 0;
+
+	for (Slot slot = 0; slot < m_entries.size(); ++slot) {
+		if (m_entries[slot].live) {
+			insertIntoTrie(slot);
+		}
+	}
+}
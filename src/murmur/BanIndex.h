@@ -0,0 +1,103 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_BANINDEX_H_
+#define MUMBLE_MURMUR_BANINDEX_H_
+
+#include "Ban.h"
+#include "HostAddress.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <tuple>
+#include <vector>
+
+/// An index of a server's bans, so that checking a connecting client doesn't have to look at every single ban.
+///
+/// The address ranges are stored in a path-compressed binary trie over the (IPv6 or IPv4-mapped) addresses, in
+/// which every ban is attached to the node representing its network prefix. All bans matching an address lie on
+/// the path from the root to the address, which takes at most 128 steps, no matter how many bans there are. The
+/// certificate hashes are kept in a hash table and the expiry times of temporary bans in a min-heap.
+///
+/// The index holds a set of bans: Bans that occur more than once (see Ban::operator==) are stored once.
+class BanIndex {
+public:
+	BanIndex();
+
+	/// Makes the index contain exactly the given bans. Only the differences to the current contents are applied, so
+	/// updating a large ban list doesn't rebuild the whole index.
+	void update(const QList< Ban > &bans);
+	/// Adds the given ban (if it isn't part of the index already)
+	void add(const Ban &ban);
+	/// Removes the given ban. Returns false if the index doesn't contain it.
+	bool remove(const Ban &ban);
+	void clear();
+
+	/// Removes all bans that have expired from the index and returns them
+	QList< Ban > takeExpired();
+
+	/// @returns The first ban that covers the given address and that hasn't expired, or nullptr if there is none. The
+	///          returned pointer is valid until the index is modified.
+	const Ban *findAddressBan(const HostAddress &address) const;
+	/// @returns The first ban of the given certificate hash that hasn't expired, or nullptr if there is none. The
+	///          returned pointer is valid until the index is modified.
+	const Ban *findHashBan(const QString &hash) const;
+
+	std::size_t size() const;
+
+private:
+	using Slot = std::uint32_t;
+
+	struct Entry {
+		Ban ban;
+		bool live = false;
+		/// Incremented whenever the slot is freed, so that outdated expiry heap entries can be recognized
+		std::uint32_t generation = 0;
+	};
+
+	struct Node {
+		/// The node's prefix (with all bits after the first length bits being zero)
+		HostAddress prefix;
+		unsigned int length = 0;
+		int children[2]     = { -1, -1 };
+		/// The bans of exactly this prefix
+		std::vector< Slot > bans;
+	};
+
+	/// The time (in milliseconds since the epoch) a ban expires at, the slot and its generation
+	using Expiry = std::tuple< qint64, Slot, std::uint32_t >;
+
+	std::vector< Entry > m_entries;
+	std::vector< Slot > m_freeSlots;
+	QHash< Ban, Slot > m_slots;
+
+	/// The trie's nodes. The first one is the root (the prefix of length 0).
+	std::vector< Node > m_nodes;
+	/// The number of bans that have been removed from the trie since it has been built. Their nodes stay around
+	/// until there are more of them than live bans, at which point the trie is rebuilt.
+	std::size_t m_removedFromTrie = 0;
+
+	QHash< QString, std::vector< Slot > > m_hashes;
+
+	std::priority_queue< Expiry, std::vector< Expiry >, std::greater< Expiry > > m_expiries;
+
+	/// @returns The prefix length the given ban covers (bans are stored with masks of up to 128 bits)
+	static unsigned int prefixLength(const Ban &ban);
+	static unsigned int bitAt(const HostAddress &address, unsigned int bit);
+	/// @returns The length of the common prefix of both addresses, limited to the given amount of bits
+	static unsigned int commonPrefixLength(const HostAddress &a, const HostAddress &b, unsigned int limit);
+	static HostAddress maskAddress(const HostAddress &address, unsigned int length);
+
+	void insertIntoTrie(Slot slot);
+	void removeFromTrie(Slot slot);
+	void rebuildTrie();
+};
+
+#endif
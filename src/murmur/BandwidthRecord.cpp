@@ -0,0 +1,127 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BandwidthRecord.h"
+
+#include <algorithm>
+#include <thread>
+
+BandwidthRecord::BandwidthRecord() {
+	for (int i = 0; i < N_BANDWIDTH_SLOTS; i++) {
+		m_sizes[i].store(0, std::memory_order_relaxed);
+		m_times[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+std::uint32_t BandwidthRecord::now() const {
+	// Wraps around, which is fine as only differences of (recent) times are used
+	return static_cast< std::uint32_t >(tFirst.elapsed() / 1000ULL);
+}
+
+bool BandwidthRecord::addFrame(int size, int maxpersec) {
+	// Mark the ring as being modified (waiting for another thread processing a frame of this user, if any)
+	std::uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+	do {
+		while (sequence & 1) {
+			std::this_thread::yield();
+			sequence = m_sequence.load(std::memory_order_relaxed);
+		}
+	} while (!m_sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire,
+											   std::memory_order_relaxed));
+	// Readers that see any of the following modifications also have to see the odd sequence number
+	std::atomic_thread_fence(std::memory_order_release);
+
+	const quint64 nowUsecs       = tFirst.elapsed();
+	const std::uint32_t nowMsecs = static_cast< std::uint32_t >(nowUsecs / 1000ULL);
+
+	if (nowUsecs - m_lastFrame.load(std::memory_order_relaxed) > STALE_MSECS * 1000ULL) {
+		for (int i = 0; i < N_BANDWIDTH_SLOTS; i++) {
+			m_sizes[i].store(0, std::memory_order_relaxed);
+			m_times[i].store(nowMsecs - STALE_MSECS, std::memory_order_relaxed);
+		}
+		m_sum = 0;
+	}
+
+	const std::uint32_t next    = m_next.load(std::memory_order_relaxed);
+	const std::uint32_t elapsed = nowMsecs - m_times[next].load(std::memory_order_relaxed);
+
+	bool accepted = false;
+
+	if (elapsed != 0) {
+		const std::uint32_t nsum = m_sum - m_sizes[next].load(std::memory_order_relaxed) + static_cast< quint32 >(size);
+		const quint64 bw         = (static_cast< quint64 >(nsum) * 1000ULL) / elapsed;
+
+		if (bw <= static_cast< quint64 >(maxpersec)) {
+			m_sizes[next].store(static_cast< std::uint16_t >(size), std::memory_order_relaxed);
+			m_times[next].store(nowMsecs, std::memory_order_relaxed);
+			m_next.store((next + 1) % N_BANDWIDTH_SLOTS, std::memory_order_relaxed);
+			m_lastFrame.store(nowUsecs, std::memory_order_relaxed);
+
+			m_sum    = nsum;
+			accepted = true;
+		}
+	}
+
+	m_sequence.store(sequence + 2, std::memory_order_release);
+
+	return accepted;
+}
+
+int BandwidthRecord::onlineSeconds() const {
+	return static_cast< int >(tFirst.elapsed() / 1000000ULL);
+}
+
+int BandwidthRecord::idleSeconds() const {
+	const quint64 last =
+		std::max(m_lastFrame.load(std::memory_order_relaxed), m_lastActivity.load(std::memory_order_relaxed));
+	const quint64 now = tFirst.elapsed();
+
+	return static_cast< int >((now > last ? now - last : 0) / 1000000ULL);
+}
+
+void BandwidthRecord::resetIdleSeconds() {
+	m_lastActivity.store(tFirst.elapsed(), std::memory_order_relaxed);
+}
+
+int BandwidthRecord::bandwidth() const {
+	quint64 sum           = 0;
+	std::uint32_t elapsed = 0;
+
+	for (;;) {
+		const std::uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+
+		if (!(sequence & 1)) {
+			const std::uint32_t nowMsecs = now();
+			const std::uint32_t next     = m_next.load(std::memory_order_relaxed);
+
+			sum     = 0;
+			elapsed = 0;
+
+			for (std::uint32_t i = 1; i < N_BANDWIDTH_SLOTS; ++i) {
+				const std::uint32_t idx = (next + N_BANDWIDTH_SLOTS - i) % N_BANDWIDTH_SLOTS;
+				const std::uint32_t e   = nowMsecs - m_times[idx].load(std::memory_order_relaxed);
+				if (e > 1000) {
+					break;
+				} else {
+					sum += m_sizes[idx].load(std::memory_order_relaxed);
+					elapsed = e;
+				}
+			}
+
+			// The ring hasn't been modified while it was read
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (m_sequence.load(std::memory_order_relaxed) == sequence) {
+				break;
+			}
+		}
+
+		std::this_thread::yield();
+	}
+
+	if (elapsed < 250)
+		return 0;
+
+	return static_cast< int >((sum * 1000ULL) / elapsed);
+}
@@ -0,0 +1,76 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_BANDWIDTHRECORD_H_
+#define MUMBLE_MURMUR_BANDWIDTHRECORD_H_
+
+#include "Timer.h"
+
+#include <QtCore/QtGlobal>
+
+#include <atomic>
+#include <cstdint>
+
+// Unfortunately, this needs to be "large enough" to hold
+// enough frames to account for both short-term and
+// long-term "maladjustments".
+
+#define N_BANDWIDTH_SLOTS 360
+
+/// Keeps track of the audio frames a user has sent, in order to limit (and report) the bandwidth they use.
+///
+/// The size and arrival time of the last N_BANDWIDTH_SLOTS frames are stored in a ring. Times are stored in
+/// milliseconds relative to the creation of the record, which keeps the ring small (about 2 KiB per user).
+///
+/// addFrame() is called for every audio packet and never blocks on readers: it marks the ring as being modified by
+/// making a sequence number odd, updates it and makes the number even again. Readers (the main thread and Ice)
+/// copy what they need and start over if the sequence number has changed in the meantime, so they always see a
+/// consistent ring. Should frames of the same user be processed by two threads at once (e.g. UDP and the TCP tunnel),
+/// the second one waits for the first one to finish its (short) update.
+class BandwidthRecord {
+public:
+	BandwidthRecord();
+	BandwidthRecord(const BandwidthRecord &) = delete;
+	BandwidthRecord &operator=(const BandwidthRecord &) = delete;
+
+	/// Records a frame of the given size, unless that would make the user exceed the given bandwidth (in bytes per
+	/// second) over the last N_BANDWIDTH_SLOTS frames.
+	///
+	/// @returns Whether the frame has been accepted
+	bool addFrame(int size, int maxpersec);
+	/// @returns The amount of seconds since the record has been created
+	int onlineSeconds() const;
+	/// @returns The amount of seconds since the user has sent audio or done something else
+	int idleSeconds() const;
+	/// Marks the user as not being idle
+	void resetIdleSeconds();
+	/// @returns The bandwidth (in bytes per second) the user has used during the last second
+	int bandwidth() const;
+
+protected:
+	/// After this amount of milliseconds without a frame, the ring is considered stale and cleared, so that the
+	/// times stored in it (which wrap around after about 49 days) are never ambiguous.
+	static constexpr std::uint32_t STALE_MSECS = 60 * 60 * 1000;
+
+	/// @returns The current time in milliseconds relative to the creation of the record
+	std::uint32_t now() const;
+
+	/// Odd while the ring is being modified
+	std::atomic< std::uint32_t > m_sequence{ 0 };
+	/// The slot the next frame is stored in
+	std::atomic< std::uint32_t > m_next{ 0 };
+	/// The sum of the sizes of all frames in the ring
+	std::uint32_t m_sum = 0;
+	std::atomic< std::uint16_t > m_sizes[N_BANDWIDTH_SLOTS];
+	std::atomic< std::uint32_t > m_times[N_BANDWIDTH_SLOTS];
+
+	/// The time (in microseconds relative to tFirst) of the last frame and of the last reset of the idle time
+	std::atomic< quint64 > m_lastFrame{ 0 };
+	std::atomic< quint64 > m_lastActivity{ 0 };
+
+	Timer tFirst;
+};
+
+#endif // MUMBLE_MURMUR_BANDWIDTHRECORD_H_
@@ -0,0 +1,88 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BlobStore.h"
+
+template< typename T > BlobStore< T >::BlobStore(std::size_t capacity) : m_capacity(capacity) {
+}
+
+template<> std::size_t BlobStore< QByteArray >::sizeOf(const QByteArray &blob) {
+	return static_cast< std::size_t >(blob.size());
+}
+
+template<> std::size_t BlobStore< QString >::sizeOf(const QString &blob) {
+	return static_cast< std::size_t >(blob.size()) * sizeof(QChar);
+}
+
+template< typename T > T BlobStore< T >::intern(const QByteArray &hash, const T &blob) {
+	auto it = m_entries.find(hash);
+	if (it != m_entries.end()) {
+		touch(*it);
+		return it->blob;
+	}
+
+	const std::size_t size = sizeOf(blob);
+	if (size > m_capacity) {
+		return blob;
+	}
+
+	m_lru.push_front(hash);
+	m_entries.insert(hash, Entry{ blob, m_lru.begin() });
+	m_size += size;
+
+	evict();
+
+	return blob;
+}
+
+template< typename T > T BlobStore< T >::find(const QByteArray &hash) {
+	auto it = m_entries.find(hash);
+	if (it == m_entries.end()) {
+		return T();
+	}
+
+	touch(*it);
+	return it->blob;
+}
+
+template< typename T > bool BlobStore< T >::contains(const QByteArray &hash) const {
+	return m_entries.contains(hash);
+}
+
+template< typename T > std::size_t BlobStore< T >::count() const {
+	return static_cast< std::size_t >(m_entries.size());
+}
+
+template< typename T > std::size_t BlobStore< T >::size() const {
+	return m_size;
+}
+
+template< typename T > void BlobStore< T >::setCapacity(std::size_t capacity) {
+	m_capacity = capacity;
+	evict();
+}
+
+template< typename T > void BlobStore< T >::clear() {
+	m_entries.clear();
+	m_lru.clear();
+	m_size = 0;
+}
+
+template< typename T > void BlobStore< T >::touch(Entry &entry) {
+	m_lru.splice(m_lru.begin(), m_lru, entry.position);
+}
+
+template< typename T > void BlobStore< T >::evict() {
+	while (m_size > m_capacity && !m_lru.empty()) {
+		auto it = m_entries.find(m_lru.back());
+
+		m_size -= sizeOf(it->blob);
+		m_entries.erase(it);
+		m_lru.pop_back();
+	}
+}
+
+template class BlobStore< QByteArray >;
+template class BlobStore< QString >;
@@ -0,0 +1,71 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_BLOBSTORE_H_
+#define MUMBLE_MURMUR_BLOBSTORE_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+#include <cstddef>
+#include <list>
+
+/// Deduplicates the blobs (textures, comments and channel descriptions) held by a server, keyed by their SHA1 hash.
+///
+/// Qt's containers are implicitly shared, so handing out the stored instance for a blob that is already known makes
+/// all users of that blob share a single buffer (e.g. when many users use the same avatar). The store keeps the most
+/// recently used blobs around, up to the given amount of bytes. Evicting a blob only drops the store's reference: the
+/// users that hold it keep their (shared) copy.
+///
+/// The store is not thread-safe and only used from the server's main thread.
+template< typename T > class BlobStore {
+public:
+	/// The default amount of bytes the store keeps blobs around for
+	static constexpr std::size_t DEFAULT_CAPACITY = 32 * 1024 * 1024;
+
+	explicit BlobStore(std::size_t capacity = DEFAULT_CAPACITY);
+
+	/// @param hash The SHA1 hash of the blob
+	/// @param blob The blob
+	/// @returns The stored instance of an identical blob (sharing its buffer) if there is one, or the given blob
+	/// 	(which is stored from now on) otherwise
+	T intern(const QByteArray &hash, const T &blob);
+	/// @returns The stored blob with the given hash, or a null blob if the store doesn't contain it
+	T find(const QByteArray &hash);
+
+	/// @returns Whether a blob with the given hash is stored
+	bool contains(const QByteArray &hash) const;
+	/// @returns The amount of stored blobs
+	std::size_t count() const;
+	/// @returns The amount of bytes taken up by the stored blobs
+	std::size_t size() const;
+
+	/// Changes the amount of bytes the store keeps blobs around for, evicting the least recently used ones if needed
+	void setCapacity(std::size_t capacity);
+	void clear();
+
+protected:
+	struct Entry {
+		T blob;
+		/// The entry's position in m_lru
+		typename std::list< QByteArray >::iterator position;
+	};
+
+	static std::size_t sizeOf(const T &blob);
+
+	/// Marks the given entry as the most recently used one
+	void touch(Entry &entry);
+	/// Evicts the least recently used blobs until the stored ones fit into the capacity
+	void evict();
+
+	QHash< QByteArray, Entry > m_entries;
+	/// The hashes of the stored blobs, the most recently used first
+	std::list< QByteArray > m_lru;
+	std::size_t m_size = 0;
+	std::size_t m_capacity;
+};
+
+#endif // MUMBLE_MURMUR_BLOBSTORE_H_
@@ -0,0 +1,81 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ChannelSyncCache.h"
+
+#include "Channel.h"
+#include "Connection.h"
+#include "MumbleProtocol.h"
+
+void ChannelSyncCache::write(Channel &root, bool descriptionHash, const Describe &describe, const CanEnter &canEnter,
+							 QByteArray &out) {
+	if (!m_structureValid) {
+		updateStructure(root);
+	}
+
+	for (Channel *channel : m_order) {
+		QByteArray *messages = m_entries[channel->iId].messages[descriptionHash ? 1 : 0];
+
+		if (messages[0].isEmpty()) {
+			MumbleProto::ChannelState mpcs;
+			describe(*channel, descriptionHash, mpcs);
+
+			mpcs.set_can_enter(false);
+			Connection::messageToNetwork(mpcs, Mumble::Protocol::TCPMessageType::ChannelState, messages[0]);
+			mpcs.set_can_enter(true);
+			Connection::messageToNetwork(mpcs, Mumble::Protocol::TCPMessageType::ChannelState, messages[1]);
+		}
+
+		out.append(messages[canEnter(*channel) ? 1 : 0]);
+	}
+
+	out.append(m_links);
+}
+
+void ChannelSyncCache::invalidate(unsigned int channelID) {
+	m_entries.remove(channelID);
+}
+
+void ChannelSyncCache::invalidateStructure() {
+	m_structureValid = false;
+	m_order.clear();
+	m_links.clear();
+}
+
+void ChannelSyncCache::clear() {
+	m_entries.clear();
+	invalidateStructure();
+}
+
+void ChannelSyncCache::updateStructure(Channel &root) {
+	m_order.clear();
+	m_order.push_back(&root);
+	// The order doubles as the queue of the traversal
+	for (std::size_t i = 0; i < m_order.size(); ++i) {
+		for (Channel *child : m_order[i]->qlChannels) {
+			m_order.push_back(child);
+		}
+	}
+
+	m_links.clear();
+	MumbleProto::ChannelState mpcs;
+	for (Channel *channel : m_order) {
+		if (channel->qhLinks.isEmpty()) {
+			continue;
+		}
+
+		mpcs.Clear();
+		mpcs.set_channel_id(channel->iId);
+		for (auto it = channel->qhLinks.cbegin(); it != channel->qhLinks.cend(); ++it) {
+			mpcs.add_links(it.key()->iId);
+		}
+
+		QByteArray message;
+		Connection::messageToNetwork(mpcs, Mumble::Protocol::TCPMessageType::ChannelState, message);
+		m_links.append(message);
+	}
+
+	m_structureValid = true;
+}
@@ -0,0 +1,68 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CHANNELSYNCCACHE_H_
+#define MUMBLE_MURMUR_CHANNELSYNCCACHE_H_
+
+#include "Mumble.pb.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+
+#include <functional>
+#include <vector>
+
+class Channel;
+
+/// Keeps the part of the initial synchronization of a client that describes the channel tree (a ChannelState message
+/// for every channel, followed by the ones announcing the links) serialized, so that it doesn't have to be built anew
+/// for every user that connects.
+///
+/// The only part of the messages that depends on the user is whether they may enter a channel. Therefore, every
+/// channel's message is kept in two variants, one for the users that may enter the channel and one for the ones
+/// that may not. Which of them is sent is decided while copying the messages into the stream.
+///
+/// The cache doesn't notice changes to the channels by itself. Whenever a channel has been edited, invalidate() has
+/// to be called, and whenever channels have been added, removed, moved or (un)linked, invalidateStructure(). Only the
+/// affected messages are serialized again (once they are needed).
+///
+/// The class isn't thread-safe. The server only uses it on its main thread.
+class ChannelSyncCache {
+public:
+	/// Fills in the message describing the given channel (apart from can_enter). The flag tells whether the
+	/// channel's description should be replaced by its hash.
+	using Describe = std::function< void(Channel &channel, bool descriptionHash, MumbleProto::ChannelState &msg) >;
+	/// Decides whether the user the stream is meant for may enter the given channel
+	using CanEnter = std::function< bool(Channel &channel) >;
+
+	/// Appends the messages describing the tree below (and including) the given root channel to out, in the order
+	/// of a breadth-first traversal.
+	void write(Channel &root, bool descriptionHash, const Describe &describe, const CanEnter &canEnter,
+			   QByteArray &out);
+
+	/// Drops the messages of the channel with the given ID
+	void invalidate(unsigned int channelID);
+	/// Drops the order of the channels as well as the messages announcing the links
+	void invalidateStructure();
+	void clear();
+
+private:
+	void updateStructure(Channel &root);
+
+	struct Entry {
+		/// The serialized messages, indexed by whether they contain the description's hash and by whether the user
+		/// may enter the channel. A variant is only serialized once it is needed.
+		QByteArray messages[2][2];
+	};
+
+	QHash< unsigned int, Entry > m_entries;
+	/// The channels in the order in which they are transmitted
+	std::vector< Channel * > m_order;
+	/// The serialized messages announcing the links between the channels
+	QByteArray m_links;
+	bool m_structureValid = false;
+};
+
+#endif // MUMBLE_MURMUR_CHANNELSYNCCACHE_H_
@@ -0,0 +1,206 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "IceCallbackDispatcher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+IceCallbackDispatcher::IceCallbackDispatcher(std::size_t queueLimit) : m_queueLimit(queueLimit) {
+}
+
+IceCallbackDispatcher::~IceCallbackDispatcher() {
+	stop();
+}
+
+void IceCallbackDispatcher::addTarget(const QString &target, std::function< void() > failed) {
+	QMutexLocker lock(&m_mutex);
+
+	Target &entry = m_targets[target];
+	entry         = Target();
+	entry.id      = m_nextID++;
+	entry.failed  = std::move(failed);
+}
+
+void IceCallbackDispatcher::removeTarget(const QString &target) {
+	QMutexLocker lock(&m_mutex);
+
+	m_targets.remove(target);
+}
+
+void IceCallbackDispatcher::post(const QString &target, Invocation invocation, const QString &coalescingKey) {
+	std::function< void() > failed;
+
+	{
+		QMutexLocker lock(&m_mutex);
+
+		auto it = m_targets.find(target);
+		if (it == m_targets.end()) {
+			return;
+		}
+
+		if (!coalescingKey.isEmpty()) {
+			auto queued = it->coalescable.find(coalescingKey);
+			if (queued != it->coalescable.end()) {
+				// The queued event hasn't been delivered yet, so it is dropped in favor of the newer one. The newer one
+				// is queued at the end, as it might depend on the events that have been posted in between.
+				it->queue.erase(std::find(it->queue.begin(), it->queue.end(), queued.value()));
+				it->coalescable.erase(queued);
+			}
+		}
+
+		if (it->queue.size() >= m_queueLimit) {
+			// The target doesn't keep up with the events, so it is most likely hung
+			failed = takeFailed(it);
+		} else {
+			auto event           = std::make_shared< Event >();
+			event->coalescingKey = coalescingKey;
+			event->invocation    = std::move(invocation);
+
+			it->queue.push_back(event);
+			if (!coalescingKey.isEmpty()) {
+				it->coalescable.insert(coalescingKey, event);
+			}
+
+			if (!it->inFlight) {
+				schedule(target, *it);
+			}
+		}
+	}
+
+	if (failed) {
+		failed();
+	}
+}
+
+void IceCallbackDispatcher::endCoalescing(const QString &target, const QString &coalescingKey) {
+	QMutexLocker lock(&m_mutex);
+
+	auto it = m_targets.find(target);
+	if (it != m_targets.end()) {
+		auto queued = it->coalescable.find(coalescingKey);
+		if (queued != it->coalescable.end()) {
+			// The event stays in the queue, it just can't be replaced anymore
+			queued.value()->coalescingKey.clear();
+			it->coalescable.erase(queued);
+		}
+	}
+}
+
+std::size_t IceCallbackDispatcher::queued(const QString &target) const {
+	QMutexLocker lock(&m_mutex);
+
+	auto it = m_targets.constFind(target);
+	return it == m_targets.cend() ? 0 : it->queue.size();
+}
+
+void IceCallbackDispatcher::stop() {
+	{
+		QMutexLocker lock(&m_mutex);
+		m_stop = true;
+		m_wakeUp.wakeOne();
+	}
+
+	wait();
+
+	QMutexLocker lock(&m_mutex);
+	m_targets.clear();
+	m_ready.clear();
+}
+
+void IceCallbackDispatcher::run() {
+	QMutexLocker lock(&m_mutex);
+
+	while (!m_stop) {
+		if (m_ready.empty()) {
+			m_wakeUp.wait(&m_mutex);
+			continue;
+		}
+
+		auto it = m_targets.find(m_ready.front());
+		m_ready.pop_front();
+
+		// The target might have been removed (and added again) in the meantime
+		if (it == m_targets.end() || !it->ready) {
+			continue;
+		}
+		it->ready = false;
+
+		std::shared_ptr< Event > event = std::move(it->queue.front());
+		it->queue.pop_front();
+		if (!event->coalescingKey.isEmpty()) {
+			it->coalescable.remove(event->coalescingKey);
+		}
+		it->inFlight = true;
+
+		const QString target = it.key();
+		const quint64 id     = it->id;
+
+		lock.unlock();
+
+		auto called     = std::make_shared< std::atomic_bool >(false);
+		Completion done = [this, target, id, called](bool success) {
+			if (!called->exchange(true)) {
+				complete(target, id, success);
+			}
+		};
+
+		try {
+			event->invocation(done);
+		} catch (...) {
+			done(false);
+		}
+
+		lock.relock();
+	}
+}
+
+void IceCallbackDispatcher::complete(const QString &target, quint64 id, bool success) {
+	std::function< void() > failed;
+
+	{
+		QMutexLocker lock(&m_mutex);
+
+		if (m_stop) {
+			return;
+		}
+
+		auto it = m_targets.find(target);
+		if (it == m_targets.end() || it->id != id) {
+			return;
+		}
+
+		it->inFlight = false;
+
+		if (success) {
+			if (!it->queue.empty()) {
+				schedule(target, *it);
+			}
+			return;
+		}
+
+		failed = takeFailed(it);
+	}
+
+	if (failed) {
+		failed();
+	}
+}
+
+void IceCallbackDispatcher::schedule(const QString &key, Target &target) {
+	if (!target.ready) {
+		target.ready = true;
+		m_ready.push_back(key);
+		m_wakeUp.wakeOne();
+	}
+}
+
+std::function< void() > IceCallbackDispatcher::takeFailed(QHash< QString, Target >::iterator target) {
+	std::function< void() > failed = std::move(target->failed);
+	m_targets.erase(target);
+
+	return failed;
+}
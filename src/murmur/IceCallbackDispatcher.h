@@ -0,0 +1,108 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_ICECALLBACKDISPATCHER_H_
+#define MUMBLE_MURMUR_ICECALLBACKDISPATCHER_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+
+/// Delivers events to the callbacks registered via Ice on a background thread, so that a slow (or hung) callback
+/// can't stall the server's main thread.
+///
+/// Every callback (target) has its own queue, from which the invocations are started one at a time (so they arrive
+/// in order), asynchronously. While an invocation is in flight, the target's following events wait in the queue
+/// without holding up any other target. Queued events of the same kind concerning the same object (e.g. the state
+/// of a user) are coalesced, so that only the latest one is delivered (in the position it has been posted in). A
+/// target is considered broken and is dropped once one of its invocations fails or its queue overflows.
+class IceCallbackDispatcher : public QThread {
+private:
+	Q_DISABLE_COPY(IceCallbackDispatcher)
+
+public:
+	/// Reports the outcome of an invocation. May be called from any thread, but only once.
+	using Completion = std::function< void(bool success) >;
+	/// Starts an invocation and calls the given completion once it has finished (or failed). Exceptions thrown by it
+	/// count as a failed invocation.
+	using Invocation = std::function< void(const Completion &done) >;
+
+	/// @param queueLimit The amount of events that may be queued for a single target
+	explicit IceCallbackDispatcher(std::size_t queueLimit);
+	/// Stops the background thread (see stop())
+	~IceCallbackDispatcher() override;
+
+	/// Registers a target. The given function is called once the target is found to be broken, at which point it has
+	/// been removed already. It is called from any thread, with no lock held.
+	void addTarget(const QString &target, std::function< void() > failed);
+	/// Removes the target and discards all of its queued events
+	void removeTarget(const QString &target);
+	/// Queues the invocation for the given target (if it is registered). If an invocation with the same non-empty
+	/// coalescing key is still waiting in the target's queue, it is discarded, so that the events keep the order
+	/// they have been posted in.
+	void post(const QString &target, Invocation invocation, const QString &coalescingKey = QString());
+	/// Makes the events that are queued for the target with the given coalescing key final, so that they aren't
+	/// coalesced with any events posted later on. To be used once the object the key refers to is gone, as its ID
+	/// might be reused for another one.
+	void endCoalescing(const QString &target, const QString &coalescingKey);
+
+	/// The amount of events that are waiting in the target's queue
+	std::size_t queued(const QString &target) const;
+
+	/// Stops the background thread. The outcome of invocations that are still in flight is ignored, but they may
+	/// call their completion until whatever performs them (i.e. the Ice communicator) has been shut down, so the
+	/// dispatcher has to stay around until then.
+	void stop();
+
+protected:
+	void run() override;
+
+private:
+	struct Event {
+		QString coalescingKey;
+		Invocation invocation;
+	};
+
+	struct Target {
+		/// Identifies the registration, so that completions for a target that has been removed (and maybe added
+		/// again in the meantime) are ignored
+		quint64 id = 0;
+		std::function< void() > failed;
+		std::deque< std::shared_ptr< Event > > queue;
+		/// The queued events that can be coalesced, by their key
+		QHash< QString, std::shared_ptr< Event > > coalescable;
+		bool inFlight = false;
+		/// Whether the target is waiting in m_ready
+		bool ready = false;
+	};
+
+	const std::size_t m_queueLimit;
+
+	mutable QMutex m_mutex;
+	/// Signalled whenever a target may have become ready for its next invocation or the thread should stop
+	QWaitCondition m_wakeUp;
+	QHash< QString, Target > m_targets;
+	/// The targets that can start their next invocation, in the order they have become ready in
+	std::deque< QString > m_ready;
+	quint64 m_nextID = 1;
+	bool m_stop      = false;
+
+	/// Marks the target as ready for its next invocation
+	/// @note Must be called with m_mutex locked
+	void schedule(const QString &key, Target &target);
+	void complete(const QString &target, quint64 id, bool success);
+	/// Removes the broken target and returns its failure handler, which has to be called once m_mutex is unlocked
+	/// @note Must be called with m_mutex locked
+	std::function< void() > takeFailed(QHash< QString, Target >::iterator target);
+};
+
+#endif
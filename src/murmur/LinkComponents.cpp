@@ -0,0 +1,165 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "LinkComponents.h"
+
+#include <utility>
+
+void LinkComponents::link(unsigned int channel, unsigned int other) {
+	if (channel == other || m_links.value(channel).contains(other)) {
+		return;
+	}
+
+	m_links[channel].insert(other);
+	m_links[other].insert(channel);
+
+	std::shared_ptr< Component > component      = m_components.value(channel);
+	std::shared_ptr< Component > otherComponent = m_components.value(other);
+
+	if (component && component == otherComponent) {
+		// Just another path between channels that are linked already
+		return;
+	}
+
+	if (!component && !otherComponent) {
+		std::shared_ptr< Component > created = makeComponent();
+		created->channels                    = { channel, other };
+
+		m_components.insert(channel, created);
+		m_components.insert(other, created);
+		return;
+	}
+
+	// Move the channels of the smaller component (or the unlinked channel) over to the larger one
+	if (!component || (otherComponent && otherComponent->channels.size() > component->channels.size())) {
+		std::swap(component, otherComponent);
+		std::swap(channel, other);
+	}
+
+	if (otherComponent) {
+		for (unsigned int moved : otherComponent->channels) {
+			component->channels.push_back(moved);
+			m_components.insert(moved, component);
+		}
+		m_componentCount--;
+	} else {
+		component->channels.push_back(other);
+		m_components.insert(other, component);
+	}
+
+	component->version = m_nextVersion++;
+}
+
+void LinkComponents::unlink(unsigned int channel, unsigned int other) {
+	auto it = m_links.find(channel);
+	if (it == m_links.end() || !it->remove(other)) {
+		return;
+	}
+	if (it->isEmpty()) {
+		m_links.erase(it);
+	}
+
+	it = m_links.find(other);
+	it->remove(channel);
+	if (it->isEmpty()) {
+		m_links.erase(it);
+	}
+
+	// The copy is needed as split() replaces the component
+	const std::vector< unsigned int > channels = m_components.value(channel)->channels;
+	split(channels);
+}
+
+void LinkComponents::unlinkAll(unsigned int channel) {
+	auto it = m_links.find(channel);
+	if (it == m_links.end()) {
+		return;
+	}
+
+	for (unsigned int other : *it) {
+		auto otherIt = m_links.find(other);
+		otherIt->remove(channel);
+		if (otherIt->isEmpty()) {
+			m_links.erase(otherIt);
+		}
+	}
+	m_links.remove(channel);
+
+	const std::vector< unsigned int > channels = m_components.value(channel)->channels;
+	split(channels);
+}
+
+void LinkComponents::clear() {
+	m_links.clear();
+	m_components.clear();
+	m_componentCount = 0;
+}
+
+const std::vector< unsigned int > &LinkComponents::linkedChannels(unsigned int channel) const {
+	static const std::vector< unsigned int > unlinked;
+
+	auto it = m_components.constFind(channel);
+	return it == m_components.constEnd() ? unlinked : (*it)->channels;
+}
+
+std::uint64_t LinkComponents::version(unsigned int channel) const {
+	auto it = m_components.constFind(channel);
+	return it == m_components.constEnd() ? 0 : (*it)->version;
+}
+
+std::size_t LinkComponents::count() const {
+	return m_componentCount;
+}
+
+void LinkComponents::split(const std::vector< unsigned int > &channels) {
+	// The channels that are still linked to the first one keep the component (or rather a new version of it)
+	std::shared_ptr< Component > kept = m_components.value(channels.front());
+	for (unsigned int channel : channels) {
+		m_components.remove(channel);
+	}
+	m_componentCount--;
+
+	std::vector< unsigned int > stack;
+	for (unsigned int start : channels) {
+		if (!m_links.contains(start) || m_components.contains(start)) {
+			continue;
+		}
+
+		std::shared_ptr< Component > component;
+		if (kept) {
+			component = std::move(kept);
+			component->channels.clear();
+			component->version = m_nextVersion++;
+			m_componentCount++;
+		} else {
+			component = makeComponent();
+		}
+
+		m_components.insert(start, component);
+		component->channels.push_back(start);
+		stack.push_back(start);
+
+		while (!stack.empty()) {
+			const unsigned int current = stack.back();
+			stack.pop_back();
+
+			for (unsigned int linked : m_links.value(current)) {
+				if (!m_components.contains(linked)) {
+					m_components.insert(linked, component);
+					component->channels.push_back(linked);
+					stack.push_back(linked);
+				}
+			}
+		}
+	}
+}
+
+std::shared_ptr< LinkComponents::Component > LinkComponents::makeComponent() {
+	std::shared_ptr< Component > component = std::make_shared< Component >();
+	component->version                     = m_nextVersion++;
+	m_componentCount++;
+
+	return component;
+}
@@ -0,0 +1,64 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_LINKCOMPONENTS_H_
+#define MUMBLE_MURMUR_LINKCOMPONENTS_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// Keeps track of which channels are (directly or indirectly) linked to each other, so that audio can be routed to
+/// all of them without walking the links of the channels for every packet (see Channel::allLinks).
+///
+/// The linked channels form connected components, each of which is stored once and shared by all of its channels.
+/// Linking two channels merges their components by moving the channels of the smaller one over to the larger one.
+/// Unlinking them only has to look at the component they were part of, which might fall apart into two.
+///
+/// Every component carries a version that is handed out anew whenever the channels belonging to it might have
+/// changed, so that anything derived from a component can tell whether it is still up-to-date. Channels that aren't
+/// linked at all don't belong to any component.
+///
+/// The class isn't thread-safe. The server modifies it while holding the voice lock exclusively.
+class LinkComponents {
+public:
+	/// Links the channels with the given IDs. Linking channels that are linked already has no effect.
+	void link(unsigned int channel, unsigned int other);
+	/// Removes the link between the channels with the given IDs (if there is one)
+	void unlink(unsigned int channel, unsigned int other);
+	/// Removes all links of the channel with the given ID (e.g. because it is about to be removed)
+	void unlinkAll(unsigned int channel);
+	void clear();
+
+	/// @returns The IDs of the channels the given one is linked to, including itself, or an empty list if it isn't
+	/// 	linked to any channel. The list is valid until the links are modified.
+	const std::vector< unsigned int > &linkedChannels(unsigned int channel) const;
+	/// @returns The version of the component of the given channel, or 0 if it isn't linked to any channel
+	std::uint64_t version(unsigned int channel) const;
+	/// @returns The amount of components, i.e. of distinct groups of linked channels
+	std::size_t count() const;
+
+private:
+	struct Component {
+		std::uint64_t version;
+		std::vector< unsigned int > channels;
+	};
+
+	/// Replaces the components of the given channels (which must have been part of the same component) by the
+	/// components their links form now
+	void split(const std::vector< unsigned int > &channels);
+	std::shared_ptr< Component > makeComponent();
+
+	/// The channels every channel is linked to directly
+	QHash< unsigned int, QSet< unsigned int > > m_links;
+	QHash< unsigned int, std::shared_ptr< Component > > m_components;
+	std::size_t m_componentCount = 0;
+	std::uint64_t m_nextVersion  = 1;
+};
+
+#endif // MUMBLE_MURMUR_LINKCOMPONENTS_H_
@@ -11,6 +11,7 @@
 #include "Group.h"
 #include "Meta.h"
 #include "MumbleConstants.h"
+#include "PBKDF2.h"
 #include "ProtoUtils.h"
 #include "QtUtils.h"
 #include "Server.h"
@@ -23,6 +24,8 @@
 #include <cassert>
 #include <unordered_map>
 
+#include <QtCore/QCoreApplication>
+#include <QtCore/QPointer>
 #include <QtCore/QStack>
 #include <QtCore/QTimeZone>
 #include <QtCore/QtEndian>
@@ -205,19 +208,71 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		qhHostUsers[uSource->haAddress].insert(uSource);
 	}
 
-	Channel *root = qhChannels.value(0);
-	Channel *c;
-
 	uSource->qsName = u8(msg.username()).trimmed();
 
-	bool ok     = false;
-	bool nameok = validateUserName(uSource->qsName);
-	QString pw  = u8(msg.password());
+	const bool nameok = validateUserName(uSource->qsName);
+	const QString pw  = u8(msg.password());
 
 	// Fetch ID and stored username.
 	// This function needs to support the fact that sessions may go away.
-	int id = authenticate(uSource->qsName, pw, static_cast< int >(uSource->uiSession), uSource->qslEmail,
-						  uSource->qsHash, uSource->bVerified, uSource->peerCertificateChain());
+	int id = authenticateExternally(uSource->qsName, pw, static_cast< int >(uSource->uiSession), uSource->qsHash,
+									uSource->bVerified, uSource->peerCertificateChain());
+
+	if (id == -2) {
+		const StoredPassword stored = readStoredPassword(uSource->qsName);
+
+		if (stored.requiresPBKDF2()) {
+			// Computing the hash is expensive on purpose, so it is done on another thread. The authentication is
+			// finished on this thread once the hash is available.
+			uSource->bAuthenticationPending = true;
+
+			QPointer< ServerUser > user = uSource;
+			m_authenticationPool.start([this, user, msg, nameok, pw, stored]() {
+				const QString pbkdf2Hash = PBKDF2::getHash(stored.salt, pw, stored.kdfIterations);
+
+				QCoreApplication::postEvent(this, new ExecEvent([this, user, msg, nameok, pw, stored, pbkdf2Hash]() {
+					// The user might have disconnected in the meantime
+					if (!user || qhUsers.value(user->uiSession) != user) {
+						return;
+					}
+
+					user->bAuthenticationPending = false;
+
+					const int result = authenticateLocally(user->qsName, pw, user->qslEmail, user->qsHash,
+														   user->bVerified, stored, pbkdf2Hash);
+					finishAuthentication(user, msg, result, nameok, pw);
+
+					// Process the messages that have been received in the meantime (unless the user has been
+					// rejected)
+					const QList< QPair< Mumble::Protocol::TCPMessageType, QByteArray > > pending =
+						std::move(user->qlPendingMessages);
+					user->qlPendingMessages.clear();
+
+					for (const QPair< Mumble::Protocol::TCPMessageType, QByteArray > &current : pending) {
+						if (!user || user->sState != ServerUser::Authenticated) {
+							break;
+						}
+
+						message(current.first, current.second, user);
+					}
+				}));
+			});
+
+			return;
+		}
+
+		id = authenticateLocally(uSource->qsName, pw, uSource->qslEmail, uSource->qsHash, uSource->bVerified, stored,
+								 QString());
+	}
+
+	finishAuthentication(uSource, msg, id, nameok, pw);
+}
+
+void Server::finishAuthentication(ServerUser *uSource, const MumbleProto::Authenticate &msg, int id, bool nameok,
+								  const QString &pw) {
+	Channel *root = qhChannels.value(0);
+
+	bool ok = false;
 
 	uSource->iId = id >= 0 ? id : -1;
 
@@ -374,56 +429,15 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 						  "talk to or hear most clients. Please make sure your client was built with CELT support."));
 	}
 
-	// Transmit channel tree
-	QQueue< Channel * > q;
-	QSet< Channel * > chans;
-	q << root;
-	MumbleProto::ChannelState mpcs;
-
-	while (!q.isEmpty()) {
-		c = q.dequeue();
-		chans.insert(c);
-
-		mpcs.Clear();
-
-		mpcs.set_channel_id(c->iId);
-		if (c->cParent)
-			mpcs.set_parent(c->cParent->iId);
-		if (c->iId == 0)
-			mpcs.set_name(u8(qsRegName.isEmpty() ? QLatin1String("Root") : qsRegName));
-		else
-			mpcs.set_name(u8(c->qsName));
-
-		mpcs.set_position(c->iPosition);
-
-		if ((uSource->m_version >= Version::fromComponents(1, 2, 2)) && !c->qbaDescHash.isEmpty())
-			mpcs.set_description_hash(blob(c->qbaDescHash));
-		else if (!c->qsDesc.isEmpty())
-			mpcs.set_description(u8(c->qsDesc));
-
-		mpcs.set_max_users(c->uiMaxUsers);
-
-		// Include info about enter restrictions of this channel
-		mpcs.set_is_enter_restricted(isChannelEnterRestricted(c));
-		mpcs.set_can_enter(hasPermission(uSource, c, ChanACL::Enter));
-
-		sendMessage(uSource, mpcs);
-
-		foreach (c, c->qlChannels)
-			q.enqueue(c);
-	}
-
-	// Transmit links
-	foreach (c, chans) {
-		if (c->qhLinks.count() > 0) {
-			mpcs.Clear();
-			mpcs.set_channel_id(c->iId);
-
-			foreach (Channel *l, c->qhLinks.keys())
-				mpcs.add_links(l->iId);
-			sendMessage(uSource, mpcs);
-		}
-	}
+	// Transmit channel tree (in one go, as it is made up of one message per channel)
+	QByteArray channelTree;
+	m_channelSyncCache.write(
+		*root, uSource->m_version >= Version::fromComponents(1, 2, 2),
+		[this](Channel &channel, bool descriptionHash, MumbleProto::ChannelState &mpcs) {
+			describeChannel(channel, descriptionHash, mpcs);
+		},
+		[this, uSource](Channel &channel) { return hasPermission(uSource, &channel, ChanACL::Enter); }, channelTree);
+	uSource->sendMessage(channelTree);
 
 	loadChannelListenersOf(*uSource);
 
@@ -463,15 +477,20 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 
 	mpus.set_channel_id(uSource->cChannel->iId);
 
-	sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+	QByteArray cache;
+	sendAll(mpus, cache, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
 
 	if ((uSource->qbaTexture.length() >= 4)
 		&& (qFromBigEndian< unsigned int >(reinterpret_cast< const unsigned char * >(uSource->qbaTexture.constData()))
-			== 600 * 60 * 4))
+			== 600 * 60 * 4)) {
 		mpus.set_texture(blob(uSource->qbaTexture));
-	if (!uSource->qsComment.isEmpty())
+		cache.clear();
+	}
+	if (!uSource->qsComment.isEmpty()) {
 		mpus.set_comment(u8(uSource->qsComment));
-	sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
+		cache.clear();
+	}
+	sendAll(mpus, cache, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
 
 	// Transmit other users profiles
 	foreach (ServerUser *u, qhUsers) {
@@ -545,9 +564,7 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	if (uSource->iId == 0) {
 		mpss.set_permissions(ChanACL::All);
 	} else {
-		QMutexLocker qml(&qmCache);
-		ChanACL::hasPermission(uSource, root, ChanACL::Enter, &acCache);
-		mpss.set_permissions(acCache.value(uSource)->value(root));
+		mpss.set_permissions(static_cast< unsigned int >(effectivePermissions(uSource, root) | ChanACL::Cached));
 	}
 
 	sendMessage(uSource, mpss);
@@ -650,6 +667,28 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	emit userConnected(uSource);
 }
 
+void Server::describeChannel(Channel &channel, bool descriptionHash, MumbleProto::ChannelState &mpcs) const {
+	mpcs.set_channel_id(channel.iId);
+	if (channel.cParent)
+		mpcs.set_parent(channel.cParent->iId);
+	if (channel.iId == 0)
+		mpcs.set_name(u8(qsRegName.isEmpty() ? QLatin1String("Root") : qsRegName));
+	else
+		mpcs.set_name(u8(channel.qsName));
+
+	mpcs.set_position(channel.iPosition);
+
+	if (descriptionHash && !channel.qbaDescHash.isEmpty())
+		mpcs.set_description_hash(blob(channel.qbaDescHash));
+	else if (!channel.qsDesc.isEmpty())
+		mpcs.set_description(u8(channel.qsDesc));
+
+	mpcs.set_max_users(channel.uiMaxUsers);
+
+	// Include info about enter restrictions of this channel
+	mpcs.set_is_enter_restricted(isChannelEnterRestricted(&channel));
+}
+
 void Server::msgBanList(ServerUser *uSource, MumbleProto::BanList &msg) {
 	ZoneScoped;
 
@@ -701,6 +740,7 @@ void Server::msgBanList(ServerUser *uSource, MumbleProto::BanList &msg) {
 				qlBans << b;
 			}
 		}
+		m_banIndex.update(qlBans);
 		newBans             = QSet< Ban >(qlBans.begin(), qlBans.end());
 		QSet< Ban > removed = previousBans - newBans;
 		QSet< Ban > added   = newBans - previousBans;
@@ -1088,11 +1128,13 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 			adjustment->set_volume_adjustment(volumeAdjustment);
 		}
 	}
+	QSet< unsigned int > removedListenerChannels;
 	for (int i = 0; i < msg.listening_channel_remove_size(); i++) {
 		Channel *c = qhChannels.value(msg.listening_channel_remove(i));
 
 		if (c) {
 			disableChannelListener(*pDstServerUser, *c);
+			removedListenerChannels << c->iId;
 
 			log(QString::fromLatin1("\"%1\" is no longer listening to \"%2\"")
 					.arg(QString(*pDstServerUser))
@@ -1108,8 +1150,13 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 
 	if (listenerChanged || listenerVolumeChanged) {
 		// As whisper targets also contain information about ChannelListeners and
-		// their associated volume adjustment, we have to clear the target cache
-		clearWhisperTargetCache();
+		// their associated volume adjustment, we have to update the targets to the affected channels
+		QSet< unsigned int > changedChannels = volumeAdjustedChannels + removedListenerChannels;
+		for (const Channel *c : listeningChannelsAdd) {
+			changedChannels << c->iId;
+		}
+
+		refreshWhisperTargetCache(changedChannels, {});
 	}
 
 
@@ -1136,6 +1183,9 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 	}
 
 	if (bBroadcast) {
+		// The message is serialized once for each of its versions
+		QByteArray cache;
+
 		// Texture handling for clients < 1.2.2.
 		// Send the texture data in the message.
 		if (msg.has_texture() && (pDstServerUser->qbaTexture.length() >= 4)
@@ -1149,7 +1199,7 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		} else {
 			// This is an old style texture, empty texture or there was no texture in this packet,
 			// send the message unchanged.
-			sendAll(msg, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
+			sendAll(msg, cache, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
 		}
 
 		// Texture / comment handling for clients >= 1.2.2.
@@ -1157,30 +1207,29 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		if (msg.has_texture() && !pDstServerUser->qbaTextureHash.isEmpty()) {
 			msg.clear_texture();
 			msg.set_texture_hash(blob(pDstServerUser->qbaTextureHash));
+			cache.clear();
 		}
 		if (msg.has_comment() && !pDstServerUser->qbaCommentHash.isEmpty()) {
 			msg.clear_comment();
 			msg.set_comment_hash(blob(pDstServerUser->qbaCommentHash));
+			cache.clear();
 		}
 
 		if (uSource->m_version >= Version::fromComponents(1, 2, 2)) {
-			sendMessage(uSource, msg);
+			sendMessage(uSource, msg, cache);
 		}
-		if (!broadcastListenerVolumeAdjustments) {
+		if (!broadcastListenerVolumeAdjustments && msg.listening_volume_adjustment_size() > 0) {
 			// Don't broadcast the volume adjustments to everyone
 			msg.clear_listening_volume_adjustment();
+			cache.clear();
 		}
 
 		if (broadcastListenerVolumeAdjustments || !broadcastingBecauseOfVolumeChange) {
-			sendExcept(uSource, msg, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+			sendExcept(uSource, msg, cache, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
 		}
 
 		if (bDstAclChanged) {
 			clearACLCache(pDstServerUser);
-		} else if (listenerChanged || listenerVolumeChanged) {
-			// We only have to do this if the ACLs didn't change as
-			// clearACLCache calls clearWhisperTargetChache anyways
-			clearWhisperTargetCache();
 		}
 	}
 
@@ -1215,6 +1264,7 @@ void Server::msgUserRemove(ServerUser *uSource, MumbleProto::UserRemove &msg) {
 		b.qdtStart   = QDateTime::currentDateTime().toUTC();
 		b.iDuration  = 0;
 		qlBans << b;
+		m_banIndex.add(b);
 		saveBans();
 	}
 
@@ -1357,12 +1407,14 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 		log(uSource, QString("Added channel %1 under %2").arg(QString(*c), QString(*p)));
 		emit channelCreated(c);
 
-		sendAll(msg, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
+		QByteArray cache;
+		sendAll(msg, cache, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
 		if (!c->qbaDescHash.isEmpty()) {
 			msg.clear_description();
 			msg.set_description_hash(blob(c->qbaDescHash));
+			cache.clear();
 		}
-		sendAll(msg, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+		sendAll(msg, cache, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
 
 		if (c->bTemporary) {
 			// If a temporary channel has been created move the creator right in there
@@ -1483,6 +1535,7 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 				c->cParent->removeChannel(c);
 				p->addChannel(c);
 			}
+			m_channelSyncCache.invalidateStructure();
 		}
 		if (!qsName.isNull()) {
 			log(uSource, QString("Renamed channel %1 to %2").arg(QString(*c), QString(qsName)));
@@ -1503,12 +1556,14 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 		updateChannel(c);
 		emit channelStateChanged(c);
 
-		sendAll(msg, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
+		QByteArray cache;
+		sendAll(msg, cache, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
 		if (msg.has_description() && !c->qbaDescHash.isEmpty()) {
 			msg.clear_description();
 			msg.set_description_hash(blob(c->qbaDescHash));
+			cache.clear();
 		}
-		sendAll(msg, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+		sendAll(msg, cache, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
 	}
 }
 
@@ -2221,6 +2276,13 @@ void Server::msgVoiceTarget(ServerUser *uSource, MumbleProto::VoiceTarget &msg)
 			uSource->qmTargets.insert(target, std::move(wt));
 		}
 	}
+
+	lock.unlock();
+
+	if (uSource->qmTargets.contains(target)) {
+		// Build the cache entry right away, instead of when the first audio packet is sent to the target
+		buildWhisperTargetCaches({ qMakePair(uSource, target) });
+	}
 }
 
 void Server::msgPermissionQuery(ServerUser *uSource, MumbleProto::PermissionQuery &msg) {
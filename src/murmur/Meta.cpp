@@ -68,6 +68,7 @@ MetaParams::MetaParams() {
 	qsDatabase                 = QString();
 	iSQLiteWAL                 = 0;
 	iDBPort                    = 0;
+	iDBWriteBehindInterval     = 1000;
 	qsDBDriver                 = "QSQLITE";
 	qsLogfile                  = "mumble-server.log";
 
@@ -114,6 +115,9 @@ MetaParams::MetaParams() {
 
 	rollingStatsWindow = 300;
 
+	voiceThreads     = 1;
+	qsVoiceEventLoop = QLatin1String("epoll");
+
 	qsSettings = nullptr;
 }
 
@@ -294,6 +298,8 @@ void MetaParams::read(QString fname) {
 	qsDBOpts     = typeCheckedFromSettings("dbOpts", qsDBOpts);
 	iDBPort      = typeCheckedFromSettings("dbPort", iDBPort);
 
+	iDBWriteBehindInterval = typeCheckedFromSettings("dbWriteBehindInterval", iDBWriteBehindInterval);
+
 	qsIceEndpoint    = typeCheckedFromSettings("ice", qsIceEndpoint);
 	qsIceSecretRead  = typeCheckedFromSettings("icesecret", qsIceSecretRead);
 	qsIceSecretRead  = typeCheckedFromSettings("icesecretread", qsIceSecretRead);
@@ -333,6 +339,9 @@ void MetaParams::read(QString fname) {
 
 	rollingStatsWindow = typeCheckedFromSettings("rollingStatsWindow", rollingStatsWindow);
 
+	voiceThreads     = typeCheckedFromSettings("voiceThreads", voiceThreads);
+	qsVoiceEventLoop = typeCheckedFromSettings("voiceEventLoop", qsVoiceEventLoop);
+
 	iOpusThreshold = typeCheckedFromSettings("opusthreshold", iOpusThreshold);
 
 	iChannelNestingLimit = typeCheckedFromSettings("channelnestinglimit", iChannelNestingLimit);
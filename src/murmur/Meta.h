@@ -77,6 +77,9 @@ public:
 	QString qsDBPrefix;
 	QString qsDBOpts;
 	int iDBPort;
+	/// The time in milliseconds that updates of the users' activity (last channel, channel listeners, ...) and the
+	/// server log may be held back for in order to write them to the database in batches. 0 writes them right away.
+	int iDBWriteBehindInterval;
 
 	int iLogDays;
 
@@ -156,6 +159,14 @@ public:
 	/// The number of seconds to keep rolling stats for per client
 	unsigned int rollingStatsWindow;
 
+	/// The number of threads processing UDP voice packets per virtual server.
+	/// 0 means one thread per CPU core.
+	unsigned int voiceThreads;
+
+	/// The mechanism the voice threads use to wait for UDP packets (only used on Linux).
+	/// One of "poll", "epoll" or "io_uring".
+	QString qsVoiceEventLoop;
+
 	/// qsAbsSettingsFilePath is the absolute path to
 	/// the murmur.ini used by this Meta instance.
 	QString qsAbsSettingsFilePath;
@@ -37,6 +37,31 @@ static MumbleServerIce *mi = nullptr;
 static Ice::ObjectPtr iopServer;
 static Ice::PropertiesPtr ippProperties;
 
+/// The amount of events that may be queued for a single ServerCallback. A callback that falls further behind is
+/// considered to be hung and is removed.
+constexpr const std::size_t CALLBACK_QUEUE_LIMIT = 1000;
+
+/// The coalescing keys of the state changes of users and channels (see IceCallbackDispatcher::post)
+static QString userStateKey(unsigned int session) {
+	return QString::fromLatin1("userStateChanged/%1").arg(session);
+}
+
+static QString channelStateKey(unsigned int channelID) {
+	return QString::fromLatin1("channelStateChanged/%1").arg(channelID);
+}
+
+#if ICE_INT_VERSION >= 30600
+/// Invokes the operation on the given callback proxy asynchronously and reports the outcome to done
+#	define INVOKE_CALLBACK(prx, operation, done, ...)                                                 \
+		prx->begin_##operation(                                                                       \
+			__VA_ARGS__, [done]() { done(true); }, [done](const ::Ice::Exception &) { done(false); })
+#else
+// Without support for lambdas in AMI calls, the dispatcher thread waits for every invocation to finish
+#	define INVOKE_CALLBACK(prx, operation, done, ...) \
+		prx->operation(__VA_ARGS__);                  \
+		done(true)
+#endif
+
 void IceParse(int &argc, char *argv[]) {
 	ippProperties = Ice::createProperties(argc, argv);
 }
@@ -271,6 +296,9 @@ MumbleServerIce::MumbleServerIce() {
 
 		iopServer = new ServerI;
 
+		m_callbackDispatcher = std::make_unique< IceCallbackDispatcher >(CALLBACK_QUEUE_LIMIT);
+		m_callbackDispatcher->start();
+
 		adapter->activate();
 		foreach (const Ice::EndpointPtr ep, mprx->ice_getEndpoints()) {
 			qWarning("MumbleServerIce: Endpoint \"%s\" running", qPrintable(u8(ep->toString())));
@@ -287,6 +315,12 @@ MumbleServerIce::MumbleServerIce() {
 }
 
 MumbleServerIce::~MumbleServerIce() {
+	// Invocations that are still in flight complete (or fail) while the communicator is destroyed, so the dispatcher
+	// may only be deleted afterwards
+	if (m_callbackDispatcher) {
+		m_callbackDispatcher->stop();
+	}
+
 	if (communicator) {
 		communicator->shutdown();
 		communicator->waitForShutdown();
@@ -295,6 +329,8 @@ MumbleServerIce::~MumbleServerIce() {
 		qWarning("MumbleServerIce: Shutdown complete");
 	}
 	iopServer = nullptr;
+
+	m_callbackDispatcher.reset();
 }
 
 void MumbleServerIce::customEvent(QEvent *evt) {
@@ -312,6 +348,13 @@ void MumbleServerIce::badServerProxy(const ::MumbleServer::ServerCallbackPrx &pr
 	removeServerCallback(server, prx);
 }
 
+void MumbleServerIce::badServerProxy(const ::MumbleServer::ServerCallbackPrx &prx, int server_id) {
+	const ::Server *server = meta->qhServers.value(server_id);
+	if (server) {
+		badServerProxy(prx, server);
+	}
+}
+
 void MumbleServerIce::badAuthenticator(::Server *server) {
 	server->disconnectAuthenticator(this);
 	const ::MumbleServer::ServerAuthenticatorPrx &prx = qmServerAuthenticator.value(server->iServerNum);
@@ -340,11 +383,19 @@ void MumbleServerIce::addServerCallback(const ::Server *server, const ::MumbleSe
 		server->log(
 			QString("Added Ice ServerCallback %1").arg(QString::fromStdString(communicator->proxyToString(prx))));
 		cbList.append(prx);
+
+		const int server_id = server->iServerNum;
+		m_callbackDispatcher->addTarget(callbackTarget(server, prx), [this, prx, server_id]() {
+			// This may be called from any thread, so the callback is removed on the main thread
+			QCoreApplication::postEvent(
+				this, new ExecEvent([this, prx, server_id]() { badServerProxy(prx, server_id); }));
+		});
 	}
 }
 
 void MumbleServerIce::removeServerCallback(const ::Server *server, const ::MumbleServer::ServerCallbackPrx &prx) {
 	if (qmServerCallbacks[server->iServerNum].removeAll(prx)) {
+		m_callbackDispatcher->removeTarget(callbackTarget(server, prx));
 		server->log(
 			QString("Removed Ice ServerCallback %1").arg(QString::fromStdString(communicator->proxyToString(prx))));
 	}
@@ -352,11 +403,37 @@ void MumbleServerIce::removeServerCallback(const ::Server *server, const ::Mumbl
 
 void MumbleServerIce::removeServerCallbacks(const ::Server *server) {
 	if (qmServerCallbacks.contains(server->iServerNum)) {
+		foreach (const ::MumbleServer::ServerCallbackPrx &prx, qmServerCallbacks.value(server->iServerNum)) {
+			m_callbackDispatcher->removeTarget(callbackTarget(server, prx));
+		}
+
 		server->log(QString("Removed all Ice ServerCallbacks"));
 		qmServerCallbacks.remove(server->iServerNum);
 	}
 }
 
+QString MumbleServerIce::callbackTarget(const ::Server *server, const ::MumbleServer::ServerCallbackPrx &prx) const {
+	return QString::number(server->iServerNum) + QLatin1Char('/')
+		   + QString::fromStdString(communicator->proxyToString(prx));
+}
+
+void MumbleServerIce::postServerCallbacks(
+	const ::Server *server, const QString &coalescingKey,
+	const std::function< void(const ::MumbleServer::ServerCallbackPrx &, const IceCallbackDispatcher::Completion &) >
+		&invoke) {
+	foreach (const ::MumbleServer::ServerCallbackPrx &prx, qmServerCallbacks.value(server->iServerNum)) {
+		m_callbackDispatcher->post(
+			callbackTarget(server, prx),
+			[prx, invoke](const IceCallbackDispatcher::Completion &done) { invoke(prx, done); }, coalescingKey);
+	}
+}
+
+void MumbleServerIce::endServerCallbacksCoalescing(const ::Server *server, const QString &coalescingKey) {
+	foreach (const ::MumbleServer::ServerCallbackPrx &prx, qmServerCallbacks.value(server->iServerNum)) {
+		m_callbackDispatcher->endCoalescing(callbackTarget(server, prx), coalescingKey);
+	}
+}
+
 void MumbleServerIce::addServerContextCallback(const ::Server *server, int session_id, const QString &action,
 											   const ::MumbleServer::ServerContextCallbackPrx &prx) {
 	QMap< QString, ::MumbleServer::ServerContextCallbackPrx > &callbacks =
@@ -482,13 +559,8 @@ void MumbleServerIce::userConnected(const ::User *p) {
 	::MumbleServer::User mp;
 	userToUser(p, mp);
 
-	foreach (const ::MumbleServer::ServerCallbackPrx &prx, qmList) {
-		try {
-			prx->userConnected(mp);
-		} catch (...) {
-			badServerProxy(prx, s);
-		}
-	}
+	postServerCallbacks(s, QString(),
+						[mp](const auto &prx, const auto &done) { INVOKE_CALLBACK(prx, userConnected, done, mp); });
 }
 
 void MumbleServerIce::userDisconnected(const ::User *p) {
@@ -504,13 +576,11 @@ void MumbleServerIce::userDisconnected(const ::User *p) {
 	::MumbleServer::User mp;
 	userToUser(p, mp);
 
-	foreach (const ::MumbleServer::ServerCallbackPrx &prx, qmList) {
-		try {
-			prx->userDisconnected(mp);
-		} catch (...) {
-			badServerProxy(prx, s);
-		}
-	}
+	// The session might be handed out to another user, whose state must not replace the pending ones of this user
+	endServerCallbacksCoalescing(s, userStateKey(p->uiSession));
+
+	postServerCallbacks(s, QString(),
+						[mp](const auto &prx, const auto &done) { INVOKE_CALLBACK(prx, userDisconnected, done, mp); });
 }
 
 void MumbleServerIce::userStateChanged(const ::User *p) {
@@ -524,13 +594,8 @@ void MumbleServerIce::userStateChanged(const ::User *p) {
 	::MumbleServer::User mp;
 	userToUser(p, mp);
 
-	foreach (const ::MumbleServer::ServerCallbackPrx &prx, qmList) {
-		try {
-			prx->userStateChanged(mp);
-		} catch (...) {
-			badServerProxy(prx, s);
-		}
-	}
+	postServerCallbacks(s, userStateKey(p->uiSession),
+						[mp](const auto &prx, const auto &done) { INVOKE_CALLBACK(prx, userStateChanged, done, mp); });
 }
 
 void MumbleServerIce::userTextMessage(const ::User *p, const ::TextMessage &message) {
@@ -547,13 +612,10 @@ void MumbleServerIce::userTextMessage(const ::User *p, const ::TextMessage &mess
 	::MumbleServer::TextMessage textMessage;
 	textmessageToTextmessage(message, textMessage);
 
-	foreach (const ::MumbleServer::ServerCallbackPrx &prx, qmList) {
-		try {
-			prx->userTextMessage(mp, textMessage);
-		} catch (...) {
-			badServerProxy(prx, s);
-		}
-	}
+	postServerCallbacks(s, QString(),
+						[mp, textMessage](const auto &prx, const auto &done) {
+							INVOKE_CALLBACK(prx, userTextMessage, done, mp, textMessage);
+						});
 }
 
 void MumbleServerIce::channelCreated(const ::Channel *c) {
@@ -567,13 +629,8 @@ void MumbleServerIce::channelCreated(const ::Channel *c) {
 	::MumbleServer::Channel mc;
 	channelToChannel(c, mc);
 
-	foreach (const ::MumbleServer::ServerCallbackPrx &prx, qmList) {
-		try {
-			prx->channelCreated(mc);
-		} catch (...) {
-			badServerProxy(prx, s);
-		}
-	}
+	postServerCallbacks(s, QString(),
+						[mc](const auto &prx, const auto &done) { INVOKE_CALLBACK(prx, channelCreated, done, mc); });
 }
 
 void MumbleServerIce::channelRemoved(const ::Channel *c) {
@@ -587,13 +644,11 @@ void MumbleServerIce::channelRemoved(const ::Channel *c) {
 	::MumbleServer::Channel mc;
 	channelToChannel(c, mc);
 
-	foreach (const ::MumbleServer::ServerCallbackPrx &prx, qmList) {
-		try {
-			prx->channelRemoved(mc);
-		} catch (...) {
-			badServerProxy(prx, s);
-		}
-	}
+	// Like sessions, channel IDs might be reused
+	endServerCallbacksCoalescing(s, channelStateKey(c->iId));
+
+	postServerCallbacks(s, QString(),
+						[mc](const auto &prx, const auto &done) { INVOKE_CALLBACK(prx, channelRemoved, done, mc); });
 }
 
 void MumbleServerIce::channelStateChanged(const ::Channel *c) {
@@ -607,13 +662,10 @@ void MumbleServerIce::channelStateChanged(const ::Channel *c) {
 	::MumbleServer::Channel mc;
 	channelToChannel(c, mc);
 
-	foreach (const ::MumbleServer::ServerCallbackPrx &prx, qmList) {
-		try {
-			prx->channelStateChanged(mc);
-		} catch (...) {
-			badServerProxy(prx, s);
-		}
-	}
+	postServerCallbacks(s, channelStateKey(c->iId),
+						[mc](const auto &prx, const auto &done) {
+							INVOKE_CALLBACK(prx, channelStateChanged, done, mc);
+						});
 }
 
 void MumbleServerIce::contextAction(const ::User *pSrc, const QString &action, unsigned int session, int iChannel) {
@@ -1152,6 +1204,7 @@ static void impl_Server_setBans(const ::MumbleServer::AMD_Server_setBansPtr cb,
 			banToBan(mb, ban);
 			server->qlBans << ban;
 		}
+		server->m_banIndex.update(server->qlBans);
 	}
 
 	server->saveBans();
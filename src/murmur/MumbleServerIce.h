@@ -20,8 +20,12 @@
 #include <QtCore/QWaitCondition>
 #include <QtNetwork/QSslCertificate>
 
+#include "IceCallbackDispatcher.h"
 #include "MumbleServerI.h"
 
+#include <functional>
+#include <memory>
+
 class Channel;
 class Server;
 class User;
@@ -38,12 +42,24 @@ protected:
 	void customEvent(QEvent *evt);
 	void badMetaProxy(const ::MumbleServer::MetaCallbackPrx &prx);
 	void badServerProxy(const ::MumbleServer::ServerCallbackPrx &prx, const ::Server *server);
+	void badServerProxy(const ::MumbleServer::ServerCallbackPrx &prx, int server_id);
 	void badAuthenticator(::Server *);
 	QList<::MumbleServer::MetaCallbackPrx > qlMetaCallbacks;
 	QMap< int, QList<::MumbleServer::ServerCallbackPrx > > qmServerCallbacks;
 	QMap< int, QMap< int, QMap< QString, ::MumbleServer::ServerContextCallbackPrx > > > qmServerContextCallbacks;
 	QMap< int, ::MumbleServer::ServerAuthenticatorPrx > qmServerAuthenticator;
 	QMap< int, ::MumbleServer::ServerUpdatingAuthenticatorPrx > qmServerUpdatingAuthenticator;
+	/// Delivers the events to the ServerCallbacks, so that they don't block the main thread
+	std::unique_ptr< IceCallbackDispatcher > m_callbackDispatcher;
+
+	QString callbackTarget(const ::Server *server, const ::MumbleServer::ServerCallbackPrx &prx) const;
+	/// Queues the invocation for all ServerCallbacks of the given server (see IceCallbackDispatcher::post)
+	void postServerCallbacks(const ::Server *server, const QString &coalescingKey,
+							 const std::function< void(const ::MumbleServer::ServerCallbackPrx &,
+													   const IceCallbackDispatcher::Completion &) > &invoke);
+	/// Ends the coalescing of the given key for all ServerCallbacks of the given server (see
+	/// IceCallbackDispatcher::endCoalescing)
+	void endServerCallbacksCoalescing(const ::Server *server, const QString &coalescingKey);
 
 public:
 	Ice::CommunicatorPtr communicator;
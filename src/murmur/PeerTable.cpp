@@ -0,0 +1,235 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PeerTable.h"
+
+#include <QtCore/QtGlobal>
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+#	include <winsock2.h>
+#	include <ws2tcpip.h>
+#else
+#	include <netinet/in.h>
+#	include <sys/socket.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+constexpr static const std::size_t MIN_CAPACITY = 16;
+
+PeerTable::Snapshot::Snapshot(std::size_t capacity) : mask(capacity - 1), slots(capacity) {
+	assert((capacity & mask) == 0);
+}
+
+const PeerTable::Slot &PeerTable::Snapshot::probe(const Key &key) const {
+	std::size_t index = PeerTable::hash(key) & mask;
+
+	// As the table is never full, this always terminates
+	while (slots[index].peer.user && !(slots[index].key == key)) {
+		index = (index + 1) & mask;
+	}
+
+	return slots[index];
+}
+
+PeerTable::Slot &PeerTable::Snapshot::probe(const Key &key) {
+	return const_cast< Slot & >(static_cast< const Snapshot * >(this)->probe(key));
+}
+
+void PeerTable::Snapshot::erase(Slot &slot) {
+	std::size_t hole = static_cast< std::size_t >(&slot - slots.data());
+	std::size_t next = hole;
+
+	while (true) {
+		next = (next + 1) & mask;
+		if (!slots[next].peer.user) {
+			break;
+		}
+
+		// An entry may only be moved into the hole if the hole lies between its home slot and its current
+		// position (cyclically). Otherwise it couldn't be found anymore.
+		std::size_t home = PeerTable::hash(slots[next].key) & mask;
+		bool reachable   = (hole <= next) ? (hole < home && home <= next) : (hole < home || home <= next);
+		if (reachable) {
+			continue;
+		}
+
+		slots[hole] = slots[next];
+		hole        = next;
+	}
+
+	slots[hole] = Slot();
+	size--;
+}
+
+
+PeerTable::PeerTable(std::size_t readerCount)
+	: m_current(new Snapshot(MIN_CAPACITY)), m_readers(new ReaderState[std::max< std::size_t >(readerCount, 1)]),
+	  m_readerCount(std::max< std::size_t >(readerCount, 1)) {
+}
+
+PeerTable::~PeerTable() {
+	// There must not be any readers left at this point
+	delete m_current.load();
+}
+
+PeerTable::Peer PeerTable::find(const sockaddr_storage &address, std::size_t reader) const {
+	assert(reader < m_readerCount);
+
+	const Key key = makeKey(address);
+
+	// Announce the epoch this reader is in before loading the snapshot. Any snapshot that is retired
+	// from now on won't be freed until the epoch is reset below.
+	ReaderState &state = m_readers[reader];
+	state.epoch.store(m_epoch.load());
+
+	const Snapshot *snapshot = m_current.load();
+	Peer peer                = snapshot->probe(key).peer;
+
+	state.epoch.store(0, std::memory_order_release);
+
+	return peer;
+}
+
+void PeerTable::insert(const sockaddr_storage &address, ServerUser *user, unsigned int session) {
+	assert(user);
+
+	const Key key = makeKey(address);
+
+	std::lock_guard< std::mutex > lock(m_writeMutex);
+
+	std::unique_ptr< Snapshot > snapshot = copy(m_current.load()->size + 1);
+
+	Slot &slot = snapshot->probe(key);
+	if (!slot.peer.user) {
+		slot.key = key;
+		snapshot->size++;
+	}
+	slot.peer.user    = user;
+	slot.peer.session = session;
+
+	publish(std::move(snapshot));
+}
+
+void PeerTable::remove(const sockaddr_storage &address) {
+	const Key key = makeKey(address);
+
+	std::lock_guard< std::mutex > lock(m_writeMutex);
+
+	const Snapshot *current = m_current.load();
+	if (!current->probe(key).peer.user) {
+		// Nothing to do
+		return;
+	}
+
+	std::unique_ptr< Snapshot > snapshot = copy(current->size - 1);
+	snapshot->erase(snapshot->probe(key));
+
+	publish(std::move(snapshot));
+}
+
+std::size_t PeerTable::size() const {
+	std::lock_guard< std::mutex > lock(m_writeMutex);
+
+	return m_current.load()->size;
+}
+
+std::size_t PeerTable::retiredCount() const {
+	std::lock_guard< std::mutex > lock(m_writeMutex);
+
+	return m_retired.size();
+}
+
+PeerTable::Key PeerTable::makeKey(const sockaddr_storage &address) {
+	unsigned char bytes[16] = {};
+	Key key;
+
+	if (address.ss_family == AF_INET6) {
+		const sockaddr_in6 *in6 = reinterpret_cast< const sockaddr_in6 * >(&address);
+		memcpy(bytes, in6->sin6_addr.s6_addr, sizeof(bytes));
+		key.port = in6->sin6_port;
+	} else if (address.ss_family == AF_INET) {
+		const sockaddr_in *in = reinterpret_cast< const sockaddr_in * >(&address);
+		bytes[10]             = 0xFF;
+		bytes[11]             = 0xFF;
+		memcpy(&bytes[12], &in->sin_addr.s_addr, sizeof(in->sin_addr.s_addr));
+		key.port = in->sin_port;
+	}
+
+	memcpy(&key.high, &bytes[0], sizeof(key.high));
+	memcpy(&key.low, &bytes[8], sizeof(key.low));
+
+	return key;
+}
+
+std::size_t PeerTable::hash(const Key &key) {
+	// The address bytes aren't evenly distributed (IPv4-mapped addresses only differ in the last 4 bytes
+	// and ports are often sequential), so the words are mixed before being used as an index.
+	std::uint64_t h = key.high * 0x9E3779B97F4A7C15ULL;
+	h ^= key.low + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2);
+	h ^= static_cast< std::uint64_t >(key.port) << 48;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+
+	return static_cast< std::size_t >(h);
+}
+
+std::unique_ptr< PeerTable::Snapshot > PeerTable::copy(std::size_t size) const {
+	const Snapshot *current = m_current.load();
+
+	// The table is kept at most half full, so that probe sequences stay short. It only shrinks once it is less
+	// than an eighth full, so that alternating insertions and removals don't rehash every time.
+	std::size_t capacity = current->slots.size();
+	while (capacity < size * 2) {
+		capacity *= 2;
+	}
+	while (capacity > MIN_CAPACITY && size * 8 < capacity) {
+		capacity /= 2;
+	}
+
+	if (capacity == current->slots.size()) {
+		return std::make_unique< Snapshot >(*current);
+	}
+
+	std::unique_ptr< Snapshot > snapshot = std::make_unique< Snapshot >(capacity);
+
+	for (const Slot &slot : current->slots) {
+		if (slot.peer.user) {
+			snapshot->probe(slot.key) = slot;
+			snapshot->size++;
+		}
+	}
+
+	return snapshot;
+}
+
+void PeerTable::publish(std::unique_ptr< Snapshot > snapshot) {
+	Snapshot *previous = m_current.exchange(snapshot.release());
+
+	// Readers that announce an epoch after this increment are guaranteed to load the new snapshot
+	m_retired.push_back({ std::unique_ptr< Snapshot >(previous), m_epoch.fetch_add(1) });
+
+	reclaim();
+}
+
+void PeerTable::reclaim() {
+	// A retired snapshot can only be in use by readers that entered an epoch up to the one in which it has
+	// been retired. Thus everything retired before the oldest active epoch can be freed.
+	std::uint64_t oldestActive = m_epoch.load();
+	for (std::size_t i = 0; i < m_readerCount; ++i) {
+		std::uint64_t epoch = m_readers[i].epoch.load();
+		if (epoch != 0) {
+			oldestActive = std::min(oldestActive, epoch);
+		}
+	}
+
+	m_retired.erase(std::remove_if(m_retired.begin(), m_retired.end(),
+								   [oldestActive](const Retired &retired) { return retired.epoch < oldestActive; }),
+					m_retired.end());
+}
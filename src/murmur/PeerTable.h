@@ -0,0 +1,131 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_PEERTABLE_H_
+#define MUMBLE_MURMUR_PEERTABLE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class ServerUser;
+struct sockaddr_storage;
+
+/// Maps the UDP addresses of the connected users to the respective ServerUser.
+///
+/// Lookups are wait-free: the table is an immutable open-addressing hash table (a snapshot) that is
+/// replaced as a whole whenever it is modified. Writers copy the current snapshot, modify the copy and
+/// publish it with a single atomic store. Replaced snapshots are only freed once no reader can still be
+/// accessing them, which is tracked with one epoch counter per reader.
+///
+/// Every reader has to use its own reader index (in the range [0, readerCount)). Writers are serialized
+/// internally and never wait for readers.
+class PeerTable {
+public:
+	/// The result of a lookup. The user pointer is taken from a snapshot and therefore is not guaranteed
+	/// to be valid anymore by the time it is used. Callers have to make sure that the user still exists
+	/// (e.g. by checking that Server::qhUsers maps the session to the same pointer) before dereferencing it.
+	struct Peer {
+		ServerUser *user     = nullptr;
+		unsigned int session = 0;
+	};
+
+	/// @param readerCount The amount of threads that will concurrently look up addresses
+	explicit PeerTable(std::size_t readerCount = 1);
+	~PeerTable();
+	PeerTable(const PeerTable &) = delete;
+	PeerTable &operator=(const PeerTable &) = delete;
+
+	/// Looks up the user with the given UDP address. This never blocks.
+	///
+	/// @param address The address (including the port) to look up
+	/// @param reader The index of the calling reader. No two threads may use the same index at the same time.
+	/// @returns The found peer. Its user is nullptr if the address is unknown.
+	Peer find(const sockaddr_storage &address, std::size_t reader = 0) const;
+
+	/// Associates the given address with the given user, replacing any previous association of that address
+	void insert(const sockaddr_storage &address, ServerUser *user, unsigned int session);
+	/// Removes the association of the given address (if any)
+	void remove(const sockaddr_storage &address);
+
+	/// @returns The amount of addresses contained in the current snapshot
+	std::size_t size() const;
+
+	/// @returns The amount of replaced snapshots that haven't been freed yet
+	std::size_t retiredCount() const;
+
+protected:
+	/// The key is built from the raw address bytes. IPv4 addresses are stored as IPv4-mapped IPv6 addresses, so
+	/// that the same peer is found regardless of whether it has been received on a dual-stack socket or not.
+	struct Key {
+		std::uint64_t high = 0;
+		std::uint64_t low  = 0;
+		std::uint16_t port = 0;
+
+		bool operator==(const Key &other) const {
+			return high == other.high && low == other.low && port == other.port;
+		}
+	};
+
+	struct Slot {
+		Key key;
+		Peer peer;
+	};
+
+	struct Snapshot {
+		/// The amount of slots minus one. The amount of slots is always a power of two.
+		std::size_t mask = 0;
+		/// The amount of used slots
+		std::size_t size = 0;
+		std::vector< Slot > slots;
+
+		explicit Snapshot(std::size_t capacity);
+
+		/// @returns The slot for the given key. This is either the slot containing the key or the empty
+		/// 	slot at which the key would have to be inserted.
+		const Slot &probe(const Key &key) const;
+		Slot &probe(const Key &key);
+		/// Clears the given slot and moves the following entries of its probe sequence back, so that no
+		/// tombstones are needed.
+		void erase(Slot &slot);
+	};
+
+	struct Retired {
+		std::unique_ptr< Snapshot > snapshot;
+		/// The epoch in which the snapshot has been replaced
+		std::uint64_t epoch;
+	};
+
+	/// Each reader publishes the epoch it has entered (or 0 while it isn't reading). The slots are padded to a
+	/// cache line each, so that readers don't slow each other down.
+	struct alignas(64) ReaderState {
+		std::atomic< std::uint64_t > epoch{ 0 };
+	};
+
+	static Key makeKey(const sockaddr_storage &address);
+	static std::size_t hash(const Key &key);
+
+	/// Creates a copy of the current snapshot that is suitable for holding the given amount of entries. The table is
+	/// only rehashed if its capacity has to change, otherwise the slots are copied as they are.
+	std::unique_ptr< Snapshot > copy(std::size_t size) const;
+	/// Makes the given snapshot the current one and retires the previous one. Must be called with m_writeMutex
+	/// held.
+	void publish(std::unique_ptr< Snapshot > snapshot);
+	/// Frees all retired snapshots that no reader can be accessing anymore. Must be called with m_writeMutex held.
+	void reclaim();
+
+	std::atomic< Snapshot * > m_current;
+	std::atomic< std::uint64_t > m_epoch{ 1 };
+	std::unique_ptr< ReaderState[] > m_readers;
+	std::size_t m_readerCount;
+
+	mutable std::mutex m_writeMutex;
+	std::vector< Retired > m_retired;
+};
+
+#endif // MUMBLE_MURMUR_PEERTABLE_H_
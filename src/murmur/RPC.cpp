@@ -125,6 +125,7 @@ bool Server::setChannelState(Channel *cChannel, Channel *cParent, const QString
 			cChannel->cParent->removeChannel(cChannel);
 			cParent->addChannel(cChannel);
 		}
+		m_channelSyncCache.invalidateStructure();
 
 		mpcs.set_parent(cParent->iId);
 
@@ -31,7 +31,6 @@
 #include <QtCore/QCoreApplication>
 #include <QtCore/QRegularExpression>
 #include <QtCore/QSet>
-#include <QtCore/QXmlStreamAttributes>
 #include <QtCore/QtEndian>
 #include <QtNetwork/QHostInfo>
 #include <QtNetwork/QSslConfiguration>
@@ -78,6 +77,21 @@ QSslSocket *SslServer::nextPendingSSLConnection() {
 	return qlSockets.takeFirst();
 }
 
+VoiceWorker::VoiceWorker(unsigned int index) : index(index) {
+#ifdef Q_OS_UNIX
+	aiNotify[0] = aiNotify[1] = -1;
+#else
+	hNotify = nullptr;
+#endif
+}
+
+VoiceThread::VoiceThread(Server &server, VoiceWorker &worker) : QThread(&server), m_server(server), m_worker(worker) {
+}
+
+void VoiceThread::run() {
+	m_server.runVoiceWorker(m_worker);
+}
+
 
 Server::Server(int snum, QObject *p) : QThread(p) {
 	tracy::SetThreadName("mumble-server");
@@ -89,11 +103,6 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 #endif
 	bUsingMetaCert = false;
 
-#ifdef Q_OS_UNIX
-	aiNotify[0] = aiNotify[1] = -1;
-#else
-	hNotify = nullptr;
-#endif
 	qtTimeout = new QTimer(this);
 
 	iCodecAlpha = iCodecBeta = 0;
@@ -122,6 +131,18 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 	if (!bValid)
 		return;
 
+#if !defined(Q_OS_LINUX) || !defined(SO_REUSEPORT)
+	// Sharding incoming datagrams between multiple sockets bound to the same port
+	// relies on the load balancing of SO_REUSEPORT, which only Linux provides.
+	if (voiceThreads > 1) {
+		log(QString("Multiple voice threads are not supported on this platform, using a single one"));
+		voiceThreads = 1;
+	}
+#endif
+	for (unsigned int i = 0; i < voiceThreads; ++i) {
+		m_voiceWorkers.push_back(std::make_unique< VoiceWorker >(i));
+	}
+
 	foreach (SslServer *ss, qlServer) {
 		sockaddr_storage addr;
 #ifdef Q_OS_UNIX
@@ -133,99 +154,120 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 #endif
 		memset(&addr, 0, sizeof(addr));
 		getsockname(tcpsock, reinterpret_cast< struct sockaddr * >(&addr), &len);
+
+		for (std::unique_ptr< VoiceWorker > &worker : m_voiceWorkers) {
 #ifdef Q_OS_UNIX
-		int sock = ::socket(addr.ss_family, SOCK_DGRAM, 0);
+			int sock = ::socket(addr.ss_family, SOCK_DGRAM, 0);
 #	ifdef Q_OS_LINUX
-		int sockopt = 1;
-		if (setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &sockopt, sizeof(sockopt)))
-			log(QString("Failed to set IP_PKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
-		sockopt = 1;
-		if (setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &sockopt, sizeof(sockopt)))
-			log(QString("Failed to set IPV6_RECVPKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
+			int sockopt = 1;
+			if (setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &sockopt, sizeof(sockopt)))
+				log(QString("Failed to set IP_PKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
+			sockopt = 1;
+			if (setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &sockopt, sizeof(sockopt)))
+				log(QString("Failed to set IPV6_RECVPKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
 #	endif
 #else
 #	ifndef SIO_UDP_CONNRESET
 #		define SIO_UDP_CONNRESET _WSAIOW(IOC_VENDOR, 12)
 #	endif
-		SOCKET sock           = ::WSASocket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0, WSA_FLAG_OVERLAPPED);
-		DWORD dwBytesReturned = 0;
-		BOOL bNewBehaviour    = FALSE;
-		if (WSAIoctl(sock, SIO_UDP_CONNRESET, &bNewBehaviour, sizeof(bNewBehaviour), nullptr, 0, &dwBytesReturned,
-					 nullptr, nullptr)
-			== SOCKET_ERROR) {
-			log(QString("Failed to set SIO_UDP_CONNRESET: %1").arg(WSAGetLastError()));
-		}
+			SOCKET sock = ::WSASocket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0, WSA_FLAG_OVERLAPPED);
+
+			DWORD dwBytesReturned = 0;
+			BOOL bNewBehaviour    = FALSE;
+			if (WSAIoctl(sock, SIO_UDP_CONNRESET, &bNewBehaviour, sizeof(bNewBehaviour), nullptr, 0, &dwBytesReturned,
+						 nullptr, nullptr)
+				== SOCKET_ERROR) {
+				log(QString("Failed to set SIO_UDP_CONNRESET: %1").arg(WSAGetLastError()));
+			}
 #endif
-		if (sock == INVALID_SOCKET) {
-			log("Failed to create UDP Socket");
-			bValid = false;
-			return;
-		} else {
-			if (addr.ss_family == AF_INET6) {
-				// Copy IPV6_V6ONLY attribute from tcp socket, it defaults to nonzero on Windows
-				// See https://msdn.microsoft.com/en-us/library/windows/desktop/ms738574%28v=vs.85%29.aspx
-				// This will fail for WindowsXP which is ok. Our TCP code will have split that up
-				// into two sockets.
-				int ipv6only     = 0;
-				socklen_t optlen = sizeof(ipv6only);
-				if (::getsockopt(tcpsock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< char * >(&ipv6only), &optlen)
-					== 0) {
-					if (::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< const char * >(&ipv6only),
-									 optlen)
-						== SOCKET_ERROR) {
-						log(QString("Failed to copy IPV6_V6ONLY socket attribute from tcp to udp socket"));
+			if (sock == INVALID_SOCKET) {
+				log("Failed to create UDP Socket");
+				bValid = false;
+				return;
+			} else {
+				if (addr.ss_family == AF_INET6) {
+					// Copy IPV6_V6ONLY attribute from tcp socket, it defaults to nonzero on Windows
+					// See https://msdn.microsoft.com/en-us/library/windows/desktop/ms738574%28v=vs.85%29.aspx
+					// This will fail for WindowsXP which is ok. Our TCP code will have split that up
+					// into two sockets.
+					int ipv6only     = 0;
+					socklen_t optlen = sizeof(ipv6only);
+					if (::getsockopt(tcpsock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< char * >(&ipv6only), &optlen)
+						== 0) {
+						if (::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< const char * >(&ipv6only),
+										 optlen)
+							== SOCKET_ERROR) {
+							log(QString("Failed to copy IPV6_V6ONLY socket attribute from tcp to udp socket"));
+						}
 					}
 				}
-			}
 
-			if (::bind(sock, reinterpret_cast< sockaddr * >(&addr), len) == SOCKET_ERROR) {
+#if defined(Q_OS_LINUX) && defined(SO_REUSEPORT)
+				if (m_voiceWorkers.size() > 1) {
+					int reuse = 1;
+					if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)))
+						log(QString("Failed to set SO_REUSEPORT for %1")
+								.arg(addressToString(ss->serverAddress(), usPort)));
+				}
+#endif
+
+				if (::bind(sock, reinterpret_cast< sockaddr * >(&addr), len) == SOCKET_ERROR) {
 #ifdef Q_OS_WIN
-				log(QString("Failed to bind UDP Socket to %1: %2")
-						.arg(addressToString(ss->serverAddress(), usPort), WSAGetLastError()));
+					log(QString("Failed to bind UDP Socket to %1: %2")
+							.arg(addressToString(ss->serverAddress(), usPort), WSAGetLastError()));
 #else
-				log(QString("Failed to bind UDP Socket to %1: %2")
-						.arg(addressToString(ss->serverAddress(), usPort), errno));
+					log(QString("Failed to bind UDP Socket to %1: %2")
+							.arg(addressToString(ss->serverAddress(), usPort), errno));
 #endif
-			} else {
+				} else {
 #ifdef Q_OS_UNIX
-				int val = 0xe0;
-				if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
-					val = 0x80;
-					if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val)))
-						log("Server: Failed to set TOS for UDP Socket");
-				}
+					int val = 0xe0;
+					if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
+						val = 0x80;
+						if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val)))
+							log("Server: Failed to set TOS for UDP Socket");
+					}
 #	if defined(SO_PRIORITY)
-				socklen_t optlen = sizeof(val);
-				if (getsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
-					if (val == 0) {
-						val = 6;
-						setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+					socklen_t optlen = sizeof(val);
+					if (getsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
+						if (val == 0) {
+							val = 6;
+							setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+						}
 					}
-				}
 #	endif
 #endif
+				}
+				QSocketNotifier *qsn = new QSocketNotifier(sock, QSocketNotifier::Read, this);
+				connect(qsn, SIGNAL(activated(int)), this, SLOT(udpActivated(int)));
+				worker->qlUdpSocket << sock;
+				qlUdpSocket << sock;
+				qlUdpNotifier << qsn;
 			}
-			QSocketNotifier *qsn = new QSocketNotifier(sock, QSocketNotifier::Read, this);
-			connect(qsn, SIGNAL(activated(int)), this, SLOT(udpActivated(int)));
-			qlUdpSocket << sock;
-			qlUdpNotifier << qsn;
 		}
 	}
 
-	bValid = bValid && (qlServer.count() == qlBind.count()) && (qlUdpSocket.count() == qlBind.count());
+	bValid = bValid && (qlServer.count() == qlBind.count())
+			 && (qlUdpSocket.count() == qlBind.count() * static_cast< int >(m_voiceWorkers.size()));
 	if (!bValid)
 		return;
 
+	for (std::unique_ptr< VoiceWorker > &worker : m_voiceWorkers) {
 #ifdef Q_OS_UNIX
-	if (socketpair(AF_UNIX, SOCK_STREAM, 0, aiNotify) != 0) {
-		log("Failed to create notify socket");
-		bValid = false;
-		return;
-	}
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, worker->aiNotify) != 0) {
+			log("Failed to create notify socket");
+			bValid = false;
+			return;
+		}
 #else
-	hNotify = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		worker->hNotify = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 #endif
 
+		if (worker->index > 0) {
+			qlVoiceThreads << new VoiceThread(*this, *worker);
+		}
+	}
+
 	connect(this, SIGNAL(tcpTransmit(QByteArray, unsigned int)), this, SLOT(tcpTransmitData(QByteArray, unsigned int)),
 			Qt::QueuedConnection);
 	connect(this, SIGNAL(reqSync(unsigned int)), this, SLOT(doSync(unsigned int)));
@@ -250,13 +292,58 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 }
 
 void Server::startThread() {
-	if (!isRunning()) {
-		log("Starting voice thread");
+	if (voiceThreadsRunning() && !bRunning) {
+		// A worker has failed and stopped the others, which might not have exited yet. They all have to be joined
+		// before their event loops can be replaced.
+		stopThread();
+	}
+
+	if (!voiceThreadsRunning()) {
+		if (m_voiceWorkers.size() > 1) {
+			log(QString("Starting %1 voice threads").arg(m_voiceWorkers.size()));
+		} else {
+			log("Starting voice thread");
+		}
 		bRunning = true;
 
+#ifdef Q_OS_LINUX
+		VoiceEventLoop::Backend backend = VoiceEventLoop::Backend::Epoll;
+		if (!VoiceEventLoop::fromString(qsVoiceEventLoop.toStdString(), backend)) {
+			log(QString("Unknown voice event loop \"%1\", using %2")
+					.arg(qsVoiceEventLoop, QString::fromLatin1(VoiceEventLoop::toString(backend))));
+		}
+
+		for (std::unique_ptr< VoiceWorker > &worker : m_voiceWorkers) {
+			const std::vector< int > sockets(worker->qlUdpSocket.begin(), worker->qlUdpSocket.end());
+
+			worker->m_eventLoop = VoiceEventLoop::create(backend, sockets, worker->aiNotify[0]);
+			if (!worker->m_eventLoop) {
+				// The selected backend is either not supported by the running kernel or this build
+				log(QString("Voice event loop %1 is not available, using poll")
+						.arg(QString::fromLatin1(VoiceEventLoop::toString(backend))));
+
+				backend             = VoiceEventLoop::Backend::Poll;
+				worker->m_eventLoop = VoiceEventLoop::create(backend, sockets, worker->aiNotify[0]);
+			}
+		}
+#endif
+
+		// Workers that have exited on their own didn't consume the notification sent by stopThread()
+		for (std::unique_ptr< VoiceWorker > &worker : m_voiceWorkers) {
+#ifdef Q_OS_UNIX
+			unsigned char val;
+			while (::recv(worker->aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {
+			};
+#else
+			ResetEvent(worker->hNotify);
+#endif
+		}
+
 		foreach (QSocketNotifier *qsn, qlUdpNotifier)
 			qsn->setEnabled(false);
 		start(QThread::HighestPriority);
+		foreach (VoiceThread *vt, qlVoiceThreads)
+			vt->start(QThread::HighestPriority);
 #ifdef Q_OS_LINUX
 		// QThread::HighestPriority == Same as everything else...
 		int policy;
@@ -274,19 +361,43 @@ void Server::startThread() {
 		qtTimeout->start(15500);
 }
 
-void Server::stopThread() {
-	bRunning = false;
-	if (isRunning()) {
-		log("Ending voice thread");
+bool Server::voiceThreadsRunning() const {
+	if (isRunning())
+		return true;
+	foreach (const VoiceThread *vt, qlVoiceThreads) {
+		if (vt->isRunning())
+			return true;
+	}
+	return false;
+}
 
+void Server::notifyVoiceWorkers() {
+	for (std::unique_ptr< VoiceWorker > &worker : m_voiceWorkers) {
 #ifdef Q_OS_UNIX
 		unsigned char val = 0;
-		if (::write(aiNotify[1], &val, 1) != 1)
-			log("Failed to signal voice thread");
+		if (::write(worker->aiNotify[1], &val, 1) != 1)
+			qWarning("Failed to signal voice thread %u", worker->index);
 #else
-		SetEvent(hNotify);
+		SetEvent(worker->hNotify);
 #endif
+	}
+}
+
+void Server::stopThread() {
+	bRunning = false;
+	if (voiceThreadsRunning()) {
+		log("Ending voice thread");
+
+		notifyVoiceWorkers();
 		wait();
+		foreach (VoiceThread *vt, qlVoiceThreads)
+			vt->wait();
+
+#ifdef Q_OS_LINUX
+		for (std::unique_ptr< VoiceWorker > &worker : m_voiceWorkers) {
+			worker->m_eventLoop.reset();
+		}
+#endif
 
 		foreach (QSocketNotifier *qsn, qlUdpNotifier)
 			qsn->setEnabled(true);
@@ -295,6 +406,9 @@ void Server::stopThread() {
 }
 
 Server::~Server() {
+	// Results that are still being computed are discarded along with the events they are posted in
+	m_authenticationPool.waitForDone();
+
 #ifdef USE_ZEROCONF
 	removeZeroconf();
 #endif
@@ -308,15 +422,19 @@ Server::~Server() {
 	foreach (int s, qlUdpSocket)
 		close(s);
 
-	if (aiNotify[0] >= 0)
-		close(aiNotify[0]);
-	if (aiNotify[1] >= 0)
-		close(aiNotify[1]);
+	for (std::unique_ptr< VoiceWorker > &worker : m_voiceWorkers) {
+		if (worker->aiNotify[0] >= 0)
+			close(worker->aiNotify[0]);
+		if (worker->aiNotify[1] >= 0)
+			close(worker->aiNotify[1]);
+	}
 #else
 	foreach (SOCKET s, qlUdpSocket)
 		closesocket(s);
-	if (hNotify)
-		CloseHandle(hNotify);
+	for (std::unique_ptr< VoiceWorker > &worker : m_voiceWorkers) {
+		if (worker->hNotify)
+			CloseHandle(worker->hNotify);
+	}
 #endif
 	clearACLCache();
 
@@ -348,6 +466,8 @@ void Server::readParams() {
 	bAllowPing                         = Meta::mp->bAllowPing;
 	allowRecording                     = Meta::mp->allowRecording;
 	rollingStatsWindow                 = Meta::mp->rollingStatsWindow;
+	voiceThreads                       = Meta::mp->voiceThreads;
+	qsVoiceEventLoop                   = Meta::mp->qsVoiceEventLoop;
 	bCertRequired                      = Meta::mp->bCertRequired;
 	bForceExternalAuth                 = Meta::mp->bForceExternalAuth;
 	qrUserName                         = Meta::mp->qrUserName;
@@ -448,6 +568,12 @@ void Server::readParams() {
 	iChannelNestingLimit = getConf("channelnestinglimit", iChannelNestingLimit).toInt();
 	iChannelCountLimit   = getConf("channelcountlimit", iChannelCountLimit).toInt();
 	rollingStatsWindow   = getConf("rollingStatsWindow", rollingStatsWindow).toUInt();
+	voiceThreads         = getConf("voiceThreads", voiceThreads).toUInt();
+	if (voiceThreads == 0) {
+		// 0 means: use one voice thread per CPU core
+		voiceThreads = static_cast< unsigned int >(std::max(QThread::idealThreadCount(), 1));
+	}
+	qsVoiceEventLoop = getConf("voiceEventLoop", qsVoiceEventLoop).toString();
 
 	qrUserName =
 		decltype(qrUserName)(QRegularExpression::anchoredPattern(getConf("username", qrUserName.pattern()).toString()));
@@ -548,6 +674,7 @@ void Server::setLiveConf(const QString &key, const QString &value) {
 		QString text = !v.isNull() ? v : Meta::mp->qsRegName;
 		if (text != qsRegName) {
 			qsRegName = text;
+			m_channelSyncCache.invalidate(Channel::ROOT_ID);
 			if (!qsRegName.isEmpty()) {
 				MumbleProto::ChannelState mpcs;
 				mpcs.set_channel_id(0);
@@ -743,67 +870,102 @@ void Server::udpActivated(int socket) {
 }
 
 void Server::run() {
+	runVoiceWorker(*m_voiceWorkers.front());
+}
+
+void Server::runVoiceWorker(VoiceWorker &worker) {
 	tracy::SetThreadName("Audio");
 
+#ifdef Q_OS_LINUX
+	while (bRunning) {
+		FrameMarkNamed(TracyConstants::UDP_FRAME);
+
+		const VoiceEventLoop::Status status = worker.m_eventLoop->wait();
+		if (status == VoiceEventLoop::Status::Notified) {
+			break;
+		} else if (status == VoiceEventLoop::Status::Failed) {
+			qCritical("UDP event loop failure");
+			bRunning = false;
+			notifyVoiceWorkers();
+			break;
+		}
+
+		for (const ReceivedDatagram &datagram : worker.m_eventLoop->getDatagrams()) {
+			gsl::span< const Mumble::Protocol::byte > encodedPing =
+				handleDatagram(worker, datagram.socket, datagram.data, static_cast< qint32 >(datagram.length),
+							   *datagram.from, &worker.m_sendBatch);
+
+			if (!encodedPing.empty()) {
+				// We are only reading from the buffer and thus the const_cast should be fine
+				datagram.header->msg_iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(encodedPing.data());
+				datagram.header->msg_iov[0].iov_len  = encodedPing.size();
+				::sendmsg(datagram.socket, datagram.header, 0);
+			}
+		}
+
+		// Send out the audio of all datagrams received in this iteration
+		worker.m_sendBatch.flush();
+	}
+#else
 	qint32 len;
-#if defined(__LP64__)
+#	if defined(__LP64__)
 	unsigned char encbuff[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
 	unsigned char *encrypt = encbuff + 4;
-#else
+#	else
 	unsigned char encrypt[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
-#endif
-	unsigned char buffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+#	endif
 
 	sockaddr_storage from;
-	unsigned int nfds = static_cast< unsigned int >(qlUdpSocket.count());
+	unsigned int nfds = static_cast< unsigned int >(worker.qlUdpSocket.count());
 
-#ifdef Q_OS_UNIX
+#	ifdef Q_OS_UNIX
 	socklen_t fromlen;
 	std::vector< struct pollfd > fds;
 	fds.resize(static_cast< std::size_t >(nfds + 1));
 
 	for (unsigned int i = 0; i < nfds; ++i) {
-		fds[i].fd      = qlUdpSocket.at(static_cast< int >(i));
+		fds[i].fd      = worker.qlUdpSocket.at(static_cast< int >(i));
 		fds[i].events  = POLLIN;
 		fds[i].revents = 0;
 	}
 
-	fds[nfds].fd      = aiNotify[0];
+	fds[nfds].fd      = worker.aiNotify[0];
 	fds[nfds].events  = POLLIN;
 	fds[nfds].revents = 0;
-#else
+#	else
 	int fromlen;
 	std::vector< SOCKET > fds;
 	fds.resize(nfds);
 	std::vector< HANDLE > events;
 	events.resize(nfds + 1);
 	for (unsigned int i = 0; i < nfds; ++i) {
-		fds[i]    = qlUdpSocket.at(i);
+		fds[i]    = worker.qlUdpSocket.at(i);
 		events[i] = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 		::WSAEventSelect(fds[i], events[i], FD_READ);
 	}
-	events[nfds] = hNotify;
-#endif
+	events[nfds] = worker.hNotify;
+#	endif
 
 	++nfds;
 
 	while (bRunning) {
 		FrameMarkNamed(TracyConstants::UDP_FRAME);
 
-#ifdef Q_OS_UNIX
+#	ifdef Q_OS_UNIX
 		int pret = poll(fds.data(), nfds, -1);
 		if (pret <= 0) {
 			if (errno == EINTR)
 				continue;
 			qCritical("poll failure");
 			bRunning = false;
+			notifyVoiceWorkers();
 			break;
 		}
 
 		if (fds[nfds - 1].revents) {
 			// Drain pipe
 			unsigned char val;
-			while (::recv(aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {
+			while (::recv(worker.aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {
 			};
 			break;
 		}
@@ -813,11 +975,12 @@ void Server::run() {
 				if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
 					qCritical("poll event failure");
 					bRunning = false;
+					notifyVoiceWorkers();
 					break;
 				}
 
 				int sock = fds[i].fd;
-#else
+#	else
 		for (unsigned int i = 0; i < 1; ++i) {
 			{
 				DWORD ret = WaitForMultipleObjects(nfds, events.data(), FALSE, INFINITE);
@@ -827,193 +990,176 @@ void Server::run() {
 				if (ret == WAIT_FAILED) {
 					qCritical("UDP wait failed");
 					bRunning = false;
+					notifyVoiceWorkers();
 					break;
 				}
 				SOCKET sock = fds[ret - WAIT_OBJECT_0];
-#endif
+#	endif
 
 				fromlen = sizeof(from);
-#ifdef Q_OS_WIN
+#	ifdef Q_OS_WIN
 				len = ::recvfrom(sock, reinterpret_cast< char * >(encrypt), Mumble::Protocol::MAX_UDP_PACKET_SIZE, 0,
 								 reinterpret_cast< struct sockaddr * >(&from), &fromlen);
-#else
-#	ifdef Q_OS_LINUX
-				struct msghdr msg;
-				struct iovec iov[1];
-
-				iov[0].iov_base = encrypt;
-				iov[0].iov_len  = Mumble::Protocol::MAX_UDP_PACKET_SIZE;
-
-				uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
-
-				memset(&msg, 0, sizeof(msg));
-				msg.msg_name       = reinterpret_cast< struct sockaddr * >(&from);
-				msg.msg_namelen    = sizeof(from);
-				msg.msg_iov        = iov;
-				msg.msg_iovlen     = 1;
-				msg.msg_control    = controldata;
-				msg.msg_controllen = sizeof(controldata);
-
-				len = static_cast< qint32 >(::recvmsg(sock, &msg, MSG_TRUNC));
-				Q_UNUSED(fromlen);
 #	else
 				len = static_cast< qint32 >(::recvfrom(sock, encrypt, Mumble::Protocol::MAX_UDP_PACKET_SIZE, MSG_TRUNC,
 													   reinterpret_cast< struct sockaddr * >(&from), &fromlen));
 #	endif
-#endif
 
-				// Capture only the processing without the polling
-				ZoneScopedN(TracyConstants::UDP_PACKET_PROCESSING_ZONE);
+				gsl::span< const Mumble::Protocol::byte > encodedPing =
+					handleDatagram(worker, sock, encrypt, len, from, nullptr);
 
-				if (len == 0) {
-					break;
-				} else if (len == SOCKET_ERROR) {
-					break;
-				} else if (len < 5) {
-					// 4 bytes crypt header + type + session
-					continue;
-				} else if (static_cast< unsigned int >(len) > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
-					// This will also catch the len == -1 case (indicating error)
-					static_assert(static_cast< unsigned int >(-1) > Mumble::Protocol::MAX_UDP_PACKET_SIZE,
-								  "Invalid assumption");
-					continue;
+				if (!encodedPing.empty()) {
+#	ifdef Q_OS_WIN
+					using size_type = int;
+#	else
+					using size_type = std::size_t;
+#	endif
+					::sendto(sock, reinterpret_cast< const char * >(encodedPing.data()),
+							 static_cast< size_type >(encodedPing.size()), 0,
+							 reinterpret_cast< struct sockaddr * >(&from), fromlen);
 				}
+#	ifdef Q_OS_UNIX
+				fds[i].revents = 0;
+#	endif
+			}
+		}
+	}
+#	ifdef Q_OS_WIN
+	for (unsigned int i = 0; i < nfds - 1; ++i) {
+		::WSAEventSelect(fds[i], nullptr, 0);
+		CloseHandle(events[i]);
+	}
+#	endif
+#endif
+}
 
-				QReadLocker rl(&qrwlVoiceThread);
+#ifdef Q_OS_UNIX
+gsl::span< const Mumble::Protocol::byte > Server::handleDatagram(VoiceWorker &worker, int sock, unsigned char *encrypt,
+																 qint32 len, sockaddr_storage &from,
+																 UDPSendBatch *sendBatch) {
+#else
+gsl::span< const Mumble::Protocol::byte > Server::handleDatagram(VoiceWorker &worker, SOCKET sock,
+																 unsigned char *encrypt, qint32 len,
+																 sockaddr_storage &from, UDPSendBatch *sendBatch) {
+#endif
+	// Capture only the processing without the polling
+	ZoneScopedN(TracyConstants::UDP_PACKET_PROCESSING_ZONE);
 
-				quint16 port = (from.ss_family == AF_INET6) ? (reinterpret_cast< sockaddr_in6 * >(&from)->sin6_port)
-															: (reinterpret_cast< sockaddr_in * >(&from)->sin_port);
-				const HostAddress &ha = HostAddress(from);
+	unsigned char buffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
 
-				const QPair< HostAddress, quint16 > &key = QPair< HostAddress, quint16 >(ha, port);
+	if (len == 0) {
+		return {};
+	} else if (len == SOCKET_ERROR) {
+		return {};
+	} else if (len < 5) {
+		// 4 bytes crypt header + type + session
+		return {};
+	} else if (static_cast< unsigned int >(len) > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
+		// This will also catch the len == -1 case (indicating error)
+		static_assert(static_cast< unsigned int >(-1) > Mumble::Protocol::MAX_UDP_PACKET_SIZE, "Invalid assumption");
+		return {};
+	}
 
-				ServerUser *u = qhPeerUsers.value(key);
+	// The peer table can be read without holding any lock. However, the found user may have been removed in the
+	// meantime, so it is only used if it still exists once the lock is held.
+	const PeerTable::Peer peer = worker.m_peerUsers.find(from);
 
-				if (u) {
-					m_udpDecoder.setProtocolVersion(u->m_version);
-				} else {
-					m_udpDecoder.setProtocolVersion(Version::UNKNOWN);
-				}
-				// This may be a general ping requesting server details, unencrypted.
-				if (bAllowPing
-					&& m_udpDecoder.decodePing(
-						gsl::span< Mumble::Protocol::byte >(encrypt, static_cast< std::size_t >(len)))
-					&& m_udpDecoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
-					ZoneScopedN(TracyConstants::PING_PROCESSING_ZONE);
+	QReadLocker rl(&qrwlVoiceThread);
 
-					gsl::span< const Mumble::Protocol::byte > encodedPing =
-						handlePing(m_udpDecoder, m_udpPingEncoder, true);
+	ServerUser *u = (peer.user && qhUsers.value(peer.session) == peer.user) ? peer.user : nullptr;
 
-					if (!encodedPing.empty()) {
-#ifdef Q_OS_LINUX
-						// We are only reading from the buffer and thus the const_cast should be fine
-						iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(encodedPing.data());
-						iov[0].iov_len  = encodedPing.size();
-						::sendmsg(sock, &msg, 0);
-#else
-#	ifdef Q_OS_WIN
-						using size_type = int;
-#	else
-						using size_type = std::size_t;
-#	endif
-						::sendto(sock, reinterpret_cast< const char * >(encodedPing.data()),
-								 static_cast< size_type >(encodedPing.size()), 0,
-								 reinterpret_cast< struct sockaddr * >(&from), fromlen);
-#endif
-					}
+	if (u) {
+		worker.m_udpDecoder.setProtocolVersion(u->m_version);
+	} else {
+		worker.m_udpDecoder.setProtocolVersion(Version::UNKNOWN);
+	}
+	// This may be a general ping requesting server details, unencrypted.
+	if (bAllowPing
+		&& worker.m_udpDecoder.decodePing(gsl::span< Mumble::Protocol::byte >(encrypt, static_cast< std::size_t >(len)))
+		&& worker.m_udpDecoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
+		ZoneScopedN(TracyConstants::PING_PROCESSING_ZONE);
 
-					continue;
+		return handlePing(worker.m_udpDecoder, worker.m_udpPingEncoder, true);
+	}
+
+
+	if (u) {
+		if (!checkDecrypt(u, encrypt, buffer, static_cast< unsigned int >(len))) {
+			return {};
+		}
+	} else {
+		ZoneScopedN(TracyConstants::DECRYPT_UNKNOWN_PEER_ZONE);
+
+		// Unknown peer
+		foreach (ServerUser *usr, qhHostUsers.value(HostAddress(from))) {
+			if (checkDecrypt(usr, encrypt, buffer,
+							 static_cast< unsigned int >(len))) { // checkDecrypt takes the User's qrwlCrypt lock.
+				// Every time we relock, reverify users' existence.
+				// The main thread might delete the user while the lock isn't held.
+				unsigned int uiSession = usr->uiSession;
+				rl.unlock();
+				qrwlVoiceThread.lockForWrite();
+				if (qhUsers.contains(uiSession)) {
+					u             = usr;
+					u->sUdpSocket = sock;
+					memcpy(&u->saiUdpAddress, &from, sizeof(from));
+					qhHostUsers[from].remove(u);
+					worker.m_peerUsers.insert(from, u, uiSession);
 				}
+				qrwlVoiceThread.unlock();
+				rl.relock();
+				if (u && !qhUsers.contains(uiSession))
+					u = nullptr;
+				break;
+			}
+		}
+		if (!u) {
+			return {};
+		}
+	}
+	len -= 4;
 
+	if (worker.m_udpDecoder.decode(gsl::span< Mumble::Protocol::byte >(buffer, static_cast< std::size_t >(len)))) {
+		switch (worker.m_udpDecoder.getMessageType()) {
+			case Mumble::Protocol::UDPMessageType::Audio: {
+				Mumble::Protocol::AudioData audioData = worker.m_udpDecoder.getAudioData();
 
-				if (u) {
-					if (!checkDecrypt(u, encrypt, buffer, static_cast< unsigned int >(len))) {
-						continue;
-					}
-				} else {
-					ZoneScopedN(TracyConstants::DECRYPT_UNKNOWN_PEER_ZONE);
-
-					// Unknown peer
-					foreach (ServerUser *usr, qhHostUsers.value(ha)) {
-						if (checkDecrypt(
-								usr, encrypt, buffer,
-								static_cast< unsigned int >(len))) { // checkDecrypt takes the User's qrwlCrypt lock.
-							// Every time we relock, reverify users' existence.
-							// The main thread might delete the user while the lock isn't held.
-							unsigned int uiSession = usr->uiSession;
-							rl.unlock();
-							qrwlVoiceThread.lockForWrite();
-							if (qhUsers.contains(uiSession)) {
-								u             = usr;
-								u->sUdpSocket = sock;
-								memcpy(&u->saiUdpAddress, &from, sizeof(from));
-								qhHostUsers[from].remove(u);
-								qhPeerUsers.insert(key, u);
-							}
-							qrwlVoiceThread.unlock();
-							rl.relock();
-							if (u && !qhUsers.contains(uiSession))
-								u = nullptr;
-							break;
-						}
-					}
-					if (!u) {
-						continue;
-					}
+				// Allow all voice packets through by default.
+				bool ok = true;
+				// ...Unless we're in Opus mode. In Opus mode, only Opus packets are allowed.
+				if (bOpus && audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
+					ok = false;
 				}
-				len -= 4;
-
-				if (m_udpDecoder.decode(gsl::span< Mumble::Protocol::byte >(buffer, static_cast< std::size_t >(len)))) {
-					switch (m_udpDecoder.getMessageType()) {
-						case Mumble::Protocol::UDPMessageType::Audio: {
-							Mumble::Protocol::AudioData audioData = m_udpDecoder.getAudioData();
-
-							// Allow all voice packets through by default.
-							bool ok = true;
-							// ...Unless we're in Opus mode. In Opus mode, only Opus packets are allowed.
-							if (bOpus && audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
-								ok = false;
-							}
 
-							if (ok) {
-								u->aiUdpFlag = 1;
+				if (ok) {
+					u->aiUdpFlag = 1;
 
-								// Add session id
-								audioData.senderSession = u->uiSession;
+					// Add session id
+					audioData.senderSession = u->uiSession;
 
-								processMsg(u, audioData, m_udpAudioReceivers, m_udpAudioEncoder);
-							}
-							break;
-						}
-						case Mumble::Protocol::UDPMessageType::Ping: {
-							ZoneScopedN(TracyConstants::UDP_PING_PROCESSING_ZONE);
-
-							Mumble::Protocol::PingData pingData = m_udpDecoder.getPingData();
-							if (!pingData.requestAdditionalInformation && !pingData.containsAdditionalInformation) {
-								// At this point here, we only want to handle connectivity pings
-								gsl::span< const Mumble::Protocol::byte > encodedPing =
-									handlePing(m_udpDecoder, m_udpPingEncoder, false);
-
-								QByteArray cache;
-								sendMessage(*u, encodedPing.data(), static_cast< int >(encodedPing.size()), cache,
-											true);
-							}
-							break;
-						}
-					}
+					processMsg(u, audioData, worker.m_udpAudioReceivers, worker.m_udpAudioEncoder, sendBatch);
 				}
-#ifdef Q_OS_UNIX
-				fds[i].revents = 0;
-#endif
+				break;
+			}
+			case Mumble::Protocol::UDPMessageType::Ping: {
+				ZoneScopedN(TracyConstants::UDP_PING_PROCESSING_ZONE);
+
+				Mumble::Protocol::PingData pingData = worker.m_udpDecoder.getPingData();
+				if (!pingData.requestAdditionalInformation && !pingData.containsAdditionalInformation) {
+					// At this point here, we only want to handle connectivity pings
+					gsl::span< const Mumble::Protocol::byte > encodedPing =
+						handlePing(worker.m_udpDecoder, worker.m_udpPingEncoder, false);
+
+					QByteArray cache;
+					sendMessage(*u, encodedPing.data(), static_cast< int >(encodedPing.size()), cache, true,
+								sendBatch);
+				}
+				break;
 			}
 		}
 	}
-#ifdef Q_OS_WIN
-	for (unsigned int i = 0; i < nfds - 1; ++i) {
-		::WSAEventSelect(fds[i], nullptr, 0);
-		CloseHandle(events[i]);
-	}
-#endif
+
+	return {};
 }
 
 bool Server::checkDecrypt(ServerUser *u, const unsigned char *encrypt, unsigned char *plain, unsigned int len) {
@@ -1034,12 +1180,37 @@ bool Server::checkDecrypt(ServerUser *u, const unsigned char *encrypt, unsigned
 	return false;
 }
 
-void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force) {
+void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force,
+						 UDPSendBatch *sendBatch) {
 	ZoneScoped;
 
 	if ((u.aiUdpFlag.loadRelaxed() == 1 || force) && (u.sUdpSocket != INVALID_SOCKET)) {
+#ifdef Q_OS_LINUX
+		if (sendBatch && static_cast< std::size_t >(len + 4) <= UDPSendBatch::MAX_DATAGRAM_SIZE) {
+			// Encrypt directly into the batch. The datagram is sent once the batch gets flushed.
+			unsigned char *buffer = sendBatch->getBuffer();
+			{
+				QMutexLocker wl(&u.qmCrypt);
+
+				if (!u.csCrypt->isValid()) {
+					return;
+				}
+
+				if (!u.csCrypt->encrypt(data, buffer, static_cast< unsigned int >(len))) {
+					return;
+				}
+			}
+
+			sendBatch->commit(u.sUdpSocket, u.saiUdpAddress, HostAddress(u.saiTcpLocalAddress),
+							  static_cast< std::size_t >(len + 4));
+			return;
+		}
+#else
+		Q_UNUSED(sendBatch);
+#endif
 #if defined(__LP64__)
-		static std::vector< char > ebuffer;
+		// This is called concurrently by all voice threads
+		thread_local std::vector< char > ebuffer;
 		ebuffer.resize(static_cast< std::size_t >(len + 4 + 16));
 		char *buffer = reinterpret_cast< char * >(
 			((reinterpret_cast< quint64 >(ebuffer.data()) + 8) & static_cast< quint64 >(~7)) + 4);
@@ -1143,7 +1314,8 @@ void Server::addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, Ser
 }
 
 void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer,
-						Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder) {
+						Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder,
+						UDPSendBatch *sendBatch) {
 	ZoneScoped;
 
 	// Note that in this function we never have to acquire a read-lock on qrwlVoiceThread
@@ -1192,31 +1364,61 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 
 		// Send audio to all linked channels the user has speak-permission
 		if (!c->qhLinks.isEmpty()) {
-			QSet< Channel * > chans = c->allLinks();
-			chans.remove(c);
-
-			QMutexLocker qml(&qmCache);
-
-			for (Channel *l : chans) {
-				if (ChanACL::hasPermission(u, l, ChanACL::Speak, &acCache)) {
-					// Send the audio stream to all users that are listening to the linked channel
-					for (unsigned int currentSession : m_channelListenerManager.getListenersForChannel(l->iId)) {
-						ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-						if (pDst) {
-							buffer.addReceiver(
-								*u, *pDst, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
-								m_channelListenerManager.getListenerVolumeAdjustment(pDst->uiSession, l->iId));
-						}
-					}
+			bool cacheUpToDate = isLinkedChannelsCacheUpToDate(*u);
+			if (!cacheUpToDate) {
+				ZoneScopedN(TracyConstants::AUDIO_LINK_CACHE_CREATE);
+
+				// The cache is only ever written with the lock held exclusively, as several threads might be
+				// processing audio of the same user at once
+				const unsigned int uiSession = u->uiSession;
+				qrwlVoiceThread.unlock();
+				qrwlVoiceThread.lockForWrite();
+
+				if (!qhUsers.contains(uiSession)) {
+					return;
+				}
+
+				updateLinkedChannelsCache(*u);
+
+				qrwlVoiceThread.unlock();
+				qrwlVoiceThread.lockForRead();
+				if (!qhUsers.contains(uiSession))
+					return;
 
-					// Send audio to users in the linked channel
-					for (User *p : l->qlUsers) {
-						ServerUser *pDst = static_cast< ServerUser * >(p);
+				// The speaker might have moved or the channels, their links or the permissions might have changed
+				// while the lock wasn't held, in which case the cache might refer to channels that have been deleted
+				// by now
+				cacheUpToDate = isLinkedChannelsCacheUpToDate(*u);
+			}
+
+			// If the cache has been outdated again, the channels are determined for this packet only. The cache is
+			// rebuilt for the next one.
+			std::vector< Channel * > uncachedChannels;
+			if (!cacheUpToDate && u->cChannel) {
+				uncachedChannels = linkedChannelsOf(*u);
+			}
 
-						buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::NORMAL,
-										   audioData.containsPositionalData);
+			const std::vector< Channel * > &linkedChannels =
+				cacheUpToDate ? u->m_linkedChannelsCache.channels : uncachedChannels;
+
+			for (Channel *l : linkedChannels) {
+				// Send the audio stream to all users that are listening to the linked channel
+				for (unsigned int currentSession : m_channelListenerManager.getListenersForChannel(l->iId)) {
+					ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
+					if (pDst) {
+						buffer.addReceiver(
+							*u, *pDst, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
+							m_channelListenerManager.getListenerVolumeAdjustment(pDst->uiSession, l->iId));
 					}
 				}
+
+				// Send audio to users in the linked channel
+				for (User *p : l->qlUsers) {
+					ServerUser *pDst = static_cast< ServerUser * >(p);
+
+					buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::NORMAL,
+									   audioData.containsPositionalData);
+				}
 			}
 		}
 	} else if (u->qmTargets.contains(static_cast< int >(audioData.targetOrContext))) { // Whisper/Shout
@@ -1330,9 +1532,17 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 			tcpCache.clear();
 
 			// Send encoded packet to all receivers of this range
-			for (auto it = currentRange.begin; it != currentRange.end; ++it) {
-				sendMessage(it->getReceiver(), encodedPacket.data(), static_cast< int >(encodedPacket.size()),
-							tcpCache);
+#ifdef Q_OS_LINUX
+			if (sendBatch) {
+				sendMessages(currentRange.begin, currentRange.end, encodedPacket.data(),
+							 static_cast< int >(encodedPacket.size()), tcpCache, *sendBatch);
+			} else
+#endif
+			{
+				for (auto it = currentRange.begin; it != currentRange.end; ++it) {
+					sendMessage(it->getReceiver(), encodedPacket.data(), static_cast< int >(encodedPacket.size()),
+								tcpCache, false, sendBatch);
+				}
 			}
 
 			// Find next range
@@ -1341,6 +1551,93 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 	}
 }
 
+#ifdef Q_OS_LINUX
+void Server::sendMessages(std::vector< AudioReceiver >::iterator begin, std::vector< AudioReceiver >::iterator end,
+						  const unsigned char *data, int len, QByteArray &cache, UDPSendBatch &sendBatch) {
+	ZoneScoped;
+
+	ServerUser *users[CryptStateOCB2::MAX_BATCH_SIZE];
+	std::size_t count = 0;
+
+	const bool fitsIntoBatch = static_cast< std::size_t >(len + 4) <= UDPSendBatch::MAX_DATAGRAM_SIZE;
+
+	for (auto it = begin; it != end; ++it) {
+		ServerUser &u = it->getReceiver();
+
+		// Connection always creates a CryptStateOCB2, but better safe than sorry
+		const CryptStateOCB2 *crypt = dynamic_cast< const CryptStateOCB2 * >(u.csCrypt.get());
+
+		if (!fitsIntoBatch || u.aiUdpFlag.loadRelaxed() != 1 || u.sUdpSocket == INVALID_SOCKET || !crypt
+			|| !crypt->usesHardwareAES()) {
+			sendMessage(u, data, len, cache, false, &sendBatch);
+			continue;
+		}
+
+		users[count++] = &u;
+		if (count == CryptStateOCB2::MAX_BATCH_SIZE) {
+			sendEncryptedBatch(users, count, data, len, sendBatch);
+			count = 0;
+		}
+	}
+
+	if (count > 0) {
+		sendEncryptedBatch(users, count, data, len, sendBatch);
+	}
+}
+
+void Server::sendEncryptedBatch(ServerUser **users, std::size_t count, const unsigned char *data, int len,
+								UDPSendBatch &sendBatch) {
+	ZoneScoped;
+
+	if (sendBatch.available() < count) {
+		sendBatch.flush();
+	}
+
+	// Other voice threads may be encrypting for some of these users as well, so the locks are always taken in the
+	// same order to avoid deadlocks.
+	std::sort(users, users + count);
+	for (std::size_t i = 0; i < count; ++i) {
+		users[i]->qmCrypt.lock();
+	}
+
+	ServerUser *receivers[CryptStateOCB2::MAX_BATCH_SIZE];
+	CryptStateOCB2 *states[CryptStateOCB2::MAX_BATCH_SIZE];
+	unsigned char *buffers[CryptStateOCB2::MAX_BATCH_SIZE];
+	std::size_t receiverCount = 0;
+
+	for (std::size_t i = 0; i < count; ++i) {
+		if (users[i]->csCrypt->isValid()) {
+			receivers[receiverCount] = users[i];
+			states[receiverCount]    = static_cast< CryptStateOCB2 * >(users[i]->csCrypt.get());
+			buffers[receiverCount]   = sendBatch.getBuffer(receiverCount);
+			receiverCount++;
+		}
+	}
+
+	CryptStateOCB2::encryptBatch(states, buffers, receiverCount, data, static_cast< unsigned int >(len));
+
+	for (std::size_t i = 0; i < count; ++i) {
+		users[i]->qmCrypt.unlock();
+	}
+
+	// The datagrams have been written to consecutive slots of the batch. If one of them can't be queued, the
+	// following ones have to be moved down by one slot.
+	std::size_t queued = 0;
+	for (std::size_t i = 0; i < receiverCount; ++i) {
+		ServerUser &u = *receivers[i];
+
+		if (i != queued) {
+			memcpy(sendBatch.getBuffer(), sendBatch.getBuffer(i - queued), static_cast< std::size_t >(len + 4));
+		}
+
+		if (sendBatch.commit(u.sUdpSocket, u.saiUdpAddress, HostAddress(u.saiTcpLocalAddress),
+							 static_cast< std::size_t >(len + 4))) {
+			queued++;
+		}
+	}
+}
+#endif
+
 void Server::log(ServerUser *u, const QString &str) const {
 	QString msg = QString("<%1:%2(%3)> %4").arg(QString::number(u->uiSession), u->qsName, QString::number(u->iId), str);
 	log(msg);
@@ -1372,25 +1669,21 @@ void Server::newClient() {
 
 		HostAddress ha(adr);
 
-		QList< Ban > tmpBans = qlBans;
-		foreach (const Ban &ban, qlBans) {
-			if (ban.isExpired())
-				tmpBans.removeOne(ban);
-		}
-		if (qlBans.count() != tmpBans.count()) {
-			qlBans = tmpBans;
+		const QList< Ban > expiredBans = m_banIndex.takeExpired();
+		if (!expiredBans.isEmpty()) {
+			for (const Ban &ban : expiredBans) {
+				qlBans.removeAll(ban);
+			}
 			saveBans();
 		}
 
-		foreach (const Ban &ban, qlBans) {
-			if (ban.haAddress.match(ha, static_cast< unsigned int >(ban.iMask))) {
-				log(QString("Ignoring connection: %1, Reason: %2, Username: %3, Hash: %4 (Server ban)")
-						.arg(addressToString(sock->peerAddress(), sock->peerPort()), ban.qsReason, ban.qsUsername,
-							 ban.qsHash));
-				sock->disconnectFromHost();
-				sock->deleteLater();
-				return;
-			}
+		if (const Ban *ban = m_banIndex.findAddressBan(ha)) {
+			log(QString("Ignoring connection: %1, Reason: %2, Username: %3, Hash: %4 (Server ban)")
+					.arg(addressToString(sock->peerAddress(), sock->peerPort()), ban->qsReason, ban->qsUsername,
+						 ban->qsHash));
+			sock->disconnectFromHost();
+			sock->deleteLater();
+			return;
 		}
 
 #ifdef Q_OS_MAC
@@ -1509,12 +1802,10 @@ void Server::encrypted() {
 							 .arg(issuer));
 		}
 
-		foreach (const Ban &ban, qlBans) {
-			if (ban.qsHash == uSource->qsHash) {
-				log(uSource, QString("Certificate hash is banned: %1, Username: %2, Reason: %3.")
-								 .arg(ban.qsHash, ban.qsUsername, ban.qsReason));
-				uSource->disconnectSocket();
-			}
+		if (const Ban *ban = m_banIndex.findHashBan(uSource->qsHash)) {
+			log(uSource, QString("Certificate hash is banned: %1, Username: %2, Reason: %3.")
+							 .arg(ban->qsHash, ban->qsUsername, ban->qsReason));
+			uSource->disconnectSocket();
 		}
 	}
 }
@@ -1640,11 +1931,11 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 		qhUsers.remove(u->uiSession);
 		qhHostUsers[u->haAddress].remove(u);
 
-		quint16 port = (u->saiUdpAddress.ss_family == AF_INET6)
-						   ? (reinterpret_cast< sockaddr_in6 * >(&u->saiUdpAddress)->sin6_port)
-						   : (reinterpret_cast< sockaddr_in * >(&u->saiUdpAddress)->sin_port);
-		const QPair< HostAddress, quint16 > &key = QPair< HostAddress, quint16 >(u->haAddress, port);
-		qhPeerUsers.remove(key);
+		// Lookups don't need the lock, but the voice threads only insert into the peer tables while holding it.
+		// Removing the address without it could remove a user that has taken it over in the meantime.
+		for (std::unique_ptr< VoiceWorker > &worker : m_voiceWorkers) {
+			worker->m_peerUsers.remove(u->saiUdpAddress);
+		}
 
 		if (old)
 			old->removeUser(u);
@@ -1675,6 +1966,19 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 		u = static_cast< ServerUser * >(sender());
 	}
 
+	if (u->bAuthenticationPending) {
+		// Keep the order of the messages by processing them once the authentication is done (see msgAuthenticate)
+		if (u->qlPendingMessages.size() >= ServerUser::MAX_PENDING_MESSAGES) {
+			log(u, "Too many messages while authenticating");
+			u->disconnectSocket(true);
+			return;
+		}
+
+		// The message refers to the connection's receive buffer, so it has to be copied
+		u->qlPendingMessages.append(qMakePair(type, QByteArray(qbaMsg.constData(), qbaMsg.size())));
+		return;
+	}
+
 	if (u->sState == ServerUser::Authenticated) {
 		u->resetActivityTime();
 	}
@@ -1790,20 +2094,18 @@ void Server::doSync(unsigned int id) {
 }
 
 void Server::sendProtoMessage(ServerUser *u, const ::google::protobuf::Message &msg,
-							  Mumble::Protocol::TCPMessageType msgType) {
-	QByteArray cache;
+							  Mumble::Protocol::TCPMessageType msgType, QByteArray &cache) {
 	u->sendMessage(msg, msgType, cache);
 }
 
 void Server::sendProtoAll(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType msgType,
-						  Version::full_t version, Version::CompareMode mode) {
-	sendProtoExcept(nullptr, msg, msgType, version, mode);
+						  Version::full_t version, Version::CompareMode mode, QByteArray &cache) {
+	sendProtoExcept(nullptr, msg, msgType, version, mode, cache);
 }
 
 void Server::sendProtoExcept(ServerUser *u, const ::google::protobuf::Message &msg,
 							 Mumble::Protocol::TCPMessageType msgType, Version::full_t version,
-							 Version::CompareMode mode) {
-	QByteArray cache;
+							 Version::CompareMode mode, QByteArray &cache) {
 	foreach (ServerUser *usr, qhUsers)
 		if ((usr != u) && (usr->sState == ServerUser::Authenticated)) {
 			assert(mode == Version::CompareMode::AtLeast || mode == Version::CompareMode::LessThan);
@@ -1812,7 +2114,13 @@ void Server::sendProtoExcept(ServerUser *u, const ::google::protobuf::Message &m
 			const bool fulfillsVersionRequirement =
 				mode == Version::CompareMode::AtLeast ? usr->m_version >= version : usr->m_version < version;
 			if (isUnknown || fulfillsVersionRequirement) {
-				usr->sendMessage(msg, msgType, cache);
+				// Serialize lazily, so that nothing is serialized if there is no recipient
+				if (cache.isEmpty()) {
+					Connection::messageToNetwork(msg, msgType, cache);
+				}
+
+				// All recipients share the same buffer
+				usr->queueMessage(cache);
 			}
 		}
 }
@@ -1833,6 +2141,7 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 		chan->unlink(nullptr);
+		m_linkComponents.unlinkAll(chan->iId);
 	}
 
 	foreach (c, chan->qlChannels) { removeChannel(c, dest); }
@@ -1885,6 +2194,11 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 		chan->cParent->removeChannel(chan);
 	}
 
+	// The channel's ID may be reused by a new channel, which must not inherit the cached permissions (or messages)
+	acCache.invalidate();
+	m_channelSyncCache.invalidate(chan->iId);
+	m_channelSyncCache.invalidateStructure();
+
 	delete chan;
 }
 
@@ -1974,11 +2288,16 @@ void Server::userEnterChannel(User *p, Channel *c, MumbleProto::UserState &mpus)
 }
 
 bool Server::hasPermission(ServerUser *p, Channel *c, QFlags< ChanACL::Perm > perm) {
-	QMutexLocker qml(&qmCache);
-	return ChanACL::hasPermission(p, c, perm, &acCache);
+	return (effectivePermissions(p, c) & perm) != ChanACL::None;
 }
 
 QFlags< ChanACL::Perm > Server::effectivePermissions(ServerUser *p, Channel *c) {
+	// Cached permissions can be looked up without the lock (which is what the voice threads usually do)
+	ChanACL::Permissions granted;
+	if (acCache.lookup(p->m_aclCache, c->iId, granted)) {
+		return granted | ChanACL::Cached;
+	}
+
 	QMutexLocker qml(&qmCache);
 	return ChanACL::effectivePermissions(p, c, &acCache);
 }
@@ -1989,13 +2308,8 @@ void Server::sendClientPermission(ServerUser *u, Channel *c, bool explicitlyRequ
 	if (u->iId == 0)
 		return;
 
-	{
-		QMutexLocker qml(&qmCache);
-		// Abuse that hasPermission will update acCache with the latest permissions (all of them,
-		// not only the requested one) so that we can pull this information out of it afterwards.
-		ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-		perm = acCache.value(u)->value(c);
-	}
+	// Clients have always been sent the permissions including the Cached flag
+	perm = static_cast< unsigned int >(effectivePermissions(u, c) | ChanACL::Cached);
 
 	if (explicitlyRequested) {
 		// Store the last channel the client showed explicit interest in
@@ -2031,8 +2345,8 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 		if (!c) {
 			match = false;
 		} else {
-			ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-			unsigned int perm = acCache.value(u)->value(c);
+			unsigned int perm =
+				static_cast< unsigned int >(ChanACL::effectivePermissions(u, c, &acCache) | ChanACL::Cached);
 			if (perm != i.value())
 				match = false;
 		}
@@ -2049,8 +2363,7 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 		u->iLastPermissionCheck = static_cast< int >(c->iId);
 	}
 
-	ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-	unsigned int perm = acCache.value(u)->value(c);
+	unsigned int perm = static_cast< unsigned int >(ChanACL::effectivePermissions(u, c, &acCache) | ChanACL::Cached);
 	u->qmPermissionSent.insert(static_cast< int >(c->iId), perm);
 
 	mppq.Clear();
@@ -2068,14 +2381,11 @@ void Server::clearACLCache(User *p) {
 		QMutexLocker qml(&qmCache);
 
 		if (p) {
-			ChanACL::ChanCache *h = acCache.take(p);
-			delete h;
+			acCache.invalidate(static_cast< ServerUser * >(p)->m_aclCache);
 
 			flushClientPermissionCache(static_cast< ServerUser * >(p), mppq);
 		} else {
-			foreach (ChanACL::ChanCache *h, acCache)
-				delete h;
-			acCache.clear();
+			acCache.invalidate();
 
 			foreach (ServerUser *u, qhUsers)
 				if (u->sState == ServerUser::Authenticated)
@@ -2110,13 +2420,80 @@ void Server::clearACLCache(User *p) {
 
 	// A change in ACLs means that the user might be able to whisper
 	// to users it didn't have permission to do before (or vice versa)
-	clearWhisperTargetCache();
+	if (p) {
+		// The user's groups and permissions affect the targets they whisper to, the targets they receive audio from
+		// and the group-restricted shouts to the channel they are in or listen to
+		QSet< unsigned int > channels = m_channelListenerManager.getListenedChannelsForUser(p->uiSession);
+		if (p->cChannel) {
+			channels.insert(p->cChannel->iId);
+		}
+
+		refreshWhisperTargetCache(channels, { p->uiSession });
+	} else {
+		refreshWhisperTargetCache();
+	}
+}
+
+void Server::refreshWhisperTargetCache() {
+	QList< QPair< ServerUser *, int > > cached;
+
+	{
+		QReadLocker lock(&qrwlVoiceThread);
+
+		for (ServerUser *u : qhUsers) {
+			for (auto it = u->qmTargetCache.cbegin(); it != u->qmTargetCache.cend(); ++it) {
+				cached << qMakePair(u, it.key());
+			}
+		}
+	}
+
+	buildWhisperTargetCaches(cached);
+}
+
+void Server::refreshWhisperTargetCache(const QSet< unsigned int > &channels, const QSet< unsigned int > &sessions) {
+	QList< QPair< ServerUser *, int > > affected;
+
+	{
+		QReadLocker lock(&qrwlVoiceThread);
+
+		for (ServerUser *u : qhUsers) {
+			const bool speakerChanged = sessions.contains(u->uiSession);
+
+			for (auto it = u->qmTargetCache.cbegin(); it != u->qmTargetCache.cend(); ++it) {
+				if (speakerChanged || it->dependencies.dependsOn(channels, sessions)) {
+					affected << qMakePair(u, it.key());
+				}
+			}
+		}
+	}
+
+	buildWhisperTargetCaches(affected);
 }
 
-void Server::clearWhisperTargetCache() {
+void Server::buildWhisperTargetCaches(const QList< QPair< ServerUser *, int > > &targets) {
+	if (targets.isEmpty()) {
+		return;
+	}
+
+	// Users, channels and whisper targets are only ever changed by the main thread, so the caches can be built
+	// without holding the lock. Only storing them requires it.
+	std::vector< WhisperTargetCache > caches;
+	caches.reserve(static_cast< std::size_t >(targets.size()));
+	for (const QPair< ServerUser *, int > &target : targets) {
+		caches.push_back(createWhisperTargetCacheFor(*target.first, target.first->qmTargets.value(target.second)));
+	}
+
 	QWriteLocker lock(&qrwlVoiceThread);
 
-	foreach (ServerUser *u, qhUsers) { u->qmTargetCache.clear(); }
+	for (int i = 0; i < targets.size(); ++i) {
+		ServerUser *speaker = targets[i].first;
+
+		if (speaker->qmTargets.contains(targets[i].second)) {
+			speaker->qmTargetCache.insert(targets[i].second, std::move(caches[static_cast< std::size_t >(i)]));
+		} else {
+			speaker->qmTargetCache.remove(targets[i].second);
+		}
+	}
 }
 
 QString Server::addressToString(const QHostAddress &adr, unsigned short port) {
@@ -2267,19 +2644,23 @@ void Server::recheckCodecVersions(ServerUser *connectingUser) {
 }
 
 void Server::hashAssign(QString &dest, QByteArray &hash, const QString &src) {
-	dest = src;
-	if (src.length() >= 128)
+	if (src.length() >= 128) {
 		hash = sha1(src);
-	else
+		dest = m_textStore.intern(hash, src);
+	} else {
+		dest = src;
 		hash = QByteArray();
+	}
 }
 
 void Server::hashAssign(QByteArray &dest, QByteArray &hash, const QByteArray &src) {
-	dest = src;
-	if (src.length() >= 128)
+	if (src.length() >= 128) {
 		hash = sha1(src);
-	else
+		dest = m_textureStore.intern(hash, src);
+	} else {
+		dest = src;
 		hash = QByteArray();
+	}
 }
 
 bool Server::isTextAllowed(QString &text, bool &changed) {
@@ -2311,35 +2692,46 @@ bool Server::isTextAllowed(QString &text, bool &changed) {
 		if (!text.contains(QLatin1Char('<')))
 			return false;
 
-		// Strip value from <img>s src attributes to check text-length only -
+		// Check the text-length without the value of <img>s src attributes -
 		// we already ensured the img-length requirement is met
-		QString qsOut;
-		QXmlStreamReader qxsr(QString::fromLatin1("<document>%1</document>").arg(text));
-		QXmlStreamWriter qxsw(&qsOut);
-		while (!qxsr.atEnd()) {
-			switch (qxsr.readNext()) {
-				case QXmlStreamReader::Invalid:
-					return false;
-				case QXmlStreamReader::StartElement: {
-					if (qxsr.name() == QLatin1String("img")) {
-						qxsw.writeStartElement(qxsr.namespaceUri().toString(), qxsr.name().toString());
-						foreach (const QXmlStreamAttribute &a, qxsr.attributes())
-							if (a.name() != QLatin1String("src"))
-								qxsw.writeAttribute(a);
-					} else {
-						qxsw.writeCurrentToken(qxsr);
-					}
-				} break;
-				default:
-					qxsw.writeCurrentToken(qxsr);
-					break;
-			}
-		}
+		HTMLFilter::Measurement measurement;
+		if (!HTMLFilter::measure(text, measurement))
+			return false;
+
+		return (measurement.textLength <= iMaxTextMessageLength);
+	}
+}
+
+bool Server::isLinkedChannelsCacheUpToDate(const ServerUser &speaker) const {
+	const LinkedChannelsCache &cache = speaker.m_linkedChannelsCache;
 
-		length = qsOut.length();
+	return speaker.cChannel && cache.channelID == speaker.cChannel->iId
+		   && cache.linkVersion == m_linkComponents.version(cache.channelID)
+		   && acCache.isUpToDate(speaker.m_aclCache, cache.aclGeneration);
+}
+
+void Server::updateLinkedChannelsCache(ServerUser &speaker) {
+	LinkedChannelsCache &cache = speaker.m_linkedChannelsCache;
 
-		return (length <= iMaxTextMessageLength);
+	// Has to be obtained before the permissions are checked, so that changes to them in the meantime aren't missed
+	cache.aclGeneration = acCache.generation();
+	cache.channelID     = speaker.cChannel->iId;
+	cache.linkVersion   = m_linkComponents.version(cache.channelID);
+	cache.channels      = linkedChannelsOf(speaker);
+}
+
+std::vector< Channel * > Server::linkedChannelsOf(ServerUser &speaker) {
+	std::vector< Channel * > channels;
+
+	for (unsigned int id : m_linkComponents.linkedChannels(speaker.cChannel->iId)) {
+		Channel *l = qhChannels.value(id);
+
+		if (l && l != speaker.cChannel && hasPermission(&speaker, l, ChanACL::Speak)) {
+			channels.push_back(l);
+		}
 	}
+
+	return channels;
 }
 
 bool Server::isChannelFull(Channel *c, ServerUser *u) {
@@ -2374,6 +2766,8 @@ WhisperTargetCache Server::createWhisperTargetCacheFor(ServerUser &speaker, cons
 			Channel *targetChannel = qhChannels.value(currentTarget.id);
 
 			if (targetChannel) {
+				cache.dependencies.channels.insert(targetChannel->iId);
+
 				bool includeLinks    = currentTarget.includeLinks && !targetChannel->qhLinks.isEmpty();
 				bool includeChildren = currentTarget.includeChildren && !targetChannel->qlChannels.isEmpty();
 				bool restrictToGroup = !currentTarget.targetGroup.isEmpty();
@@ -2417,6 +2811,8 @@ WhisperTargetCache Server::createWhisperTargetCacheFor(ServerUser &speaker, cons
 					const QString &targetGroup = redirect.isEmpty() ? currentTarget.targetGroup : redirect;
 
 					for (Channel *subTargetChan : channels) {
+						cache.dependencies.channels.insert(subTargetChan->iId);
+
 						if (ChanACL::hasPermission(&speaker, subTargetChan, ChanACL::Whisper, &acCache)) {
 							for (User *p : subTargetChan->qlUsers) {
 								ServerUser *su = static_cast< ServerUser * >(p);
@@ -2447,6 +2843,9 @@ WhisperTargetCache Server::createWhisperTargetCacheFor(ServerUser &speaker, cons
 	}
 
 	for (unsigned int id : target.sessions) {
+		// Whether the user may be whispered to depends on the channel they are in
+		cache.dependencies.sessions.insert(id);
+
 		ServerUser *pDst = qhUsers.value(id);
 		if (pDst && ChanACL::hasPermission(&speaker, pDst->cChannel, ChanACL::Whisper, &acCache)
 			&& !cache.channelTargets.contains(pDst))
@@ -2458,6 +2857,13 @@ WhisperTargetCache Server::createWhisperTargetCacheFor(ServerUser &speaker, cons
 	cache.directTargets.remove(&speaker);
 	cache.listeningTargets.remove(&speaker);
 
+	for (const ServerUser *receiver : cache.channelTargets) {
+		cache.dependencies.sessions.insert(receiver->uiSession);
+	}
+	for (auto it = cache.listeningTargets.cbegin(); it != cache.listeningTargets.cend(); ++it) {
+		cache.dependencies.sessions.insert(it.key()->uiSession);
+	}
+
 	return cache;
 }
 
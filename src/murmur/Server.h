@@ -13,12 +13,18 @@
 #endif
 
 #include "ACL.h"
+#include "ACLCache.h"
 #include "AudioReceiverBuffer.h"
 #include "Ban.h"
+#include "BanIndex.h"
+#include "BlobStore.h"
 #include "ChannelListenerManager.h"
+#include "ChannelSyncCache.h"
 #include "HostAddress.h"
+#include "LinkComponents.h"
 #include "Mumble.pb.h"
 #include "MumbleProtocol.h"
+#include "PeerTable.h"
 #include "Timer.h"
 #include "User.h"
 #include "Version.h"
@@ -36,6 +42,7 @@
 #include <QtCore/QSocketNotifier>
 #include <QtCore/QStringList>
 #include <QtCore/QThread>
+#include <QtCore/QThreadPool>
 #include <QtCore/QTimer>
 #include <QtCore/QUrl>
 #include <QtNetwork/QSslCertificate>
@@ -46,15 +53,24 @@
 #	include <QtNetwork/QSslDiffieHellmanParameters>
 #endif
 
+#include <memory>
+#include <vector>
+
 #ifdef Q_OS_WIN
 #	include <winsock2.h>
 #endif
 
+#ifdef Q_OS_LINUX
+#	include "UDPBatch.h"
+#	include "VoiceEventLoop.h"
+#endif
+
 class Zeroconf;
 class Channel;
 class PacketDataStream;
 class ServerUser;
 class User;
+class UDPSendBatch;
 class QNetworkAccessManager;
 
 struct TextMessage {
@@ -90,6 +106,63 @@ public:
 	void execute();
 };
 
+class Server;
+
+/// The state owned by a single UDP voice worker.
+///
+/// Every worker polls its own UDP socket for each bind address. With more than
+/// one worker, these sockets are opened with SO_REUSEPORT, so that the kernel
+/// distributes incoming datagrams among the workers based on a hash of the
+/// sender's address. As that hash is stable, a given client will always be
+/// served by the same worker, which is why each worker can keep its own peer
+/// table.
+struct VoiceWorker {
+	/// The index of this worker. Worker 0 is run by the Server thread itself.
+	unsigned int index;
+
+#ifdef Q_OS_UNIX
+	int aiNotify[2];
+	QList< int > qlUdpSocket;
+#else
+	HANDLE hNotify;
+	QList< SOCKET > qlUdpSocket;
+#endif
+
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_udpDecoder;
+	Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > m_udpPingEncoder;
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > m_udpAudioEncoder;
+	AudioReceiverBuffer m_udpAudioReceivers;
+
+#ifdef Q_OS_LINUX
+	/// Waits for and reads the datagrams arriving on qlUdpSocket. This is created whenever the voice threads
+	/// are started.
+	std::unique_ptr< VoiceEventLoop > m_eventLoop;
+	/// The audio fan-out of all datagrams returned by one wakeup of m_eventLoop is sent using sendmmsg
+	UDPSendBatch m_sendBatch;
+#endif
+
+	/// The users whose UDP address is known to this worker. Only the thread running this worker
+	/// looks up addresses in it, which doesn't require holding Server::qrwlVoiceThread.
+	PeerTable m_peerUsers;
+
+	VoiceWorker(unsigned int index);
+};
+
+/// Thread running an additional VoiceWorker (all but the first one).
+class VoiceThread : public QThread {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(VoiceThread)
+
+protected:
+	Server &m_server;
+	VoiceWorker &m_worker;
+
+public:
+	VoiceThread(Server &server, VoiceWorker &worker);
+	void run() Q_DECL_OVERRIDE;
+};
+
 class Server : public QThread {
 private:
 	Q_OBJECT
@@ -105,6 +178,11 @@ protected:
 #endif
 	void startThread();
 	void stopThread();
+	/// @returns Whether any of the voice workers is still running. Workers can exit on their own (when
+	/// 	waiting for datagrams fails), so this can't be told from the Server thread alone.
+	bool voiceThreadsRunning() const;
+	/// Wakes up all voice workers. Those that see bRunning unset then exit.
+	void notifyVoiceWorkers();
 
 	void customEvent(QEvent *evt);
 	// Former ServerParams
@@ -138,6 +216,10 @@ public:
 	bool bAllowPing;
 	bool allowRecording;
 	unsigned int rollingStatsWindow;
+	/// The amount of UDP voice workers (threads) used by this server
+	unsigned int voiceThreads;
+	/// The name of the event loop backend used by the voice threads (only used on Linux)
+	QString qsVoiceEventLoop;
 
 	QRegularExpression qrUserName;
 	QRegularExpression qrChannelName;
@@ -179,10 +261,11 @@ public:
 	ChannelListenerManager m_channelListenerManager;
 
 
+	// Used by the main thread for answering pings while no voice thread is running
 	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_udpDecoder;
-	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_tcpTunnelDecoder;
 	Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > m_udpPingEncoder;
-	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > m_udpAudioEncoder;
+
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_tcpTunnelDecoder;
 	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > m_tcpAudioEncoder;
 
 	gsl::span< const Mumble::Protocol::byte >
@@ -206,12 +289,20 @@ public:
 	void initRegister();
 
 	WhisperTargetCache createWhisperTargetCacheFor(ServerUser &speaker, const WhisperTarget &target);
+	/// @returns Whether the speaker's LinkedChannelsCache matches the channel they are in, its links and their
+	/// 	permissions. Requires a lock on qrwlVoiceThread.
+	bool isLinkedChannelsCacheUpToDate(const ServerUser &speaker) const;
+	/// Determines the linked channels (not including their own) the speaker may speak to from the channel they are in.
+	/// Requires a lock on qrwlVoiceThread.
+	std::vector< Channel * > linkedChannelsOf(ServerUser &speaker);
+	/// Stores the result of linkedChannelsOf() in the speaker's LinkedChannelsCache
+	/// @note Requires a write lock on qrwlVoiceThread
+	void updateLinkedChannelsCache(ServerUser &speaker);
 
 private:
 	int iChannelNestingLimit;
 	int iChannelCountLimit;
 
-	AudioReceiverBuffer m_udpAudioReceivers;
 	AudioReceiverBuffer m_tcpAudioReceivers;
 
 public slots:
@@ -251,20 +342,25 @@ public:
 	QTimer *qtTimeout;
 
 #ifdef Q_OS_UNIX
-	int aiNotify[2];
 	QList< int > qlUdpSocket;
 #else
-	HANDLE hNotify;
 	QList< SOCKET > qlUdpSocket;
 #endif
 	QList< QSocketNotifier * > qlUdpNotifier;
 
+	/// The UDP voice workers of this server. Worker 0 is run by this thread (see run()),
+	/// all other workers are run by their respective entry in qlVoiceThreads.
+	std::vector< std::unique_ptr< VoiceWorker > > m_voiceWorkers;
+	QList< VoiceThread * > qlVoiceThreads;
+
 	/// This lock provides synchronization between the
 	/// main thread (where control channel messages and
 	/// RPC happens), and the Server's voice thread.
 	///
-	/// These are the only two threads in Murmur that
-	/// access a Server's data.
+	/// These are the only two kinds of threads in Murmur
+	/// that access a Server's data. Note that there may
+	/// be multiple voice threads (see VoiceWorker), which
+	/// only ever take read locks concurrently.
 	///
 	/// The easiest way to understand the locking strategy
 	/// and synchronization between the main thread and the
@@ -306,23 +402,69 @@ public:
 	///    other thread can write to that data.
 	QReadWriteLock qrwlVoiceThread;
 	QHash< unsigned int, ServerUser * > qhUsers;
-	QHash< QPair< HostAddress, quint16 >, ServerUser * > qhPeerUsers;
 	QHash< HostAddress, QSet< ServerUser * > > qhHostUsers;
 	QHash< unsigned int, Channel * > qhChannels;
-
+	/// The channels linked to each other, as the channels' links (see Channel::link) are. Only modified while
+	/// holding qrwlVoiceThread exclusively, just like the links.
+	LinkComponents m_linkComponents;
+	/// The serialized description of the channel tree sent to every user that connects
+	ChannelSyncCache m_channelSyncCache;
+
+	/// Has to be held while computing permissions (i.e. on a miss in acCache) from a voice thread and while
+	/// modifying a user's access tokens. Looking up cached permissions doesn't require it.
 	QMutex qmCache;
-	ChanACL::ACLCache acCache;
+	ACLCache acCache;
 
 	QHash< int, QString > qhUserNameCache;
 	QHash< QString, int > qhUserIDCache;
 
+	/// The (deduplicated) textures, comments and channel descriptions held by the users and channels
+	BlobStore< QByteArray > m_textureStore;
+	BlobStore< QString > m_textStore;
+	/// The hashes of the textures stored in the database for the registered users, by user ID. The hash is empty if a
+	/// user doesn't have a texture. Used to look up the texture in m_textureStore instead of loading it again.
+	QHash< int, QByteArray > m_userTextureHashes;
+
+	/// The threads the PBKDF2 hashes of passwords are computed on during authentication (one per CPU core). This
+	/// is expensive on purpose and would otherwise block the main thread (and thus all control channel messages),
+	/// e.g. when many users reconnect at the same time.
+	QThreadPool m_authenticationPool;
+
 	QList< Ban > qlBans;
+	/// The index connecting clients are checked against. It has to be updated whenever qlBans is modified.
+	BanIndex m_banIndex;
 
 	void addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, ServerUser &user, const Channel &channel);
 	void processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer,
-					Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder);
-	void sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force = false);
+					Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder,
+					UDPSendBatch *sendBatch = nullptr);
+	void sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force = false,
+					 UDPSendBatch *sendBatch = nullptr);
+#ifdef Q_OS_LINUX
+	/// Sends the same packet to all receivers in the given range. The packet is encrypted for up to
+	/// CryptStateOCB2::MAX_BATCH_SIZE receivers at once (see CryptStateOCB2::encryptBatch) and queued in the given
+	/// batch. Receivers that can't be served this way (e.g. because they are using TCP) are passed to sendMessage().
+	void sendMessages(std::vector< AudioReceiver >::iterator begin, std::vector< AudioReceiver >::iterator end,
+					  const unsigned char *data, int len, QByteArray &cache, UDPSendBatch &sendBatch);
+	/// Encrypts the given packet for all of the given users at once and queues the results in the given batch
+	void sendEncryptedBatch(ServerUser **users, std::size_t count, const unsigned char *data, int len,
+							UDPSendBatch &sendBatch);
+#endif
 	void run();
+	void runVoiceWorker(VoiceWorker &worker);
+	/// Handles a single datagram that has been received by the given voice worker.
+	///
+	/// @returns The encoded answer to an unencrypted ping or an empty span. The answer has to be sent back
+	/// 	to the datagram's sender by the caller.
+#ifdef Q_OS_UNIX
+	gsl::span< const Mumble::Protocol::byte > handleDatagram(VoiceWorker &worker, int sock, unsigned char *encrypt,
+															 qint32 len, struct sockaddr_storage &from,
+															 UDPSendBatch *sendBatch);
+#else
+	gsl::span< const Mumble::Protocol::byte > handleDatagram(VoiceWorker &worker, SOCKET sock, unsigned char *encrypt,
+															 qint32 len, struct sockaddr_storage &from,
+															 UDPSendBatch *sendBatch);
+#endif
 
 	bool validateChannelName(const QString &name);
 	bool validateUserName(const QString &name);
@@ -334,34 +476,63 @@ public:
 	void sendClientPermission(ServerUser *u, Channel *c, bool explicitlyRequested = false);
 	void flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQuery &mpqq);
 	void clearACLCache(User *p = nullptr);
-	void clearWhisperTargetCache();
+	/// Rebuilds all cached whisper targets
+	void refreshWhisperTargetCache();
+	/// Rebuilds the cached whisper targets of the given users and the ones depending on the given channels or users
+	/// (see WhisperTargetDependencies)
+	void refreshWhisperTargetCache(const QSet< unsigned int > &channels, const QSet< unsigned int > &sessions);
+	/// Builds the cache entries for the given whisper targets (speaker and target ID) ahead of time, so that the
+	/// voice threads don't have to do so (while holding the lock exclusively) once audio is sent to them.
+	/// @note Must be called on the main thread without holding qrwlVoiceThread
+	void buildWhisperTargetCaches(const QList< QPair< ServerUser *, int > > &targets);
 
 	void sendProtoAll(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type,
-					  Version::full_t version, Version::CompareMode mode);
+					  Version::full_t version, Version::CompareMode mode, QByteArray &cache);
 	void sendProtoExcept(ServerUser *, const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type,
-						 Version::full_t version, Version::CompareMode mode);
-	void sendProtoMessage(ServerUser *, const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type);
+						 Version::full_t version, Version::CompareMode mode, QByteArray &cache);
+	void sendProtoMessage(ServerUser *, const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type,
+						  QByteArray &cache);
 
 	// sendAll sends a protobuf message to all users on the server whose version is either bigger than v or
 	// lower than ~v. If v == 0 the message is sent to everyone.
-#define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                                                        \
-	void sendAll(const MumbleProto::name &msg, Version::full_t v = Version::UNKNOWN,                   \
-				 Version::CompareMode mode = Version::CompareMode::AtLeast) {                          \
-		sendProtoAll(msg, Mumble::Protocol::TCPMessageType::name, v, mode);                            \
-	}                                                                                                  \
-	void sendExcept(ServerUser *u, const MumbleProto::name &msg, Version::full_t v = Version::UNKNOWN, \
-					Version::CompareMode mode = Version::CompareMode::AtLeast) {                       \
-		sendProtoExcept(u, msg, Mumble::Protocol::TCPMessageType::name, v, mode);                      \
-	}                                                                                                  \
-	void sendMessage(ServerUser *u, const MumbleProto::name &msg) {                                    \
-		sendProtoMessage(u, msg, Mumble::Protocol::TCPMessageType::name);                              \
+	// The message is serialized only once for all of its recipients and the writes to each user's socket are
+	// coalesced until control returns to the event loop. The variants taking a cache store the serialized message
+	// in it (unless it is non-empty already, in which case its contents are sent as they are). This way, a message
+	// that is sent to several groups of users is serialized only once as well. The cache has to be cleared whenever
+	// the message is modified in between.
+#define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                                                                    \
+	void sendAll(const MumbleProto::name &msg, Version::full_t v = Version::UNKNOWN,                               \
+				 Version::CompareMode mode = Version::CompareMode::AtLeast) {                                      \
+		QByteArray cache;                                                                                          \
+		sendProtoAll(msg, Mumble::Protocol::TCPMessageType::name, v, mode, cache);                                 \
+	}                                                                                                              \
+	void sendAll(const MumbleProto::name &msg, QByteArray &cache, Version::full_t v, Version::CompareMode mode) { \
+		sendProtoAll(msg, Mumble::Protocol::TCPMessageType::name, v, mode, cache);                                 \
+	}                                                                                                              \
+	void sendExcept(ServerUser *u, const MumbleProto::name &msg, Version::full_t v = Version::UNKNOWN,             \
+					Version::CompareMode mode = Version::CompareMode::AtLeast) {                                   \
+		QByteArray cache;                                                                                          \
+		sendProtoExcept(u, msg, Mumble::Protocol::TCPMessageType::name, v, mode, cache);                           \
+	}                                                                                                              \
+	void sendExcept(ServerUser *u, const MumbleProto::name &msg, QByteArray &cache, Version::full_t v,             \
+					Version::CompareMode mode) {                                                                   \
+		sendProtoExcept(u, msg, Mumble::Protocol::TCPMessageType::name, v, mode, cache);                           \
+	}                                                                                                              \
+	void sendMessage(ServerUser *u, const MumbleProto::name &msg) {                                                \
+		QByteArray cache;                                                                                          \
+		sendProtoMessage(u, msg, Mumble::Protocol::TCPMessageType::name, cache);                                   \
+	}                                                                                                              \
+	void sendMessage(ServerUser *u, const MumbleProto::name &msg, QByteArray &cache) {                             \
+		sendProtoMessage(u, msg, Mumble::Protocol::TCPMessageType::name, cache);                                   \
 	}
 
 	MUMBLE_ALL_TCP_MESSAGES
 #undef PROCESS_MUMBLE_TCP_MESSAGE
 
-	static void hashAssign(QString &destination, QByteArray &hash, const QString &str);
-	static void hashAssign(QByteArray &destination, QByteArray &hash, const QByteArray &source);
+	/// Assigns the given text or texture and computes its hash (if it is large enough for clients to request it on
+	/// demand). Large blobs are deduplicated through m_textStore or m_textureStore.
+	void hashAssign(QString &destination, QByteArray &hash, const QString &str);
+	void hashAssign(QByteArray &destination, QByteArray &hash, const QByteArray &source);
 	bool isTextAllowed(QString &str, bool &changed);
 
 	void setLiveConf(const QString &key, const QString &value);
@@ -436,6 +607,29 @@ public:
 	int authenticate(QString &name, const QString &pw, int sessionId = 0, const QStringList &emails = QStringList(),
 					 const QString &certhash = QString(), bool bStrongCert = false,
 					 const QList< QSslCertificate > & = QList< QSslCertificate >());
+
+	/// A user's password as stored in the database
+	struct StoredPassword {
+		/// Whether a user with the given name is registered at all
+		bool exists = false;
+		int userID  = -1;
+		QString name;
+		QString hash;
+		QString salt;
+		int kdfIterations = 0;
+
+		/// @returns Whether checking a password against this one requires computing its (expensive) PBKDF2 hash
+		bool requiresPBKDF2() const { return exists && !hash.isEmpty() && kdfIterations > 0; }
+	};
+
+	// The steps of authenticate(). Only computing the PBKDF2 hash in between them may happen on another thread.
+	/// @returns The result of the external authenticators or -2 if none of them handled the user
+	int authenticateExternally(QString &name, const QString &pw, int sessionId, const QString &certhash,
+							   bool bStrongCert, const QList< QSslCertificate > &certs);
+	StoredPassword readStoredPassword(const QString &name);
+	/// @param pbkdf2Hash The PBKDF2 hash of pw, if the stored password requires it
+	int authenticateLocally(QString &name, const QString &pw, const QStringList &emails, const QString &certhash,
+							bool bStrongCert, const StoredPassword &stored, const QString &pbkdf2Hash);
 	Channel *addChannel(Channel *c, const QString &name, bool temporary = false, int position = 0,
 						unsigned int maxUsers = 0);
 	void removeChannelDB(const Channel *c);
@@ -481,6 +675,16 @@ public:
 #define PROCESS_MUMBLE_TCP_MESSAGE(name, value) void msg##name(ServerUser *, MumbleProto::name &);
 	MUMBLE_ALL_TCP_MESSAGES
 #undef PROCESS_MUMBLE_TCP_MESSAGE
+
+	/// The part of msgAuthenticate that follows checking the user's credentials
+	///
+	/// @param id The result of authenticate()
+	void finishAuthentication(ServerUser *uSource, const MumbleProto::Authenticate &msg, int id, bool nameok,
+							  const QString &pw);
+	/// Fills in the ChannelState message sent to a user that connects (apart from whether they may enter the channel)
+	///
+	/// @param descriptionHash Whether to send the hash of the channel's description rather than the description
+	void describeChannel(Channel &channel, bool descriptionHash, MumbleProto::ChannelState &mpcs) const;
 };
 
 #endif
@@ -4,6 +4,7 @@
 // Mumble source tree or at <https://www.mumble.info/LICENSE>.
 
 #include "ServerDB.h"
+#include "ServerDBWriteBehind.h"
 
 #ifdef Q_OS_WIN
 #	include "win.h"
@@ -16,6 +17,7 @@
 #include "Meta.h"
 #include "PBKDF2.h"
 #include "PasswordGenerator.h"
+#include "QtUtils.h"
 #include "Server.h"
 #include "ServerUser.h"
 #include "User.h"
@@ -60,6 +62,7 @@ public:
 };
 
 QSqlDatabase *ServerDB::db = nullptr;
+ServerDBWriteBehind *ServerDB::writeBehind = nullptr;
 Timer ServerDB::tLogClean;
 QString ServerDB::qsUpgradeSuffix;
 
@@ -869,9 +872,21 @@ ServerDB::ServerDB() {
 		}
 	}
 	query.clear();
+
+	int writeBehindInterval = Meta::mp->iDBWriteBehindInterval;
+	if (Meta::mp->qsDBDriver == "QSQLITE" && db->databaseName() == QLatin1String(":memory:")) {
+		// Another connection would open a database of its own
+		writeBehindInterval = 0;
+	}
+	writeBehind =
+		new ServerDBWriteBehind(db->connectionName(), Meta::mp->qsDBDriver, Meta::mp->qsDBPrefix, writeBehindInterval);
 }
 
 ServerDB::~ServerDB() {
+	// Write everything that is still pending
+	delete writeBehind;
+	writeBehind = nullptr;
+
 	db->close();
 	delete db;
 	db = nullptr;
@@ -1147,6 +1162,7 @@ int Server::registerUser(const QMap< int, QString > &info) {
 	}
 
 	qhUserNameCache.remove(id);
+	m_userTextureHashes.remove(id);
 
 	setInfo(id, info);
 
@@ -1164,6 +1180,7 @@ bool Server::unregisterUserDB(int id) {
 
 	qhUserIDCache.remove(info.value(ServerDB::User_Name));
 	qhUserNameCache.remove(id);
+	m_userTextureHashes.remove(id);
 
 	int res = -2;
 	emit unregisterUserSig(res, id);
@@ -1171,6 +1188,9 @@ bool Server::unregisterUserDB(int id) {
 		return false;
 	}
 
+	// Otherwise a pending channel listener would be recreated
+	ServerDB::writeBehind->flushUser(iServerNum, id);
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1197,6 +1217,8 @@ QList< UserInfo > Server::getRegisteredUsersEx() {
 		users.insert(it.key(), UserInfo(it.key(), it.value()));
 	}
 
+	ServerDB::writeBehind->flush();
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1275,6 +1297,8 @@ QMap< int, QString > Server::getRegistration(int id) {
 	if (res >= 0)
 		return info;
 
+	ServerDB::writeBehind->flushUser(iServerNum, id);
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1303,6 +1327,20 @@ QMap< int, QString > Server::getRegistration(int id) {
 ///         -3 for authentication failures where the data could (temporarily) not be verified.
 int Server::authenticate(QString &name, const QString &password, int sessionId, const QStringList &emails,
 						 const QString &certhash, bool bStrongCert, const QList< QSslCertificate > &certs) {
+	int res = authenticateExternally(name, password, sessionId, certhash, bStrongCert, certs);
+	if (res != -2) {
+		return res;
+	}
+
+	const StoredPassword stored = readStoredPassword(name);
+	const QString pbkdf2Hash =
+		stored.requiresPBKDF2() ? PBKDF2::getHash(stored.salt, password, stored.kdfIterations) : QString();
+
+	return authenticateLocally(name, password, emails, certhash, bStrongCert, stored, pbkdf2Hash);
+}
+
+int Server::authenticateExternally(QString &name, const QString &password, int sessionId, const QString &certhash,
+								   bool bStrongCert, const QList< QSslCertificate > &certs) {
 	int res = bForceExternalAuth ? -3 : -2;
 
 	emit authenticateSig(res, name, sessionId, certs, certhash, bStrongCert, password);
@@ -1342,25 +1380,50 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 		}
 		if (res >= 0) {
 			qhUserNameCache.remove(res);
+			m_userTextureHashes.remove(res);
 			qhUserIDCache.remove(name);
 		}
-		return res;
 	}
 
+	return res;
+}
+
+Server::StoredPassword Server::readStoredPassword(const QString &name) {
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
+	StoredPassword stored;
+
 	SQLPREP("SELECT `user_id`,`name`,`pw`, `salt`, `kdfiterations` FROM `%1users` WHERE `server_id` = ? AND "
 			"LOWER(`name`) = LOWER(?)");
 	query.addBindValue(iServerNum);
 	query.addBindValue(name);
 	SQLEXEC();
 	if (query.next()) {
-		const int userId                 = query.value(0).toInt();
-		const QString storedPasswordHash = query.value(2).toString();
-		const QString storedSalt         = query.value(3).toString();
-		const int storedKdfIterations    = query.value(4).toInt();
-		res                              = -1;
+		stored.exists        = true;
+		stored.userID        = query.value(0).toInt();
+		stored.name          = query.value(1).toString();
+		stored.hash          = query.value(2).toString();
+		stored.salt          = query.value(3).toString();
+		stored.kdfIterations = query.value(4).toInt();
+	}
+
+	return stored;
+}
+
+int Server::authenticateLocally(QString &name, const QString &password, const QStringList &emails,
+								const QString &certhash, bool bStrongCert, const StoredPassword &stored,
+								const QString &pbkdf2Hash) {
+	int res = -2;
+
+	TransactionHolder th;
+	QSqlQuery &query = *th.qsqQuery;
+
+	if (stored.exists) {
+		const int userId                  = stored.userID;
+		const QString &storedPasswordHash = stored.hash;
+		const int storedKdfIterations     = stored.kdfIterations;
+		res                               = -1;
 
 		if (!storedPasswordHash.isEmpty()) {
 			// A user has password authentication enabled if there is a password hash.
@@ -1369,8 +1432,8 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 				// If storedKdfIterations is <=0 this means this is an old-style SHA1 hash
 				// that hasn't been converted yet. Or we are operating in legacy mode.
 				if (ServerDB::getLegacySHA1Hash(password) == storedPasswordHash) {
-					name = query.value(1).toString();
-					res  = query.value(0).toInt();
+					name = stored.name;
+					res  = userId;
 
 					if (!Meta::mp->legacyPasswordHash) {
 						// Unless disabled upgrade the user password hash
@@ -1385,9 +1448,9 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 					}
 				}
 			} else {
-				if (PBKDF2::getHash(storedSalt, password, storedKdfIterations) == storedPasswordHash) {
-					name = query.value(1).toString();
-					res  = query.value(0).toInt();
+				if (pbkdf2Hash == storedPasswordHash) {
+					name = stored.name;
+					res  = userId;
 
 					if (Meta::mp->legacyPasswordHash) {
 						// Downgrade the password to the legacy hash
@@ -1503,6 +1566,7 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 	}
 	if (res >= 0) {
 		qhUserNameCache.remove(res);
+		m_userTextureHashes.remove(res);
 		qhUserIDCache.remove(name);
 	}
 	return res;
@@ -1624,6 +1688,7 @@ bool Server::setTexture(int id, const QByteArray &texture) {
 		if (u->iId == id)
 			hashAssign(u->qbaTexture, u->qbaTextureHash, tex);
 	}
+	m_userTextureHashes.remove(id);
 
 	int res = -2;
 	emit setTextureSig(res, id, tex);
@@ -1752,6 +1817,20 @@ QByteArray Server::getUserTexture(int id) {
 		return qba;
 	}
 
+	// Textures only change in the database through setTexture(), so a texture that has been loaded before can be
+	// taken from m_textureStore (as long as it hasn't been evicted)
+	auto it = m_userTextureHashes.constFind(id);
+	if (it != m_userTextureHashes.constEnd()) {
+		if (it->isEmpty()) {
+			return QByteArray();
+		}
+
+		qba = m_textureStore.find(*it);
+		if (!qba.isNull()) {
+			return qba;
+		}
+	}
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1765,6 +1844,15 @@ QByteArray Server::getUserTexture(int id) {
 			if (qba.size() == 600 * 60 * 4)
 				qba = qCompress(qba);
 	}
+
+	if (qba.isEmpty()) {
+		m_userTextureHashes.insert(id, QByteArray());
+	} else if (qba.size() >= 128) {
+		const QByteArray hash = sha1(qba);
+		qba                   = m_textureStore.intern(hash, qba);
+		m_userTextureHashes.insert(id, hash);
+	}
+
 	return qba;
 }
 
@@ -1772,7 +1860,9 @@ void Server::addLink(Channel *c, Channel *l) {
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 		c->link(l);
+		m_linkComponents.link(c->iId, l->iId);
 	}
+	m_channelSyncCache.invalidateStructure();
 
 	if (c->bTemporary || l->bTemporary)
 		return;
@@ -1795,7 +1885,9 @@ void Server::removeLink(Channel *c, Channel *l) {
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 		c->unlink(l);
+		m_linkComponents.unlink(c->iId, l->iId);
 	}
+	m_channelSyncCache.invalidateStructure();
 
 	if (c->bTemporary || l->bTemporary)
 		return;
@@ -1866,11 +1958,15 @@ Channel *Server::addChannel(Channel *p, const QString &name, bool temporary, int
 	c->iPosition  = position;
 	c->uiMaxUsers = maxUsers;
 	qhChannels.insert(id, c);
+	m_channelSyncCache.invalidateStructure();
 	return c;
 }
 
 void Server::removeChannelDB(const Channel *c) {
 	if (!c->bTemporary) {
+		// Otherwise a pending channel listener would be recreated
+		ServerDB::writeBehind->flush();
+
 		TransactionHolder th;
 
 		QSqlQuery &query = *th.qsqQuery;
@@ -1883,6 +1979,8 @@ void Server::removeChannelDB(const Channel *c) {
 }
 
 void Server::updateChannel(const Channel *c) {
+	m_channelSyncCache.invalidate(c->iId);
+
 	if (c->bTemporary)
 		return;
 	TransactionHolder th;
@@ -2165,6 +2263,7 @@ void Server::readLinks() {
 		if (c && l) {
 			QWriteLocker wl(&qrwlVoiceThread);
 			c->link(l);
+			m_linkComponents.link(c->iId, l->iId);
 		}
 	}
 }
@@ -2176,18 +2275,7 @@ void Server::setLastChannel(const User *p) {
 	if (p->cChannel->bTemporary)
 		return;
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
-	if (Meta::mp->qsDBDriver == "QSQLITE") {
-		SQLPREP("UPDATE `%1users` SET `lastchannel`=? WHERE `server_id` = ? AND `user_id` = ?");
-	} else {
-		SQLPREP("UPDATE `%1users` SET `lastchannel`=?, `last_active` = now() WHERE `server_id` = ? AND `user_id` = ?");
-	}
-	query.addBindValue(p->cChannel->iId);
-	query.addBindValue(iServerNum);
-	query.addBindValue(p->iId);
-	SQLEXEC();
+	ServerDB::writeBehind->setLastChannel(iServerNum, p->iId, p->cChannel->iId);
 }
 
 int Server::readLastChannel(int id) {
@@ -2197,6 +2285,8 @@ int Server::readLastChannel(int id) {
 	if (!Meta::mp->bRememberChan)
 		return -1;
 
+	ServerDB::writeBehind->flushUser(iServerNum, id);
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2263,18 +2353,7 @@ void Server::setLastDisconnect(const User *p) {
 	if (p->iId < 0)
 		return;
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
-	if (Meta::mp->qsDBDriver == "QSQLITE") {
-		SQLPREP("UPDATE `%1users` SET `last_disconnect` = datetime('now') WHERE `server_id` = ? AND `user_id` = ?");
-	} else {
-		// MySQL or PostgreSQL
-		SQLPREP("UPDATE `%1users` SET `last_disconnect` = now() WHERE `server_id` = ? AND `user_id` = ?");
-	}
-	query.addBindValue(iServerNum);
-	query.addBindValue(p->iId);
-	SQLEXEC();
+	ServerDB::writeBehind->setLastDisconnect(iServerNum, p->iId);
 }
 
 void Server::dumpChannel(const Channel *c) {
@@ -2334,6 +2413,8 @@ void Server::getBans() {
 		if (ban.isValid())
 			qlBans << ban;
 	}
+
+	m_banIndex.update(qlBans);
 }
 
 void Server::saveBans() {
@@ -2397,9 +2478,6 @@ void Server::setConf(const QString &key, const QVariant &value) {
 }
 
 void Server::dblog(const QString &str) const {
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
 	// Is logging disabled?
 	if (Meta::mp->iLogDays < 0)
 		return;
@@ -2407,23 +2485,11 @@ void Server::dblog(const QString &str) const {
 	// Once per hour
 	if (Meta::mp->iLogDays > 0) {
 		if (ServerDB::tLogClean.isElapsed(3600ULL * 1000000ULL)) {
-			QString qstr;
-			if (Meta::mp->qsDBDriver == "QSQLITE") {
-				qstr = QString::fromLatin1("msgtime < datetime('now','-%1 days')").arg(Meta::mp->iLogDays);
-			} else if (Meta::mp->qsDBDriver == "QPSQL") {
-				qstr = QString::fromLatin1("msgtime < now() - INTERVAL '%1 day'").arg(Meta::mp->iLogDays);
-			} else {
-				qstr = QString::fromLatin1("msgtime < now() - INTERVAL %1 day").arg(Meta::mp->iLogDays);
-			}
-			ServerDB::prepare(query, QString::fromLatin1("DELETE FROM %1slog WHERE ") + qstr);
-			SQLEXEC();
+			ServerDB::writeBehind->expireLogs(Meta::mp->iLogDays);
 		}
 	}
 
-	SQLPREP("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)");
-	query.addBindValue(iServerNum);
-	query.addBindValue(str);
-	SQLEXEC();
+	ServerDB::writeBehind->log(iServerNum, str);
 }
 
 void Server::loadChannelListenersOf(const ServerUser &user) {
@@ -2432,6 +2498,8 @@ void Server::loadChannelListenersOf(const ServerUser &user) {
 		return;
 	}
 
+	ServerDB::writeBehind->flushUser(iServerNum, user.iId);
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2459,32 +2527,7 @@ void Server::loadChannelListenersOf(const ServerUser &user) {
 
 void Server::addChannelListener(const ServerUser &user, const Channel &channel) {
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		// Update or insert entry
-		SQLPREP(
-			"SELECT COUNT(*) FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-
-		SQLEXEC();
-
-		bool entryAlreadyExists = query.next() && query.value(0).toInt() > 0;
-
-		if (entryAlreadyExists) {
-			SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = 1 WHERE `server_id` = ? AND `user_id`= ? AND "
-					"`channel_id` = ?");
-		} else {
-			SQLPREP("INSERT INTO `%1channel_listeners` (`server_id`, `user_id`, `channel_id`) VALUES (?, ?, ?)");
-		}
-
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-
-		SQLEXEC();
+		ServerDB::writeBehind->enableChannelListener(iServerNum, user.iId, channel.iId);
 	}
 
 	m_channelListenerManager.addListener(user.uiSession, channel.iId);
@@ -2496,17 +2539,7 @@ void Server::disableChannelListener(const ServerUser &user, const Channel &chann
 	}
 
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
-				"`channel_id` = ?");
-		// Explicit cast to int is required for Postgresql
-		query.addBindValue(static_cast< int >(false));
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		ServerDB::writeBehind->disableChannelListener(iServerNum, user.iId, channel.iId);
 	}
 
 	m_channelListenerManager.removeListener(user.uiSession, channel.iId);
@@ -2518,14 +2551,7 @@ void Server::deleteChannelListener(const ServerUser &user, const Channel &channe
 	}
 
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		SQLPREP("DELETE FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		ServerDB::writeBehind->deleteChannelListener(iServerNum, user.iId, channel.iId);
 	}
 
 	m_channelListenerManager.removeListener(user.uiSession, channel.iId);
@@ -2533,16 +2559,7 @@ void Server::deleteChannelListener(const ServerUser &user, const Channel &channe
 
 void Server::setChannelListenerVolume(const ServerUser &user, const Channel &channel, float volumeAdjustment) {
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		SQLPREP("UPDATE `%1channel_listeners` SET `volume_adjustment` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
-				"`channel_id` = ?");
-		query.addBindValue(volumeAdjustment);
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		ServerDB::writeBehind->setChannelListenerVolume(iServerNum, user.iId, channel.iId, volumeAdjustment);
 	}
 
 	m_channelListenerManager.setListenerVolumeAdjustment(user.uiSession, channel.iId,
@@ -2550,6 +2567,8 @@ void Server::setChannelListenerVolume(const ServerUser &user, const Channel &cha
 }
 
 void ServerDB::wipeLogs() {
+	writeBehind->flush();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2557,6 +2576,8 @@ void ServerDB::wipeLogs() {
 }
 
 QList< ServerDB::LogRecord > ServerDB::getLog(int server_id, unsigned int offs_min, unsigned int offs_max) {
+	writeBehind->flush();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2584,6 +2605,8 @@ QList< ServerDB::LogRecord > ServerDB::getLog(int server_id, unsigned int offs_m
 }
 
 int ServerDB::getLogLen(int server_id) {
+	writeBehind->flush();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2686,6 +2709,8 @@ int ServerDB::addServer() {
 }
 
 void ServerDB::deleteServer(int server_id) {
+	writeBehind->flush();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("DELETE FROM `%1servers` WHERE `server_id` = ?");
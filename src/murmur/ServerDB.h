@@ -14,6 +14,7 @@ class Server;
 class Channel;
 class User;
 class Connection;
+class ServerDBWriteBehind;
 class QSqlDatabase;
 class QSqlQuery;
 
@@ -43,6 +44,8 @@ public:
 	typedef QPair< std::int64_t, QString > LogRecord;
 	static Timer tLogClean;
 	static QSqlDatabase *db;
+	/// Writes the updates of the users' activity and the server log in the background
+	static ServerDBWriteBehind *writeBehind;
 	static QString qsUpgradeSuffix;
 	static void setSUPW(int iServNum, const QString &pw);
 	static void disableSU(int srvnum);
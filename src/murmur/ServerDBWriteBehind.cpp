@@ -0,0 +1,397 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ServerDBWriteBehind.h"
+
+#include <QtCore/QDeadlineTimer>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+
+#include <utility>
+
+/// The name of the background thread's database connection
+static const QString WRITER_CONNECTION_NAME = QStringLiteral("ServerDBWriteBehind");
+
+ServerDBWriteBehind::ServerDBWriteBehind(const QString &connectionName, const QString &driver, const QString &prefix,
+										 int interval)
+	: m_connectionName(connectionName), m_driver(driver), m_prefix(prefix), m_interval(interval) {
+	if (m_interval > 0) {
+		start();
+	}
+}
+
+ServerDBWriteBehind::~ServerDBWriteBehind() {
+	if (isRunning()) {
+		{
+			QMutexLocker lock(&m_mutex);
+			m_stop = true;
+			m_wakeUp.wakeOne();
+		}
+
+		// The thread writes everything that is still pending before it exits
+		wait();
+	} else {
+		flush();
+	}
+}
+
+ServerDBWriteBehind::UserUpdate &ServerDBWriteBehind::pendingUpdate(int serverID, int userID) {
+	if (m_pending.isEmpty()) {
+		m_wakeUp.wakeOne();
+	}
+
+	return m_pending.users[qMakePair(serverID, userID)];
+}
+
+void ServerDBWriteBehind::updated() {
+	if (m_interval <= 0) {
+		flush();
+	}
+}
+
+void ServerDBWriteBehind::setLastChannel(int serverID, int userID, unsigned int channelID) {
+	{
+		QMutexLocker lock(&m_mutex);
+
+		UserUpdate &update    = pendingUpdate(serverID, userID);
+		update.setLastChannel = true;
+		update.lastChannel    = channelID;
+	}
+
+	updated();
+}
+
+void ServerDBWriteBehind::setLastDisconnect(int serverID, int userID) {
+	{
+		QMutexLocker lock(&m_mutex);
+
+		pendingUpdate(serverID, userID).setLastDisconnect = true;
+	}
+
+	updated();
+}
+
+void ServerDBWriteBehind::enableChannelListener(int serverID, int userID, unsigned int channelID) {
+	{
+		QMutexLocker lock(&m_mutex);
+
+		pendingUpdate(serverID, userID).listeners[channelID].state = ListenerUpdate::Enable;
+	}
+
+	updated();
+}
+
+void ServerDBWriteBehind::disableChannelListener(int serverID, int userID, unsigned int channelID) {
+	{
+		QMutexLocker lock(&m_mutex);
+
+		ListenerUpdate &update = pendingUpdate(serverID, userID).listeners[channelID];
+		// A listener that is enabled and disabled again in the same batch still has to exist afterwards
+		update.state = update.state == ListenerUpdate::Enable || update.state == ListenerUpdate::CreateDisabled
+						   ? ListenerUpdate::CreateDisabled
+						   : ListenerUpdate::Disable;
+	}
+
+	updated();
+}
+
+void ServerDBWriteBehind::deleteChannelListener(int serverID, int userID, unsigned int channelID) {
+	{
+		QMutexLocker lock(&m_mutex);
+
+		// Whatever has happened to the listener before doesn't matter anymore
+		ListenerUpdate &update = pendingUpdate(serverID, userID).listeners[channelID];
+		update                 = ListenerUpdate();
+		update.deleteFirst     = true;
+	}
+
+	updated();
+}
+
+void ServerDBWriteBehind::setChannelListenerVolume(int serverID, int userID, unsigned int channelID,
+												   float volumeAdjustment) {
+	{
+		QMutexLocker lock(&m_mutex);
+
+		ListenerUpdate &update = pendingUpdate(serverID, userID).listeners[channelID];
+		update.setVolume       = true;
+		update.volume          = volumeAdjustment;
+	}
+
+	updated();
+}
+
+void ServerDBWriteBehind::log(int serverID, const QString &message) {
+	{
+		QMutexLocker lock(&m_mutex);
+
+		if (m_pending.isEmpty()) {
+			m_wakeUp.wakeOne();
+		}
+		m_pending.logs.append(qMakePair(serverID, message));
+	}
+
+	updated();
+}
+
+void ServerDBWriteBehind::expireLogs(int days) {
+	{
+		QMutexLocker lock(&m_mutex);
+
+		if (m_pending.isEmpty()) {
+			m_wakeUp.wakeOne();
+		}
+		m_pending.expireLogsDays = days;
+	}
+
+	updated();
+}
+
+void ServerDBWriteBehind::flush() {
+	if (m_interval <= 0) {
+		Batch batch;
+		{
+			QMutexLocker lock(&m_mutex);
+			std::swap(batch, m_pending);
+		}
+
+		if (!batch.isEmpty()) {
+			QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+			write(db, batch);
+		}
+
+		return;
+	}
+
+	QMutexLocker lock(&m_mutex);
+
+	if (m_pending.isEmpty() && m_writing.isEmpty()) {
+		return;
+	}
+
+	m_flushRequested = true;
+	m_wakeUp.wakeOne();
+
+	while (!m_pending.isEmpty() || !m_writing.isEmpty()) {
+		m_written.wait(&m_mutex);
+	}
+}
+
+void ServerDBWriteBehind::flushUser(int serverID, int userID) {
+	{
+		QMutexLocker lock(&m_mutex);
+
+		const QPair< int, int > key = qMakePair(serverID, userID);
+		if (!m_pending.users.contains(key) && !m_writing.users.contains(key)) {
+			return;
+		}
+	}
+
+	flush();
+}
+
+void ServerDBWriteBehind::run() {
+	{
+		QSqlDatabase db = QSqlDatabase::cloneDatabase(m_connectionName, WRITER_CONNECTION_NAME);
+		if (!db.open()) {
+			qFatal("ServerDBWriteBehind: Failed to open database: %s", qPrintable(db.lastError().text()));
+		}
+
+		QMutexLocker lock(&m_mutex);
+
+		while (true) {
+			while (m_pending.isEmpty() && !m_stop) {
+				m_wakeUp.wait(&m_mutex);
+			}
+
+			if (m_pending.isEmpty()) {
+				// Stopped and everything has been written
+				break;
+			}
+
+			// Collect the updates of one interval
+			QDeadlineTimer deadline(m_interval);
+			while (!m_stop && !m_flushRequested && !deadline.hasExpired()) {
+				m_wakeUp.wait(&m_mutex, deadline);
+			}
+
+			m_flushRequested = false;
+			std::swap(m_writing, m_pending);
+
+			lock.unlock();
+			write(db, m_writing);
+			lock.relock();
+
+			m_writing = Batch();
+			m_written.wakeAll();
+		}
+
+		db.close();
+	}
+
+	QSqlDatabase::removeDatabase(WRITER_CONNECTION_NAME);
+}
+
+void ServerDBWriteBehind::write(QSqlDatabase &db, const Batch &batch) const {
+	// Without a background thread, the updates are written on the server's own connection, which might be in the
+	// middle of a transaction (e.g. of a TransactionHolder). Starting another one would fail or (depending on the
+	// driver) commit the active one, and reconnecting would roll it back or even wipe an in-memory database. So the
+	// updates simply become part of whatever is going on on that connection.
+	const bool ownConnection = m_interval > 0;
+
+	if (ownConnection && !db.transaction()) {
+		// The connection might have been lost
+		db.close();
+		if (!db.open() || !db.transaction()) {
+			qWarning("ServerDBWriteBehind: Lost connection to SQL Database, dropping updates: %s",
+					 qPrintable(db.lastError().text()));
+			return;
+		}
+	}
+
+	const bool sqlite = m_driver == QLatin1String("QSQLITE");
+
+	QSqlQuery query(db);
+
+	for (auto it = batch.users.cbegin(); it != batch.users.cend(); ++it) {
+		const int serverID       = it.key().first;
+		const int userID         = it.key().second;
+		const UserUpdate &update = it.value();
+
+		if (update.setLastChannel) {
+			if (sqlite) {
+				exec(query,
+					 QLatin1String("UPDATE `%1users` SET `lastchannel`=? WHERE `server_id` = ? AND `user_id` = ?"),
+					 { update.lastChannel, serverID, userID });
+			} else {
+				exec(query,
+					 QLatin1String("UPDATE `%1users` SET `lastchannel`=?, `last_active` = now() WHERE `server_id` = ? "
+								   "AND `user_id` = ?"),
+					 { update.lastChannel, serverID, userID });
+			}
+		}
+
+		if (update.setLastDisconnect) {
+			if (sqlite) {
+				exec(query,
+					 QLatin1String("UPDATE `%1users` SET `last_disconnect` = datetime('now') WHERE `server_id` = ? AND "
+								   "`user_id` = ?"),
+					 { serverID, userID });
+			} else {
+				// MySQL or PostgreSQL
+				exec(query,
+					 QLatin1String(
+						 "UPDATE `%1users` SET `last_disconnect` = now() WHERE `server_id` = ? AND `user_id` = ?"),
+					 { serverID, userID });
+			}
+		}
+
+		for (auto listener = update.listeners.cbegin(); listener != update.listeners.cend(); ++listener) {
+			const unsigned int channelID = listener.key();
+			const ListenerUpdate &change = listener.value();
+
+			if (change.deleteFirst) {
+				exec(query,
+					 QLatin1String("DELETE FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND "
+								   "`channel_id` = ?"),
+					 { serverID, userID, channelID });
+			}
+
+			// Explicit cast to int is required for Postgresql
+			const int enabled = static_cast< int >(change.state == ListenerUpdate::Enable);
+
+			switch (change.state) {
+				case ListenerUpdate::Unchanged:
+					break;
+				case ListenerUpdate::Enable:
+				case ListenerUpdate::CreateDisabled: {
+					// Update or insert entry
+					exec(query,
+						 QLatin1String("SELECT COUNT(*) FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` "
+									   "= ? AND `channel_id` = ?"),
+						 { serverID, userID, channelID });
+
+					const bool entryAlreadyExists = query.next() && query.value(0).toInt() > 0;
+
+					if (entryAlreadyExists) {
+						exec(query,
+							 QLatin1String("UPDATE `%1channel_listeners` SET `enabled` = ? WHERE `server_id` = ? AND "
+										   "`user_id`= ? AND `channel_id` = ?"),
+							 { enabled, serverID, userID, channelID });
+					} else {
+						exec(query,
+							 QLatin1String("INSERT INTO `%1channel_listeners` (`server_id`, `user_id`, `channel_id`, "
+										   "`enabled`) VALUES (?, ?, ?, ?)"),
+							 { serverID, userID, channelID, enabled });
+					}
+					break;
+				}
+				case ListenerUpdate::Disable:
+					exec(query,
+						 QLatin1String("UPDATE `%1channel_listeners` SET `enabled` = ? WHERE `server_id` = ? AND "
+									   "`user_id` = ? AND `channel_id` = ?"),
+						 { enabled, serverID, userID, channelID });
+					break;
+			}
+
+			if (change.setVolume) {
+				exec(query,
+					 QLatin1String("UPDATE `%1channel_listeners` SET `volume_adjustment` = ? WHERE `server_id` = ? AND "
+								   "`user_id` = ? AND `channel_id` = ?"),
+					 { change.volume, serverID, userID, channelID });
+			}
+		}
+	}
+
+	if (batch.expireLogsDays > 0) {
+		QString condition;
+		if (sqlite) {
+			condition = QString::fromLatin1("msgtime < datetime('now','-%1 days')").arg(batch.expireLogsDays);
+		} else if (m_driver == QLatin1String("QPSQL")) {
+			condition = QString::fromLatin1("msgtime < now() - INTERVAL '%1 day'").arg(batch.expireLogsDays);
+		} else {
+			condition = QString::fromLatin1("msgtime < now() - INTERVAL %1 day").arg(batch.expireLogsDays);
+		}
+
+		exec(query, QLatin1String("DELETE FROM `%1slog` WHERE ") + condition, {});
+	}
+
+	for (const QPair< int, QString > &entry : batch.logs) {
+		exec(query, QLatin1String("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)"),
+			 { entry.first, entry.second });
+	}
+
+	query.clear();
+
+	if (ownConnection && !db.commit()) {
+		qWarning("ServerDBWriteBehind: Failed to commit: %s", qPrintable(db.lastError().text()));
+	}
+}
+
+bool ServerDBWriteBehind::exec(QSqlQuery &query, const QString &statement, const QVariantList &values) const {
+	QString q = statement.arg(m_prefix);
+	if (m_driver == QLatin1String("QPSQL")) {
+		q.replace("`", "\"");
+	}
+
+	if (!query.prepare(q)) {
+		qWarning("ServerDBWriteBehind: SQL Prepare Error [%s]: %s", qPrintable(q),
+				 qPrintable(query.lastError().text()));
+		return false;
+	}
+
+	for (const QVariant &value : values) {
+		query.addBindValue(value);
+	}
+
+	if (!query.exec()) {
+		qWarning("ServerDBWriteBehind: SQL Error [%s]: %s", qPrintable(query.lastQuery()),
+				 qPrintable(query.lastError().text()));
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,123 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_SERVERDBWRITEBEHIND_H_
+#define MUMBLE_MURMUR_SERVERDBWRITEBEHIND_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#include <QtCore/QVariant>
+#include <QtCore/QWaitCondition>
+
+class QSqlDatabase;
+class QSqlQuery;
+
+/// Collects the updates of the users' activity (their last channel, the time they disconnected and their channel
+/// listeners) and the server log entries, which are written whenever users move or disconnect, and writes them to
+/// the database on a background thread. Updates of the same value are coalesced, so only the latest one is written,
+/// and everything that has been collected during one interval is written in a single transaction.
+///
+/// All functions have to be called from the thread that owns the database connection the background thread's own
+/// connection is cloned from. Code that reads any of the affected values from the database has to call flush() (or
+/// flushUser()) first.
+class ServerDBWriteBehind : public QThread {
+private:
+	Q_DISABLE_COPY(ServerDBWriteBehind)
+
+public:
+	/// @param connectionName The name of the database connection to write to. The background thread uses its own
+	///        connection with the same parameters.
+	/// @param driver The name of the database driver (as in the "dbDriver" setting)
+	/// @param prefix The prefix of all table names (as in the "dbPrefix" setting)
+	/// @param interval The time in milliseconds that updates may be held back for. If it is 0, no background thread is
+	///        used and all updates are written right away on the calling thread, using the given connection as it is.
+	///        If a transaction is active on it, the updates become part of that transaction.
+	ServerDBWriteBehind(const QString &connectionName, const QString &driver, const QString &prefix, int interval);
+	/// Writes everything that is still pending before stopping the background thread
+	~ServerDBWriteBehind() override;
+
+	void setLastChannel(int serverID, int userID, unsigned int channelID);
+	void setLastDisconnect(int serverID, int userID);
+	void enableChannelListener(int serverID, int userID, unsigned int channelID);
+	void disableChannelListener(int serverID, int userID, unsigned int channelID);
+	void deleteChannelListener(int serverID, int userID, unsigned int channelID);
+	void setChannelListenerVolume(int serverID, int userID, unsigned int channelID, float volumeAdjustment);
+	void log(int serverID, const QString &message);
+	/// Deletes the log entries (of all servers) that are older than the given amount of days
+	void expireLogs(int days);
+
+	/// Blocks until everything that has been collected so far has been written
+	void flush();
+	/// Blocks until everything concerning the given user has been written. Returns right away if there is nothing.
+	void flushUser(int serverID, int userID);
+
+protected:
+	void run() override;
+
+private:
+	/// The changes of a channel listener in the order they are applied in
+	struct ListenerUpdate {
+		enum State {
+			Unchanged,
+			Enable,
+			/// Only disables an existing listener
+			Disable,
+			/// Disables the listener, creating it if it doesn't exist (it has been enabled before being disabled)
+			CreateDisabled
+		};
+
+		bool deleteFirst = false;
+		State state      = Unchanged;
+		bool setVolume   = false;
+		float volume     = 1.0f;
+	};
+
+	struct UserUpdate {
+		bool setLastChannel      = false;
+		unsigned int lastChannel = 0;
+		bool setLastDisconnect   = false;
+		QHash< unsigned int, ListenerUpdate > listeners;
+	};
+
+	struct Batch {
+		QHash< QPair< int, int >, UserUpdate > users;
+		QList< QPair< int, QString > > logs;
+		int expireLogsDays = 0;
+
+		bool isEmpty() const { return users.isEmpty() && logs.isEmpty() && expireLogsDays <= 0; }
+	};
+
+	const QString m_connectionName;
+	const QString m_driver;
+	const QString m_prefix;
+	const int m_interval;
+
+	QMutex m_mutex;
+	/// Signalled when there are new updates or when the thread should stop
+	QWaitCondition m_wakeUp;
+	/// Signalled whenever a batch has been written
+	QWaitCondition m_written;
+	/// The updates that haven't been picked up by the background thread yet
+	Batch m_pending;
+	/// The updates that are being written by the background thread
+	Batch m_writing;
+	bool m_flushRequested = false;
+	bool m_stop           = false;
+
+	/// Returns the pending update for the given user (and schedules writing it)
+	/// @note Must be called with m_mutex locked
+	UserUpdate &pendingUpdate(int serverID, int userID);
+	/// To be called after each update with m_mutex unlocked
+	void updated();
+
+	void write(QSqlDatabase &db, const Batch &batch) const;
+	bool exec(QSqlQuery &query, const QString &statement, const QVariantList &values) const;
+};
+
+#endif
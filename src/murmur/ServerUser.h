@@ -12,13 +12,17 @@
 #	include "win.h"
 #endif
 
+#include "ACLCache.h"
+#include "BandwidthRecord.h"
 #include "ClientType.h"
 #include "Connection.h"
 #include "HostAddress.h"
 #include "Timer.h"
 #include "User.h"
+#include "WhisperTargetDependencies.h"
 
 #include <QtCore/QElapsedTimer>
+#include <QtCore/QPair>
 #include <QtCore/QStringList>
 
 #ifdef Q_OS_WIN
@@ -29,29 +33,6 @@
 
 #include <vector>
 
-// Unfortunately, this needs to be "large enough" to hold
-// enough frames to account for both short-term and
-// long-term "maladjustments".
-
-#define N_BANDWIDTH_SLOTS 360
-
-struct BandwidthRecord {
-	int iRecNum;
-	int iSum;
-	Timer tFirst;
-	Timer tIdleControl;
-	unsigned short a_iBW[N_BANDWIDTH_SLOTS];
-	Timer a_qtWhen[N_BANDWIDTH_SLOTS];
-	mutable QMutex qmMutex;
-
-	BandwidthRecord();
-	bool addFrame(int size, int maxpersec);
-	int onlineSeconds() const;
-	int idleSeconds() const;
-	void resetIdleSeconds();
-	int bandwidth() const;
-};
-
 struct WhisperTarget {
 	struct Channel {
 		unsigned int id;
@@ -70,6 +51,19 @@ struct WhisperTargetCache {
 	QSet< ServerUser * > channelTargets;
 	QSet< ServerUser * > directTargets;
 	QHash< ServerUser *, VolumeAdjustment > listeningTargets;
+	WhisperTargetDependencies dependencies;
+};
+
+/// The linked channels a user may speak to from the channel they are in (see Server::processMsg). It stays valid until
+/// the user changes channels, the channels linked to theirs change or their permissions change.
+struct LinkedChannelsCache {
+	unsigned int channelID = 0;
+	/// The version of the channel's component in Server::m_linkComponents
+	std::uint64_t linkVersion = 0;
+	/// The generation of Server::acCache the permissions have been checked in
+	std::uint64_t aclGeneration = 0;
+	/// The linked channels (not including the user's own channel) the user has Speak permission in
+	std::vector< Channel * > channels;
 };
 
 class Server;
@@ -147,8 +141,19 @@ public:
 
 	QStringList qslAccessTokens;
 
+	/// Whether the user's password is being checked on another thread (see Server::m_authenticationPool). Messages
+	/// that are received in the meantime are queued in qlPendingMessages and processed once the check is done.
+	bool bAuthenticationPending;
+	QList< QPair< Mumble::Protocol::TCPMessageType, QByteArray > > qlPendingMessages;
+	/// Clients that send more messages than this while authenticating are disconnected
+	constexpr static const int MAX_PENDING_MESSAGES = 64;
+
+	/// The permissions of this user as cached by Server::acCache
+	ACLCache::UserCache m_aclCache;
+
 	QMap< int, WhisperTarget > qmTargets;
 	QMap< int, WhisperTargetCache > qmTargetCache;
+	LinkedChannelsCache m_linkedChannelsCache;
 	QMap< QString, QString > qmWhisperRedirect;
 
 	LeakyBucket leakyBucket;
@@ -0,0 +1,175 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "UDPBatch.h"
+#include "HostAddress.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// Each slot holds a single datagram. The data pointer handed out for a slot is 4 bytes past an 8 byte boundary, so
+// that the encrypted payload following the 4 byte crypt header is 8 byte aligned.
+constexpr static const std::size_t SLOT_SIZE   = Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8;
+constexpr static const std::size_t SLOT_OFFSET = 4;
+constexpr static const std::size_t CONTROL_SIZE =
+	CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)));
+
+static_assert(SLOT_SIZE % 8 == 0, "Slots must preserve the alignment of the buffer");
+static_assert(SLOT_SIZE - SLOT_OFFSET >= UDPSendBatch::MAX_DATAGRAM_SIZE, "Slots are too small");
+
+UDPReceiveBatch::UDPReceiveBatch()
+	: m_headers(BATCH_SIZE), m_iovecs(BATCH_SIZE), m_addresses(BATCH_SIZE), m_controlData(BATCH_SIZE * CONTROL_SIZE),
+	  m_buffer(BATCH_SIZE * SLOT_SIZE) {
+	memset(m_headers.data(), 0, m_headers.size() * sizeof(mmsghdr));
+
+	for (std::size_t i = 0; i < BATCH_SIZE; ++i) {
+		m_iovecs[i].iov_base = &m_buffer[i * SLOT_SIZE + SLOT_OFFSET];
+
+		m_headers[i].msg_hdr.msg_name    = &m_addresses[i];
+		m_headers[i].msg_hdr.msg_iov     = &m_iovecs[i];
+		m_headers[i].msg_hdr.msg_iovlen  = 1;
+		m_headers[i].msg_hdr.msg_control = &m_controlData[i * CONTROL_SIZE];
+	}
+}
+
+std::size_t UDPReceiveBatch::receive(int socket) {
+	// The kernel (and answered pings) modify these fields, so they have to be reset before every call
+	for (std::size_t i = 0; i < BATCH_SIZE; ++i) {
+		m_iovecs[i].iov_base = &m_buffer[i * SLOT_SIZE + SLOT_OFFSET];
+		m_iovecs[i].iov_len  = Mumble::Protocol::MAX_UDP_PACKET_SIZE;
+
+		m_headers[i].msg_hdr.msg_namelen    = sizeof(sockaddr_storage);
+		m_headers[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+		m_headers[i].msg_hdr.msg_flags      = 0;
+		m_headers[i].msg_len                = 0;
+	}
+
+	int received = ::recvmmsg(socket, m_headers.data(), static_cast< unsigned int >(BATCH_SIZE),
+							  MSG_DONTWAIT | MSG_TRUNC, nullptr);
+
+	return received > 0 ? static_cast< std::size_t >(received) : 0;
+}
+
+unsigned char *UDPReceiveBatch::getData(std::size_t index) {
+	return &m_buffer[index * SLOT_SIZE + SLOT_OFFSET];
+}
+
+std::size_t UDPReceiveBatch::getLength(std::size_t index) const {
+	return m_headers[index].msg_len;
+}
+
+sockaddr_storage &UDPReceiveBatch::getAddress(std::size_t index) {
+	return m_addresses[index];
+}
+
+msghdr &UDPReceiveBatch::getHeader(std::size_t index) {
+	return m_headers[index].msg_hdr;
+}
+
+
+UDPSendBatch::UDPSendBatch()
+	: m_headers(BATCH_SIZE), m_iovecs(BATCH_SIZE), m_addresses(BATCH_SIZE), m_controlData(BATCH_SIZE * CONTROL_SIZE),
+	  m_buffer(BATCH_SIZE * SLOT_SIZE), m_sockets(BATCH_SIZE) {
+	memset(m_headers.data(), 0, m_headers.size() * sizeof(mmsghdr));
+
+	for (std::size_t i = 0; i < BATCH_SIZE; ++i) {
+		m_iovecs[i].iov_base = &m_buffer[i * SLOT_SIZE + SLOT_OFFSET];
+
+		m_headers[i].msg_hdr.msg_name    = &m_addresses[i];
+		m_headers[i].msg_hdr.msg_iov     = &m_iovecs[i];
+		m_headers[i].msg_hdr.msg_iovlen  = 1;
+		m_headers[i].msg_hdr.msg_control = &m_controlData[i * CONTROL_SIZE];
+	}
+}
+
+unsigned char *UDPSendBatch::getBuffer(std::size_t offset) {
+	assert(offset < available());
+
+	return &m_buffer[(m_size + offset) * SLOT_SIZE + SLOT_OFFSET];
+}
+
+bool UDPSendBatch::commit(int socket, const sockaddr_storage &destination, const HostAddress &source,
+						  std::size_t length) {
+	msghdr &msg = m_headers[m_size].msg_hdr;
+
+	memcpy(&m_addresses[m_size], &destination, sizeof(sockaddr_storage));
+	msg.msg_namelen = static_cast< socklen_t >((destination.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6)
+																				   : sizeof(struct sockaddr_in));
+
+	m_iovecs[m_size].iov_len = std::min(length, MAX_DATAGRAM_SIZE);
+
+	unsigned char *controlData = &m_controlData[m_size * CONTROL_SIZE];
+	memset(controlData, 0, CONTROL_SIZE);
+	msg.msg_controllen = CMSG_SPACE((destination.ss_family == AF_INET6) ? sizeof(struct in6_pktinfo)
+																		: sizeof(struct in_pktinfo));
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (destination.ss_family == AF_INET6) {
+		cmsg->cmsg_level            = IPPROTO_IPV6;
+		cmsg->cmsg_type             = IPV6_PKTINFO;
+		cmsg->cmsg_len              = CMSG_LEN(sizeof(struct in6_pktinfo));
+		struct in6_pktinfo *pktinfo = reinterpret_cast< struct in6_pktinfo * >(CMSG_DATA(cmsg));
+		memcpy(&pktinfo->ipi6_addr.s6_addr[0], source.getByteRepresentation().data(),
+			   sizeof(pktinfo->ipi6_addr.s6_addr));
+	} else {
+		if (source.isV6()) {
+			return false;
+		}
+
+		cmsg->cmsg_level             = IPPROTO_IP;
+		cmsg->cmsg_type              = IP_PKTINFO;
+		cmsg->cmsg_len               = CMSG_LEN(sizeof(struct in_pktinfo));
+		struct in_pktinfo *pktinfo   = reinterpret_cast< struct in_pktinfo * >(CMSG_DATA(cmsg));
+		pktinfo->ipi_spec_dst.s_addr = source.toIPv4();
+	}
+
+	m_sockets[m_size] = socket;
+	++m_size;
+
+	if (m_size == BATCH_SIZE) {
+		flush();
+	}
+
+	return true;
+}
+
+std::size_t UDPSendBatch::flush() {
+	std::size_t calls = 0;
+	std::size_t start = 0;
+
+	while (start < m_size) {
+		// Find the run of datagrams that are to be sent on the same socket
+		std::size_t end = start + 1;
+		while (end < m_size && m_sockets[end] == m_sockets[start]) {
+			++end;
+		}
+
+		while (start < end) {
+			int sent = ::sendmmsg(m_sockets[start], &m_headers[start], static_cast< unsigned int >(end - start), 0);
+			++calls;
+
+			if (sent <= 0) {
+				// The datagram at the front could not be sent. Same as with a single sendmsg, we simply drop it and
+				// carry on with the remaining ones.
+				sent = 1;
+			}
+
+			start += static_cast< std::size_t >(sent);
+		}
+	}
+
+	m_size = 0;
+
+	return calls;
+}
+
+std::size_t UDPSendBatch::size() const {
+	return m_size;
+}
+
+std::size_t UDPSendBatch::available() const {
+	return BATCH_SIZE - m_size;
+}
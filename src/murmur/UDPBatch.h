@@ -0,0 +1,112 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_UDPBATCH_H_
+#define MUMBLE_MURMUR_UDPBATCH_H_
+
+// The classes in this file make use of recvmmsg and sendmmsg and are therefore only available on Linux.
+
+#include "MumbleProtocol.h"
+
+#include <cstddef>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+struct HostAddress;
+
+/// Receives multiple datagrams from a UDP socket using a single recvmmsg call.
+///
+/// The payload buffers are laid out such that the data following the 4 byte crypt header
+/// is 8 byte aligned (the same as the receive buffer in Server::run used to be).
+class UDPReceiveBatch {
+public:
+	/// The maximum amount of datagrams read from the socket at once
+	constexpr static const std::size_t BATCH_SIZE = 32;
+
+	UDPReceiveBatch();
+	// The headers point into the buffers of this object, so it can't be copied
+	UDPReceiveBatch(const UDPReceiveBatch &) = delete;
+	UDPReceiveBatch &operator=(const UDPReceiveBatch &) = delete;
+
+	/// Reads all datagrams (up to BATCH_SIZE) that are currently queued on the given socket. This never blocks.
+	///
+	/// @returns The amount of received datagrams. 0 if there were none or in case of an error.
+	std::size_t receive(int socket);
+
+	/// @returns The payload of the datagram at the given index
+	unsigned char *getData(std::size_t index);
+	/// @returns The length of the datagram at the given index. Truncated datagrams report their full length, which
+	/// 	exceeds the buffer size.
+	std::size_t getLength(std::size_t index) const;
+	/// @returns The address the datagram at the given index was sent from
+	sockaddr_storage &getAddress(std::size_t index);
+	/// @returns The message header the datagram at the given index was received with. This contains the sender's
+	/// 	address as well as the local address the datagram was received on and thus can be used to send an answer
+	/// 	after adjusting msg_iov.
+	msghdr &getHeader(std::size_t index);
+
+protected:
+	std::vector< mmsghdr > m_headers;
+	std::vector< iovec > m_iovecs;
+	std::vector< sockaddr_storage > m_addresses;
+	std::vector< unsigned char > m_controlData;
+	std::vector< unsigned char > m_buffer;
+};
+
+/// Collects outgoing datagrams and sends them using as few sendmmsg calls as possible.
+///
+/// Every datagram carries its own destination and source address, so datagrams for different users
+/// can be batched together. Datagrams are grouped into one sendmmsg call per consecutive run of
+/// datagrams using the same socket.
+class UDPSendBatch {
+public:
+	/// The maximum amount of datagrams queued before the batch is flushed automatically
+	constexpr static const std::size_t BATCH_SIZE = 64;
+	/// The maximum size of a single queued datagram (an encrypted packet)
+	constexpr static const std::size_t MAX_DATAGRAM_SIZE = Mumble::Protocol::MAX_UDP_PACKET_SIZE + 4;
+
+	UDPSendBatch();
+	UDPSendBatch(const UDPSendBatch &) = delete;
+	UDPSendBatch &operator=(const UDPSendBatch &) = delete;
+
+	/// @param offset Allows to get the buffers of the datagrams following the next one, so that multiple datagrams
+	/// 	can be prepared at once. Must be less than available().
+	/// @returns A buffer of MAX_DATAGRAM_SIZE bytes that the next datagram can be written to. The pointer
+	/// 	is offset by 4 bytes from an 8 byte boundary (see UDPReceiveBatch).
+	unsigned char *getBuffer(std::size_t offset = 0);
+
+	/// Queues the datagram that has been written to getBuffer(). If the batch is full afterwards, it is flushed.
+	///
+	/// @param socket The socket to send the datagram on
+	/// @param destination The address to send the datagram to
+	/// @param source The local address the datagram should originate from
+	/// @param length The length of the datagram
+	/// @returns Whether the datagram has been queued. This fails if the source address is not usable
+	/// 	for the destination's address family.
+	bool commit(int socket, const sockaddr_storage &destination, const HostAddress &source, std::size_t length);
+
+	/// Sends all queued datagrams
+	///
+	/// @returns The amount of sendmmsg calls that were necessary
+	std::size_t flush();
+
+	/// @returns The amount of currently queued datagrams
+	std::size_t size() const;
+	/// @returns The amount of datagrams that can still be queued before the batch is flushed
+	std::size_t available() const;
+
+protected:
+	std::vector< mmsghdr > m_headers;
+	std::vector< iovec > m_iovecs;
+	std::vector< sockaddr_storage > m_addresses;
+	std::vector< unsigned char > m_controlData;
+	std::vector< unsigned char > m_buffer;
+	std::vector< int > m_sockets;
+	std::size_t m_size = 0;
+};
+
+#endif // MUMBLE_MURMUR_UDPBATCH_H_
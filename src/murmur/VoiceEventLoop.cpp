@@ -0,0 +1,476 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "VoiceEventLoop.h"
+#include "UDPBatch.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#ifdef USE_IO_URING
+#	include <liburing.h>
+#endif
+
+static void drainNotifySocket(int socket) {
+	unsigned char val;
+	while (::recv(socket, &val, 1, MSG_DONTWAIT) == 1) {
+	}
+}
+
+/// Base class for the backends that wait for the sockets to become readable and then read the datagrams using
+/// recvmmsg.
+class ReadinessEventLoop : public VoiceEventLoop {
+public:
+	ReadinessEventLoop(const std::vector< int > &sockets, int notifySocket)
+		: m_sockets(sockets), m_notifySocket(notifySocket) {
+		for (std::size_t i = 0; i < m_sockets.size(); ++i) {
+			m_batches.push_back(std::make_unique< UDPReceiveBatch >());
+		}
+	}
+
+protected:
+	std::vector< int > m_sockets;
+	int m_notifySocket;
+	std::vector< std::unique_ptr< UDPReceiveBatch > > m_batches;
+
+	/// Reads all queued datagrams from the socket at the given index
+	void receive(std::size_t index) {
+		UDPReceiveBatch &batch = *m_batches[index];
+
+		const std::size_t count = batch.receive(m_sockets[index]);
+		for (std::size_t i = 0; i < count; ++i) {
+			m_datagrams.push_back({ m_sockets[index], batch.getData(i), batch.getLength(i), &batch.getAddress(i),
+									&batch.getHeader(i) });
+		}
+	}
+};
+
+class PollEventLoop : public ReadinessEventLoop {
+public:
+	PollEventLoop(const std::vector< int > &sockets, int notifySocket) : ReadinessEventLoop(sockets, notifySocket) {
+		m_fds.resize(m_sockets.size() + 1);
+
+		for (std::size_t i = 0; i < m_sockets.size(); ++i) {
+			m_fds[i].fd     = m_sockets[i];
+			m_fds[i].events = POLLIN;
+		}
+
+		m_fds.back().fd     = m_notifySocket;
+		m_fds.back().events = POLLIN;
+	}
+
+	Status wait() override {
+		m_datagrams.clear();
+
+		while (m_datagrams.empty()) {
+			for (pollfd &fd : m_fds) {
+				fd.revents = 0;
+			}
+
+			if (poll(m_fds.data(), static_cast< nfds_t >(m_fds.size()), -1) <= 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return Status::Failed;
+			}
+
+			if (m_fds.back().revents) {
+				drainNotifySocket(m_notifySocket);
+				return Status::Notified;
+			}
+
+			for (std::size_t i = 0; i < m_sockets.size(); ++i) {
+				if (m_fds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+					return Status::Failed;
+				}
+
+				if (m_fds[i].revents) {
+					receive(i);
+				}
+			}
+		}
+
+		return Status::Ready;
+	}
+
+	Backend getBackend() const override { return Backend::Poll; }
+
+protected:
+	std::vector< pollfd > m_fds;
+};
+
+class EpollEventLoop : public ReadinessEventLoop {
+public:
+	EpollEventLoop(const std::vector< int > &sockets, int notifySocket) : ReadinessEventLoop(sockets, notifySocket) {
+		m_epoll = epoll_create1(EPOLL_CLOEXEC);
+		m_events.resize(m_sockets.size() + 1);
+	}
+
+	~EpollEventLoop() override {
+		if (m_epoll != -1) {
+			::close(m_epoll);
+		}
+	}
+
+	/// Registers all sockets with the epoll instance
+	bool init() {
+		if (m_epoll == -1) {
+			return false;
+		}
+
+		// The index of the socket is stored as the event data. The notify socket uses the index past the last socket.
+		for (std::size_t i = 0; i <= m_sockets.size(); ++i) {
+			epoll_event event;
+			memset(&event, 0, sizeof(event));
+			event.events   = EPOLLIN;
+			event.data.u64 = i;
+
+			const int fd = (i < m_sockets.size()) ? m_sockets[i] : m_notifySocket;
+			if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	Status wait() override {
+		m_datagrams.clear();
+
+		while (m_datagrams.empty()) {
+			const int count = epoll_wait(m_epoll, m_events.data(), static_cast< int >(m_events.size()), -1);
+			if (count <= 0) {
+				if (count == 0 || errno == EINTR) {
+					continue;
+				}
+				return Status::Failed;
+			}
+
+			for (int i = 0; i < count; ++i) {
+				const std::size_t index = static_cast< std::size_t >(m_events[static_cast< std::size_t >(i)].data.u64);
+
+				if (index == m_sockets.size()) {
+					drainNotifySocket(m_notifySocket);
+					return Status::Notified;
+				}
+
+				if (m_events[static_cast< std::size_t >(i)].events & (EPOLLHUP | EPOLLERR)) {
+					return Status::Failed;
+				}
+
+				receive(index);
+			}
+		}
+
+		return Status::Ready;
+	}
+
+	Backend getBackend() const override { return Backend::Epoll; }
+
+protected:
+	int m_epoll;
+	std::vector< epoll_event > m_events;
+};
+
+#ifdef USE_IO_URING
+class IoUringEventLoop : public VoiceEventLoop {
+public:
+	/// The amount of provided buffers (has to be a power of two). If they are all in use, the datagrams remain queued
+	/// on the socket until the next call to wait().
+	constexpr static const unsigned int BUFFER_COUNT = 256;
+	constexpr static const int BUFFER_GROUP          = 0;
+	constexpr static const std::size_t CONTROL_SIZE =
+		CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)));
+	/// Every buffer holds the io_uring_recvmsg_out header, followed by the sender's address, the control data
+	/// and finally the payload.
+	constexpr static const std::size_t BUFFER_SIZE = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_storage)
+													 + CONTROL_SIZE + Mumble::Protocol::MAX_UDP_PACKET_SIZE;
+	/// The buffers are placed such that the payload ends up 4 bytes past an 8 byte boundary
+	constexpr static const std::size_t BUFFER_OFFSET =
+		(4 + 8 - (sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_storage) + CONTROL_SIZE) % 8) % 8;
+	constexpr static const std::size_t SLOT_SIZE = (BUFFER_SIZE + BUFFER_OFFSET + 7) / 8 * 8;
+	/// The user data of the completion for the notify socket. Completions for the sockets use their index.
+	constexpr static const __u64 NOTIFY_DATA = ~static_cast< __u64 >(0);
+
+	IoUringEventLoop(const std::vector< int > &sockets, int notifySocket)
+		: m_sockets(sockets), m_notifySocket(notifySocket), m_buffer(BUFFER_COUNT * SLOT_SIZE),
+		  m_addresses(BUFFER_COUNT), m_controlData(BUFFER_COUNT * CONTROL_SIZE), m_headers(BUFFER_COUNT),
+		  m_iovecs(BUFFER_COUNT) {
+		memset(&m_ring, 0, sizeof(m_ring));
+		memset(&m_template, 0, sizeof(m_template));
+		m_template.msg_namelen    = sizeof(sockaddr_storage);
+		m_template.msg_controllen = CONTROL_SIZE;
+
+		m_usedBuffers.reserve(BUFFER_COUNT);
+	}
+
+	~IoUringEventLoop() override {
+		if (m_bufferRing) {
+			io_uring_free_buf_ring(&m_ring, m_bufferRing, BUFFER_COUNT, BUFFER_GROUP);
+		}
+		if (m_initialized) {
+			io_uring_queue_exit(&m_ring);
+		}
+	}
+
+	/// Sets up the ring and the provided buffers and arms the receive requests
+	bool init() {
+		// Every datagram results in a completion, so the completion queue is made large enough to hold one for
+		// every buffer
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		params.flags      = IORING_SETUP_CQSIZE;
+		params.cq_entries = BUFFER_COUNT;
+
+		if (io_uring_queue_init_params(static_cast< unsigned int >(m_sockets.size() + 1), &m_ring, &params) != 0) {
+			return false;
+		}
+		m_initialized = true;
+
+		int ret      = 0;
+		m_bufferRing = io_uring_setup_buf_ring(&m_ring, BUFFER_COUNT, BUFFER_GROUP, 0, &ret);
+		if (!m_bufferRing) {
+			return false;
+		}
+
+		for (unsigned short i = 0; i < BUFFER_COUNT; ++i) {
+			m_usedBuffers.push_back(i);
+		}
+		recycleBuffers();
+
+		for (std::size_t i = 0; i < m_sockets.size(); ++i) {
+			if (!armReceive(i)) {
+				return false;
+			}
+		}
+
+		io_uring_sqe *sqe = io_uring_get_sqe(&m_ring);
+		if (!sqe) {
+			return false;
+		}
+		io_uring_prep_poll_add(sqe, m_notifySocket, POLLIN);
+		io_uring_sqe_set_data64(sqe, NOTIFY_DATA);
+
+		return io_uring_submit(&m_ring) >= 0;
+	}
+
+	Status wait() override {
+		m_datagrams.clear();
+
+		while (m_datagrams.empty()) {
+			// None of the buffers is referenced by a datagram at this point
+			recycleBuffers();
+
+			// This also submits the receive requests that had to be re-armed
+			int ret = io_uring_submit_and_wait(&m_ring, 1);
+			if (ret < 0) {
+				if (ret == -EINTR) {
+					continue;
+				}
+				return Status::Failed;
+			}
+
+			bool notified = false;
+			bool failed   = false;
+
+			unsigned int head;
+			unsigned int count = 0;
+			io_uring_cqe *cqe;
+			io_uring_for_each_cqe(&m_ring, head, cqe) {
+				++count;
+
+				if (io_uring_cqe_get_data64(cqe) == NOTIFY_DATA) {
+					notified = true;
+					continue;
+				}
+
+				const std::size_t index = static_cast< std::size_t >(io_uring_cqe_get_data64(cqe));
+
+				if (cqe->flags & IORING_CQE_F_BUFFER) {
+					const unsigned short bufferID =
+						static_cast< unsigned short >(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+
+					if (cqe->res > 0) {
+						addDatagram(index, bufferID, static_cast< unsigned int >(cqe->res));
+					} else {
+						m_usedBuffers.push_back(bufferID);
+					}
+				}
+
+				if (!(cqe->flags & IORING_CQE_F_MORE)) {
+					// The multishot request has been terminated (e.g. because we ran out of buffers) and has to be
+					// re-armed. Errors other than running out of buffers are treated the same as poll errors.
+					if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+						failed = true;
+					} else if (!armReceive(index)) {
+						failed = true;
+					}
+				}
+			}
+			io_uring_cq_advance(&m_ring, count);
+
+			if (notified) {
+				drainNotifySocket(m_notifySocket);
+				return Status::Notified;
+			}
+			if (failed) {
+				return Status::Failed;
+			}
+		}
+
+		return Status::Ready;
+	}
+
+	Backend getBackend() const override { return Backend::IoUring; }
+
+protected:
+	std::vector< int > m_sockets;
+	int m_notifySocket;
+
+	io_uring m_ring;
+	bool m_initialized             = false;
+	io_uring_buf_ring *m_bufferRing = nullptr;
+	msghdr m_template;
+
+	std::vector< unsigned char > m_buffer;
+	/// The buffers that have been handed out by the kernel and have to be given back
+	std::vector< unsigned short > m_usedBuffers;
+
+	// The storage backing the ReceivedDatagrams. The index into these is the ID of the buffer the datagram is in.
+	std::vector< sockaddr_storage > m_addresses;
+	std::vector< unsigned char > m_controlData;
+	std::vector< msghdr > m_headers;
+	std::vector< iovec > m_iovecs;
+
+	unsigned char *getSlot(unsigned short bufferID) { return &m_buffer[bufferID * SLOT_SIZE + BUFFER_OFFSET]; }
+
+	/// Hands the buffers of the previous call to wait() back to the kernel
+	void recycleBuffers() {
+		if (m_usedBuffers.empty()) {
+			return;
+		}
+
+		const int mask = io_uring_buf_ring_mask(BUFFER_COUNT);
+		for (std::size_t i = 0; i < m_usedBuffers.size(); ++i) {
+			io_uring_buf_ring_add(m_bufferRing, getSlot(m_usedBuffers[i]), static_cast< unsigned int >(BUFFER_SIZE),
+								  m_usedBuffers[i], mask, static_cast< int >(i));
+		}
+		io_uring_buf_ring_advance(m_bufferRing, static_cast< int >(m_usedBuffers.size()));
+
+		m_usedBuffers.clear();
+	}
+
+	bool armReceive(std::size_t index) {
+		io_uring_sqe *sqe = io_uring_get_sqe(&m_ring);
+		if (!sqe) {
+			return false;
+		}
+
+		io_uring_prep_recvmsg_multishot(sqe, m_sockets[index], &m_template, MSG_TRUNC);
+		sqe->flags |= IOSQE_BUFFER_SELECT;
+		sqe->buf_group = BUFFER_GROUP;
+		io_uring_sqe_set_data64(sqe, index);
+
+		return true;
+	}
+
+	void addDatagram(std::size_t index, unsigned short bufferID, unsigned int length) {
+		m_usedBuffers.push_back(bufferID);
+
+		io_uring_recvmsg_out *out =
+			io_uring_recvmsg_validate(getSlot(bufferID), static_cast< int >(length), &m_template);
+		if (!out) {
+			return;
+		}
+
+		// Copy the address and control data out of the buffer, such that they are properly aligned and can be used
+		// to answer the datagram
+		sockaddr_storage &from = m_addresses[bufferID];
+		memset(&from, 0, sizeof(from));
+		memcpy(&from, io_uring_recvmsg_name(out), std::min< std::size_t >(out->namelen, sizeof(from)));
+
+		unsigned char *controlData = &m_controlData[bufferID * CONTROL_SIZE];
+		const std::size_t controlLength = std::min< std::size_t >(out->controllen, CONTROL_SIZE);
+		memcpy(controlData, reinterpret_cast< unsigned char * >(io_uring_recvmsg_name(out)) + m_template.msg_namelen,
+			   controlLength);
+
+		msghdr &header = m_headers[bufferID];
+		memset(&header, 0, sizeof(header));
+		header.msg_name       = &from;
+		header.msg_namelen    = std::min< socklen_t >(out->namelen, sizeof(from));
+		header.msg_iov        = &m_iovecs[bufferID];
+		header.msg_iovlen     = 1;
+		header.msg_control    = controlData;
+		header.msg_controllen = controlLength;
+
+		unsigned char *payload = reinterpret_cast< unsigned char * >(io_uring_recvmsg_payload(out, &m_template));
+		m_iovecs[bufferID].iov_base = payload;
+		m_iovecs[bufferID].iov_len  = io_uring_recvmsg_payload_length(out, static_cast< int >(length), &m_template);
+
+		// payloadlen is the full length of the datagram, even if it has been truncated
+		m_datagrams.push_back({ m_sockets[index], payload, out->payloadlen, &from, &header });
+	}
+};
+#endif
+
+std::unique_ptr< VoiceEventLoop > VoiceEventLoop::create(Backend backend, const std::vector< int > &sockets,
+														 int notifySocket) {
+	switch (backend) {
+		case Backend::Poll:
+			return std::make_unique< PollEventLoop >(sockets, notifySocket);
+		case Backend::Epoll: {
+			std::unique_ptr< EpollEventLoop > loop = std::make_unique< EpollEventLoop >(sockets, notifySocket);
+			if (loop->init()) {
+				return loop;
+			}
+			break;
+		}
+		case Backend::IoUring: {
+#ifdef USE_IO_URING
+			std::unique_ptr< IoUringEventLoop > loop = std::make_unique< IoUringEventLoop >(sockets, notifySocket);
+			if (loop->init()) {
+				return loop;
+			}
+#endif
+			break;
+		}
+	}
+
+	return nullptr;
+}
+
+const std::vector< ReceivedDatagram > &VoiceEventLoop::getDatagrams() const {
+	return m_datagrams;
+}
+
+const char *VoiceEventLoop::toString(Backend backend) {
+	switch (backend) {
+		case Backend::Poll:
+			return "poll";
+		case Backend::Epoll:
+			return "epoll";
+		case Backend::IoUring:
+			return "io_uring";
+	}
+
+	return "unknown";
+}
+
+bool VoiceEventLoop::fromString(const std::string &name, Backend &backend) {
+	for (Backend current : { Backend::Poll, Backend::Epoll, Backend::IoUring }) {
+		if (name == toString(current)) {
+			backend = current;
+			return true;
+		}
+	}
+
+	return false;
+}
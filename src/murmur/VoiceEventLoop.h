@@ -0,0 +1,78 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_VOICEEVENTLOOP_H_
+#define MUMBLE_MURMUR_VOICEEVENTLOOP_H_
+
+// The event loops in this file are only available on Linux.
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+/// A datagram that has been received by a VoiceEventLoop
+struct ReceivedDatagram {
+	/// The socket the datagram has been received on
+	int socket;
+	/// The payload of the datagram. The pointer is 4 bytes past an 8 byte boundary.
+	unsigned char *data;
+	/// The length of the datagram. Truncated datagrams report their full length.
+	std::size_t length;
+	/// The address the datagram has been sent from
+	sockaddr_storage *from;
+	/// The header that contains the sender's address as well as the local address the datagram has been received
+	/// on. It can be used to send an answer after adjusting msg_iov.
+	msghdr *header;
+};
+
+/// Waits for and reads the datagrams arriving on the UDP sockets of a voice worker.
+///
+/// The different backends only differ in how they wait for and obtain the datagrams:
+/// - Poll: poll() over all sockets, followed by a recvmmsg per readable socket
+/// - Epoll: the same as Poll, but the set of sockets is only registered once
+/// - IoUring: a multishot recvmsg per socket that places the datagrams into a ring of provided
+///   buffers, so that no syscall per datagram (or per socket) is necessary. Only available if the
+///   server has been built with liburing.
+class VoiceEventLoop {
+public:
+	enum class Backend { Poll, Epoll, IoUring };
+	enum class Status { Ready, Notified, Failed };
+
+	virtual ~VoiceEventLoop() = default;
+
+	/// Creates an event loop for the given sockets using the given backend.
+	///
+	/// @param backend The backend to use
+	/// @param sockets The UDP sockets to receive datagrams from
+	/// @param notifySocket A socket that is used to wake up the loop. Everything written to it will be discarded.
+	/// @returns The created event loop or nullptr if the given backend isn't supported by this build or by the
+	/// 	running kernel
+	static std::unique_ptr< VoiceEventLoop > create(Backend backend, const std::vector< int > &sockets,
+													int notifySocket);
+
+	/// Blocks until datagrams have been received or the notify socket has been written to. This invalidates
+	/// the datagrams that have been received by the previous call.
+	///
+	/// @returns Status::Ready if datagrams have been received, Status::Notified if the notify socket has been
+	/// 	written to and Status::Failed if the sockets can't be waited on anymore
+	virtual Status wait() = 0;
+
+	/// @returns The datagrams that have been received by the last call to wait()
+	const std::vector< ReceivedDatagram > &getDatagrams() const;
+
+	virtual Backend getBackend() const = 0;
+
+	static const char *toString(Backend backend);
+	/// @returns Whether the given name (as used in the server's configuration) refers to a backend
+	static bool fromString(const std::string &name, Backend &backend);
+
+protected:
+	std::vector< ReceivedDatagram > m_datagrams;
+};
+
+#endif // MUMBLE_MURMUR_VOICEEVENTLOOP_H_
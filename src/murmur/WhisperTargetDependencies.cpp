@@ -0,0 +1,11 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "WhisperTargetDependencies.h"
+
+bool WhisperTargetDependencies::dependsOn(const QSet< unsigned int > &changedChannels,
+										  const QSet< unsigned int > &changedSessions) const {
+	return channels.intersects(changedChannels) || sessions.intersects(changedSessions);
+}
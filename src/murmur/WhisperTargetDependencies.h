@@ -0,0 +1,26 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_WHISPERTARGETDEPENDENCIES_H_
+#define MUMBLE_MURMUR_WHISPERTARGETDEPENDENCIES_H_
+
+#include <QtCore/QSet>
+
+/// What a cached whisper target (see WhisperTargetCache) has been determined from, so that the server only has to
+/// rebuild the cached targets that are actually affected by a change (instead of all of them).
+struct WhisperTargetDependencies {
+	/// The channels whose users and listeners have been considered, i.e. the target channels including their linked
+	/// channels and subchannels (if requested)
+	QSet< unsigned int > channels;
+	/// The sessions of the users that have been targeted directly or that receive the audio
+	QSet< unsigned int > sessions;
+
+	/// @param changedChannels The channels that users have entered or left or started or stopped listening to
+	/// @param changedSessions The users whose channel, listeners, groups or permissions have changed
+	/// @returns Whether the cached target might be affected by the given changes
+	bool dependsOn(const QSet< unsigned int > &changedChannels, const QSet< unsigned int > &changedSessions) const;
+};
+
+#endif
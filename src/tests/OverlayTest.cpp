@@ -37,6 +37,12 @@ protected:
 	unsigned int iFrameCount;
 	int iLastFpsUpdate;
 
+	/// The amount of renders of the client (batches of blits that arrive at once), of blits and of bytes copied out of
+	/// the shared memory since the last FPS update, to measure how much of the image the client touches per render
+	quint64 iRenderCount;
+	quint64 iBlitCount;
+	quint64 iBlitBytes;
+
 	unsigned int uiWidth, uiHeight;
 
 	void resizeEvent(QResizeEvent *);
@@ -112,6 +118,9 @@ void OverlayWidget::init(const QSize &sz) {
 	qtWall.start();
 	iFrameCount    = 0;
 	iLastFpsUpdate = 0;
+	iRenderCount   = 0;
+	iBlitCount     = 0;
+	iBlitBytes     = 0;
 
 	OverlayMsg m;
 	m.omh.uiMagic  = OVERLAY_MAGIC_NUMBER;
@@ -187,8 +196,17 @@ void OverlayWidget::update() {
 			qlsSocket->write(reinterpret_cast< char * >(&om), sizeof(OverlayMsgHeader) + om.omh.iLength);
 		}
 
+		if (iRenderCount > 0) {
+			qWarning() << "RENDERS" << iRenderCount << "BLITS/RENDER"
+					   << static_cast< double >(iBlitCount) / static_cast< double >(iRenderCount) << "BYTES/RENDER"
+					   << static_cast< double >(iBlitBytes) / static_cast< double >(iRenderCount);
+		}
+
 		iFrameCount    = 0;
 		iLastFpsUpdate = 0;
+		iRenderCount   = 0;
+		iBlitCount     = 0;
+		iBlitBytes     = 0;
 		qtWall.start();
 	}
 
@@ -200,6 +218,8 @@ void OverlayWidget::readyRead() {
 	if (qls != qlsSocket)
 		return;
 
+	bool blitted = false;
+
 	while (true) {
 		int ready = qlsSocket->bytesAvailable();
 
@@ -263,7 +283,12 @@ void OverlayWidget::readyRead() {
 						memcpy(dst, src, omb->w * 4);
 					}
 
-					update();
+					++iBlitCount;
+					iBlitBytes += static_cast< quint64 >(omb->w) * omb->h * 4;
+					blitted = true;
+
+					// Only repaint, the frames are counted by the timer
+					QWidget::update();
 				} break;
 				case OVERLAY_MSGTYPE_ACTIVE: {
 					OverlayMsgActive *oma = &om.oma;
@@ -271,7 +296,7 @@ void OverlayWidget::readyRead() {
 					qWarning() << "ACTIVE" << oma->x << oma->y << oma->w << oma->h;
 
 					qrActive = QRect(oma->x, oma->y, oma->w, oma->h);
-					update();
+					QWidget::update();
 				}; break;
 				default:
 					break;
@@ -282,6 +307,11 @@ void OverlayWidget::readyRead() {
 			break;
 		}
 	}
+
+	// The client writes all blits of a render at once
+	if (blitted) {
+		++iRenderCount;
+	}
 }
 
 class TestWin : public QObject {
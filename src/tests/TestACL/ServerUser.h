@@ -0,0 +1,19 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+
+// NOTE: This is merely a mock of the ServerUser class
+
+#include "ACLCache.h"
+#include "User.h"
+
+#include <QtCore/QStringList>
+
+class ServerUser : public User {
+public:
+	QStringList qslAccessTokens;
+	bool bVerified = true;
+	ACLCache::UserCache m_aclCache;
+};
@@ -0,0 +1,250 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ACL.h"
+#include "ACLCache.h"
+#include "Channel.h"
+#include "Group.h"
+#include "ServerUser.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+// Group specifications that are used for random ACLs. They cover all the ways a specification may depend on the
+// channel the permissions are evaluated for.
+static const char *GROUP_SPECIFICATIONS[] = { "admin",   "~admin", "!admin", "mod",        "~mod",       "all",
+											  "auth",    "strong", "in",     "out",        "~in",        "!~out",
+											  "sub",     "sub,1",  "~sub",   "sub,-1,1,2", "~sub,1,1,1", "#token",
+											  "!#token", "$hash",  "none",   "" };
+
+/// Evaluates the permissions in the given channel from scratch
+static ChanACL::Permissions fullEvaluation(ServerUser &user, Channel &channel) {
+	return ChanACL::effectivePermissions(&user, &channel, nullptr);
+}
+
+/// Evaluates the permissions in the given channel, resuming from the parent channels' cached state where possible
+static ChanACL::Permissions incrementalEvaluation(ServerUser &user, Channel &channel, ACLCache &cache) {
+	return ChanACL::effectivePermissions(&user, &channel, &cache) & ~ChanACL::Cached;
+}
+
+class TestACL : public QObject {
+	Q_OBJECT
+private slots:
+	void redefinedGroup();
+	void userChannel();
+	void incrementalMatchesFull();
+	void benchmarkEvaluation_data();
+	void benchmarkEvaluation();
+};
+
+void TestACL::redefinedGroup() {
+	Channel root(0, QLatin1String("Root"));
+	Channel *a  = new Channel(1, QLatin1String("A"), &root);
+	Channel *a1 = new Channel(2, QLatin1String("A1"), a);
+	Channel *b  = new Channel(3, QLatin1String("B"), &root);
+	Channel *b1 = new Channel(4, QLatin1String("B1"), b);
+
+	Group *admins = new Group(&root, QLatin1String("admin"));
+	admins->qsAdd.insert(1);
+
+	ChanACL *acl = new ChanACL(&root);
+	acl->qsGroup = QLatin1String("admin");
+	acl->pAllow  = ChanACL::Write;
+
+	// B redefines the group without the user
+	Group *redefined    = new Group(b, QLatin1String("admin"));
+	redefined->bInherit = false;
+
+	ServerUser user;
+	user.iId      = 1;
+	user.cChannel = &root;
+
+	ACLCache cache;
+
+	// Evaluating A1 caches the state root hands down
+	QVERIFY(incrementalEvaluation(user, *a1, cache) & ChanACL::Write);
+	QVERIFY(!(incrementalEvaluation(user, *b1, cache) & ChanACL::Write));
+	QVERIFY(!(incrementalEvaluation(user, *b, cache) & ChanACL::Write));
+
+	QCOMPARE(incrementalEvaluation(user, *a, cache), fullEvaluation(user, *a));
+	QCOMPARE(incrementalEvaluation(user, *b1, cache), fullEvaluation(user, *b1));
+}
+
+void TestACL::userChannel() {
+	Channel root(0, QLatin1String("Root"));
+	Channel *a = new Channel(1, QLatin1String("A"), &root);
+	Channel *b = new Channel(2, QLatin1String("B"), &root);
+
+	ChanACL *acl = new ChanACL(&root);
+	acl->qsGroup = QLatin1String("in");
+	acl->pDeny   = ChanACL::Enter;
+
+	ServerUser user;
+	user.iId      = 1;
+	user.cChannel = a;
+
+	ACLCache cache;
+
+	QVERIFY(!(incrementalEvaluation(user, *a, cache) & ChanACL::Enter));
+	QVERIFY(incrementalEvaluation(user, *b, cache) & ChanACL::Enter);
+
+	// Moving into the other channel invalidates the user's cache
+	user.cChannel = b;
+	cache.invalidate(user.m_aclCache);
+
+	QVERIFY(incrementalEvaluation(user, *a, cache) & ChanACL::Enter);
+	QVERIFY(!(incrementalEvaluation(user, *b, cache) & ChanACL::Enter));
+}
+
+void TestACL::incrementalMatchesFull() {
+	std::mt19937 rng(42);
+
+	constexpr const std::size_t SPECIFICATION_COUNT = sizeof(GROUP_SPECIFICATIONS) / sizeof(GROUP_SPECIFICATIONS[0]);
+	constexpr const int USER_COUNT                  = 6;
+
+	for (int round = 0; round < 200; ++round) {
+		// Random tree with random groups and ACLs
+		const unsigned int channelCount = 2 + rng() % 40;
+
+		Channel root(0, QLatin1String("Root"));
+		std::vector< Channel * > channels = { &root };
+		for (unsigned int i = 1; i < channelCount; ++i) {
+			channels.push_back(new Channel(i, QString::number(i), channels[rng() % channels.size()]));
+		}
+
+		for (Channel *channel : channels) {
+			channel->bInheritACL = (rng() % 6 != 0);
+
+			for (unsigned int i = rng() % 3; i > 0; --i) {
+				Group *group        = new Group(channel, QLatin1String(rng() % 2 ? "admin" : "mod"));
+				group->bInherit     = (rng() % 3 != 0);
+				group->bInheritable = (rng() % 3 != 0);
+				for (int id = 1; id <= USER_COUNT; ++id) {
+					if (rng() % 3 == 0) {
+						group->qsAdd.insert(id);
+					}
+				}
+				if (rng() % 4 == 0) {
+					group->qsRemove.insert(1 + static_cast< int >(rng() % USER_COUNT));
+				}
+			}
+
+			for (unsigned int i = rng() % 4; i > 0; --i) {
+				ChanACL *acl    = new ChanACL(channel);
+				acl->bApplyHere = (rng() % 2 != 0);
+				acl->bApplySubs = (rng() % 3 != 0);
+				if (rng() % 8 == 0) {
+					acl->iUserId = 1 + static_cast< int >(rng() % USER_COUNT);
+				} else {
+					acl->qsGroup = QLatin1String(GROUP_SPECIFICATIONS[rng() % SPECIFICATION_COUNT]);
+				}
+				acl->pAllow = static_cast< ChanACL::Permissions >(static_cast< int >(rng() & rng() & ChanACL::All));
+				acl->pDeny =
+					static_cast< ChanACL::Permissions >(static_cast< int >(rng() & rng() & rng() & ChanACL::All));
+			}
+		}
+
+		std::vector< std::unique_ptr< ServerUser > > users;
+		for (int id = 1; id <= USER_COUNT; ++id) {
+			users.push_back(std::make_unique< ServerUser >());
+			users.back()->iId       = id;
+			users.back()->uiSession = static_cast< unsigned int >(id);
+			users.back()->cChannel  = channels[rng() % channels.size()];
+			users.back()->bVerified = (rng() % 2 != 0);
+			users.back()->qsHash    = QLatin1String(rng() % 2 ? "hash" : "");
+			if (rng() % 2) {
+				users.back()->qslAccessTokens << QLatin1String("Token");
+			}
+		}
+
+		ACLCache cache;
+
+		for (int pass = 0; pass < 4; ++pass) {
+			for (unsigned int i = 0; i < 10 * channelCount; ++i) {
+				ServerUser &user = *users[rng() % users.size()];
+				Channel &channel = *channels[rng() % channels.size()];
+
+				QCOMPARE(incrementalEvaluation(user, channel, cache), fullEvaluation(user, channel));
+			}
+
+			// Change the state the same way the server does it (and invalidate the cache accordingly)
+			ServerUser &user = *users[rng() % users.size()];
+			user.cChannel    = channels[rng() % channels.size()];
+			cache.invalidate(user.m_aclCache);
+
+			Channel &channel = *channels[rng() % channels.size()];
+			if (channel.qhGroups.isEmpty()) {
+				new Group(&channel, QLatin1String(rng() % 2 ? "admin" : "mod"));
+			} else {
+				delete channel.qhGroups.take(channel.qhGroups.constBegin().key());
+			}
+			cache.invalidate();
+		}
+	}
+}
+
+void TestACL::benchmarkEvaluation_data() {
+	QTest::addColumn< bool >("incremental");
+
+	QTest::newRow("full") << false;
+	QTest::newRow("incremental") << true;
+}
+
+void TestACL::benchmarkEvaluation() {
+	QFETCH(bool, incremental);
+
+	// A deep tree of 3280 channels (7 levels below the root with 3 subchannels each) with the default ACLs in the
+	// root channel and a couple of ACLs in every other channel
+	Channel root(0, QLatin1String("Root"));
+	std::vector< Channel * > channels = { &root };
+
+	Group *admins = new Group(&root, QLatin1String("admin"));
+	admins->qsAdd.insert(2);
+
+	for (const char *group : { "admin", "auth", "all" }) {
+		ChanACL *acl = new ChanACL(&root);
+		acl->qsGroup = QLatin1String(group);
+		acl->pAllow  = ChanACL::Write;
+	}
+
+	for (std::size_t parent = 0; channels.size() < 3280; ++parent) {
+		for (int i = 0; i < 3; ++i) {
+			Channel *channel = new Channel(static_cast< unsigned int >(channels.size()),
+										   QString::number(channels.size()), channels[parent]);
+
+			ChanACL *acl = new ChanACL(channel);
+			acl->qsGroup = QLatin1String(i == 0 ? "~in" : "#token");
+			acl->pAllow  = ChanACL::Speak;
+
+			channels.push_back(channel);
+		}
+	}
+
+	ServerUser user;
+	user.iId      = 1;
+	user.cChannel = channels[100];
+
+	ACLCache cache;
+
+	// Evaluate all channels after an ACL edit, like flushing the permissions of a client that knows all of them
+	QBENCHMARK {
+		cache.invalidate();
+
+		for (Channel *channel : channels) {
+			if (incremental) {
+				ChanACL::effectivePermissions(&user, channel, &cache);
+			} else {
+				ChanACL::effectivePermissions(&user, channel, nullptr);
+			}
+		}
+	}
+}
+
+QTEST_MAIN(TestACL)
+#include "TestACL.moc"
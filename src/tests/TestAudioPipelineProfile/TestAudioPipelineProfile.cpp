@@ -0,0 +1,118 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioPipelineProfile.h"
+
+#include <QObject>
+#include <QtTest>
+
+using Stage = AudioPipelineProfile::Stage;
+
+class TestAudioPipelineProfile : public QObject {
+	Q_OBJECT
+private slots:
+	void buckets();
+	void statistics();
+	void quantiles();
+	void stopwatch();
+	void reset();
+	void report();
+};
+
+void TestAudioPipelineProfile::buckets() {
+	QCOMPARE(AudioPipelineProfile::bucketFor(std::chrono::nanoseconds(-1)), std::size_t(0));
+	QCOMPARE(AudioPipelineProfile::bucketFor(std::chrono::nanoseconds(999)), std::size_t(0));
+	QCOMPARE(AudioPipelineProfile::bucketFor(std::chrono::microseconds(1)), std::size_t(1));
+	QCOMPARE(AudioPipelineProfile::bucketFor(std::chrono::microseconds(3)), std::size_t(2));
+	QCOMPARE(AudioPipelineProfile::bucketFor(std::chrono::microseconds(4)), std::size_t(3));
+	QCOMPARE(AudioPipelineProfile::bucketFor(std::chrono::microseconds(1023)), std::size_t(10));
+	QCOMPARE(AudioPipelineProfile::bucketFor(std::chrono::hours(1)), AudioPipelineProfile::BUCKET_COUNT - 1);
+}
+
+void TestAudioPipelineProfile::statistics() {
+	AudioPipelineProfile profile;
+
+	profile.record(Stage::Encoding, std::chrono::microseconds(10));
+	profile.record(Stage::Encoding, std::chrono::microseconds(30));
+	profile.record(Stage::Encoding, std::chrono::microseconds(20));
+
+	QCOMPARE(profile.count(Stage::Encoding), std::uint64_t(3));
+	QCOMPARE(profile.total(Stage::Encoding), std::chrono::nanoseconds(std::chrono::microseconds(60)));
+	QCOMPARE(profile.max(Stage::Encoding), std::chrono::nanoseconds(std::chrono::microseconds(30)));
+	QCOMPARE(profile.bucketCount(Stage::Encoding, 4), std::uint64_t(1));
+	QCOMPARE(profile.bucketCount(Stage::Encoding, 5), std::uint64_t(2));
+
+	// The stages are kept apart
+	QCOMPARE(profile.count(Stage::Decoding), std::uint64_t(0));
+	QCOMPARE(profile.max(Stage::Decoding), std::chrono::nanoseconds(0));
+}
+
+void TestAudioPipelineProfile::quantiles() {
+	AudioPipelineProfile profile;
+
+	QCOMPARE(profile.quantile(Stage::Capture, 0.5), std::chrono::nanoseconds(0));
+
+	for (int i = 0; i < 99; ++i) {
+		profile.record(Stage::Capture, std::chrono::microseconds(10));
+	}
+	profile.record(Stage::Capture, std::chrono::microseconds(1000));
+
+	// The quantiles are the upper bounds of the buckets they fall into...
+	QCOMPARE(profile.quantile(Stage::Capture, 0.5), std::chrono::nanoseconds(std::chrono::microseconds(16)));
+	QCOMPARE(profile.quantile(Stage::Capture, 0.99), std::chrono::nanoseconds(std::chrono::microseconds(16)));
+	// ...but never more than the longest duration
+	QCOMPARE(profile.quantile(Stage::Capture, 1.0), std::chrono::nanoseconds(std::chrono::microseconds(1000)));
+
+	// Durations in the last bucket are only bounded by the longest one
+	profile.record(Stage::Playback, std::chrono::seconds(10));
+	QCOMPARE(profile.quantile(Stage::Playback, 0.5), std::chrono::nanoseconds(std::chrono::seconds(10)));
+}
+
+void TestAudioPipelineProfile::stopwatch() {
+	AudioPipelineProfile profile;
+
+	AudioPipelineProfile::Stopwatch stopwatch(&profile);
+	stopwatch.start();
+	stopwatch.stop(Stage::NoiseSuppression);
+	stopwatch.start();
+	stopwatch.stop(Stage::NoiseSuppression);
+
+	QCOMPARE(profile.count(Stage::NoiseSuppression), std::uint64_t(2));
+
+	// Without a profile, nothing is recorded
+	AudioPipelineProfile::Stopwatch disabled(nullptr);
+	disabled.start();
+	disabled.stop(Stage::NoiseSuppression);
+
+	QCOMPARE(profile.count(Stage::NoiseSuppression), std::uint64_t(2));
+}
+
+void TestAudioPipelineProfile::reset() {
+	AudioPipelineProfile profile;
+
+	profile.record(Stage::Preprocessing, std::chrono::microseconds(5));
+	profile.reset();
+
+	QCOMPARE(profile.count(Stage::Preprocessing), std::uint64_t(0));
+	QCOMPARE(profile.total(Stage::Preprocessing), std::chrono::nanoseconds(0));
+	QCOMPARE(profile.max(Stage::Preprocessing), std::chrono::nanoseconds(0));
+	QCOMPARE(profile.bucketCount(Stage::Preprocessing, 3), std::uint64_t(0));
+}
+
+void TestAudioPipelineProfile::report() {
+	AudioPipelineProfile profile;
+
+	profile.record(Stage::EchoCancellation, std::chrono::microseconds(100));
+
+	const QString report = profile.report();
+
+	QVERIFY(report.contains(QLatin1String("Echo cancellation")));
+	QVERIFY(report.contains(QLatin1String("< 128 us")));
+	// Stages that haven't been recorded are left out
+	QVERIFY(!report.contains(QLatin1String("Decoding")));
+}
+
+QTEST_MAIN(TestAudioPipelineProfile)
+#include "TestAudioPipelineProfile.moc"
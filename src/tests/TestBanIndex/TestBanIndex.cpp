@@ -0,0 +1,198 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "Ban.h"
+#include "BanIndex.h"
+#include "HostAddress.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <random>
+
+/// Creates a ban of the given IPv4 network (with a mask of up to 32 bits, as entered by users)
+static Ban ipv4Ban(const char *address, int mask, unsigned int duration = 0) {
+	Ban ban;
+	ban.haAddress = HostAddress(QHostAddress(QLatin1String(address)));
+	ban.iMask     = 96 + mask;
+	ban.qdtStart  = QDateTime::currentDateTime().toUTC();
+	ban.iDuration = duration;
+	return ban;
+}
+
+static HostAddress ipv4(const char *address) {
+	return HostAddress(QHostAddress(QLatin1String(address)));
+}
+
+/// Checks the bans one by one, as the server used to do it
+static const Ban *linearScan(const QList< Ban > &bans, const HostAddress &address) {
+	for (const Ban &ban : bans) {
+		if (!ban.isExpired() && address.match(ban.haAddress, static_cast< unsigned int >(ban.iMask))) {
+			return &ban;
+		}
+	}
+	return nullptr;
+}
+
+class TestBanIndex : public QObject {
+	Q_OBJECT
+private slots:
+	void matchesNetworks();
+	void matchesHashes();
+	void update();
+	void expiry();
+	void matchesLinearScan();
+};
+
+void TestBanIndex::matchesNetworks() {
+	BanIndex index;
+	index.add(ipv4Ban("10.1.16.0", 20));
+	index.add(ipv4Ban("192.168.0.7", 32));
+
+	QVERIFY(index.findAddressBan(ipv4("10.1.16.0")));
+	QVERIFY(index.findAddressBan(ipv4("10.1.31.255")));
+	QVERIFY(!index.findAddressBan(ipv4("10.1.32.0")));
+	QVERIFY(!index.findAddressBan(ipv4("10.1.15.255")));
+
+	QVERIFY(index.findAddressBan(ipv4("192.168.0.7")));
+	QVERIFY(!index.findAddressBan(ipv4("192.168.0.6")));
+
+	// A wider network containing the existing ones
+	QVERIFY(!index.findAddressBan(ipv4("192.168.1.1")));
+	index.add(ipv4Ban("192.168.0.0", 16));
+	QVERIFY(index.findAddressBan(ipv4("192.168.1.1")));
+	QCOMPARE(index.findAddressBan(ipv4("192.168.0.7"))->haAddress, ipv4("192.168.0.0"));
+
+	Ban ipv6;
+	ipv6.haAddress = HostAddress(QHostAddress(QLatin1String("2001:db8:1234::")));
+	ipv6.iMask     = 48;
+	ipv6.iDuration = 0;
+	index.add(ipv6);
+
+	QVERIFY(index.findAddressBan(HostAddress(QHostAddress(QLatin1String("2001:db8:1234:ffff::1")))));
+	QVERIFY(!index.findAddressBan(HostAddress(QHostAddress(QLatin1String("2001:db8:1235::1")))));
+}
+
+void TestBanIndex::matchesHashes() {
+	Ban ban    = ipv4Ban("10.0.0.1", 32);
+	ban.qsHash = QLatin1String("0123456789abcdef0123456789abcdef01234567");
+
+	BanIndex index;
+	index.add(ban);
+
+	QVERIFY(index.findHashBan(ban.qsHash));
+	QVERIFY(!index.findHashBan(QLatin1String("76543210fedcba9876543210fedcba9876543210")));
+
+	index.remove(ban);
+	QVERIFY(!index.findHashBan(ban.qsHash));
+}
+
+void TestBanIndex::update() {
+	QList< Ban > bans = { ipv4Ban("10.0.0.1", 32), ipv4Ban("10.0.1.0", 24), ipv4Ban("10.0.0.1", 32) };
+
+	BanIndex index;
+	index.update(bans);
+
+	// Duplicates are stored once
+	QCOMPARE(index.size(), static_cast< std::size_t >(2));
+	QVERIFY(index.findAddressBan(ipv4("10.0.1.1")));
+
+	bans.removeAt(1);
+	bans << ipv4Ban("10.0.2.0", 24);
+	index.update(bans);
+
+	QCOMPARE(index.size(), static_cast< std::size_t >(2));
+	QVERIFY(index.findAddressBan(ipv4("10.0.0.1")));
+	QVERIFY(!index.findAddressBan(ipv4("10.0.1.1")));
+	QVERIFY(index.findAddressBan(ipv4("10.0.2.1")));
+}
+
+void TestBanIndex::expiry() {
+	Ban expired      = ipv4Ban("10.0.0.1", 32, 10);
+	expired.qdtStart = expired.qdtStart.addSecs(-60);
+
+	BanIndex index;
+	index.add(expired);
+	index.add(ipv4Ban("10.0.0.2", 32, 3600));
+	index.add(ipv4Ban("10.0.0.3", 32));
+
+	// Expired bans don't match, even before they have been taken out of the index
+	QVERIFY(!index.findAddressBan(ipv4("10.0.0.1")));
+
+	const QList< Ban > taken = index.takeExpired();
+	QCOMPARE(taken.size(), 1);
+	QCOMPARE(taken.first().haAddress, ipv4("10.0.0.1"));
+
+	QCOMPARE(index.size(), static_cast< std::size_t >(2));
+	QVERIFY(index.takeExpired().isEmpty());
+	QVERIFY(index.findAddressBan(ipv4("10.0.0.2")));
+	QVERIFY(index.findAddressBan(ipv4("10.0.0.3")));
+}
+
+void TestBanIndex::matchesLinearScan() {
+	std::mt19937 rng(42);
+
+	for (int round = 0; round < 50; ++round) {
+		// Addresses are derived from a few networks with some bits flipped, so that the bans overlap a lot
+		std::vector< HostAddress > networks;
+		for (int i = 0; i < 4; ++i) {
+			HostAddress network;
+			network.reset();
+			for (std::size_t byte = 0; byte < 16; ++byte) {
+				network.setByte(byte, rng() % 4 == 0 ? static_cast< std::uint8_t >(rng()) : 0);
+			}
+			networks.push_back(network);
+		}
+
+		auto randomAddress = [&]() {
+			HostAddress address = networks[rng() % networks.size()];
+			for (unsigned int flips = rng() % 6; flips > 0; --flips) {
+				const unsigned int bit = rng() % 128;
+				address.setByte(bit / 8, static_cast< std::uint8_t >(address.getByteRepresentation()[bit / 8]
+																	  ^ (0x80 >> (bit % 8))));
+			}
+			return address;
+		};
+
+		QList< Ban > bans;
+		BanIndex index;
+
+		for (int step = 0; step < 20; ++step) {
+			if (rng() % 3 != 0) {
+				for (unsigned int i = 1 + rng() % 30; i > 0; --i) {
+					Ban ban;
+					ban.haAddress = randomAddress();
+					ban.iMask     = static_cast< int >(64 + rng() % 65);
+					ban.qdtStart  = QDateTime::currentDateTime().toUTC();
+					ban.iDuration = 0;
+					bans << ban;
+				}
+			} else {
+				QList< Ban > remaining;
+				for (const Ban &ban : bans) {
+					if (rng() % 3 != 0) {
+						remaining << ban;
+					}
+				}
+				bans = remaining;
+			}
+
+			index.update(bans);
+
+			for (int i = 0; i < 200; ++i) {
+				const HostAddress address = randomAddress();
+
+				const Ban *found = index.findAddressBan(address);
+				QCOMPARE(found != nullptr, linearScan(bans, address) != nullptr);
+				if (found) {
+					QVERIFY(address.match(found->haAddress, static_cast< unsigned int >(found->iMask)));
+				}
+			}
+		}
+	}
+}
+
+QTEST_MAIN(TestBanIndex)
+#include "TestBanIndex.moc"
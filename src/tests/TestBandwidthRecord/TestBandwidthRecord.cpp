@@ -0,0 +1,97 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BandwidthRecord.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+class TestBandwidthRecord : public QObject {
+	Q_OBJECT
+private slots:
+	void limitsBandwidth();
+	void measuresBandwidth();
+	void idleSeconds();
+	void concurrentReaders();
+};
+
+void TestBandwidthRecord::limitsBandwidth() {
+	BandwidthRecord record;
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+	// 1000 bytes in (a little more than) 20ms are way more than 2000 bytes per second
+	QVERIFY(!record.addFrame(1000, 2000));
+	QVERIFY(record.addFrame(100, 10000));
+
+	// A burst of frames exceeds the limit soon
+	int accepted = 0;
+	for (int i = 0; i < 100; ++i) {
+		if (record.addFrame(100, 10000)) {
+			accepted++;
+		}
+	}
+	QVERIFY(accepted < 100);
+
+	// Rejected frames don't count towards the bandwidth, so a higher limit lets more frames through
+	QVERIFY(record.addFrame(100, 1000000));
+}
+
+void TestBandwidthRecord::measuresBandwidth() {
+	BandwidthRecord record;
+	QCOMPARE(record.bandwidth(), 0);
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+	// 100 bytes every 10ms (or a bit more, depending on the scheduler) are at most 10000 bytes per second
+	for (int i = 0; i < 40; ++i) {
+		QVERIFY(record.addFrame(100, 1000000));
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	const int bandwidth = record.bandwidth();
+	QVERIFY(bandwidth > 1000);
+	QVERIFY(bandwidth <= 12000);
+}
+
+void TestBandwidthRecord::idleSeconds() {
+	BandwidthRecord record;
+	QCOMPARE(record.idleSeconds(), 0);
+	QCOMPARE(record.onlineSeconds(), 0);
+
+	record.resetIdleSeconds();
+	record.addFrame(100, 1000000);
+	QCOMPARE(record.idleSeconds(), 0);
+}
+
+void TestBandwidthRecord::concurrentReaders() {
+	BandwidthRecord record;
+	std::atomic< bool > stop(false);
+
+	std::thread writer([&]() {
+		while (!stop.load()) {
+			record.addFrame(1000, 50000);
+			std::this_thread::yield();
+		}
+	});
+
+	// Every frame is accepted only if the limit isn't exceeded, so a consistent view of the ring never shows a lot
+	// more than the limit
+	const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+	while (std::chrono::steady_clock::now() < end) {
+		const int bandwidth = record.bandwidth();
+		QVERIFY(bandwidth >= 0);
+		QVERIFY(bandwidth <= 4 * 50000);
+		record.resetIdleSeconds();
+	}
+
+	stop.store(true);
+	writer.join();
+}
+
+QTEST_MAIN(TestBandwidthRecord)
+#include "TestBandwidthRecord.moc"
@@ -0,0 +1,120 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BlobStore.h"
+#include "QtUtils.h"
+
+#include <QObject>
+#include <QtTest>
+
+static QByteArray texture(char fill, int size = 1000) {
+	return QByteArray(size, fill);
+}
+
+class TestBlobStore : public QObject {
+	Q_OBJECT
+private slots:
+	void deduplicates();
+	void deduplicatesText();
+	void evictsLeastRecentlyUsed();
+	void skipsHugeBlobs();
+	void setCapacity();
+};
+
+void TestBlobStore::deduplicates() {
+	BlobStore< QByteArray > store;
+
+	// Two separately loaded copies of the same texture
+	const QByteArray first  = texture('a');
+	const QByteArray second = texture('a');
+	QVERIFY(first.constData() != second.constData());
+
+	const QByteArray internedFirst  = store.intern(sha1(first), first);
+	const QByteArray internedSecond = store.intern(sha1(second), second);
+
+	QCOMPARE(internedSecond, second);
+	QCOMPARE(internedFirst.constData(), first.constData());
+	QCOMPARE(internedSecond.constData(), first.constData());
+
+	QCOMPARE(store.count(), static_cast< std::size_t >(1));
+	QCOMPARE(store.size(), static_cast< std::size_t >(1000));
+
+	QCOMPARE(store.find(sha1(first)).constData(), first.constData());
+	QVERIFY(store.find(sha1(texture('b'))).isNull());
+}
+
+void TestBlobStore::deduplicatesText() {
+	BlobStore< QString > store;
+
+	const QString first  = QString(200, QLatin1Char('x'));
+	const QString second = QString(200, QLatin1Char('x'));
+
+	store.intern(sha1(first), first);
+	QCOMPARE(store.intern(sha1(second), second).constData(), first.constData());
+	QCOMPARE(store.size(), static_cast< std::size_t >(200 * sizeof(QChar)));
+}
+
+void TestBlobStore::evictsLeastRecentlyUsed() {
+	BlobStore< QByteArray > store(3000);
+
+	const QByteArray a = texture('a');
+	const QByteArray b = texture('b');
+	const QByteArray c = texture('c');
+	const QByteArray d = texture('d');
+
+	store.intern(sha1(a), a);
+	store.intern(sha1(b), b);
+	store.intern(sha1(c), c);
+
+	// Using a makes b the least recently used blob
+	QVERIFY(!store.find(sha1(a)).isNull());
+	store.intern(sha1(d), d);
+
+	QVERIFY(store.contains(sha1(a)));
+	QVERIFY(!store.contains(sha1(b)));
+	QVERIFY(store.contains(sha1(c)));
+	QVERIFY(store.contains(sha1(d)));
+	QCOMPARE(store.size(), static_cast< std::size_t >(3000));
+
+	// An evicted blob can be stored again
+	const QByteArray bAgain = texture('b');
+	QCOMPARE(store.intern(sha1(bAgain), bAgain).constData(), bAgain.constData());
+	QVERIFY(!store.contains(sha1(c)));
+}
+
+void TestBlobStore::skipsHugeBlobs() {
+	BlobStore< QByteArray > store(1500);
+
+	const QByteArray small = texture('a');
+	const QByteArray huge  = texture('b', 2000);
+
+	store.intern(sha1(small), small);
+	QCOMPARE(store.intern(sha1(huge), huge), huge);
+
+	QVERIFY(!store.contains(sha1(huge)));
+	QVERIFY(store.contains(sha1(small)));
+}
+
+void TestBlobStore::setCapacity() {
+	BlobStore< QByteArray > store;
+
+	for (char fill = 'a'; fill <= 'j'; ++fill) {
+		const QByteArray blob = texture(fill);
+		store.intern(sha1(blob), blob);
+	}
+	QCOMPARE(store.count(), static_cast< std::size_t >(10));
+
+	store.setCapacity(2500);
+	QCOMPARE(store.count(), static_cast< std::size_t >(2));
+	QVERIFY(store.contains(sha1(texture('j'))));
+	QVERIFY(store.contains(sha1(texture('i'))));
+
+	store.clear();
+	QCOMPARE(store.count(), static_cast< std::size_t >(0));
+	QCOMPARE(store.size(), static_cast< std::size_t >(0));
+}
+
+QTEST_MAIN(TestBlobStore)
+#include "TestBlobStore.moc"
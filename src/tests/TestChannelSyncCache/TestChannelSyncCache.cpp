@@ -0,0 +1,203 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "Channel.h"
+#include "ChannelSyncCache.h"
+#include "MumbleProtocol.h"
+
+#include <QObject>
+#include <QtCore>
+#include <QtEndian>
+#include <QtTest>
+
+#include <vector>
+
+/// Splits a stream of serialized messages up again
+static std::vector< MumbleProto::ChannelState > parse(const QByteArray &stream) {
+	std::vector< MumbleProto::ChannelState > messages;
+
+	const unsigned char *data = reinterpret_cast< const unsigned char * >(stream.constData());
+	qsizetype offset          = 0;
+	while (offset + 6 <= stream.size()) {
+		const quint16 type   = qFromBigEndian< quint16 >(data + offset);
+		const quint32 length = qFromBigEndian< quint32 >(data + offset + 2);
+		offset += 6;
+
+		if (type != static_cast< quint16 >(Mumble::Protocol::TCPMessageType::ChannelState)
+			|| offset + length > static_cast< quint32 >(stream.size())) {
+			break;
+		}
+
+		MumbleProto::ChannelState msg;
+		msg.ParseFromArray(data + offset, static_cast< int >(length));
+		messages.push_back(msg);
+
+		offset += length;
+	}
+
+	// The stream has to consist of complete messages only
+	if (offset != stream.size()) {
+		messages.clear();
+	}
+
+	return messages;
+}
+
+class TestChannelSyncCache : public QObject {
+	Q_OBJECT
+private:
+	Channel *root;
+	Channel *a;
+	Channel *b;
+	Channel *c;
+
+	ChannelSyncCache cache;
+	ChannelSyncCache::Describe describe;
+	/// The amount of times a channel has been described
+	int described;
+
+	std::vector< MumbleProto::ChannelState > write(bool descriptionHash, const ChannelSyncCache::CanEnter &canEnter) {
+		QByteArray stream;
+		cache.write(*root, descriptionHash, describe, canEnter, stream);
+		return parse(stream);
+	}
+
+private slots:
+	void init();
+	void cleanup();
+	void order();
+	void canEnter();
+	void description();
+	void invalidate();
+	void invalidateStructure();
+};
+
+void TestChannelSyncCache::init() {
+	// Root
+	// ├── A
+	// │   └── C
+	// └── B
+	root = new Channel(0, QLatin1String("Root"));
+	a    = new Channel(1, QLatin1String("A"), root);
+	b    = new Channel(2, QLatin1String("B"), root);
+	c    = new Channel(3, QLatin1String("C"), a);
+	b->link(c);
+
+	b->qsDesc      = QLatin1String("Description");
+	b->qbaDescHash = QByteArray("hash");
+
+	cache.clear();
+	described = 0;
+	describe  = [this](Channel &channel, bool descriptionHash, MumbleProto::ChannelState &msg) {
+		++described;
+
+		msg.set_channel_id(channel.iId);
+		msg.set_name(channel.qsName.toStdString());
+		if (channel.cParent) {
+			msg.set_parent(channel.cParent->iId);
+		}
+		if (descriptionHash && !channel.qbaDescHash.isEmpty()) {
+			msg.set_description_hash(channel.qbaDescHash.toStdString());
+		} else if (!channel.qsDesc.isEmpty()) {
+			msg.set_description(channel.qsDesc.toStdString());
+		}
+	};
+}
+
+void TestChannelSyncCache::cleanup() {
+	delete root;
+}
+
+void TestChannelSyncCache::order() {
+	const std::vector< MumbleProto::ChannelState > messages = write(true, [](Channel &) { return true; });
+
+	// The channels in breadth-first order, followed by the links (which are announced from both ends)
+	QCOMPARE(messages.size(), std::size_t(6));
+	QCOMPARE(messages[0].channel_id(), 0u);
+	QCOMPARE(messages[1].channel_id(), 1u);
+	QCOMPARE(messages[2].channel_id(), 2u);
+	QCOMPARE(messages[3].channel_id(), 3u);
+	QCOMPARE(messages[3].parent(), 1u);
+	QCOMPARE(messages[3].name(), std::string("C"));
+
+	QCOMPARE(messages[4].channel_id(), 2u);
+	QCOMPARE(messages[4].links_size(), 1);
+	QCOMPARE(messages[4].links(0), 3u);
+	QVERIFY(!messages[4].has_can_enter());
+	QCOMPARE(messages[5].channel_id(), 3u);
+	QCOMPARE(messages[5].links(0), 2u);
+}
+
+void TestChannelSyncCache::canEnter() {
+	std::vector< MumbleProto::ChannelState > messages = write(true, [](Channel &) { return true; });
+	for (std::size_t i = 0; i < 4; ++i) {
+		QVERIFY(messages[i].has_can_enter());
+		QVERIFY(messages[i].can_enter());
+	}
+
+	// Only the permissions differ between users, so the channels aren't described again
+	messages = write(true, [](Channel &channel) { return channel.iId != 1; });
+	QCOMPARE(described, 4);
+	QVERIFY(messages[0].can_enter());
+	QVERIFY(!messages[1].can_enter());
+	QVERIFY(messages[2].can_enter());
+	QVERIFY(messages[3].can_enter());
+}
+
+void TestChannelSyncCache::description() {
+	std::vector< MumbleProto::ChannelState > messages = write(true, [](Channel &) { return true; });
+	QCOMPARE(messages[2].description_hash(), std::string("hash"));
+	QVERIFY(!messages[2].has_description());
+
+	// Clients that don't know about hashes get the description itself
+	messages = write(false, [](Channel &) { return true; });
+	QCOMPARE(described, 8);
+	QCOMPARE(messages[2].description(), std::string("Description"));
+	QVERIFY(!messages[2].has_description_hash());
+
+	write(true, [](Channel &) { return true; });
+	write(false, [](Channel &) { return true; });
+	QCOMPARE(described, 8);
+}
+
+void TestChannelSyncCache::invalidate() {
+	write(true, [](Channel &) { return true; });
+
+	c->qsName = QLatin1String("Renamed");
+	cache.invalidate(c->iId);
+
+	const std::vector< MumbleProto::ChannelState > messages = write(true, [](Channel &) { return true; });
+	QCOMPARE(described, 5);
+	QCOMPARE(messages[3].name(), std::string("Renamed"));
+}
+
+void TestChannelSyncCache::invalidateStructure() {
+	write(true, [](Channel &) { return true; });
+
+	// Move C over to B and add a new channel below it
+	a->removeChannel(c);
+	b->addChannel(c);
+	new Channel(4, QLatin1String("D"), c);
+	b->unlink(c);
+	a->link(b);
+
+	cache.invalidate(c->iId);
+	cache.invalidateStructure();
+
+	const std::vector< MumbleProto::ChannelState > messages = write(true, [](Channel &) { return true; });
+	QCOMPARE(described, 6);
+	QCOMPARE(messages.size(), std::size_t(7));
+	QCOMPARE(messages[3].channel_id(), 3u);
+	QCOMPARE(messages[3].parent(), 2u);
+	QCOMPARE(messages[4].channel_id(), 4u);
+
+	QCOMPARE(messages[5].channel_id(), 1u);
+	QCOMPARE(messages[5].links(0), 2u);
+	QCOMPARE(messages[6].channel_id(), 2u);
+	QCOMPARE(messages[6].links(0), 1u);
+}
+
+QTEST_MAIN(TestChannelSyncCache)
+#include "TestChannelSyncCache.moc"
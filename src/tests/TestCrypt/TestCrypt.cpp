@@ -10,6 +10,8 @@
 #include "Timer.h"
 #include "Utils.h"
 #include "crypto/CryptStateOCB2.h"
+#include "crypto/HardwareAES.h"
+#include <memory>
 #include <string>
 
 class TestCrypt : public QObject {
@@ -23,6 +25,9 @@ private slots:
 	void ivrecovery();
 	void reverserecovery();
 	void tamper();
+	void hardwareAES();
+	void hardwareAESBitExact();
+	void encryptBatch();
 };
 
 void TestCrypt::initTestCase() {
@@ -301,5 +306,148 @@ void TestCrypt::tamper() {
 	QVERIFY(cs.decrypt(encrypted.data(), decrypted.data(), len + 4));
 }
 
+void TestCrypt::hardwareAES() {
+	if (!HardwareAES::isSupported()) {
+		QSKIP("The CPU doesn't support the AES instructions");
+	}
+
+	// Test vector from FIPS-197, appendix C.1
+	const unsigned char key[AES_BLOCK_SIZE]      = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+													 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+	const unsigned char plain[AES_BLOCK_SIZE]    = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+													 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+	const unsigned char expected[AES_BLOCK_SIZE] = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+													 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+
+	HardwareAES aes;
+	aes.setKey(key);
+
+	// Odd amount of blocks, so that both the pipelined and the single block code paths are used
+	constexpr const std::size_t blocks = HardwareAES::PIPELINE_BLOCKS + 1;
+	unsigned char buffer[blocks * AES_BLOCK_SIZE];
+	for (std::size_t i = 0; i < blocks; ++i) {
+		memcpy(buffer + i * AES_BLOCK_SIZE, plain, AES_BLOCK_SIZE);
+	}
+
+	aes.encrypt(buffer, buffer, blocks);
+	for (std::size_t i = 0; i < blocks * AES_BLOCK_SIZE; ++i) {
+		QCOMPARE(buffer[i], expected[i % AES_BLOCK_SIZE]);
+	}
+
+	aes.decrypt(buffer, buffer, blocks);
+	for (std::size_t i = 0; i < blocks * AES_BLOCK_SIZE; ++i) {
+		QCOMPARE(buffer[i], plain[i % AES_BLOCK_SIZE]);
+	}
+}
+
+void TestCrypt::hardwareAESBitExact() {
+	if (!HardwareAES::isSupported()) {
+		QSKIP("The CPU doesn't support the AES instructions");
+	}
+
+	CryptStateOCB2 hardware(true);
+	CryptStateOCB2 software(false);
+	QVERIFY(hardware.usesHardwareAES());
+	QVERIFY(!software.usesHardwareAES());
+
+	hardware.genKey();
+	software.setKey(hardware.getRawKey(), hardware.getEncryptIV(), hardware.getDecryptIV());
+
+	for (unsigned int len = 0; len < 256; len++) {
+		unsigned char nonce[AES_BLOCK_SIZE];
+		for (unsigned char i = 0; i < AES_BLOCK_SIZE; i++)
+			nonce[i] = static_cast< unsigned char >(len * 7 + i);
+
+		std::vector< unsigned char > src(len);
+		for (unsigned int i = 0; i < len; i++)
+			src[i] = static_cast< unsigned char >(i * 31 + len);
+
+		// Every third message contains the block that triggers the XEX* attack countermeasure
+		if (len > 2 * AES_BLOCK_SIZE && len % 3 == 0) {
+			const unsigned int critical = ((len - 1) / AES_BLOCK_SIZE - 1) * AES_BLOCK_SIZE;
+			memset(src.data() + critical, 0, AES_BLOCK_SIZE - 1);
+		}
+
+		unsigned char hardwareTag[AES_BLOCK_SIZE];
+		unsigned char softwareTag[AES_BLOCK_SIZE];
+		std::vector< unsigned char > hardwareEncrypted(len);
+		std::vector< unsigned char > softwareEncrypted(len);
+
+		QVERIFY(hardware.ocb_encrypt(src.data(), hardwareEncrypted.data(), len, nonce, hardwareTag));
+		QVERIFY(software.ocb_encrypt(src.data(), softwareEncrypted.data(), len, nonce, softwareTag));
+
+		QVERIFY(hardwareEncrypted == softwareEncrypted);
+		QVERIFY(memcmp(hardwareTag, softwareTag, AES_BLOCK_SIZE) == 0);
+
+		std::vector< unsigned char > hardwareDecrypted(len);
+		std::vector< unsigned char > softwareDecrypted(len);
+
+		QVERIFY(hardware.ocb_decrypt(hardwareEncrypted.data(), hardwareDecrypted.data(), len, nonce, hardwareTag));
+		QVERIFY(software.ocb_decrypt(softwareEncrypted.data(), softwareDecrypted.data(), len, nonce, softwareTag));
+
+		QVERIFY(hardwareDecrypted == softwareDecrypted);
+		QVERIFY(memcmp(hardwareTag, softwareTag, AES_BLOCK_SIZE) == 0);
+	}
+}
+
+void TestCrypt::encryptBatch() {
+	// More states than fit into a single batch, with and without hardware AES (which takes the fallback path)
+	for (bool allowHardwareAES : { true, false }) {
+		const std::size_t count = CryptStateOCB2::MAX_BATCH_SIZE * 2 + 3;
+
+		std::vector< std::unique_ptr< CryptStateOCB2 > > batched;
+		std::vector< std::unique_ptr< CryptStateOCB2 > > individual;
+		std::vector< std::unique_ptr< CryptStateOCB2 > > receivers;
+		std::vector< CryptStateOCB2 * > states;
+
+		for (std::size_t i = 0; i < count; ++i) {
+			batched.push_back(std::make_unique< CryptStateOCB2 >(allowHardwareAES));
+			individual.push_back(std::make_unique< CryptStateOCB2 >(allowHardwareAES));
+			receivers.push_back(std::make_unique< CryptStateOCB2 >());
+
+			batched[i]->genKey();
+			individual[i]->setKey(batched[i]->getRawKey(), batched[i]->getEncryptIV(), batched[i]->getDecryptIV());
+			receivers[i]->setKey(batched[i]->getRawKey(), batched[i]->getDecryptIV(), batched[i]->getEncryptIV());
+			states.push_back(batched[i].get());
+		}
+
+		for (unsigned int len = 0; len < 150; len++) {
+			std::vector< unsigned char > src(len);
+			for (unsigned int i = 0; i < len; i++)
+				src[i] = static_cast< unsigned char >(i * 17 + len);
+
+			// See hardwareAESBitExact
+			if (len > 2 * AES_BLOCK_SIZE && len % 3 == 0) {
+				const unsigned int critical = ((len - 1) / AES_BLOCK_SIZE - 1) * AES_BLOCK_SIZE;
+				memset(src.data() + critical, 0, AES_BLOCK_SIZE - 1);
+			}
+
+			std::vector< std::vector< unsigned char > > batchEncrypted(count, std::vector< unsigned char >(len + 4));
+			std::vector< unsigned char * > destinations;
+			for (std::vector< unsigned char > &encrypted : batchEncrypted) {
+				destinations.push_back(encrypted.data());
+			}
+
+			CryptStateOCB2::encryptBatch(states.data(), destinations.data(), count, src.data(), len);
+
+			for (std::size_t i = 0; i < count; ++i) {
+				std::vector< unsigned char > encrypted(len + 4);
+				QVERIFY(individual[i]->encrypt(src.data(), encrypted.data(), len));
+
+				QVERIFY(batchEncrypted[i] == encrypted);
+
+				std::vector< unsigned char > decrypted(len);
+				QVERIFY(receivers[i]->decrypt(batchEncrypted[i].data(), decrypted.data(), len + 4));
+
+				// Apart from a flipped bit in critical packets, the plaintext is unchanged
+				if (len > 2 * AES_BLOCK_SIZE && len % 3 == 0) {
+					decrypted[((len - 1) / AES_BLOCK_SIZE - 1) * AES_BLOCK_SIZE] ^= 1;
+				}
+				QVERIFY(decrypted == src);
+			}
+		}
+	}
+}
+
 QTEST_MAIN(TestCrypt)
 #include "TestCrypt.moc"
@@ -0,0 +1,266 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "DatabaseCache.h"
+
+#include <QObject>
+#include <QtCore>
+#include <QtSql>
+#include <QtTest>
+
+/// The amount of users on the simulated server
+constexpr int USER_COUNT = 2000;
+
+static QString userHash(int user) {
+	return QString::fromLatin1("%1").arg(user, 40, 16, QLatin1Char('0'));
+}
+
+class TestDatabaseCache : public QObject {
+	Q_OBJECT
+private:
+	QSqlDatabase db;
+
+	/// @returns The amount of rows of the given table matching the given condition
+	int count(const QString &table, const QString &condition = QLatin1String("1")) {
+		QSqlQuery query(db);
+		query.exec(QString::fromLatin1("SELECT COUNT(*) FROM `%1` WHERE %2").arg(table, condition));
+		return query.next() ? query.value(0).toInt() : -1;
+	}
+
+private slots:
+	void initTestCase();
+	void init();
+	void cleanup();
+	void cleanupTestCase();
+	void load();
+	void writeThrough();
+	void filterModes();
+	void seenComments();
+	void sync();
+};
+
+void TestDatabaseCache::initTestCase() {
+	db = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), QLatin1String("TestDatabaseCache"));
+	db.setDatabaseName(QLatin1String(":memory:"));
+	QVERIFY(db.open());
+}
+
+void TestDatabaseCache::init() {
+	// The tables as Database creates them
+	QSqlQuery query(db);
+	QVERIFY(query.exec(QLatin1String("CREATE TABLE `comments` (`who` TEXT, `comment` BLOB, `seen` DATE)")));
+	QVERIFY(query.exec(QLatin1String("CREATE UNIQUE INDEX `comments_comment` ON `comments`(`who`, `comment`)")));
+	QVERIFY(query.exec(QLatin1String("CREATE TABLE `ignored` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `hash` TEXT)")));
+	QVERIFY(query.exec(QLatin1String("CREATE UNIQUE INDEX `ignored_hash` ON `ignored`(`hash`)")));
+	QVERIFY(query.exec(
+		QLatin1String("CREATE TABLE `ignored_tts` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `hash` TEXT)")));
+	QVERIFY(query.exec(QLatin1String("CREATE UNIQUE INDEX `ignored_tts_hash` ON `ignored_tts`(`hash`)")));
+	QVERIFY(query.exec(QLatin1String("CREATE TABLE `muted` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `hash` TEXT)")));
+	QVERIFY(query.exec(QLatin1String("CREATE UNIQUE INDEX `muted_hash` ON `muted`(`hash`)")));
+	QVERIFY(query.exec(QLatin1String(
+		"CREATE TABLE `volume` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `hash` TEXT, `volume` FLOAT)")));
+	QVERIFY(query.exec(QLatin1String("CREATE UNIQUE INDEX `volume_hash` ON `volume`(`hash`)")));
+	QVERIFY(query.exec(QLatin1String(
+		"CREATE TABLE `nicknames` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `hash` TEXT, `nickname` TEXT)")));
+	QVERIFY(query.exec(QLatin1String("CREATE UNIQUE INDEX `nicknames_hash` ON `nicknames`(`hash`)")));
+	QVERIFY(query.exec(QLatin1String("CREATE TABLE `filtered_channels` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, "
+									 "`server_cert_digest` TEXT NOT NULL, `channel_id` INTEGER NOT NULL, "
+									 "`filter_mode` INTEGER DEFAULT 1)")));
+	QVERIFY(query.exec(QLatin1String("CREATE UNIQUE INDEX `filtered_channels_entry` ON "
+									 "`filtered_channels`(`server_cert_digest`, `channel_id`)")));
+}
+
+void TestDatabaseCache::cleanup() {
+	QSqlQuery query(db);
+	for (const QString &table : db.tables()) {
+		query.exec(QString::fromLatin1("DROP TABLE `%1`").arg(table));
+	}
+}
+
+void TestDatabaseCache::cleanupTestCase() {
+	db.close();
+	db = QSqlDatabase();
+	QSqlDatabase::removeDatabase(QLatin1String("TestDatabaseCache"));
+}
+
+void TestDatabaseCache::load() {
+	QSqlQuery query(db);
+	QVERIFY(query.exec(QLatin1String("INSERT INTO `ignored` (`hash`) VALUES ('a')")));
+	QVERIFY(query.exec(QLatin1String("INSERT INTO `ignored_tts` (`hash`) VALUES ('b')")));
+	QVERIFY(query.exec(QLatin1String("INSERT INTO `muted` (`hash`) VALUES ('c')")));
+	QVERIFY(query.exec(QLatin1String("INSERT INTO `volume` (`hash`, `volume`) VALUES ('a', '0.5')")));
+	QVERIFY(query.exec(QLatin1String("INSERT INTO `nicknames` (`hash`, `nickname`) VALUES ('b', 'Bee')")));
+
+	DatabaseCache cache;
+	cache.load(db);
+
+	QVERIFY(cache.isLocalIgnored(QLatin1String("a")));
+	QVERIFY(!cache.isLocalIgnored(QLatin1String("b")));
+	QVERIFY(cache.isLocalIgnoredTTS(QLatin1String("b")));
+	QVERIFY(cache.isLocalMuted(QLatin1String("c")));
+	QVERIFY(!cache.isLocalMuted(QLatin1String("a")));
+	QCOMPARE(cache.getUserLocalVolume(QLatin1String("a")), 0.5f);
+	QCOMPARE(cache.getUserLocalVolume(QLatin1String("b")), 1.0f);
+	QCOMPARE(cache.getUserLocalNickname(QLatin1String("b")), QLatin1String("Bee"));
+	QVERIFY(cache.getUserLocalNickname(QLatin1String("a")).isNull());
+	QVERIFY(!cache.hasPendingWrites());
+}
+
+void TestDatabaseCache::writeThrough() {
+	DatabaseCache cache;
+	cache.load(db);
+
+	cache.setLocalIgnored(QLatin1String("a"), true);
+	cache.setLocalIgnoredTTS(QLatin1String("a"), true);
+	cache.setLocalMuted(QLatin1String("a"), true);
+	cache.setLocalMuted(QLatin1String("b"), true);
+	cache.setUserLocalVolume(QLatin1String("a"), 2.0f);
+	cache.setUserLocalNickname(QLatin1String("a"), QLatin1String("Ay"));
+
+	// The changes take effect right away, but are only written when flushing
+	QVERIFY(cache.isLocalIgnored(QLatin1String("a")));
+	QCOMPARE(cache.getUserLocalVolume(QLatin1String("a")), 2.0f);
+	QVERIFY(cache.hasPendingWrites());
+	QCOMPARE(count(QLatin1String("muted")), 0);
+
+	cache.flush(db);
+	QVERIFY(!cache.hasPendingWrites());
+	QCOMPARE(count(QLatin1String("ignored"), QLatin1String("`hash` = 'a'")), 1);
+	QCOMPARE(count(QLatin1String("ignored_tts"), QLatin1String("`hash` = 'a'")), 1);
+	QCOMPARE(count(QLatin1String("muted")), 2);
+	QCOMPARE(count(QLatin1String("volume"), QLatin1String("`hash` = 'a' AND `volume` = 2")), 1);
+	QCOMPARE(count(QLatin1String("nicknames"), QLatin1String("`hash` = 'a' AND `nickname` = 'Ay'")), 1);
+
+	// Changes that don't change anything aren't written
+	cache.setLocalIgnored(QLatin1String("a"), true);
+	cache.setLocalMuted(QLatin1String("c"), false);
+	QVERIFY(!cache.hasPendingWrites());
+
+	// The order of the changes is kept
+	cache.setLocalIgnored(QLatin1String("a"), false);
+	cache.clearLocalMuted();
+	cache.setLocalMuted(QLatin1String("c"), true);
+	cache.flush(db);
+	QCOMPARE(count(QLatin1String("ignored")), 0);
+	QCOMPARE(count(QLatin1String("muted")), 1);
+	QVERIFY(!cache.isLocalMuted(QLatin1String("a")));
+	QVERIFY(cache.isLocalMuted(QLatin1String("c")));
+
+	// A fresh cache sees the same as the one that made the changes
+	DatabaseCache reloaded;
+	reloaded.load(db);
+	QVERIFY(!reloaded.isLocalIgnored(QLatin1String("a")));
+	QVERIFY(reloaded.isLocalIgnoredTTS(QLatin1String("a")));
+	QVERIFY(reloaded.isLocalMuted(QLatin1String("c")));
+	QCOMPARE(reloaded.getUserLocalVolume(QLatin1String("a")), 2.0f);
+	QCOMPARE(reloaded.getUserLocalNickname(QLatin1String("a")), QLatin1String("Ay"));
+}
+
+void TestDatabaseCache::filterModes() {
+	const QByteArray server      = QByteArray("server");
+	const QByteArray otherServer = QByteArray("other");
+
+	DatabaseCache cache;
+	cache.load(db);
+
+	cache.setChannelFilterMode(server, 1, ChannelFilterMode::HIDE);
+	cache.setChannelFilterMode(server, 2, ChannelFilterMode::PIN);
+	cache.setChannelFilterMode(otherServer, 1, ChannelFilterMode::PIN);
+	cache.setChannelFilterMode(otherServer, 1, ChannelFilterMode::NORMAL);
+	cache.flush(db);
+
+	QCOMPARE(cache.getChannelFilterMode(server, 1), ChannelFilterMode::HIDE);
+	QCOMPARE(cache.getChannelFilterMode(otherServer, 1), ChannelFilterMode::NORMAL);
+	QCOMPARE(count(QLatin1String("filtered_channels")), 2);
+
+	DatabaseCache reloaded;
+	reloaded.load(db);
+	QCOMPARE(reloaded.getChannelFilterMode(server, 1), ChannelFilterMode::HIDE);
+	QCOMPARE(reloaded.getChannelFilterMode(server, 2), ChannelFilterMode::PIN);
+	QCOMPARE(reloaded.getChannelFilterMode(server, 3), ChannelFilterMode::NORMAL);
+	QCOMPARE(reloaded.getChannelFilterMode(otherServer, 1), ChannelFilterMode::NORMAL);
+}
+
+void TestDatabaseCache::seenComments() {
+	QSqlQuery query(db);
+	QVERIFY(query.exec(QLatin1String(
+		"INSERT INTO `comments` (`who`, `comment`, `seen`) VALUES ('a', X'01', datetime('now', '-1 months'))")));
+
+	DatabaseCache cache;
+	cache.load(db);
+
+	QVERIFY(cache.seenComment(QLatin1String("a"), QByteArray("\x01")));
+	QVERIFY(!cache.seenComment(QLatin1String("a"), QByteArray("\x02")));
+	QVERIFY(!cache.seenComment(QLatin1String("b"), QByteArray("\x01")));
+
+	// Seeing a comment again counts as seeing it now
+	cache.flush(db);
+	QCOMPARE(count(QLatin1String("comments"), QLatin1String("`seen` > datetime('now', '-1 days')")), 1);
+
+	cache.setSeenComment(QLatin1String("b"), QByteArray("\x02"));
+	QVERIFY(cache.seenComment(QLatin1String("b"), QByteArray("\x02")));
+	cache.flush(db);
+	QCOMPARE(count(QLatin1String("comments")), 2);
+}
+
+void TestDatabaseCache::sync() {
+	// Every tenth user of the server is muted and has their volume adjusted, every fifth one has a comment that has
+	// been seen before
+	QSqlQuery query(db);
+	db.transaction();
+	for (int i = 0; i < USER_COUNT; ++i) {
+		if (i % 10 == 0) {
+			query.prepare(QLatin1String("INSERT INTO `muted` (`hash`) VALUES (?)"));
+			query.addBindValue(userHash(i));
+			QVERIFY(query.exec());
+
+			query.prepare(QLatin1String("INSERT INTO `volume` (`hash`, `volume`) VALUES (?, ?)"));
+			query.addBindValue(userHash(i));
+			query.addBindValue(QLatin1String("0.5"));
+			QVERIFY(query.exec());
+		}
+		if (i % 5 == 0) {
+			query.prepare(QLatin1String("INSERT INTO `comments` (`who`, `comment`, `seen`) VALUES (?, ?, 0)"));
+			query.addBindValue(userHash(i));
+			query.addBindValue(QByteArray::number(i));
+			QVERIFY(query.exec());
+		}
+	}
+	db.commit();
+
+	DatabaseCache cache;
+	cache.load(db);
+
+	// What the client looks up for every user that shows up during the synchronization
+	int muted = 0;
+	int seen  = 0;
+	for (int i = 0; i < USER_COUNT; ++i) {
+		const QString hash = userHash(i);
+
+		if (cache.isLocalMuted(hash)) {
+			++muted;
+			QCOMPARE(cache.getUserLocalVolume(hash), 0.5f);
+		} else {
+			QCOMPARE(cache.getUserLocalVolume(hash), 1.0f);
+		}
+		QVERIFY(!cache.isLocalIgnored(hash));
+		QVERIFY(!cache.isLocalIgnoredTTS(hash));
+		QVERIFY(cache.getUserLocalNickname(hash).isNull());
+
+		if (cache.seenComment(hash, QByteArray::number(i))) {
+			++seen;
+		}
+	}
+
+	QCOMPARE(muted, USER_COUNT / 10);
+	QCOMPARE(seen, USER_COUNT / 5);
+
+	// Updating the time the comments have been seen at happens in a single transaction
+	cache.flush(db);
+	QCOMPARE(count(QLatin1String("comments"), QLatin1String("`seen` = 0")), 0);
+}
+
+QTEST_MAIN(TestDatabaseCache)
+#include "TestDatabaseCache.moc"
@@ -0,0 +1,172 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "HTMLFilter.h"
+
+#include <QObject>
+#include <QtCore>
+#include <QtTest>
+
+/// The way HTMLFilter::filter used to convert documents, by parsing them with QXmlStreamReader
+static bool referenceFilter(const QString &in, QString &out) {
+	if (!in.contains(QLatin1Char('<'))) {
+		out = in.simplified();
+		return true;
+	}
+
+	QXmlStreamReader qxsr(QString::fromLatin1("<document>%1</document>").arg(in));
+	QString qs;
+	while (!qxsr.atEnd()) {
+		switch (qxsr.readNext()) {
+			case QXmlStreamReader::Invalid:
+				return false;
+			case QXmlStreamReader::Characters:
+				qs += qxsr.text();
+				break;
+			case QXmlStreamReader::EndElement:
+				if ((qxsr.name() == QLatin1String("br")) || (qxsr.name() == QLatin1String("p")))
+					qs += QLatin1Char('\n');
+				break;
+			default:
+				break;
+		}
+	}
+
+	out = qs.simplified();
+	out.replace(QLatin1Char('<'), QLatin1String("&lt;"));
+	out.replace(QLatin1Char('>'), QLatin1String("&gt;"));
+	return true;
+}
+
+class TestHTMLFilter : public QObject {
+	Q_OBJECT
+private slots:
+	void filter_data();
+	void filter();
+	void filterMatchesXmlStreamReader_data();
+	void filterMatchesXmlStreamReader();
+	void measure_data();
+	void measure();
+	void measureLargeImage();
+};
+
+void TestHTMLFilter::filter_data() {
+	QTest::addColumn< QString >("in");
+	QTest::addColumn< bool >("ok");
+	QTest::addColumn< QString >("out");
+
+	QTest::newRow("plain") << QString::fromLatin1("  hello \n world ") << true << QString::fromLatin1("hello world");
+	QTest::newRow("plain keeps entities") << QString::fromLatin1("a &amp; b > c") << true
+										  << QString::fromLatin1("a &amp; b > c");
+	QTest::newRow("tags") << QString::fromLatin1("<b>bold</b> <i>text</i>") << true
+						  << QString::fromLatin1("bold text");
+	QTest::newRow("line breaks") << QString::fromLatin1("line<br/>next<p>para</p>end") << true
+								 << QString::fromLatin1("line nextpara end");
+	QTest::newRow("references") << QString::fromLatin1("<i>&lt;s&gt;</i> &amp; &#65;&#x42;") << true
+								<< QString::fromLatin1("&lt;s&gt; & AB");
+	QTest::newRow("attributes") << QString::fromLatin1("<a href=\"x\" title='y &amp; z'>link</a>") << true
+								<< QString::fromLatin1("link");
+	QTest::newRow("comment and CDATA") << QString::fromLatin1("<!-- c --><![CDATA[<raw>]]>x") << true
+									   << QString::fromLatin1("&lt;raw&gt;x");
+	QTest::newRow("unclosed") << QString::fromLatin1("<b>unclosed") << false << QString();
+	QTest::newRow("mismatched") << QString::fromLatin1("<b>x</i>") << false << QString();
+	QTest::newRow("unknown entity") << QString::fromLatin1("&nbsp;<br/>") << false << QString();
+	QTest::newRow("invalid character") << QString::fromLatin1("&#0;<br/>") << false << QString();
+	QTest::newRow("unquoted attribute") << QString::fromLatin1("<img src=foo/>") << false << QString();
+	QTest::newRow("unseparated attributes") << QString::fromLatin1("<b a='1'b='2'>x</b>") << false << QString();
+	QTest::newRow("doctype") << QString::fromLatin1("<!DOCTYPE html>") << false << QString();
+	QTest::newRow("truncated") << QString::fromLatin1("text <") << false << QString();
+	QTest::newRow("duplicate attribute") << QString::fromLatin1("<a href='x' href='y'>link</a>") << false << QString();
+	QTest::newRow("CDATA end in text") << QString::fromLatin1("<b>a ]]> b</b>") << false << QString();
+	QTest::newRow("control character") << QString::fromLatin1("<b>a\x01z</b>") << false << QString();
+	QTest::newRow("space in reference") << QString::fromLatin1("<b>&#x 41;</b>") << false << QString();
+	QTest::newRow("sign in reference") << QString::fromLatin1("<b>&#+65;</b>") << false << QString();
+}
+
+void TestHTMLFilter::filter() {
+	QFETCH(QString, in);
+	QFETCH(bool, ok);
+	QFETCH(QString, out);
+
+	QString result = QString::fromLatin1("unchanged");
+	QCOMPARE(HTMLFilter::filter(in, result), ok);
+	QCOMPARE(result, ok ? out : QString::fromLatin1("unchanged"));
+}
+
+void TestHTMLFilter::filterMatchesXmlStreamReader_data() {
+	QTest::addColumn< QString >("in");
+
+	QTest::newRow("message") << QString::fromLatin1("<p>Hello <b>there</b>,<br/>how are <i>you</i>?</p>");
+	QTest::newRow("link") << QString::fromLatin1("<a href=\"https://www.mumble.info/\">Mumble</a> &gt; all");
+	QTest::newRow("nested") << QString::fromLatin1("<div><span style='color:#ff0000'>red <u>and</u></span></div>");
+	QTest::newRow("image") << QString::fromLatin1("look: <img src=\"data:image/png;base64,iVBORw0KGgo=\" />");
+	QTest::newRow("unicode") << QString::fromUtf8("<b>\xc3\xa4\xc3\xb6\xc3\xbc</b> &#x1F600; \xe2\x82\xac");
+	QTest::newRow("whitespace") << QString::fromLatin1("<p>\n\t a </p>\n<p> b\r\n</p>");
+	QTest::newRow("broken") << QString::fromLatin1("<p>unclosed <b>tags</p>");
+	QTest::newRow("brackets") << QString::fromLatin1("<b>a ]] b ]&gt; c ]]&gt; d]</b>");
+	QTest::newRow("duplicate attribute") << QString::fromLatin1("<a href='x' title='y' href='z'>link</a>");
+	QTest::newRow("CDATA end in text") << QString::fromLatin1("<b>a ]]> b</b>");
+	QTest::newRow("control character in text") << QString::fromLatin1("<b>a\x01z</b>");
+	QTest::newRow("control character in attribute") << QString::fromLatin1("<a title='\x01'>x</a>");
+	QTest::newRow("control character in comment") << QString::fromLatin1("<!-- \x1f --><b>x</b>");
+	QTest::newRow("control character in CDATA") << QString::fromLatin1("<![CDATA[\x08]]><b>x</b>");
+	QTest::newRow("noncharacter") << QString::fromUtf8("<b>\xef\xbf\xbf</b>");
+	QTest::newRow("leading space in reference") << QString::fromLatin1("<b>&# 65;</b>");
+	QTest::newRow("trailing space in reference") << QString::fromLatin1("<b>&#65 ;</b>");
+	QTest::newRow("plus in reference") << QString::fromLatin1("<b>&#+65;</b>");
+	QTest::newRow("minus in reference") << QString::fromLatin1("<b>&#x-41;</b>");
+	QTest::newRow("prefix in reference") << QString::fromLatin1("<b>&#x0x41;</b>");
+	QTest::newRow("empty reference") << QString::fromLatin1("<b>&#x;</b>");
+	QTest::newRow("uppercase hex reference") << QString::fromLatin1("<b>&#x4a;&#x4A;</b>");
+}
+
+void TestHTMLFilter::filterMatchesXmlStreamReader() {
+	QFETCH(QString, in);
+
+	QString expected;
+	QString result;
+	QCOMPARE(HTMLFilter::filter(in, result), referenceFilter(in, expected));
+	QCOMPARE(result, expected);
+}
+
+void TestHTMLFilter::measure_data() {
+	QTest::addColumn< QString >("in");
+	QTest::addColumn< bool >("ok");
+	QTest::addColumn< int >("imageLength");
+
+	QTest::newRow("text") << QString::fromLatin1("<p>just text</p>") << true << 0;
+	QTest::newRow("image") << QString::fromLatin1("<p>hi</p><img src=\"data:image/png;base64,AAAA\" alt='x'/>") << true
+						   << 26;
+	QTest::newRow("two images") << QString::fromLatin1("<img src='ab'/><img alt=\"src\" src=\"cde\"/>") << true << 5;
+	QTest::newRow("src of another element") << QString::fromLatin1("<script src='abc'></script>") << true << 0;
+	QTest::newRow("malformed") << QString::fromLatin1("<img src='abc'>") << false << 0;
+	QTest::newRow("tag in attribute") << QString::fromLatin1("<img src='<'/>") << false << 0;
+}
+
+void TestHTMLFilter::measure() {
+	QFETCH(QString, in);
+	QFETCH(bool, ok);
+	QFETCH(int, imageLength);
+
+	HTMLFilter::Measurement measurement;
+	QCOMPARE(HTMLFilter::measure(in, measurement), ok);
+	if (ok) {
+		QCOMPARE(measurement.imageLength, imageLength);
+		QCOMPARE(measurement.textLength, in.size() - imageLength);
+	}
+}
+
+void TestHTMLFilter::measureLargeImage() {
+	const QString image = QString(1024 * 1024, QLatin1Char('A'));
+	const QString text  = QString::fromLatin1("<p>Look at this:</p><img src=\"data:image/png;base64,%1\"/>").arg(image);
+
+	HTMLFilter::Measurement measurement;
+	QVERIFY(HTMLFilter::measure(text, measurement));
+	QCOMPARE(measurement.imageLength, image.size() + 22);
+	QCOMPARE(measurement.textLength, 20 + 13);
+}
+
+QTEST_MAIN(TestHTMLFilter)
+#include "TestHTMLFilter.moc"
@@ -0,0 +1,273 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "IceCallbackDispatcher.h"
+
+#include <QMutex>
+#include <QObject>
+#include <QtTest>
+
+#include <atomic>
+#include <stdexcept>
+
+/// Simulates a callback registered via Ice. Its invocations stay in flight until they are completed explicitly (as
+/// the ones of a slow or hung callback do), unless it has been told to complete them immediately.
+class Callback {
+public:
+	explicit Callback(bool completeImmediately = false) : m_completeImmediately(completeImmediately) {}
+
+	IceCallbackDispatcher::Invocation event(int value) {
+		return [this, value](const IceCallbackDispatcher::Completion &done) {
+			{
+				QMutexLocker lock(&m_mutex);
+				m_received << value;
+				if (!m_completeImmediately) {
+					m_pending << done;
+					return;
+				}
+			}
+
+			done(true);
+		};
+	}
+
+	std::function< void() > failureHandler() {
+		return [this]() { m_failures++; };
+	}
+
+	QList< int > received() const {
+		QMutexLocker lock(&m_mutex);
+		return m_received;
+	}
+
+	int inFlight() const {
+		QMutexLocker lock(&m_mutex);
+		return m_pending.size();
+	}
+
+	int failures() const { return m_failures; }
+
+	void complete(bool success = true) {
+		QList< IceCallbackDispatcher::Completion > pending;
+		{
+			QMutexLocker lock(&m_mutex);
+			pending.swap(m_pending);
+		}
+
+		for (const IceCallbackDispatcher::Completion &done : pending) {
+			done(success);
+		}
+	}
+
+private:
+	const bool m_completeImmediately;
+	mutable QMutex m_mutex;
+	QList< int > m_received;
+	QList< IceCallbackDispatcher::Completion > m_pending;
+	std::atomic_int m_failures{ 0 };
+};
+
+class TestIceCallbackDispatcher : public QObject {
+	Q_OBJECT
+private slots:
+	void preservesOrder();
+	void postDoesNotWaitForCallback();
+	void slowTargetDoesNotBlockOthers();
+	void coalesces();
+	void endCoalescing();
+	void overflowDropsTarget();
+	void failedInvocationDropsTarget();
+	void throwingInvocationDropsTarget();
+};
+
+void TestIceCallbackDispatcher::preservesOrder() {
+	Callback callback(true);
+
+	IceCallbackDispatcher dispatcher(1000);
+	dispatcher.start();
+	dispatcher.addTarget(QLatin1String("target"), callback.failureHandler());
+
+	QList< int > expected;
+	for (int i = 0; i < 500; ++i) {
+		dispatcher.post(QLatin1String("target"), callback.event(i));
+		expected << i;
+	}
+
+	QTRY_COMPARE(callback.received(), expected);
+	QCOMPARE(callback.failures(), 0);
+}
+
+void TestIceCallbackDispatcher::postDoesNotWaitForCallback() {
+	Callback callback;
+
+	IceCallbackDispatcher dispatcher(1000);
+	dispatcher.start();
+	dispatcher.addTarget(QLatin1String("target"), callback.failureHandler());
+
+	dispatcher.post(QLatin1String("target"), callback.event(0));
+	QTRY_COMPARE(callback.inFlight(), 1);
+
+	// The callback doesn't answer, yet posting more events returns right away
+	for (int i = 1; i <= 100; ++i) {
+		dispatcher.post(QLatin1String("target"), callback.event(i));
+	}
+	QCOMPARE(dispatcher.queued(QLatin1String("target")), static_cast< std::size_t >(100));
+	QCOMPARE(callback.received(), QList< int >{ 0 });
+
+	// Only a single invocation is in flight at a time
+	callback.complete();
+	QTRY_COMPARE(callback.inFlight(), 1);
+	QCOMPARE(callback.received(), (QList< int >{ 0, 1 }));
+	QCOMPARE(dispatcher.queued(QLatin1String("target")), static_cast< std::size_t >(99));
+}
+
+void TestIceCallbackDispatcher::slowTargetDoesNotBlockOthers() {
+	Callback slow;
+	Callback fast(true);
+
+	IceCallbackDispatcher dispatcher(1000);
+	dispatcher.start();
+	dispatcher.addTarget(QLatin1String("slow"), slow.failureHandler());
+	dispatcher.addTarget(QLatin1String("fast"), fast.failureHandler());
+
+	QList< int > expected;
+	for (int i = 0; i < 100; ++i) {
+		dispatcher.post(QLatin1String("slow"), slow.event(i));
+		dispatcher.post(QLatin1String("fast"), fast.event(i));
+		expected << i;
+	}
+
+	QTRY_COMPARE(fast.received(), expected);
+	QCOMPARE(slow.received(), QList< int >{ 0 });
+	QCOMPARE(dispatcher.queued(QLatin1String("slow")), static_cast< std::size_t >(99));
+}
+
+void TestIceCallbackDispatcher::coalesces() {
+	Callback callback;
+
+	IceCallbackDispatcher dispatcher(1000);
+	dispatcher.start();
+	dispatcher.addTarget(QLatin1String("target"), callback.failureHandler());
+
+	dispatcher.post(QLatin1String("target"), callback.event(0), QLatin1String("key"));
+	QTRY_COMPARE(callback.inFlight(), 1);
+
+	// The event in flight can't be replaced anymore, but the queued ones can
+	dispatcher.post(QLatin1String("target"), callback.event(1), QLatin1String("key"));
+	dispatcher.post(QLatin1String("target"), callback.event(2));
+	dispatcher.post(QLatin1String("target"), callback.event(3), QLatin1String("key"));
+	dispatcher.post(QLatin1String("target"), callback.event(4), QLatin1String("other"));
+	dispatcher.post(QLatin1String("target"), callback.event(5), QLatin1String("key"));
+	QCOMPARE(dispatcher.queued(QLatin1String("target")), static_cast< std::size_t >(3));
+
+	for (int i = 0; i < 3; ++i) {
+		callback.complete();
+		QTRY_COMPARE(callback.received().size(), i + 2);
+	}
+
+	// The coalesced event is delivered in the position of the latest one, so that it doesn't overtake the events
+	// posted in between (e.g. the creation of the object it concerns)
+	QCOMPARE(callback.received(), (QList< int >{ 0, 2, 4, 5 }));
+}
+
+void TestIceCallbackDispatcher::endCoalescing() {
+	Callback callback;
+
+	IceCallbackDispatcher dispatcher(1000);
+	dispatcher.start();
+	dispatcher.addTarget(QLatin1String("target"), callback.failureHandler());
+
+	dispatcher.post(QLatin1String("target"), callback.event(0));
+	QTRY_COMPARE(callback.inFlight(), 1);
+
+	// The state of a user, who disconnects. Their session is then reused by the next user, who connects and whose
+	// state changes.
+	dispatcher.post(QLatin1String("target"), callback.event(1), QLatin1String("userStateChanged/5"));
+	dispatcher.endCoalescing(QLatin1String("target"), QLatin1String("userStateChanged/5"));
+	dispatcher.post(QLatin1String("target"), callback.event(2));
+	dispatcher.post(QLatin1String("target"), callback.event(3), QLatin1String("userStateChanged/5"));
+	QCOMPARE(dispatcher.queued(QLatin1String("target")), static_cast< std::size_t >(3));
+
+	// Delivering the previous user's state doesn't affect the coalescing of the new user's
+	callback.complete();
+	QTRY_COMPARE(callback.received().size(), 2);
+	dispatcher.post(QLatin1String("target"), callback.event(4), QLatin1String("userStateChanged/5"));
+	QCOMPARE(dispatcher.queued(QLatin1String("target")), static_cast< std::size_t >(2));
+
+	for (int i = 0; i < 2; ++i) {
+		callback.complete();
+		QTRY_COMPARE(callback.received().size(), i + 3);
+	}
+
+	QCOMPARE(callback.received(), (QList< int >{ 0, 1, 2, 4 }));
+}
+
+void TestIceCallbackDispatcher::overflowDropsTarget() {
+	Callback callback;
+
+	IceCallbackDispatcher dispatcher(10);
+	dispatcher.start();
+	dispatcher.addTarget(QLatin1String("target"), callback.failureHandler());
+
+	dispatcher.post(QLatin1String("target"), callback.event(0));
+	QTRY_COMPARE(callback.inFlight(), 1);
+
+	for (int i = 1; i <= 10; ++i) {
+		dispatcher.post(QLatin1String("target"), callback.event(i));
+	}
+	QCOMPARE(callback.failures(), 0);
+
+	dispatcher.post(QLatin1String("target"), callback.event(11));
+	QCOMPARE(callback.failures(), 1);
+	QCOMPARE(dispatcher.queued(QLatin1String("target")), static_cast< std::size_t >(0));
+
+	// Late completions of the dropped target are ignored
+	callback.complete();
+	dispatcher.post(QLatin1String("target"), callback.event(12));
+	QTest::qWait(50);
+	QCOMPARE(callback.received(), QList< int >{ 0 });
+	QCOMPARE(callback.failures(), 1);
+}
+
+void TestIceCallbackDispatcher::failedInvocationDropsTarget() {
+	Callback broken;
+	Callback working(true);
+
+	IceCallbackDispatcher dispatcher(1000);
+	dispatcher.start();
+	dispatcher.addTarget(QLatin1String("broken"), broken.failureHandler());
+	dispatcher.addTarget(QLatin1String("working"), working.failureHandler());
+
+	dispatcher.post(QLatin1String("broken"), broken.event(0));
+	dispatcher.post(QLatin1String("broken"), broken.event(1));
+	QTRY_COMPARE(broken.inFlight(), 1);
+
+	broken.complete(false);
+	QTRY_COMPARE(broken.failures(), 1);
+	QCOMPARE(dispatcher.queued(QLatin1String("broken")), static_cast< std::size_t >(0));
+
+	dispatcher.post(QLatin1String("broken"), broken.event(2));
+	dispatcher.post(QLatin1String("working"), working.event(0));
+	QTRY_COMPARE(working.received(), QList< int >{ 0 });
+	QCOMPARE(broken.received(), QList< int >{ 0 });
+	QCOMPARE(working.failures(), 0);
+}
+
+void TestIceCallbackDispatcher::throwingInvocationDropsTarget() {
+	std::atomic_int failures{ 0 };
+
+	IceCallbackDispatcher dispatcher(1000);
+	dispatcher.start();
+	dispatcher.addTarget(QLatin1String("target"), [&failures]() { failures++; });
+
+	dispatcher.post(QLatin1String("target"), [](const IceCallbackDispatcher::Completion &) {
+		throw std::runtime_error("Connection refused");
+	});
+
+	QTRY_COMPARE(failures.load(), 1);
+}
+
+QTEST_MAIN(TestIceCallbackDispatcher)
+#include "TestIceCallbackDispatcher.moc"
@@ -0,0 +1,185 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "LinkComponents.h"
+
+#include <QObject>
+#include <QtCore>
+#include <QtTest>
+
+#include <random>
+
+static QSet< unsigned int > linked(const LinkComponents &components, unsigned int channel) {
+	const std::vector< unsigned int > &channels = components.linkedChannels(channel);
+	return QSet< unsigned int >(channels.begin(), channels.end());
+}
+
+class TestLinkComponents : public QObject {
+	Q_OBJECT
+private slots:
+	void link();
+	void unlink();
+	void unlinkAll();
+	void versions();
+	void matchesTraversal();
+};
+
+void TestLinkComponents::link() {
+	LinkComponents components;
+	QVERIFY(components.linkedChannels(1).empty());
+	QCOMPARE(components.count(), std::size_t(0));
+
+	components.link(1, 2);
+	components.link(3, 4);
+	QCOMPARE(components.count(), std::size_t(2));
+	QCOMPARE(linked(components, 1), QSet< unsigned int >({ 1, 2 }));
+	QCOMPARE(linked(components, 4), QSet< unsigned int >({ 3, 4 }));
+
+	components.link(2, 3);
+	QCOMPARE(components.count(), std::size_t(1));
+	QCOMPARE(linked(components, 1), QSet< unsigned int >({ 1, 2, 3, 4 }));
+	QCOMPARE(linked(components, 4), QSet< unsigned int >({ 1, 2, 3, 4 }));
+
+	// Links are not counted
+	components.link(3, 2);
+	components.link(2, 2);
+	QCOMPARE(components.linkedChannels(1).size(), std::size_t(4));
+}
+
+void TestLinkComponents::unlink() {
+	LinkComponents components;
+	// A ring of four channels with a tail
+	components.link(1, 2);
+	components.link(2, 3);
+	components.link(3, 4);
+	components.link(4, 1);
+	components.link(4, 5);
+
+	// Still linked the other way round
+	components.unlink(1, 2);
+	QCOMPARE(components.count(), std::size_t(1));
+	QCOMPARE(linked(components, 1), QSet< unsigned int >({ 1, 2, 3, 4, 5 }));
+
+	components.unlink(3, 4);
+	QCOMPARE(components.count(), std::size_t(2));
+	QCOMPARE(linked(components, 1), QSet< unsigned int >({ 1, 4, 5 }));
+	QCOMPARE(linked(components, 2), QSet< unsigned int >({ 2, 3 }));
+
+	components.unlink(4, 5);
+	QCOMPARE(linked(components, 1), QSet< unsigned int >({ 1, 4 }));
+	QVERIFY(components.linkedChannels(5).empty());
+	QCOMPARE(components.version(5), std::uint64_t(0));
+
+	// Unlinking channels that aren't linked has no effect
+	components.unlink(1, 3);
+	components.unlink(6, 7);
+	QCOMPARE(components.count(), std::size_t(2));
+}
+
+void TestLinkComponents::unlinkAll() {
+	LinkComponents components;
+	// A star around channel 1
+	components.link(1, 2);
+	components.link(1, 3);
+	components.link(1, 4);
+	components.link(3, 4);
+
+	components.unlinkAll(1);
+	QVERIFY(components.linkedChannels(1).empty());
+	QVERIFY(components.linkedChannels(2).empty());
+	QCOMPARE(linked(components, 3), QSet< unsigned int >({ 3, 4 }));
+	QCOMPARE(components.count(), std::size_t(1));
+
+	components.clear();
+	QVERIFY(components.linkedChannels(3).empty());
+	QCOMPARE(components.count(), std::size_t(0));
+}
+
+void TestLinkComponents::versions() {
+	LinkComponents components;
+	components.link(1, 2);
+	components.link(3, 4);
+
+	const std::uint64_t first  = components.version(1);
+	const std::uint64_t second = components.version(3);
+	QVERIFY(first != 0);
+	QVERIFY(first != second);
+	QCOMPARE(components.version(2), first);
+
+	// Changes to a component don't affect the others
+	components.link(3, 5);
+	QVERIFY(components.version(3) != second);
+	QCOMPARE(components.version(1), first);
+
+	components.link(2, 3);
+	const std::uint64_t merged = components.version(1);
+	QVERIFY(merged != first);
+	QCOMPARE(components.version(5), merged);
+
+	components.unlink(2, 3);
+	QVERIFY(components.version(1) != merged);
+	QVERIFY(components.version(3) != merged);
+	QVERIFY(components.version(1) != components.version(3));
+}
+
+void TestLinkComponents::matchesTraversal() {
+	constexpr unsigned int CHANNELS = 40;
+
+	LinkComponents components;
+	QHash< unsigned int, QSet< unsigned int > > links;
+
+	std::mt19937 rng(42);
+	for (int i = 0; i < 20000; ++i) {
+		const unsigned int channel = rng() % CHANNELS;
+		const unsigned int other   = rng() % CHANNELS;
+
+		switch (rng() % 10) {
+			case 0:
+				components.unlinkAll(channel);
+				for (unsigned int l : links.take(channel)) {
+					links[l].remove(channel);
+				}
+				break;
+			case 1:
+			case 2:
+			case 3:
+			case 4:
+				components.unlink(channel, other);
+				links[channel].remove(other);
+				links[other].remove(channel);
+				break;
+			default:
+				components.link(channel, other);
+				if (channel != other) {
+					links[channel].insert(other);
+					links[other].insert(channel);
+				}
+				break;
+		}
+
+		// Compare with what walking the links (like Channel::allLinks does) yields
+		for (unsigned int c = 0; c < CHANNELS; ++c) {
+			QSet< unsigned int > expected;
+			if (!links.value(c).isEmpty()) {
+				QList< unsigned int > stack = { c };
+				expected.insert(c);
+				while (!stack.isEmpty()) {
+					for (unsigned int l : links.value(stack.takeLast())) {
+						if (!expected.contains(l)) {
+							expected.insert(l);
+							stack.append(l);
+						}
+					}
+				}
+			}
+
+			QCOMPARE(linked(components, c), expected);
+			QCOMPARE(components.linkedChannels(c).size(), static_cast< std::size_t >(expected.size()));
+		}
+	}
+}
+
+QTEST_MAIN(TestLinkComponents)
+#include "TestLinkComponents.moc"
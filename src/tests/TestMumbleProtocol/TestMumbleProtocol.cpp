@@ -11,6 +11,7 @@
 #include <QtTest>
 
 #include <cstring>
+#include <random>
 #include <sstream>
 #include <string>
 
@@ -240,6 +241,189 @@ template< Mumble::Protocol::Role encoderRole, Mumble::Protocol::Role decoderRole
 	}
 }
 
+/// Decodes an audio message the way UDPDecoder used to do it: by parsing it into a Protobuf object
+bool referenceDecode(const std::string &message, Mumble::Protocol::Role role, MumbleUDP::Audio &parsed,
+					 Mumble::Protocol::AudioData &data) {
+	data = {};
+
+	if (!parsed.ParseFromString(message)) {
+		return false;
+	}
+
+	data.targetOrContext = role == Mumble::Protocol::Role::Client ? parsed.context() : parsed.target();
+	data.usedCodec       = Mumble::Protocol::AudioCodec::Opus;
+	data.senderSession   = parsed.sender_session();
+	data.frameNumber     = parsed.frame_number();
+	if (parsed.opus_data().empty()) {
+		return false;
+	}
+	data.payload     = { reinterpret_cast< const Mumble::Protocol::byte * >(parsed.opus_data().data()),
+						 parsed.opus_data().size() };
+	data.isLastFrame = parsed.is_terminator();
+
+	if (parsed.positional_data_size() != 0) {
+		if (parsed.positional_data_size() != 3) {
+			return false;
+		}
+		for (int i = 0; i < 3; ++i) {
+			data.position[static_cast< std::size_t >(i)] = parsed.positional_data(i);
+		}
+		data.containsPositionalData = true;
+	}
+
+	data.volumeAdjustment = VolumeAdjustment::fromFactor(parsed.volume_adjustment());
+	if (data.volumeAdjustment.factor == 0.0f) {
+		data.volumeAdjustment = VolumeAdjustment::fromFactor(1.0f);
+	}
+
+	return true;
+}
+
+void appendVarint(std::string &message, std::uint64_t value) {
+	while (value >= 0x80) {
+		message += static_cast< char >((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	message += static_cast< char >(value);
+}
+
+/// Returns a random (encoded) field of an audio message. Since Protobuf messages may be concatenated, any sequence of
+/// these is a message as well (with fields appearing in any order and any number of times).
+std::string randomAudioField(std::mt19937 &rng) {
+	MumbleUDP::Audio field;
+	std::string encoded;
+
+	switch (rng() % 11) {
+		case 0:
+			field.set_target(rng());
+			break;
+		case 1:
+			field.set_context(rng());
+			break;
+		case 2:
+			field.set_sender_session(rng());
+			break;
+		case 3:
+			field.set_frame_number((static_cast< std::uint64_t >(rng()) << 32 | rng()) >> (rng() % 64));
+			break;
+		case 4:
+			field.set_opus_data(std::string(rng() % 64, static_cast< char >(rng())));
+			break;
+		case 5:
+			// Packed positional data
+			for (unsigned int i = rng() % 5; i > 0; --i) {
+				field.add_positional_data(static_cast< float >(rng() % 10000) / 7.0f);
+			}
+			break;
+		case 6:
+			field.set_volume_adjustment(static_cast< float >(rng() % 100) / 10.0f);
+			break;
+		case 7:
+			field.set_is_terminator(rng() % 2 != 0);
+			break;
+		case 8:
+			// Unpacked positional data
+			for (unsigned int i = rng() % 4; i > 0; --i) {
+				const float coordinate = static_cast< float >(rng() % 10000);
+				appendVarint(encoded, MumbleUDP::Audio::kPositionalDataFieldNumber << 3 | 5);
+				encoded.append(reinterpret_cast< const char * >(&coordinate), sizeof(coordinate));
+			}
+			return encoded;
+		case 9: {
+			// Unknown field of a random wire type
+			const std::uint32_t fieldNumber = 17 + rng() % 1000;
+			const std::uint32_t wireType    = rng() % 5;
+			appendVarint(encoded, fieldNumber << 3 | (wireType == 4 ? 3 : wireType));
+			switch (wireType) {
+				case 0:
+					appendVarint(encoded, rng());
+					break;
+				case 1:
+					encoded += std::string(8, 'a');
+					break;
+				case 2:
+					encoded += static_cast< char >(3);
+					encoded += "abc";
+					break;
+				case 3:
+				case 4:
+					// Group containing a single varint
+					appendVarint(encoded, 1 << 3);
+					appendVarint(encoded, rng());
+					appendVarint(encoded, fieldNumber << 3 | 4);
+					break;
+			}
+			return encoded;
+		}
+		default:
+			// Known field with an unexpected wire type
+			appendVarint(encoded, (1 + rng() % 7) << 3 | 2);
+			encoded += static_cast< char >(2);
+			encoded += "zz";
+			return encoded;
+	}
+
+	return field.SerializeAsString();
+}
+
+template< Mumble::Protocol::Role decoderRole > void do_test_audio_fuzz() {
+	Mumble::Protocol::UDPDecoder< decoderRole > decoder(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+	MumbleUDP::Audio parsed;
+
+	std::mt19937 rng(42);
+
+	int decoded = 0;
+	for (int i = 0; i < 200000; ++i) {
+		std::string message;
+		for (unsigned int j = rng() % 8; j > 0; --j) {
+			message += randomAudioField(rng);
+		}
+
+		// Corrupt some of the messages (by flipping bits, truncating them or inserting bytes)
+		if (rng() % 2 && !message.empty()) {
+			switch (rng() % 3) {
+				case 0:
+					message[rng() % message.size()] ^= static_cast< char >(1 << (rng() % 8));
+					break;
+				case 1:
+					message.resize(rng() % message.size());
+					break;
+				default:
+					message.insert(message.begin() + static_cast< long >(rng() % message.size()),
+								   static_cast< char >(rng()));
+					break;
+			}
+		}
+
+		Mumble::Protocol::AudioData expected;
+		const bool valid = referenceDecode(message, decoderRole, parsed, expected);
+
+		const std::string packet = static_cast< char >(Mumble::Protocol::UDPMessageType::Audio) + message;
+		const gsl::span< const Mumble::Protocol::byte > packetData(
+			reinterpret_cast< const Mumble::Protocol::byte * >(packet.data()), packet.size());
+
+		const bool success = decoder.decode(packetData);
+
+		if (valid != success) {
+			printData(packetData);
+		}
+		QCOMPARE(success, valid);
+
+		if (valid) {
+			QCOMPARE(decoder.getAudioData(), expected);
+
+			// The payload is not copied
+			const Mumble::Protocol::byte *payload = decoder.getAudioData().payload.data();
+			QVERIFY(payload > packetData.data() && payload < packetData.data() + packetData.size());
+
+			decoded++;
+		}
+	}
+
+	// Make sure that the valid messages have been tested as well
+	QVERIFY(decoded > 1000);
+}
+
 class TestMumbleProtocol : public QObject {
 	Q_OBJECT
 private slots:
@@ -259,6 +443,10 @@ private slots:
 		do_test_audio< Mumble::Protocol::Role::Server, Mumble::Protocol::Role::Client >();
 	}
 
+	void test_audio_fuzz_client() { do_test_audio_fuzz< Mumble::Protocol::Role::Client >(); }
+
+	void test_audio_fuzz_server() { do_test_audio_fuzz< Mumble::Protocol::Role::Server >(); }
+
 	void test_preEncode_audio_context() {
 		Mumble::Protocol::TestAudioEncoder< Mumble::Protocol::Role::Server > encoder;
 
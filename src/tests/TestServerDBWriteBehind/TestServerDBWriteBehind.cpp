@@ -0,0 +1,335 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ServerDBWriteBehind.h"
+
+#include <QObject>
+#include <QtCore>
+#include <QtSql>
+#include <QtTest>
+
+static const QString CONNECTION_NAME      = QStringLiteral("TestServerDBWriteBehind");
+static const QString FILE_CONNECTION_NAME = QStringLiteral("TestServerDBWriteBehindFile");
+
+/// Long enough for nothing to be written on its own while a test is running
+static constexpr int INTERVAL = 60 * 60 * 1000;
+
+class TestServerDBWriteBehind : public QObject {
+	Q_OBJECT
+private:
+	/// The database the inline writes go to
+	QSqlDatabase db;
+	/// The database the background thread writes to. It has to be stored in a file, so that the thread's own
+	/// connection sees the same data.
+	QSqlDatabase fileDb;
+	QTemporaryDir dir;
+
+	/// @returns The amount of rows of the given table matching the given condition
+	int count(QSqlDatabase &database, const QString &table, const QString &condition = QLatin1String("1")) {
+		QSqlQuery query(database);
+		query.exec(QString::fromLatin1("SELECT COUNT(*) FROM `%1` WHERE %2").arg(table, condition));
+		return query.next() ? query.value(0).toInt() : -1;
+	}
+
+	int count(const QString &table, const QString &condition = QLatin1String("1")) {
+		return count(db, table, condition);
+	}
+
+	void createTables(QSqlDatabase &database) {
+		QSqlQuery query(database);
+		QVERIFY(query.exec(QLatin1String("CREATE TABLE `users` (`server_id` INTEGER NOT NULL, `user_id` INTEGER NOT "
+										 "NULL, `name` TEXT NOT NULL, `lastchannel` INTEGER, `last_disconnect` "
+										 "DATE)")));
+		QVERIFY(query.exec(QLatin1String("CREATE TABLE `slog` (`server_id` INTEGER NOT NULL, `msg` TEXT, `msgtime` "
+										 "DATE DEFAULT (datetime('now')))")));
+		QVERIFY(query.exec(QLatin1String("CREATE TABLE `channel_listeners` (`server_id` INTEGER NOT NULL, `user_id` "
+										 "INTEGER NOT NULL, `channel_id` INTEGER NOT NULL, `volume_adjustment` FLOAT "
+										 "DEFAULT 1, `enabled` SMALLINT NOT NULL DEFAULT 1)")));
+	}
+
+	void dropTables(QSqlDatabase &database) {
+		QSqlQuery query(database);
+		QVERIFY(query.exec(QLatin1String("DROP TABLE `users`")));
+		QVERIFY(query.exec(QLatin1String("DROP TABLE `slog`")));
+		QVERIFY(query.exec(QLatin1String("DROP TABLE `channel_listeners`")));
+	}
+
+	/// Adds the given user to the file database
+	void addUser(int serverID, int userID, int lastChannel = 0) {
+		QSqlQuery query(fileDb);
+		QVERIFY(query.exec(QString::fromLatin1("INSERT INTO `users` (`server_id`, `user_id`, `name`, `lastchannel`) "
+											   "VALUES (%1, %2, 'User%2', %3)")
+							   .arg(serverID)
+							   .arg(userID)
+							   .arg(lastChannel)));
+	}
+
+	/// Adds the given channel listener to the file database
+	void addListener(int serverID, int userID, unsigned int channelID, bool enabled, float volume = 1.0f) {
+		QSqlQuery query(fileDb);
+		QVERIFY(query.exec(QString::fromLatin1("INSERT INTO `channel_listeners` (`server_id`, `user_id`, `channel_id`, "
+											   "`volume_adjustment`, `enabled`) VALUES (%1, %2, %3, %4, %5)")
+							   .arg(serverID)
+							   .arg(userID)
+							   .arg(channelID)
+							   .arg(volume)
+							   .arg(enabled ? 1 : 0)));
+	}
+
+private slots:
+	void initTestCase();
+	void init();
+	void cleanup();
+	void cleanupTestCase();
+	void inlineWrite();
+	void inlineWriteInTransaction();
+	void inlineWriteRolledBack();
+	void backgroundHeldBack();
+	void backgroundCoalesced();
+	void backgroundFlushUser();
+	void backgroundListenerEnableDisable();
+	void backgroundListenerDeleteEnable();
+	void backgroundWrittenOnDestruction();
+};
+
+void TestServerDBWriteBehind::initTestCase() {
+	// Like the server does for in-memory databases, which can't be shared with a background thread
+	db = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), CONNECTION_NAME);
+	db.setDatabaseName(QLatin1String(":memory:"));
+	QVERIFY(db.open());
+
+	QVERIFY(dir.isValid());
+	fileDb = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), FILE_CONNECTION_NAME);
+	fileDb.setDatabaseName(dir.filePath(QLatin1String("murmur.sqlite")));
+	QVERIFY(fileDb.open());
+}
+
+void TestServerDBWriteBehind::init() {
+	createTables(db);
+	createTables(fileDb);
+}
+
+void TestServerDBWriteBehind::cleanup() {
+	dropTables(db);
+	dropTables(fileDb);
+}
+
+void TestServerDBWriteBehind::cleanupTestCase() {
+	db     = QSqlDatabase();
+	fileDb = QSqlDatabase();
+	QSqlDatabase::removeDatabase(CONNECTION_NAME);
+	QSqlDatabase::removeDatabase(FILE_CONNECTION_NAME);
+}
+
+void TestServerDBWriteBehind::inlineWrite() {
+	ServerDBWriteBehind writeBehind(CONNECTION_NAME, QLatin1String("QSQLITE"), QString(), 0);
+
+	writeBehind.log(1, QLatin1String("Server listening"));
+
+	// Without a background thread, everything is written right away
+	QCOMPARE(count(QLatin1String("slog"), QLatin1String("`msg` = 'Server listening'")), 1);
+}
+
+void TestServerDBWriteBehind::inlineWriteInTransaction() {
+	ServerDBWriteBehind writeBehind(CONNECTION_NAME, QLatin1String("QSQLITE"), QString(), 0);
+
+	// What Server::initialize() does: It logs the SuperUser's password while its TransactionHolder is still active
+	QVERIFY(db.transaction());
+
+	QSqlQuery query(db);
+	QVERIFY(
+		query.exec(QLatin1String("INSERT INTO `users` (`server_id`, `user_id`, `name`) VALUES (1, 0, 'SuperUser')")));
+	query.clear();
+
+	writeBehind.log(1, QLatin1String("Password for 'SuperUser' set to 'secret'"));
+	writeBehind.setLastChannel(1, 0, 5);
+
+	QVERIFY(db.commit());
+
+	QCOMPARE(count(QLatin1String("users"), QLatin1String("`name` = 'SuperUser' AND `lastchannel` = 5")), 1);
+	QCOMPARE(count(QLatin1String("slog")), 1);
+}
+
+void TestServerDBWriteBehind::inlineWriteRolledBack() {
+	ServerDBWriteBehind writeBehind(CONNECTION_NAME, QLatin1String("QSQLITE"), QString(), 0);
+
+	QSqlQuery query(db);
+	QVERIFY(query.exec(QLatin1String("INSERT INTO `users` (`server_id`, `user_id`, `name`, `lastchannel`) VALUES (1, "
+									 "0, 'SuperUser', 1)")));
+	query.clear();
+
+	QVERIFY(db.transaction());
+
+	writeBehind.log(1, QLatin1String("Moved"));
+	writeBehind.setLastChannel(1, 0, 5);
+
+	QVERIFY(db.rollback());
+
+	// The updates have been part of the transaction instead of committing it (or starting one of their own)
+	QCOMPARE(count(QLatin1String("users"), QLatin1String("`lastchannel` = 1")), 1);
+	QCOMPARE(count(QLatin1String("slog")), 0);
+}
+
+void TestServerDBWriteBehind::backgroundHeldBack() {
+	addUser(1, 0);
+
+	ServerDBWriteBehind writeBehind(FILE_CONNECTION_NAME, QLatin1String("QSQLITE"), QString(), INTERVAL);
+
+	writeBehind.setLastChannel(1, 0, 5);
+	writeBehind.setLastDisconnect(1, 0);
+	writeBehind.log(1, QLatin1String("Moved"));
+
+	// Nothing is written before the interval has passed
+	QCOMPARE(count(fileDb, QLatin1String("users"), QLatin1String("`lastchannel` = 0 AND `last_disconnect` IS NULL")),
+			 1);
+	QCOMPARE(count(fileDb, QLatin1String("slog")), 0);
+
+	writeBehind.flush();
+
+	QCOMPARE(count(fileDb, QLatin1String("users"),
+				   QLatin1String("`lastchannel` = 5 AND `last_disconnect` IS NOT NULL")),
+			 1);
+	QCOMPARE(count(fileDb, QLatin1String("slog"), QLatin1String("`msg` = 'Moved'")), 1);
+
+	// Flushing without any pending updates returns right away
+	writeBehind.flush();
+}
+
+void TestServerDBWriteBehind::backgroundCoalesced() {
+	addUser(1, 0);
+	addUser(1, 1);
+	addUser(2, 0);
+
+	// Counts how often the last channel is actually written
+	QSqlQuery query(fileDb);
+	QVERIFY(query.exec(QLatin1String("CREATE TABLE `lastchannel_writes` (`server_id` INTEGER, `user_id` INTEGER)")));
+	QVERIFY(query.exec(QLatin1String("CREATE TRIGGER `count_lastchannel_writes` AFTER UPDATE OF `lastchannel` ON "
+									 "`users` BEGIN INSERT INTO `lastchannel_writes` VALUES (NEW.`server_id`, "
+									 "NEW.`user_id`); END")));
+	query.clear();
+
+	{
+		ServerDBWriteBehind writeBehind(FILE_CONNECTION_NAME, QLatin1String("QSQLITE"), QString(), INTERVAL);
+
+		writeBehind.setLastChannel(1, 0, 2);
+		writeBehind.setLastChannel(1, 0, 3);
+		writeBehind.setLastChannel(1, 1, 4);
+		writeBehind.setLastChannel(2, 0, 5);
+		writeBehind.setLastChannel(1, 0, 6);
+		writeBehind.log(1, QLatin1String("First"));
+		writeBehind.log(1, QLatin1String("Second"));
+
+		writeBehind.flush();
+	}
+
+	// Only the latest value is written, once per user of each server
+	QCOMPARE(count(fileDb, QLatin1String("users"), QLatin1String("`server_id` = 1 AND `user_id` = 0 AND "
+																 "`lastchannel` = 6")),
+			 1);
+	QCOMPARE(count(fileDb, QLatin1String("users"), QLatin1String("`server_id` = 1 AND `user_id` = 1 AND "
+																 "`lastchannel` = 4")),
+			 1);
+	QCOMPARE(count(fileDb, QLatin1String("users"), QLatin1String("`server_id` = 2 AND `user_id` = 0 AND "
+																 "`lastchannel` = 5")),
+			 1);
+	QCOMPARE(count(fileDb, QLatin1String("lastchannel_writes")), 3);
+	QCOMPARE(count(fileDb, QLatin1String("lastchannel_writes"), QLatin1String("`server_id` = 1 AND `user_id` = 0")),
+			 1);
+
+	// Log entries are never coalesced
+	QCOMPARE(count(fileDb, QLatin1String("slog")), 2);
+
+	QVERIFY(query.exec(QLatin1String("DROP TABLE `lastchannel_writes`")));
+}
+
+void TestServerDBWriteBehind::backgroundFlushUser() {
+	addUser(1, 0);
+	addUser(1, 1);
+
+	ServerDBWriteBehind writeBehind(FILE_CONNECTION_NAME, QLatin1String("QSQLITE"), QString(), INTERVAL);
+
+	writeBehind.setLastChannel(1, 0, 5);
+
+	// There is nothing pending for other users (or the same user ID on other servers)
+	writeBehind.flushUser(1, 1);
+	writeBehind.flushUser(2, 0);
+	QCOMPARE(count(fileDb, QLatin1String("users"), QLatin1String("`lastchannel` = 5")), 0);
+
+	writeBehind.flushUser(1, 0);
+	QCOMPARE(count(fileDb, QLatin1String("users"), QLatin1String("`user_id` = 0 AND `lastchannel` = 5")), 1);
+}
+
+void TestServerDBWriteBehind::backgroundListenerEnableDisable() {
+	addListener(1, 0, 2, true);
+
+	ServerDBWriteBehind writeBehind(FILE_CONNECTION_NAME, QLatin1String("QSQLITE"), QString(), INTERVAL);
+
+	// A new listener that is disabled within the same interval still has to be created
+	writeBehind.enableChannelListener(1, 0, 3);
+	writeBehind.disableChannelListener(1, 0, 3);
+
+	// An existing one is only disabled
+	writeBehind.disableChannelListener(1, 0, 2);
+
+	// Disabling a listener that doesn't exist doesn't create it
+	writeBehind.disableChannelListener(1, 0, 4);
+
+	// Enabled again after having been disabled
+	writeBehind.enableChannelListener(1, 0, 5);
+	writeBehind.disableChannelListener(1, 0, 5);
+	writeBehind.enableChannelListener(1, 0, 5);
+
+	writeBehind.flush();
+
+	QCOMPARE(count(fileDb, QLatin1String("channel_listeners")), 3);
+	QCOMPARE(count(fileDb, QLatin1String("channel_listeners"), QLatin1String("`channel_id` = 2 AND `enabled` = 0")), 1);
+	QCOMPARE(count(fileDb, QLatin1String("channel_listeners"), QLatin1String("`channel_id` = 3 AND `enabled` = 0")), 1);
+	QCOMPARE(count(fileDb, QLatin1String("channel_listeners"), QLatin1String("`channel_id` = 5 AND `enabled` = 1")), 1);
+}
+
+void TestServerDBWriteBehind::backgroundListenerDeleteEnable() {
+	addListener(1, 0, 2, false, 0.5f);
+	addListener(1, 0, 3, true, 0.5f);
+
+	ServerDBWriteBehind writeBehind(FILE_CONNECTION_NAME, QLatin1String("QSQLITE"), QString(), INTERVAL);
+
+	// Deleting a listener discards its previous changes, but not the ones made afterwards
+	writeBehind.setChannelListenerVolume(1, 0, 2, 2.0f);
+	writeBehind.deleteChannelListener(1, 0, 2);
+	writeBehind.enableChannelListener(1, 0, 2);
+
+	writeBehind.enableChannelListener(1, 0, 3);
+	writeBehind.setChannelListenerVolume(1, 0, 3, 2.0f);
+	writeBehind.deleteChannelListener(1, 0, 3);
+
+	writeBehind.flush();
+
+	QCOMPARE(count(fileDb, QLatin1String("channel_listeners")), 1);
+	QCOMPARE(count(fileDb, QLatin1String("channel_listeners"),
+				   QLatin1String("`channel_id` = 2 AND `enabled` = 1 AND `volume_adjustment` = 1")),
+			 1);
+}
+
+void TestServerDBWriteBehind::backgroundWrittenOnDestruction() {
+	addUser(1, 0);
+
+	{
+		ServerDBWriteBehind writeBehind(FILE_CONNECTION_NAME, QLatin1String("QSQLITE"), QString(), INTERVAL);
+
+		writeBehind.setLastChannel(1, 0, 5);
+		writeBehind.enableChannelListener(1, 0, 2);
+		writeBehind.log(1, QLatin1String("Shutting down"));
+
+		QCOMPARE(count(fileDb, QLatin1String("slog")), 0);
+	}
+
+	// Stopping the thread doesn't lose anything that hasn't been written yet
+	QCOMPARE(count(fileDb, QLatin1String("users"), QLatin1String("`lastchannel` = 5")), 1);
+	QCOMPARE(count(fileDb, QLatin1String("channel_listeners"), QLatin1String("`channel_id` = 2 AND `enabled` = 1")), 1);
+	QCOMPARE(count(fileDb, QLatin1String("slog"), QLatin1String("`msg` = 'Shutting down'")), 1);
+}
+
+QTEST_MAIN(TestServerDBWriteBehind)
+#include "TestServerDBWriteBehind.moc"
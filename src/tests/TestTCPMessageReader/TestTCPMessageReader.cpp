@@ -0,0 +1,148 @@
+// Copyright The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "TCPMessageReader.h"
+
+#include <QObject>
+#include <QtCore>
+#include <QtTest>
+
+#include <algorithm>
+
+using Message = QPair< Mumble::Protocol::TCPMessageType, QByteArray >;
+
+static QByteArray frame(const Message &message) {
+	QByteArray data(static_cast< int >(TCPMessageReader::HEADER_SIZE), Qt::Uninitialized);
+	unsigned char *header = reinterpret_cast< unsigned char * >(data.data());
+	qToBigEndian< quint16 >(static_cast< quint16 >(message.first), &header[0]);
+	qToBigEndian< quint32 >(static_cast< quint32 >(message.second.size()), &header[2]);
+
+	return data + message.second;
+}
+
+static QByteArray payload(int size) {
+	QByteArray data(size, Qt::Uninitialized);
+	for (int i = 0; i < size; ++i) {
+		data[i] = static_cast< char >(i * 31 + size);
+	}
+	return data;
+}
+
+/// Feeds the data to the reader in chunks of (at most) the given size, as a socket would, and returns the messages
+/// it has extracted
+static QList< Message > receive(TCPMessageReader &reader, const QByteArray &data, int chunkSize) {
+	QList< Message > messages;
+
+	int offset = 0;
+	while (offset < data.size()) {
+		const gsl::span< char > buffer = reader.writeBuffer();
+		const int size =
+			std::min({ chunkSize, static_cast< int >(data.size()) - offset, static_cast< int >(buffer.size()) });
+
+		std::copy(data.constData() + offset, data.constData() + offset + size, buffer.data());
+		reader.commit(static_cast< std::size_t >(size));
+		offset += size;
+
+		Mumble::Protocol::TCPMessageType type;
+		QByteArray view;
+		while (reader.next(type, view) == TCPMessageReader::Status::Message) {
+			// The view is only valid until more data is written
+			messages << Message(type, QByteArray(view.constData(), view.size()));
+		}
+
+		reader.release();
+	}
+
+	return messages;
+}
+
+class TestTCPMessageReader : public QObject {
+	Q_OBJECT
+private slots:
+	void splitsMessages_data();
+	void splitsMessages();
+	void rejectsHugeMessages();
+	void release();
+};
+
+void TestTCPMessageReader::splitsMessages_data() {
+	QTest::addColumn< int >("chunkSize");
+
+	QTest::newRow("single bytes") << 1;
+	QTest::newRow("small chunks") << 7;
+	QTest::newRow("medium chunks") << 4096;
+	QTest::newRow("everything at once") << 1024 * 1024;
+}
+
+void TestTCPMessageReader::splitsMessages() {
+	QFETCH(int, chunkSize);
+
+	const QList< Message > messages = {
+		{ Mumble::Protocol::TCPMessageType::Ping, payload(12) },
+		{ Mumble::Protocol::TCPMessageType::UserState, payload(1000) },
+		{ Mumble::Protocol::TCPMessageType::ServerSync, QByteArray() },
+		// Larger than the pooled buffers
+		{ Mumble::Protocol::TCPMessageType::TextMessage, payload(200 * 1000) },
+		{ Mumble::Protocol::TCPMessageType::ChannelState,
+		  payload(static_cast< int >(TCPMessageReader::BLOCK_SIZE - TCPMessageReader::HEADER_SIZE)) },
+		{ Mumble::Protocol::TCPMessageType::UDPTunnel, payload(50) },
+	};
+
+	QByteArray data;
+	for (int i = 0; i < 100; ++i) {
+		for (const Message &message : messages) {
+			data += frame(message);
+		}
+	}
+
+	TCPMessageReader reader;
+	const QList< Message > received = receive(reader, data, chunkSize);
+
+	QCOMPARE(received.size(), 100 * messages.size());
+	for (int i = 0; i < received.size(); ++i) {
+		QCOMPARE(received[i].first, messages[i % messages.size()].first);
+		QCOMPARE(received[i].second, messages[i % messages.size()].second);
+	}
+	QCOMPARE(reader.pending(), static_cast< std::size_t >(0));
+}
+
+void TestTCPMessageReader::rejectsHugeMessages() {
+	const Message huge(Mumble::Protocol::TCPMessageType::TextMessage,
+					   QByteArray(static_cast< int >(TCPMessageReader::MAX_PAYLOAD_SIZE + 1), 'x'));
+
+	TCPMessageReader reader;
+	const gsl::span< char > buffer = reader.writeBuffer();
+	const QByteArray data          = frame(huge).left(static_cast< int >(buffer.size()));
+	std::copy(data.constData(), data.constData() + data.size(), buffer.data());
+	reader.commit(static_cast< std::size_t >(data.size()));
+
+	Mumble::Protocol::TCPMessageType type;
+	QByteArray view;
+	QCOMPARE(reader.next(type, view), TCPMessageReader::Status::TooLarge);
+}
+
+void TestTCPMessageReader::release() {
+	const QByteArray data = frame({ Mumble::Protocol::TCPMessageType::Ping, payload(100) });
+
+	TCPMessageReader reader;
+
+	// An incomplete message is kept
+	QCOMPARE(receive(reader, data.left(50), 1024).size(), 0);
+	QCOMPARE(reader.pending(), static_cast< std::size_t >(50));
+
+	const QList< Message > received = receive(reader, data.mid(50), 1024);
+	QCOMPARE(received.size(), 1);
+	QCOMPARE(received.first().second, payload(100));
+	QCOMPARE(reader.pending(), static_cast< std::size_t >(0));
+
+	// After clearing, the reader starts over
+	receive(reader, data.left(50), 1024);
+	reader.clear();
+	QCOMPARE(reader.pending(), static_cast< std::size_t >(0));
+	QCOMPARE(receive(reader, data, 1024).size(), 1);
+}
+
+QTEST_MAIN(TestTCPMessageReader)
+#include "TestTCPMessageReader.moc"